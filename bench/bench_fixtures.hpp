@@ -0,0 +1,79 @@
+#pragma once
+
+// Fixtures the benchmark programs share: a scratch directory, and a
+// synthetic PATH of directories full of empty executables.
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// A fresh directory under the system's temporary directory, removed with
+// everything in it on destruction. The path is empty if it could not be made.
+class TempDir {
+    std::filesystem::path root_;
+
+public:
+    explicit TempDir(std::string_view name) {
+        std::string pattern = (std::filesystem::temp_directory_path() / name).string() + ".XXXXXX";
+        if (mkdtemp(pattern.data())) root_ = pattern;
+    }
+
+    ~TempDir() {
+        std::error_code ec;
+        if (!root_.empty()) std::filesystem::remove_all(root_, ec);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    bool ok() const { return !root_.empty(); }
+    const std::filesystem::path& path() const { return root_; }
+};
+
+// Directories bin0 to bin<dirs - 1>, each holding per_dir empty executables
+// named by program_name(d, i). Creating one also keeps the benchmark from
+// writing the user's saved PATH index.
+class SyntheticPath {
+    TempDir root_;
+
+public:
+    template <typename Name>
+    SyntheticPath(std::string_view name, int dirs, int per_dir, Name program_name) : root_(name) {
+        if (!root_.ok()) return;
+        for (int d = 0; d < dirs; ++d) {
+            std::filesystem::create_directory(dir(d));
+            for (int i = 0; i < per_dir; ++i) {
+                const std::filesystem::path program = dir(d) / program_name(d, i);
+                int fd = open(program.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+                if (fd >= 0) close(fd);
+            }
+            age(d);
+        }
+        setenv("SHELL_PATH_INDEX", "off", 1);
+    }
+
+    bool ok() const { return root_.ok(); }
+    std::filesystem::path dir(int d) const { return root_.path() / ("bin" + std::to_string(d)); }
+
+    // PATH made of the first dirs directories
+    void use(int dirs) const {
+        std::string path;
+        for (int d = 0; d < dirs; ++d) {
+            if (!path.empty()) path += ':';
+            path += dir(d).string();
+        }
+        setenv("PATH", path.c_str(), 1);
+    }
+
+    // Backdate a directory so its snapshot is trusted rather than re-read
+    // on every sweep as a just-modified one would be
+    void age(int d) const {
+        struct timespec times[2] = {{1'000'000'000, 0}, {1'000'000'000, 0}};
+        utimensat(AT_FDCWD, dir(d).c_str(), times, 0);
+    }
+};
@@ -0,0 +1,92 @@
+// Tab-completion latency over a synthetic PATH of 50,000 executables in ten
+// directories: the prefix query alone, a Tab press with nothing changed
+// (which still re-stats every directory), and a Tab press right after a
+// program was installed into one of them.
+
+#include "bench_fixtures.hpp"
+#include "command_index.hpp"
+#include "path_cache.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr int kDirs = 10;
+constexpr int kPerDir = 5000;
+
+SyntheticPath& synthetic_path() {
+    // Names spread over every first letter, a few thousand each
+    static SyntheticPath path("completion_bench", kDirs, kPerDir, [](int d, int i) {
+        return static_cast<char>('a' + (i * 7 + d) % 26) + std::to_string(d * kPerDir + i);
+    });
+    path.use(kDirs);
+    return path;
+}
+
+struct Completer {
+    PathCache cache;
+    CommandIndex index;
+
+    Completer() { index.update(cache); }
+};
+
+void BM_PrefixQuery(benchmark::State& state) {
+    if (!synthetic_path().ok()) return state.SkipWithError("could not create the PATH");
+    Completer completer;
+    const std::string prefix = std::string("k4").substr(0, static_cast<size_t>(state.range(0)));
+    size_t matches = 0;
+    for (auto _ : state) {
+        auto found = completer.index.complete(prefix);
+        matches = found.size();
+        benchmark::DoNotOptimize(found.data());
+    }
+    state.counters["matches"] = static_cast<double>(matches);
+    state.counters["names"] = static_cast<double>(completer.index.size());
+}
+
+void BM_TabUnchanged(benchmark::State& state) {
+    if (!synthetic_path().ok()) return state.SkipWithError("could not create the PATH");
+    Completer completer;
+    for (auto _ : state) {
+        completer.index.update(completer.cache);
+        benchmark::DoNotOptimize(completer.index.complete("k4").size());
+    }
+}
+
+void BM_TabAfterInstall(benchmark::State& state) {
+    auto& synthetic = synthetic_path();
+    if (!synthetic.ok()) return state.SkipWithError("could not create the PATH");
+    Completer completer;
+    const fs::path program = synthetic.dir(3) / "knew";
+    for (auto _ : state) {
+        state.PauseTiming();
+        int fd = open(program.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+        if (fd >= 0) close(fd);
+        state.ResumeTiming();
+
+        completer.index.update(completer.cache);
+        benchmark::DoNotOptimize(completer.index.complete("k").size());
+
+        state.PauseTiming();
+        unlink(program.c_str());
+        synthetic.age(3);
+        completer.index.update(completer.cache);
+        state.ResumeTiming();
+    }
+}
+
+BENCHMARK(BM_PrefixQuery)->ArgName("prefix_len")->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TabUnchanged)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TabAfterInstall)->Unit(benchmark::kMicrosecond);
+
+} // namespace
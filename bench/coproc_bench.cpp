@@ -0,0 +1,124 @@
+// N request lines sent through `coproc -r` to a pool of cat workers, which
+// echo each one back, with the answers put back in request order; the
+// cost per request of the exchange itself, over one worker and several.
+
+#include "builtins.hpp"
+#include "output.hpp"
+#include "shell.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+Shell& shell() {
+    static Shell s;
+    return s;
+}
+
+int coproc(std::vector<std::string_view> args, std::string& out, int in = STDIN_FILENO) {
+    args.insert(args.begin(), "coproc");
+    Output captured(out);
+    Output err(STDERR_FILENO);
+    BuiltinIO io{in, captured, err};
+    return find_builtin("coproc")->run(shell(), args, io);
+}
+
+// An exchange cut short (here by poll failing, as no descriptor may be
+// polled) leaves its request unanswered; the next exchange must get its own
+// answer, not that one. The worker answers slowly, so the two answers come
+// back apart.
+bool answers_after_failed_exchange() {
+    std::string out;
+    if (coproc({"check", "sh", "-c", "while read -r line; do sleep 0.1; echo \"$line\"; done"}, out) != 0) {
+        return false;
+    }
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    const rlim_t saved = limit.rlim_cur;
+    limit.rlim_cur = 0;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    const int failed = coproc({"-r", "check", "first"}, out);
+    limit.rlim_cur = saved;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    out.clear();
+    const int status = coproc({"-r", "check", "second"}, out);
+    std::string ignored;
+    coproc({"-k", "check"}, ignored);
+    if (failed != 0 && status == 0 && out == "second\n") return true;
+    std::cerr << "coproc_bench: after a failed exchange (status " << failed << ") the next printed [" << out
+              << "] with status " << status << '\n';
+    return false;
+}
+
+// A worker the job table reaped while reaping other children still
+// reports its own status to -k
+bool status_after_job_table_reaped() {
+    std::string out;
+    if (coproc({"exiting", "sh", "-c", "exit 3"}, out) != 0) return false;
+    const pid_t pid = static_cast<pid_t>(std::stol(*shell().vars.get("exiting_PID")));
+    siginfo_t info;
+    waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT);
+    shell().jobs.reap();
+    const int status = coproc({"-k", "exiting"}, out);
+    if (status == 3) return true;
+    std::cerr << "coproc_bench: a worker that exited 3 was reported as " << status << '\n';
+    return false;
+}
+
+// A memfd of numbered request lines, rewound before each run
+int requests(long count) {
+    const int fd = memfd_create("coproc_bench", MFD_CLOEXEC);
+    std::string text;
+    for (long i = 0; i < count; ++i) text += "request " + std::to_string(i) + '\n';
+    if (write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void BM_Exchange(benchmark::State& state) {
+    const long count = state.range(0);
+    const std::string workers = std::to_string(state.range(1));
+    const int in = requests(count);
+    if (in < 0) return state.SkipWithError("could not write the requests");
+    std::string out;
+    if (coproc({"-j", workers, "echoes", "cat"}, out) != 0) {
+        close(in);
+        return state.SkipWithError("could not start the workers");
+    }
+    for (auto _ : state) {
+        lseek(in, 0, SEEK_SET);
+        out.clear();
+        if (coproc({"-r", "echoes"}, out, in) != 0) state.SkipWithError("the exchange failed");
+    }
+    coproc({"-k", "echoes"}, out);
+    state.SetItemsProcessed(state.iterations() * count);
+    close(in);
+}
+
+BENCHMARK(BM_Exchange)->ArgNames({"requests", "workers"})->ArgsProduct({{1000, 100000}, {1, 4}});
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!answers_after_failed_exchange() || !status_after_job_table_reaped()) return 1;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
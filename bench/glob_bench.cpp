@@ -0,0 +1,110 @@
+// expand_glob over directories of 1000 to 500000 files against the naive
+// approach: readdir, fnmatch per name and a sort. The patterns take the
+// prefix/suffix path (f1*.txt, a tenth of the names) and the DFA
+// (f*[0-4]?.dat, a quarter). Sorting is included on both sides. On a disk
+// filesystem reading the directory itself is most of the time for both.
+
+#include "bench_fixtures.hpp"
+#include "glob.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr const char* kPatterns[] = {"f1*.txt", "f*[0-4]?.dat"};
+
+class Directory {
+    TempDir root{"glob_bench"};
+
+public:
+    explicit Directory(long files) {
+        if (!root.ok()) return;
+        int dir = open(root.path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        for (long i = 0; i < files; ++i) {
+            const std::string name = "f" + std::to_string(i) + (i % 2 ? ".dat" : ".txt");
+            int fd = openat(dir, name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd >= 0) close(fd);
+        }
+        close(dir);
+    }
+
+    bool ok() const { return root.ok(); }
+    const fs::path& path() const { return root.path(); }
+};
+
+// Made once per size; 500000 files take a few seconds to create
+const Directory& directory(long files) {
+    static std::map<long, std::unique_ptr<Directory>> made;
+    auto& dir = made[files];
+    if (!dir) dir = std::make_unique<Directory>(files);
+    return *dir;
+}
+
+std::vector<std::string> readdir_fnmatch(const fs::path& dir, const char* pattern) {
+    std::vector<std::string> matches;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return matches;
+    while (struct dirent* e = readdir(d)) {
+        if (fnmatch(pattern, e->d_name, FNM_PERIOD) == 0) matches.push_back(dir.string() + '/' + e->d_name);
+    }
+    closedir(d);
+    std::sort(matches.begin(), matches.end(),
+              [](const std::string& a, const std::string& b) { return std::strcoll(a.c_str(), b.c_str()) < 0; });
+    return matches;
+}
+
+void BM_ExpandGlob(benchmark::State& state) {
+    const Directory& dir = directory(state.range(0));
+    if (!dir.ok()) return state.SkipWithError("could not create the directory");
+    const std::string pattern = (dir.path() / kPatterns[state.range(1)]).string();
+    size_t found = 0;
+    for (auto _ : state) {
+        auto matches = expand_glob(pattern);
+        found = matches.size();
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(std::string(kPatterns[state.range(1)]) + ", " + std::to_string(found) + " matches");
+}
+
+void BM_ReaddirFnmatch(benchmark::State& state) {
+    const Directory& dir = directory(state.range(0));
+    if (!dir.ok()) return state.SkipWithError("could not create the directory");
+    const char* pattern = kPatterns[state.range(1)];
+    size_t found = 0;
+    for (auto _ : state) {
+        auto matches = readdir_fnmatch(dir.path(), pattern);
+        found = matches.size();
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(std::string(pattern) + ", " + std::to_string(found) + " matches");
+}
+
+void Sizes(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"files", "pattern"});
+    for (long files : {1000L, 100000L, 500000L}) {
+        for (long pattern = 0; pattern < 2; ++pattern) b->Args({files, pattern});
+    }
+}
+
+BENCHMARK(BM_ExpandGlob)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReaddirFnmatch)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+
+} // namespace
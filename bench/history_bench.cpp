@@ -0,0 +1,144 @@
+// History over a synthetic file of a million entries: what a shell pays at
+// startup (mapping the file and loading the lines the arrow keys recall),
+// building the whole trigram index, and a reverse search through the index
+// against a plain scan of the file, for text found in a handful of entries
+// and for text found everywhere.
+
+#include "bench_fixtures.hpp"
+#include "history.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr size_t kEntries = 1'000'000;
+// One entry in this many mentions the rare text
+constexpr size_t kRareEvery = 200'000;
+
+class SyntheticHistory {
+    TempDir root{"history_bench"};
+    bool written = false;
+
+public:
+    SyntheticHistory() {
+        if (!root.ok()) return;
+
+        static constexpr const char* kCommands[] = {
+            "git status", "make -j8", "ls -la src", "cd ..", "grep -rn TODO include",
+            "vim src/main.cpp", "ssh build-host", "git commit -am wip", "ctest --output-on-failure",
+        };
+        std::string text;
+        for (size_t i = 0; i < kEntries; ++i) {
+            text += kCommands[i % std::size(kCommands)];
+            text += ' ';
+            text += std::to_string(i);
+            if (i % kRareEvery == kRareEvery / 2) text += " --frobnicate";
+            text += '\n';
+        }
+        int fd = open(file().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) return;
+        written = write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size());
+        close(fd);
+    }
+
+    bool ok() const { return written; }
+    std::string file() const { return (root.path() / "history").string(); }
+};
+
+SyntheticHistory& synthetic_history() {
+    static SyntheticHistory history;
+    return history;
+}
+
+void BM_OpenAndRecall(benchmark::State& state) {
+    auto& synthetic = synthetic_history();
+    if (!synthetic.ok()) return state.SkipWithError("could not write the history");
+    for (auto _ : state) {
+        History history;
+        history.open(synthetic.file());
+        benchmark::DoNotOptimize(history.recent(1000).size());
+    }
+}
+
+void BM_BuildIndex(benchmark::State& state) {
+    auto& synthetic = synthetic_history();
+    if (!synthetic.ok()) return state.SkipWithError("could not write the history");
+    for (auto _ : state) {
+        History history;
+        history.open(synthetic.file());
+        while (history.index_step(1 << 20)) {}
+        benchmark::DoNotOptimize(history.size());
+    }
+}
+
+void search_indexed(benchmark::State& state, std::string_view text) {
+    auto& synthetic = synthetic_history();
+    if (!synthetic.ok()) return state.SkipWithError("could not write the history");
+    History history;
+    history.open(synthetic.file());
+    while (history.index_step(1 << 20)) {}
+    size_t found = 0;
+    for (auto _ : state) {
+        // Walk back through every match, as repeated Ctrl-R presses do
+        found = 0;
+        for (auto n = history.search_back(text, SIZE_MAX); n && found < 5; n = history.search_back(text, *n)) {
+            ++found;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.counters["matches"] = static_cast<double>(found);
+}
+
+// The same walk as a plain scan backwards through the mapped file
+void search_scan(benchmark::State& state, std::string_view text) {
+    auto& synthetic = synthetic_history();
+    if (!synthetic.ok()) return state.SkipWithError("could not write the history");
+    int fd = open(synthetic.file().c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    fstat(fd, &st);
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    const std::string_view all(static_cast<const char*>(map), size);
+    size_t found = 0;
+    for (auto _ : state) {
+        found = 0;
+        for (size_t end = all.size(); found < 5;) {
+            size_t at = all.rfind(text, end);
+            if (at == std::string_view::npos) break;
+            ++found;
+            end = all.rfind('\n', at);
+            if (end == std::string_view::npos) break;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.counters["matches"] = static_cast<double>(found);
+    munmap(map, size);
+    close(fd);
+}
+
+void BM_SearchRare(benchmark::State& state) { search_indexed(state, "frobnicate"); }
+void BM_SearchRareScan(benchmark::State& state) { search_scan(state, "frobnicate"); }
+void BM_SearchCommon(benchmark::State& state) { search_indexed(state, "git status"); }
+void BM_SearchCommonScan(benchmark::State& state) { search_scan(state, "git status"); }
+
+BENCHMARK(BM_OpenAndRecall)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BuildIndex)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SearchRare)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SearchRareScan)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SearchCommon)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SearchCommonScan)->Unit(benchmark::kMicrosecond);
+
+} // namespace
@@ -0,0 +1,201 @@
+// Prompt to prompt through an interactive shell on a pseudo-terminal: a
+// foreground external command, alone and with its standard input
+// redirected, as a user at the terminal runs it. Job control is only on
+// with a terminal, so piped runs never take these paths. Before timing
+// anything the program checks that such commands run and print what they
+// should, and that ^C stops them, and exits non-zero if they do not.
+
+#include <benchmark/benchmark.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+
+constexpr const char* kShell = SHELL_BINARY;
+
+// An interactive shell on the master side of a pseudo-terminal, driven a
+// line at a time
+class TerminalShell {
+    int master = -1;
+    pid_t pid = -1;
+    std::string pending;
+
+    // Read until the output ends with the prompt; false on a timeout or EOF
+    bool read_to_prompt(std::string& out, int timeout_ms) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        char buf[4096];
+        while (true) {
+            if (out.ends_with("$ ")) return true;
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) return false;
+            pollfd pfd{master, POLLIN, 0};
+            const int ready = poll(&pfd, 1, static_cast<int>(left.count()));
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) return false;
+            const ssize_t n = read(master, buf, sizeof(buf));
+            if (n <= 0) return false;
+            // Carriage returns and the bracketed paste switches go
+            for (ssize_t i = 0; i < n; ++i) {
+                if (buf[i] != '\r') out += buf[i];
+            }
+            for (std::string_view mode : {"\x1b[?2004h", "\x1b[?2004l"}) {
+                for (size_t at; (at = out.find(mode)) != std::string::npos;) out.erase(at, mode.size());
+            }
+        }
+    }
+
+public:
+    TerminalShell() {
+        pid = forkpty(&master, nullptr, nullptr, nullptr);
+        if (pid == 0) {
+            char* argv[] = {const_cast<char*>(kShell), nullptr};
+            execv(kShell, argv);
+            _exit(127);
+        }
+        std::string banner;
+        if (pid < 0 || !read_to_prompt(banner, 5000)) stop();
+    }
+
+    ~TerminalShell() { stop(); }
+
+    TerminalShell(const TerminalShell&) = delete;
+    TerminalShell& operator=(const TerminalShell&) = delete;
+
+    bool ok() const { return pid > 0; }
+
+    void stop() {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        }
+        if (master >= 0) close(master);
+        pid = -1;
+        master = -1;
+    }
+
+    // Type line, and after interrupt_ms (if given) ^C; what the shell
+    // printed before its next prompt, the echoed line left out
+    std::optional<std::string> run(std::string_view line, std::optional<int> interrupt_ms = std::nullopt,
+                                   int timeout_ms = 10000) {
+        if (!ok()) return std::nullopt;
+        std::string typed(line);
+        typed += '\n';
+        if (write(master, typed.data(), typed.size()) != static_cast<ssize_t>(typed.size())) return std::nullopt;
+        if (interrupt_ms) {
+            usleep(static_cast<useconds_t>(*interrupt_ms) * 1000);
+            if (write(master, "\x03", 1) != 1) return std::nullopt;
+        }
+        std::string out;
+        if (!read_to_prompt(out, timeout_ms)) return std::nullopt;
+        out.resize(out.size() - 2);
+        const size_t echoed = out.find('\n');
+        return echoed == std::string::npos ? std::string() : out.substr(echoed + 1);
+    }
+};
+
+struct Expectation {
+    const char* line;
+    const char* output;
+};
+
+// Foreground commands take the terminal, whatever their standard input is
+// redirected to, and give it back
+bool foreground_commands_run(TerminalShell& shell) {
+    const Expectation expected[] = {
+        {"echo one > /tmp/job_control_bench.in", ""},
+        {"wc -l < /tmp/job_control_bench.in", "1\n"},
+        {"echo $?", "0\n"},
+        {"wc -l <<< hi", "1\n"},
+        {"echo hi | /bin/cat", "hi\n"},
+        {"/bin/cat /tmp/job_control_bench.in | head -1", "one\n"},
+        {"/bin/cat < /tmp/job_control_bench.in", "one\n"},
+        {"rm /tmp/job_control_bench.in", ""},
+        // The shell's own descriptors are out of a redirection's reach
+        {"/bin/echo x >&3", "3: Bad file descriptor\n"},
+    };
+    for (const auto& [line, output] : expected) {
+        const auto printed = shell.run(line);
+        if (printed && *printed == output) continue;
+        std::cerr << "job_control_bench: `" << line << "' printed ["
+                  << (printed ? *printed : std::string("no prompt")) << "], expected [" << output << "]\n";
+        return false;
+    }
+    return true;
+}
+
+// ^C reaches what runs in the foreground, though the shell ignores it: a
+// command that would go on until interrupted stops, builtins starting
+// commands start no more, and $? says how
+bool interrupted_commands_stop(TerminalShell& shell) {
+    const char* const lines[] = {
+        "cat /dev/zero > /dev/null",
+        "cat",
+        "seq 5 5 20 | xargs -n1 sleep",
+        "xargs -n1 sleep < /tmp/job_control_bench.args",
+        "parallel -j1 sleep ::: 5 5 5",
+        "parallel -k -j2 sleep ::: 5 5 5 5",
+    };
+    shell.run("seq 5 5 15 > /tmp/job_control_bench.args");
+    for (const char* line : lines) {
+        const auto printed = shell.run(line, 300);
+        const auto status = shell.run("echo $?");
+        if (printed && status && *status == "130\n") continue;
+        std::cerr << "job_control_bench: after ^C `" << line << "' "
+                  << (printed ? "exited [" + (status ? *status : std::string()) + "], expected 130"
+                              : std::string("went on"))
+                  << '\n';
+        return false;
+    }
+    shell.run("rm /tmp/job_control_bench.args");
+    return true;
+}
+
+void BM_Foreground(benchmark::State& state, const char* line) {
+    TerminalShell shell;
+    for (auto _ : state) {
+        if (!shell.run(line)) {
+            state.SkipWithError("no prompt from the shell");
+            break;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    setenv("SHELL_PATH_INDEX", "off", 1);
+    {
+        TerminalShell shell;
+        if (!shell.ok()) {
+            std::cerr << "job_control_bench: no prompt from the shell\n";
+            return 1;
+        }
+        if (!foreground_commands_run(shell) || !interrupted_commands_stop(shell)) return 1;
+    }
+
+    benchmark::RegisterBenchmark("BM_Foreground/true", BM_Foreground, "/bin/true")
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_Foreground/redirected", BM_Foreground, "/bin/cat < /dev/null")
+        ->Unit(benchmark::kMicrosecond);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,125 @@
+// PathCache::find over synthetic PATHs of 10 to 1000 directories: a name
+// already resolved, a name found nowhere (every lookup re-stats the PATH),
+// the first lookup after `hash -r` dropped everything, a lookup of a
+// program installed since the last one, and a resolved name looked up
+// again after each cd (which only re-checks the new directory).
+
+#include "bench_fixtures.hpp"
+#include "path_cache.hpp"
+#include "variables.hpp"
+#include "working_directory.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr int kPerDir = 20;
+constexpr int kMaxDirs = 1000;
+
+std::string program_name(int d, int i) { return "p" + std::to_string(d) + "_" + std::to_string(i); }
+
+SyntheticPath& synthetic_path() {
+    static SyntheticPath path("path_cache_bench", kMaxDirs, kPerDir, program_name);
+    return path;
+}
+
+// A cache over the first dirs directories, every one read once. It follows
+// shell variables as the shell's does, so PATH is not re-read per lookup.
+struct WarmCache {
+    Variables vars;
+    PathCache cache;
+
+    explicit WarmCache(int dirs) {
+        synthetic_path().use(dirs);
+        vars.import_environment();
+        cache.follow(vars);
+        cache.find(program_name(dirs - 1, 0));
+    }
+};
+
+void BM_FindHit(benchmark::State& state) {
+    if (!synthetic_path().ok()) return state.SkipWithError("could not create the PATH");
+    const int dirs = static_cast<int>(state.range(0));
+    WarmCache warm(dirs);
+    const std::string name = program_name(dirs - 1, 0);
+    for (auto _ : state) benchmark::DoNotOptimize(warm.cache.find(name));
+}
+
+void BM_FindMiss(benchmark::State& state) {
+    if (!synthetic_path().ok()) return state.SkipWithError("could not create the PATH");
+    WarmCache warm(static_cast<int>(state.range(0)));
+    for (auto _ : state) benchmark::DoNotOptimize(warm.cache.find("no-such-program"));
+    state.counters["sweeps"] = benchmark::Counter(static_cast<double>(warm.cache.stats().sweeps),
+                                                  benchmark::Counter::kAvgIterations);
+}
+
+void BM_FindAfterClear(benchmark::State& state) {
+    if (!synthetic_path().ok()) return state.SkipWithError("could not create the PATH");
+    const int dirs = static_cast<int>(state.range(0));
+    WarmCache warm(dirs);
+    const std::string name = program_name(dirs - 1, 0);
+    for (auto _ : state) {
+        warm.cache.clear();
+        benchmark::DoNotOptimize(warm.cache.find(name));
+    }
+}
+
+void BM_FindAfterInstall(benchmark::State& state) {
+    auto& synthetic = synthetic_path();
+    if (!synthetic.ok()) return state.SkipWithError("could not create the PATH");
+    const int dirs = static_cast<int>(state.range(0));
+    WarmCache warm(dirs);
+    // Installed halfway down PATH, so the sweep has directories on both sides
+    const int target = dirs / 2;
+    // A new name each time, as a resolved one would be answered from the cache
+    int installed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        const std::string name = "fresh" + std::to_string(installed++);
+        const fs::path program = synthetic.dir(target) / name;
+        int fd = open(program.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+        if (fd >= 0) close(fd);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(warm.cache.find(name));
+
+        state.PauseTiming();
+        unlink(program.c_str());
+        synthetic.age(target);
+        state.ResumeTiming();
+    }
+}
+
+void BM_FindAfterCd(benchmark::State& state) {
+    auto& synthetic = synthetic_path();
+    if (!synthetic.ok()) return state.SkipWithError("could not create the PATH");
+    const int dirs = static_cast<int>(state.range(0));
+    WarmCache warm(dirs);
+    const std::string name = program_name(dirs - 1, 0);
+    const std::string places[] = {synthetic.dir(0).string(), synthetic.dir(1).string()};
+    const std::string home = working_directory();
+    size_t turn = 0;
+    for (auto _ : state) {
+        change_working_directory(places[turn++ & 1], false);
+        benchmark::DoNotOptimize(warm.cache.find(name));
+    }
+    change_working_directory(home, false);
+}
+
+BENCHMARK(BM_FindHit)->ArgName("dirs")->Arg(10)->Arg(100)->Arg(1000);
+BENCHMARK(BM_FindMiss)->ArgName("dirs")->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindAfterClear)->ArgName("dirs")->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindAfterInstall)->ArgName("dirs")->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindAfterCd)->ArgName("dirs")->Arg(10)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+} // namespace
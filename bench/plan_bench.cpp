@@ -0,0 +1,158 @@
+// A `for` loop over N words whose body is a few builtins, run from a plan
+// compiled once, against the same commands compiled afresh for every item,
+// as when a shell reads one line at a time. BM_Planned/static has a body
+// with nothing to expand, which is tokenized only when compiled;
+// BM_Planned/expanded reads the loop variable, and only the words that do
+// are tokenized again on each pass. BM_Compile is the cost of compiling
+// the loop alone.
+
+#include "plan.hpp"
+#include "shell.hpp"
+#include "trace.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr const char* kStaticBody = "true a b c && false || true";
+constexpr const char* kExpandedBody = "x=$i; true $x && false || true $i";
+
+std::string loop_line(long items, const char* body) {
+    std::string line = "for i in";
+    for (long i = 0; i < items; ++i) line += " w" + std::to_string(i);
+    line += "; do ";
+    line += body;
+    line += "; done";
+    return line;
+}
+
+Shell& shell() {
+    static Shell s;
+    return s;
+}
+
+void BM_Planned(benchmark::State& state) {
+    const std::string line = loop_line(state.range(0), state.range(1) ? kExpandedBody : kStaticBody);
+    Plan plan;
+    plan.compile(line, nullptr, nullptr);
+    for (auto _ : state) plan.run(shell());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(state.range(1) ? "expanded" : "static");
+}
+
+void BM_PerItem(benchmark::State& state) {
+    const long items = state.range(0);
+    const char* body = state.range(1) ? kExpandedBody : kStaticBody;
+    Plan plan;
+    for (auto _ : state) {
+        for (long i = 0; i < items; ++i) {
+            shell().vars.set("i", "w" + std::to_string(i));
+            plan.compile(body, nullptr, nullptr);
+            plan.run(shell());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * items);
+    state.SetLabel(state.range(1) ? "expanded" : "static");
+}
+
+void BM_Compile(benchmark::State& state) {
+    const std::string line = loop_line(state.range(0), kExpandedBody);
+    Plan plan;
+    for (auto _ : state) benchmark::DoNotOptimize(plan.compile(line, nullptr, nullptr));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(line.size()));
+}
+
+BENCHMARK(BM_Planned)->ArgNames({"items", "expanded"})->ArgsProduct({{100, 10000}, {0, 1}});
+BENCHMARK(BM_PerItem)->ArgNames({"items", "expanded"})->ArgsProduct({{100, 10000}, {0, 1}});
+BENCHMARK(BM_Compile)->ArgName("items")->Arg(100)->Arg(10000);
+
+// A loop body is tokenized when compiled; each pass tokenizes again only
+// its words that read $i, which the Parse spans it traces show
+bool only_sites_retokenized() {
+    Plan plan;
+    if (!plan.compile("for i in a b c; do out=\"$out$i \"; true x y $i z; done", nullptr, nullptr)) return false;
+    set_tracing(true);
+    trace_buffer().clear();
+    plan.run(shell());
+    set_tracing(false);
+
+    std::vector<std::string> parsed;
+    for (const TraceEvent& event : trace_buffer().snapshot()) {
+        if (event.phase == TracePhase::Parse) parsed.emplace_back(event.label.data());
+    }
+    const std::vector<std::string> expected = {"out=\"$out$i \"", "$i", "out=\"$out$i \"", "$i",
+                                               "out=\"$out$i \"", "$i"};
+    const std::string* out = shell().vars.get("out");
+    if (parsed == expected && out && *out == "a b c ") return true;
+    std::cerr << "plan_bench: expected only the words reading $i to be tokenized again, got";
+    for (const auto& label : parsed) std::cerr << " [" << label << "]";
+    std::cerr << " and out=[" << (out ? *out : "") << "]\n";
+    return false;
+}
+
+// Lines handed out one at a time, as a script reader does
+bool next_of(void* context, std::string& line) {
+    auto& lines = *static_cast<std::vector<std::string>*>(context);
+    if (lines.empty()) return false;
+    line = lines.front();
+    lines.erase(lines.begin());
+    return true;
+}
+
+// A command substitution left open at the end of a line goes on over the
+// lines after it, here-documents in it included, and they are not run as
+// commands of their own
+bool substitution_over_lines() {
+    std::vector<std::string> rest = {"hi", "EOF", ")"};
+    Plan plan;
+    if (plan.compile("x=$(cat <<EOF", next_of, &rest)) plan.run(shell());
+    if (plan.compile("y=$(echo a\necho b)", nullptr, nullptr)) plan.run(shell());
+    const std::string* x = shell().vars.get("x");
+    const std::string* y = shell().vars.get("y");
+    if (rest.empty() && x && *x == "hi" && y && *y == "a\nb") return true;
+    std::cerr << "plan_bench: substitutions over several lines gave x=[" << (x ? *x : "") << "] and y=["
+              << (y ? *y : "") << "], with " << rest.size() << " lines unread\n";
+    return false;
+}
+
+// Assignments alone on a line are made left to right, each expanded after
+// the ones before it took effect
+bool assignments_in_order() {
+    Plan plan;
+    if (plan.compile("a=1 b=$a c=\"$b$a\"", nullptr, nullptr)) plan.run(shell());
+    const std::string* c = shell().vars.get("c");
+    if (c && *c == "11") return true;
+    std::cerr << "plan_bench: a=1 b=$a c=\"$b$a\" set c to [" << (c ? *c : "") << "]\n";
+    return false;
+}
+
+// A break whose count is expanded when it runs leaves that many loops
+bool expanded_break_count() {
+    Plan plan;
+    const char* line = "n=2 seen=; for i in 1 2; do for j in a b; do seen=$seen$i$j; break $n; done; done";
+    if (plan.compile(line, nullptr, nullptr)) plan.run(shell());
+    const std::string* seen = shell().vars.get("seen");
+    if (seen && *seen == "1a" && shell().last_status == 0) return true;
+    std::cerr << "plan_bench: break $n with n=2 ran [" << (seen ? *seen : "") << "], status "
+              << shell().last_status << '\n';
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!only_sites_retokenized() || !substitution_over_lines() || !assignments_in_order() ||
+        !expanded_break_count()) {
+        return 1;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,246 @@
+// Tasks per second through a resident `shell --serve` against starting a
+// shell per task, by the wall clock since children do the work. Each task
+// is one command line, a builtin (the shells' own overhead only) or an
+// external program. The served variants: the thin client binary per task, a
+// connection per task made in-process as an orchestrator linking the
+// protocol would, and many tasks over one connection. Before timing anything
+// the program checks that scripts run through the client, from standard
+// input and with -c, print what the shell prints running them itself, and
+// exits non-zero if they do not.
+
+#include "bench_fixtures.hpp"
+#include "server.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace {
+
+constexpr const char* kShell = SHELL_BINARY;
+constexpr const char* kTasks[] = {"true", "uname"};
+
+// Run argv with its output thrown away and wait for it
+bool run_quietly(char* const argv[]) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    int rc = posix_spawn(&pid, argv[0], &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) return false;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+class Server {
+    TempDir dir{"server_bench"};
+    pid_t pid = -1;
+
+public:
+    Server() {
+        if (!dir.ok()) return;
+        setenv("SHELL_PATH_INDEX", "off", 1);
+
+        std::string path = socket();
+        char* argv[] = {const_cast<char*>(kShell), const_cast<char*>("--serve"), path.data(), nullptr};
+        if (posix_spawn(&pid, kShell, nullptr, nullptr, argv, environ) != 0) {
+            pid = -1;
+            return;
+        }
+        // Ready once it accepts
+        for (int tries = 0; tries < 500; ++tries) {
+            ServerConnection probe;
+            if (probe.open(socket().c_str())) return;
+            usleep(2000);
+        }
+        stop();
+    }
+
+    ~Server() { stop(); }
+
+    void stop() {
+        if (pid <= 0) return;
+        kill(pid, SIGTERM);
+        while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+        pid = -1;
+    }
+
+    bool ok() const { return pid > 0; }
+    std::string socket() const { return (dir.path() / "shell.sock").string(); }
+};
+
+Server& server() {
+    static Server instance;
+    return instance;
+}
+
+// Sessions write to this process's stdout; point it at /dev/null meanwhile
+class QuietStdout {
+    int saved;
+
+public:
+    QuietStdout() {
+        std::cout.flush();
+        saved = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    ~QuietStdout() {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+};
+
+// Run argv with input piped to its stdin and return what it printed
+std::string run_capturing(char* const argv[], const std::string& input) {
+    int in[2];
+    if (pipe2(in, O_CLOEXEC) != 0) return {};
+    const int out = memfd_create("server_bench", MFD_CLOEXEC);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    pid_t pid;
+    const int rc = posix_spawn(&pid, argv[0], &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in[0]);
+    if (rc == 0 && !input.empty()) {
+        // Far less than a pipe holds, so this cannot block
+        [[maybe_unused]] ssize_t n = write(in[1], input.data(), input.size());
+    }
+    close(in[1]);
+    std::string printed;
+    if (rc == 0) {
+        while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+        char buf[4096];
+        ssize_t n;
+        for (off_t at = 0; (n = pread(out, buf, sizeof(buf), at)) > 0; at += n) printed.append(buf, n);
+    }
+    close(out);
+    return printed;
+}
+
+// Compound commands and here-documents span lines, and a long -c script
+// spans messages; the session must see each whole
+bool client_matches_local() {
+    if (!server().ok()) {
+        std::cerr << "could not start the server\n";
+        return false;
+    }
+    const std::string piped =
+        "cat <<EOF\nhello\nEOF\necho after\nfor i in a b\ndo echo $i\ndone\n"
+        "if true\nthen echo yes\nfi\necho last\n";
+    // Over one message, under the kernel's limit on one argument
+    std::string long_script = "cat <<EOF\n";
+    for (int i = 0; i < 9000; ++i) long_script += "line " + std::to_string(i) + "\n";
+    long_script += "EOF\nfor i in a b\ndo echo $i\ndone";
+
+    std::string socket = server().socket();
+    char* local[] = {const_cast<char*>(kShell), nullptr};
+    char* client[] = {const_cast<char*>(kShell), const_cast<char*>("--connect"), socket.data(), nullptr};
+    char* local_c[] = {const_cast<char*>(kShell), const_cast<char*>("-c"), long_script.data(), nullptr};
+    char* client_c[] = {const_cast<char*>(kShell), const_cast<char*>("--connect"), socket.data(),
+                        const_cast<char*>("-c"), long_script.data(), nullptr};
+    bool ok = true;
+    const std::string expected = run_capturing(local, piped);
+    if (expected.empty() || run_capturing(client, piped) != expected) {
+        std::cerr << "a script piped to the client ran differently\n";
+        ok = false;
+    }
+    const std::string expected_c = run_capturing(local_c, {});
+    if (expected_c.empty() || run_capturing(client_c, {}) != expected_c) {
+        std::cerr << "a long -c script through the client ran differently\n";
+        ok = false;
+    }
+    return ok;
+}
+
+void BM_PerTaskLaunch(benchmark::State& state) {
+    std::string task = kTasks[state.range(0)];
+    char* argv[] = {const_cast<char*>(kShell), const_cast<char*>("-c"), task.data(), nullptr};
+    setenv("SHELL_PATH_INDEX", "off", 1);
+    for (auto _ : state) {
+        if (!run_quietly(argv)) return state.SkipWithError("the shell failed");
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(task);
+}
+
+void BM_ServedThinClient(benchmark::State& state) {
+    if (!server().ok()) return state.SkipWithError("could not start the server");
+    std::string task = kTasks[state.range(0)];
+    std::string socket = server().socket();
+    char* argv[] = {const_cast<char*>(kShell), const_cast<char*>("--connect"), socket.data(),
+                    const_cast<char*>("-c"), task.data(), nullptr};
+    for (auto _ : state) {
+        if (!run_quietly(argv)) return state.SkipWithError("the client failed");
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(task);
+}
+
+void BM_ServedConnectionPerTask(benchmark::State& state) {
+    if (!server().ok()) return state.SkipWithError("could not start the server");
+    const std::string task = kTasks[state.range(0)];
+    const std::string socket = server().socket();
+    QuietStdout quiet;
+    for (auto _ : state) {
+        ServerConnection conn;
+        int status = 0;
+        bool exited = false;
+        if (!conn.open(socket.c_str()) || !conn.run(task, status, exited) || status != 0) {
+            return state.SkipWithError("the session failed");
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(task);
+}
+
+void BM_ServedOneSession(benchmark::State& state) {
+    if (!server().ok()) return state.SkipWithError("could not start the server");
+    const std::string task = kTasks[state.range(0)];
+    QuietStdout quiet;
+    ServerConnection conn;
+    if (!conn.open(server().socket().c_str())) return state.SkipWithError("could not connect");
+    for (auto _ : state) {
+        int status = 0;
+        bool exited = false;
+        if (!conn.run(task, status, exited) || status != 0) return state.SkipWithError("the session failed");
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(task);
+}
+
+BENCHMARK(BM_PerTaskLaunch)->ArgName("task")->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ServedThinClient)->ArgName("task")->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ServedConnectionPerTask)->ArgName("task")->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ServedOneSession)->ArgName("task")->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!client_matches_local()) return 1;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,78 @@
+// End-to-end: whole scripted sessions replayed through the shell binary,
+// from exec to exit. Every file in bench/sessions is one benchmark; set
+// SHELL_BENCH_SESSIONS to a directory of your own (a copy of a history
+// file works) to replay those instead.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr const char* kShell = SHELL_BINARY;
+
+// Run `shell script` with its output thrown away; the exit status is the
+// session's own, so only a failure to start counts as an error
+bool replay(const std::string& script) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char* argv[] = {const_cast<char*>(kShell), const_cast<char*>(script.c_str()), nullptr};
+    pid_t pid;
+    int rc = posix_spawn(&pid, kShell, &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) return false;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) && WEXITSTATUS(status) != 127;
+}
+
+void BM_Session(benchmark::State& state, const std::string& script) {
+    for (auto _ : state) {
+        if (!replay(script)) return state.SkipWithError("the shell did not run the session");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // Sessions run with the PATH index off, so every run starts equally cold
+    // and the user's saved index is left alone
+    setenv("SHELL_PATH_INDEX", "off", 1);
+
+    const char* custom = std::getenv("SHELL_BENCH_SESSIONS");
+    const fs::path dir = custom && *custom ? fs::path(custom) : fs::path(SESSION_DIR);
+    std::vector<fs::path> scripts;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file()) scripts.push_back(entry.path());
+    }
+    std::sort(scripts.begin(), scripts.end());
+    for (const auto& script : scripts) {
+        benchmark::RegisterBenchmark(("BM_Session/" + script.stem().string()).c_str(), BM_Session,
+                                     script.string())
+            ->Unit(benchmark::kMillisecond);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
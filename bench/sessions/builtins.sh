@@ -0,0 +1,27 @@
+# Builtins only: nothing forks, so this is the shell's own per-line cost
+export GREETING=hello
+echo $GREETING world
+printf '%s-%d\n' item 1
+printf '%s-%d\n' item 2
+printf '%s-%d\n' item 3
+pwd
+cd /
+pwd
+cd /tmp
+cd -
+cd -P ..
+cd /tmp
+type echo cd printf
+hash
+true
+false
+test -d /tmp
+[ -n "$GREETING" ]
+NAME=value
+echo ${NAME} $? $$
+unset NAME
+echo "quoted   spaces" 'single $quotes'
+echo a b c d e f g h i j k l m n o p q r s t u v w x y z
+export PAGER=less EDITOR=vi
+export -p
+echo done
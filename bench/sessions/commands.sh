@@ -0,0 +1,22 @@
+# External programs and pipelines: lookup, spawn and wait per line
+true
+ls /
+ls -la /tmp
+uname -a
+date
+seq 1000 | wc -l
+seq 10000 | tail -n 1
+echo alpha beta gamma | tr a-z A-Z
+printf 'b\na\nc\n' | sort | uniq
+cat /etc/hostname
+env | wc -l
+LC_ALL=C sort /etc/passwd | head -n 3
+seq 100 | cat | cat | cat | wc -l
+id
+sleep 0
+seq 100000 | xargs echo | wc -l
+seq 1000 | xargs -n 100 -P 4 true
+coproc -j 2 upper sed -u s/x/y/
+seq 1000 | sed s/^/x/ | coproc -r upper | tail -1
+coproc -k upper
+echo finished
@@ -0,0 +1,21 @@
+# Lists and control flow: and-or lists, if and loops whose bodies are
+# compiled once and run many times, and a for loop over a substitution
+count=0
+for i in $(seq 2000); do
+    true $i && count=$i || echo unreachable
+done
+echo $count
+for word in alpha beta gamma; do echo $word; done
+n=0
+while test $n != 200; do
+    n=$(expr $n + 1)
+    if test $n = 100; then continue; fi
+    test $n = 150 && echo halfway
+done
+until true; do echo never; done
+for dir in /tmp /nonexistent /; do
+    if cd $dir 2> /dev/null; then pwd; else echo no $dir; fi
+done
+! false && echo negated
+for i in 1 2 3; do for j in a b c; do test $j = b && break 2; echo $i$j; done; done
+echo finished
@@ -0,0 +1,26 @@
+# Here-documents and here-strings: bodies expanded or taken literally, read
+# by builtins in the shell and by programs, alone and in pipelines
+name=world
+cat <<EOF
+hello $name from $(pwd)
+escaped \$name and `echo backquoted`
+EOF
+cat <<'EOF'
+literal $name `not run`
+EOF
+	cat <<-EOF
+	indented $name
+	EOF
+wc -l <<EOF
+one
+two
+three
+EOF
+cat <<EOF | tr a-z A-Z | wc -c
+a body that goes through a pipeline of programs
+EOF
+tr a-z A-Z <<<"here string for $name"
+lines=$(wc -w <<<"one two three")
+echo $lines
+cat <<<"$name" | cat
+echo finished
@@ -0,0 +1,21 @@
+# Redirections: builtins writing to files from inside the shell, programs
+# given theirs at launch, and both in pipelines and substitutions
+out=/tmp/shell-session-redirect
+echo first > $out
+echo second >> $out
+pwd >> $out 2>&1
+cat < $out
+wc -l < $out > /dev/null
+ls /nonexistent 2> /dev/null
+ls /nonexistent > /dev/null 2>&1
+ls /nonexistent &> /dev/null
+echo to stderr >&2 2> /dev/null
+cat $out | tr a-z A-Z > $out.upper
+cat < $out.upper | wc -c
+lines=$(wc -l < $out 2>&1)
+echo $lines
+errors=$(ls /nonexistent 2>&1)
+echo $errors
+> $out
+rm -f $out $out.upper
+echo finished
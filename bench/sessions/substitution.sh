@@ -0,0 +1,14 @@
+# Command substitution: builtins captured in-process, then programs and
+# pipelines read through a pipe
+dir=$(pwd)
+echo $(pwd) "$(echo quoted   words)"
+greeting=$(printf '%s-%s' hello world)
+echo $greeting $(echo $(echo nested))
+echo `echo backquoted`
+x=$(type cd)
+echo $(test -d $dir)
+name=$(uname)
+echo $(seq 3) $(date +%s)
+lines=$(seq 100 | wc -l)
+echo $lines $(cat /etc/hostname)
+echo finished
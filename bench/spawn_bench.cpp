@@ -0,0 +1,118 @@
+// Spawn-to-exit latency of the two launcher backends as the shell's RSS grows.
+// fork() copies page tables proportional to the resident set; the
+// posix_spawn (CLONE_VFORK) path should stay flat. BM_LaunchWithAttributes
+// is the auto backend given launch attributes, which send it through fork.
+
+#include "launcher.hpp"
+#include "path_cache.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+namespace {
+
+// Touched anonymous memory standing in for a large history and PATH index
+class Ballast {
+    void* base = nullptr;
+    size_t size = 0;
+
+public:
+    void resize(size_t bytes) {
+        if (bytes == size) return;
+        if (base) munmap(base, size);
+        base = nullptr;
+        size = bytes;
+        if (bytes == 0) return;
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            size = 0;
+            return;
+        }
+        std::memset(base, 1, bytes);
+    }
+};
+
+Ballast ballast;
+
+void BM_LaunchToExit(benchmark::State& state) {
+    auto backend = static_cast<LaunchBackend>(state.range(0));
+    ballast.resize(static_cast<size_t>(state.range(1)) << 20);
+
+    PathCache path_cache;
+    auto program = path_cache.find("true");
+    if (program.empty()) {
+        state.SkipWithError("true not found in PATH");
+        return;
+    }
+
+    std::string arg0 = "true";
+    char* argv[] = {arg0.data(), nullptr};
+    LaunchRequest req;
+    req.program = program.c_str();
+    req.argv = argv;
+
+    for (auto _ : state) {
+        pid_t pid = launch_process(req, backend);
+        if (pid < 0) {
+            state.SkipWithError("launch failed");
+            break;
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+    }
+    state.SetLabel(std::string(launch_backend_name(backend)) + "/" +
+                   std::to_string(state.range(1)) + "MiB");
+}
+
+BENCHMARK(BM_LaunchToExit)
+    ->ArgNames({"backend", "rss_mib"})
+    ->ArgsProduct({{static_cast<int64_t>(LaunchBackend::Spawn), static_cast<int64_t>(LaunchBackend::Fork)},
+                   {0, 64, 256, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_LaunchWithAttributes(benchmark::State& state) {
+    ballast.resize(static_cast<size_t>(state.range(0)) << 20);
+
+    PathCache path_cache;
+    auto program = path_cache.find("true");
+    if (program.empty()) {
+        state.SkipWithError("true not found in PATH");
+        return;
+    }
+
+    LaunchAttributes attributes;
+    cpu_set_t cpus;
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+    attributes.cpus = cpus;
+
+    std::string arg0 = "true";
+    char* argv[] = {arg0.data(), nullptr};
+    LaunchRequest req;
+    req.program = program.c_str();
+    req.argv = argv;
+    req.attributes = &attributes;
+
+    for (auto _ : state) {
+        pid_t pid = launch_process(req, LaunchBackend::Auto);
+        if (pid < 0) {
+            state.SkipWithError("launch failed");
+            break;
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+    }
+    state.SetLabel(std::to_string(state.range(0)) + "MiB");
+}
+
+BENCHMARK(BM_LaunchWithAttributes)
+    ->ArgName("rss_mib")
+    ->Arg(0)->Arg(64)->Arg(256)->Arg(1024)
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
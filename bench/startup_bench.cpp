@@ -0,0 +1,123 @@
+// Cold-start latency of the shell binary: exec to the first prompt, and exec
+// to the first external command having run, with the saved PATH index
+// (warmed beforehand) and without it. Without the index every PATH
+// directory is read before the first command can be resolved.
+
+#include "bench_fixtures.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace {
+
+constexpr const char* kShell = SHELL_BINARY;
+
+TempDir index_dir("startup_bench");
+
+void use_index(bool enabled) {
+    const std::string index_file = (index_dir.path() / "path-index").string();
+    setenv("SHELL_PATH_INDEX", enabled ? index_file.c_str() : "off", 1);
+}
+
+// Feed script to a fresh shell on a pipe and wait for it to exit
+bool run_script(const char* script) {
+    int in[2];
+    if (pipe2(in, O_CLOEXEC) != 0) return false;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char* argv[] = {const_cast<char*>(kShell), nullptr};
+    pid_t pid;
+    int rc = posix_spawn(&pid, kShell, &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in[0]);
+    if (rc != 0) {
+        close(in[1]);
+        return false;
+    }
+    ssize_t n = write(in[1], script, std::char_traits<char>::length(script));
+    close(in[1]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return n > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Start an interactive shell on a pseudo-terminal and wait for "$ "
+bool reach_prompt() {
+    int master;
+    pid_t pid = forkpty(&master, nullptr, nullptr, nullptr);
+    if (pid < 0) return false;
+    if (pid == 0) {
+        char* argv[] = {const_cast<char*>(kShell), nullptr};
+        execv(kShell, argv);
+        _exit(127);
+    }
+
+    bool seen = false;
+    char prev = 0;
+    char buf[256];
+    while (!seen) {
+        pollfd pfd{master, POLLIN, 0};
+        if (poll(&pfd, 1, 5000) <= 0) break;
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n && !seen; ++i) {
+            seen = prev == '$' && buf[i] == ' ';
+            prev = buf[i];
+        }
+    }
+    kill(pid, SIGKILL);
+    close(master);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return seen;
+}
+
+void BM_ExecToPrompt(benchmark::State& state) {
+    use_index(state.range(0) != 0);
+    for (auto _ : state) {
+        if (!reach_prompt()) {
+            state.SkipWithError("no prompt from the shell");
+            break;
+        }
+    }
+    state.SetLabel(state.range(0) ? "index" : "no index");
+}
+
+void BM_ExecToFirstCommand(benchmark::State& state) {
+    const bool indexed = state.range(0) != 0;
+    use_index(indexed);
+    // Write the index once, so every iteration starts warm
+    if (indexed && !run_script("uname\n")) {
+        state.SkipWithError("shell failed to run uname");
+        return;
+    }
+    for (auto _ : state) {
+        if (!run_script("uname\n")) {
+            state.SkipWithError("shell failed to run uname");
+            break;
+        }
+    }
+    state.SetLabel(indexed ? "index" : "no index");
+}
+
+BENCHMARK(BM_ExecToPrompt)->ArgName("index")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ExecToFirstCommand)->ArgName("index")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+} // namespace
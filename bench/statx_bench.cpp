@@ -0,0 +1,230 @@
+// PATH resolution on a slow filesystem: a sweep stats every PATH directory
+// and the name looked for in each, the miss path of PathCache::find. Here
+// the directories live on a small FUSE filesystem served from this process
+// that answers every request after kDelay, standing in for NFS, and the
+// batch is run through each statx_batch backend; Serial is one round trip
+// after another, as sweeps used to be. BM_FindMiss is the whole lookup.
+// Mounting needs root (or CAP_SYS_ADMIN); without it everything is skipped.
+
+#include "bench_fixtures.hpp"
+#include "path_cache.hpp"
+#include "statx_batch.hpp"
+#include "variables.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fuse.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr auto kDelay = std::chrono::microseconds(200);
+constexpr int kMaxDirs = 128;
+// Requests served at once; enough that none waits behind another
+constexpr int kServers = 64;
+constexpr uint64_t kFirstDir = FUSE_ROOT_ID + 1;
+
+const char* const kBackendNames[] = {"auto", "io_uring", "threads", "serial"};
+
+// A read-only filesystem of kMaxDirs empty directories, bin0 to bin127.
+// Nothing is cached by the kernel, so every path walk asks again.
+class DelayedFs {
+    TempDir root{"statx_bench"};
+    int fd = -1;
+    bool mounted = false;
+    std::vector<std::thread> servers;
+
+    static fuse_attr attributes(uint64_t node) {
+        fuse_attr attr{};
+        attr.ino = node;
+        attr.mode = S_IFDIR | 0755;
+        attr.nlink = 2;
+        attr.blksize = 4096;
+        // Old enough that no snapshot is considered racy
+        attr.mtime = attr.ctime = attr.atime = 1'000'000'000;
+        return attr;
+    }
+
+    void reply(uint64_t unique, int error, const void* body = nullptr, size_t size = 0) const {
+        fuse_out_header header{static_cast<uint32_t>(sizeof(header) + size), -error, unique};
+        iovec iov[2] = {{&header, sizeof(header)}, {const_cast<void*>(body), size}};
+        writev(fd, iov, body ? 2 : 1);
+    }
+
+    void serve() const {
+        std::vector<char> buf(FUSE_MIN_READ_BUFFER + 64 * 1024);
+        while (true) {
+            const ssize_t n = read(fd, buf.data(), buf.size());
+            if (n < 0 && (errno == EINTR || errno == ENOENT || errno == EAGAIN)) continue;
+            if (n < static_cast<ssize_t>(sizeof(fuse_in_header))) return;
+            const auto* in = reinterpret_cast<const fuse_in_header*>(buf.data());
+            const char* body = buf.data() + sizeof(fuse_in_header);
+
+            switch (in->opcode) {
+            case FUSE_INIT: {
+                const auto* init = reinterpret_cast<const fuse_init_in*>(body);
+                fuse_init_out out{};
+                out.major = FUSE_KERNEL_VERSION;
+                out.minor = FUSE_KERNEL_MINOR_VERSION;
+                out.max_readahead = init->max_readahead;
+                out.max_background = kServers;
+                out.congestion_threshold = kServers;
+                out.max_write = 4096;
+                out.time_gran = 1;
+                reply(in->unique, 0, &out, sizeof(out));
+                continue;
+            }
+            case FUSE_FORGET:
+            case FUSE_BATCH_FORGET:
+            case FUSE_INTERRUPT:
+                continue;
+            case FUSE_DESTROY:
+                reply(in->unique, 0);
+                continue;
+            }
+
+            std::this_thread::sleep_for(kDelay);
+            switch (in->opcode) {
+            case FUSE_LOOKUP: {
+                const std::string_view name(body);
+                const uint64_t node = kFirstDir + std::strtoul(body + 3, nullptr, 10);
+                if (in->nodeid != FUSE_ROOT_ID || !name.starts_with("bin") || node >= kFirstDir + kMaxDirs) {
+                    reply(in->unique, ENOENT);
+                    break;
+                }
+                fuse_entry_out out{};
+                out.nodeid = node;
+                out.attr = attributes(node);
+                reply(in->unique, 0, &out, sizeof(out));
+                break;
+            }
+            case FUSE_GETATTR: {
+                fuse_attr_out out{};
+                out.attr = attributes(in->nodeid);
+                reply(in->unique, 0, &out, sizeof(out));
+                break;
+            }
+            case FUSE_OPENDIR: {
+                fuse_open_out out{};
+                reply(in->unique, 0, &out, sizeof(out));
+                break;
+            }
+            case FUSE_READDIR:
+            case FUSE_RELEASEDIR:
+            case FUSE_ACCESS:
+                // Directories read as empty
+                reply(in->unique, 0);
+                break;
+            case FUSE_STATFS: {
+                fuse_statfs_out out{};
+                reply(in->unique, 0, &out, sizeof(out));
+                break;
+            }
+            default:
+                reply(in->unique, ENOSYS);
+                break;
+            }
+        }
+    }
+
+public:
+    DelayedFs() {
+        if (!root.ok()) return;
+        fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+        if (fd < 0) return;
+        const std::string options = "fd=" + std::to_string(fd) + ",rootmode=40000,user_id=" +
+                                    std::to_string(getuid()) + ",group_id=" + std::to_string(getgid());
+        if (mount("delayedfs", root.path().c_str(), "fuse", MS_NOSUID | MS_NODEV, options.c_str()) != 0) return;
+        mounted = true;
+        for (int i = 0; i < kServers; ++i) servers.emplace_back(&DelayedFs::serve, this);
+        // Keep the benchmark from writing the user's saved index
+        setenv("SHELL_PATH_INDEX", "off", 1);
+    }
+
+    ~DelayedFs() {
+        if (mounted) umount2(root.path().c_str(), MNT_DETACH);
+        // Servers still blocked in read go with the process
+        for (auto& t : servers) t.detach();
+        if (fd >= 0) close(fd);
+    }
+
+    bool ok() const { return mounted; }
+    fs::path dir(int d) const { return root.path() / ("bin" + std::to_string(d)); }
+
+    // PATH made of the first dirs directories
+    std::string path(int dirs) const {
+        std::string value;
+        for (int d = 0; d < dirs; ++d) {
+            if (!value.empty()) value += ':';
+            value += dir(d).string();
+        }
+        return value;
+    }
+};
+
+DelayedFs& delayed_fs() {
+    static DelayedFs fs;
+    return fs;
+}
+
+// What a sweep for a missing name stats: each directory, and the name in it
+void BM_StatxBatch(benchmark::State& state) {
+    const DelayedFs& dfs = delayed_fs();
+    if (!dfs.ok()) return state.SkipWithError("could not mount the FUSE filesystem (needs root)");
+    const auto backend = static_cast<StatxBackend>(state.range(0));
+    const int dirs = static_cast<int>(state.range(1));
+    std::vector<std::string> names;
+    for (int d = 0; d < dirs; ++d) names.push_back(dfs.dir(d).string());
+    for (int d = 0; d < dirs; ++d) names.push_back((dfs.dir(d) / "no-such-program").string());
+    std::vector<const char*> paths;
+    for (const auto& name : names) paths.push_back(name.c_str());
+    std::vector<StatxResult> results(paths.size());
+
+    StatxBackend ran = backend;
+    for (auto _ : state) {
+        ran = statx_batch(paths, STATX_TYPE | STATX_MODE | STATX_INO | STATX_MTIME, results, backend);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(paths.size()));
+    state.SetLabel(kBackendNames[static_cast<int>(ran)]);
+}
+
+void BM_FindMiss(benchmark::State& state) {
+    const DelayedFs& dfs = delayed_fs();
+    if (!dfs.ok()) return state.SkipWithError("could not mount the FUSE filesystem (needs root)");
+    const int dirs = static_cast<int>(state.range(0));
+    setenv("PATH", dfs.path(dirs).c_str(), 1);
+    Variables vars;
+    vars.import_environment();
+    PathCache cache;
+    cache.follow(vars);
+    cache.find("warm-up");
+    for (auto _ : state) benchmark::DoNotOptimize(cache.find("no-such-program"));
+}
+
+void Batches(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"backend", "dirs"});
+    for (auto backend : {StatxBackend::IoUring, StatxBackend::Threads, StatxBackend::Serial}) {
+        for (long dirs : {1L, 4L, 16L, 64L, 128L}) b->Args({static_cast<long>(backend), dirs});
+    }
+}
+
+BENCHMARK(BM_StatxBatch)->Apply(Batches)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_FindMiss)->ArgName("dirs")->Arg(1)->Arg(4)->Arg(16)->Arg(64)->Arg(128)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,350 @@
+// Tokenizer throughput on short, quoted and very long lines, compared with
+// the byte-at-a-time implementation it replaced. Before timing anything the
+// program checks the two agree on a corpus of quoting edge cases and on
+// random lines, and exits non-zero if they do not.
+
+#include "arena.hpp"
+#include "tokenizer.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cctype>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct RefToken {
+    std::string text;
+    TokenKind kind = TokenKind::Word;
+    int fd = -1;
+    RedirectOp redirect = RedirectOp::Output;
+};
+
+// The previous tokenize_command, kept as the reference, with redirections
+// (which it predates) added in the same byte-at-a-time style. Here-document
+// operators are not modelled; the lines checked never have a '<<'.
+std::vector<RefToken> reference_tokenize(std::string_view line) {
+    std::vector<RefToken> tokens;
+    tokens.reserve(8);
+    std::string token;
+    bool in_double_quotes = false;
+    bool in_single_quotes = false; // Track if we're inside single quotes
+    bool escape_next = false;
+    // Where the word being read began, to tell a descriptor number from a word
+    bool word_started = false;
+    size_t word_begin = 0;
+    // Set while the word being read is a redirection's target
+    bool operand = false;
+    bool operand_quoted = false;
+    int redirect_fd = -1;
+    RedirectOp redirect_op = RedirectOp::Output;
+
+    // End the word being read. A target still missing stays awaited.
+    auto end_word = [&] {
+        word_started = false;
+        if (!operand) {
+            if (!token.empty()) tokens.push_back({std::move(token)});
+            token.clear();
+            return;
+        }
+        if (token.empty() && !operand_quoted) return;
+        if (redirect_op == RedirectOp::Duplicate && redirect_fd == 1 && token != "-" &&
+            token.find_first_not_of("0123456789") != std::string::npos) {
+            // >&file is &>file
+            redirect_fd = -1;
+            redirect_op = RedirectOp::Output;
+        }
+        if (redirect_fd < 0) {
+            tokens.push_back({std::move(token), TokenKind::Redirect, 1, redirect_op});
+            tokens.push_back({"1", TokenKind::Redirect, 2, RedirectOp::Duplicate});
+        } else {
+            tokens.push_back({std::move(token), TokenKind::Redirect, redirect_fd, redirect_op});
+        }
+        token.clear();
+        operand = false;
+        operand_quoted = false;
+    };
+
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+
+        if (!word_started && !in_double_quotes && !in_single_quotes && !std::isspace(static_cast<unsigned char>(c))) {
+            word_started = true;
+            word_begin = i;
+        }
+        
+        if (escape_next) {
+            // Only process escape if NOT inside single quotes
+            if (!in_single_quotes) {
+                token += c;
+                escape_next = false;
+                continue;
+            }
+            // If inside single quotes, the backslash that triggered escape_next
+            // should be treated literally. Fall through to add the backslash below.
+        }
+        
+#ifndef _WIN32
+        // Unix-specific handling
+        // Handle single quotes: Toggle state, don't process content inside
+        if (c == '\'' && !in_double_quotes) {
+            in_single_quotes = !in_single_quotes;
+            operand_quoted = true;
+            continue; // Don't add the quote itself to the token yet, just toggle state
+        }
+        
+        // Handle line continuation (only outside quotes)
+        if (!in_single_quotes && !in_double_quotes && c == '\\' && i+1 < line.size() && line[i+1] == '\n') {
+            ++i; // skip the newline
+            operand_quoted = true;
+            continue;
+        }
+        
+        // Handle backslash escaping (only outside single quotes)
+        if (c == '\\' && i + 1 < line.size() && !in_single_quotes) {
+            if (in_double_quotes) {
+                // Inside double quotes, only specific chars are escapable
+                if (line[i+1] == '"' || line[i+1] == '\\' || line[i+1] == '$' || line[i+1] == '`') {
+                    escape_next = true;
+                    continue;
+                }
+                // Otherwise, add the backslash literally inside double quotes
+            } else {
+                // Outside quotes, backslash escapes the next character
+                escape_next = true;
+                operand_quoted = true;
+                continue;
+            }
+        }
+#endif
+
+        // Windows-specific handling (simplified, backslashes are less special inside double quotes here)
+#ifdef _WIN32
+        if (in_double_quotes && c == '\\' && i + 1 < line.size()) {
+            if (line[i+1] == '"' || line[i+1] == '\\') {
+                escape_next = true;
+                continue;
+            }
+        }
+#endif
+
+        // Handle double quotes (works the same regardless of single quote state for toggling)
+        if (c == '"' && !in_single_quotes) {
+            in_double_quotes = !in_double_quotes;
+            operand_quoted = true;
+            continue;
+        }
+
+        // If we reach here and we were in an escape sequence inside single quotes,
+        // the backslash should be added literally now.
+        if (escape_next && in_single_quotes) {
+             token += '\\'; // Add the backslash that started the escape
+             token += c;    // Add the character that was supposed to be escaped (but wasn't)
+             escape_next = false;
+             continue;
+        }
+        
+        // An unquoted '|' ends the word and separates pipeline stages
+        if (c == '|' && !in_double_quotes && !in_single_quotes) {
+            end_word();
+            if (operand) return {}; // the target is missing
+            tokens.push_back({"|", TokenKind::Pipe});
+            continue;
+        }
+
+        // [n]<, [n]>, [n]>>, [n]>|, [n]>&, [n]<&, &> and &>>: the word after
+        // them is the target
+        const char next = i + 1 < line.size() ? line[i + 1] : '\0';
+        const bool both_outputs = c == '&' && next == '>';
+        if ((c == '<' || c == '>' || both_outputs) && !in_double_quotes && !in_single_quotes) {
+            int fd = c == '<' ? 0 : 1;
+            if (both_outputs) {
+                fd = -1;
+            } else if (token.size() == 1 && word_begin + 1 == i && std::isdigit(static_cast<unsigned char>(line[i - 1]))) {
+                // A single digit written right before the operator
+                fd = line[i - 1] - '0';
+                token.clear();
+            }
+            end_word();
+            if (operand) return {}; // the previous target is missing
+            if (both_outputs) {
+                const bool append = i + 2 < line.size() && line[i + 2] == '>';
+                redirect_op = append ? RedirectOp::Append : RedirectOp::Output;
+                i += append ? 2 : 1;
+            } else if (next == '&') {
+                redirect_op = RedirectOp::Duplicate;
+                ++i;
+            } else if (c == '<') {
+                redirect_op = RedirectOp::Input;
+            } else if (next == '>' || next == '|') {
+                redirect_op = next == '>' ? RedirectOp::Append : RedirectOp::Output;
+                ++i;
+            } else {
+                redirect_op = RedirectOp::Output;
+            }
+            operand = true;
+            operand_quoted = false;
+            redirect_fd = fd;
+            continue;
+        }
+
+        // Handle token separation (only outside quotes)
+        if (std::isspace(static_cast<unsigned char>(c)) && !in_double_quotes && !in_single_quotes) {
+            end_word();
+            continue;
+        }
+        
+        // Add character to current token (this includes quotes for now, they're handled by the toggling logic)
+        token += c;
+    }
+    
+    // Check for unclosed quotes
+    if (in_double_quotes || in_single_quotes) {
+        std::cerr << "Error: unclosed quote\n";
+        return {};  // Return empty tokens to indicate error
+    }
+    
+    end_word();
+    if (operand) return {}; // the target is missing
+    return tokens;
+}
+
+bool same_tokens(std::string_view line) {
+    std::vector<RefToken> expected = reference_tokenize(line);
+    Arena arena;
+    std::vector<Token> actual;
+    tokenize_command(line, arena, actual);
+    if (expected.size() != actual.size()) return false;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i].kind != actual[i].kind || expected[i].text != actual[i].text) return false;
+        if (expected[i].kind == TokenKind::Redirect &&
+            (expected[i].fd != actual[i].fd || expected[i].redirect != actual[i].redirect)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void report_mismatch(std::ostream& out, std::string_view line) {
+    out << "tokenizer mismatch on: ";
+    for (char c : line) {
+        if (std::isprint(static_cast<unsigned char>(c))) {
+            out << c;
+        } else {
+            out << "\\x" << std::hex << (static_cast<unsigned>(c) & 0xff) << std::dec;
+        }
+    }
+    out << '\n';
+}
+
+// Differential check: the new tokenizer must split exactly like the old one
+bool tokenizers_agree() {
+    // Both implementations report unclosed quotes on std::cerr
+    std::ostringstream sink;
+    auto* saved = std::cerr.rdbuf(sink.rdbuf());
+    std::ostream report(saved);
+
+    const char* corpus[] = {
+        "", "   ", "echo hello world", "echo 'a  b' \"c  d\"", "echo ''", "a''b",
+        "echo \"a\\\"b\"", "echo \"a\\$b\\`c\\d\"", "echo a\\ b", "echo trailing\\",
+        "echo \"trailing\\", "echo 'it''s'", "echo 'a\\b'", "a|b", "a | b|c", "'a|b'",
+        "\"a|b\"", "a\\|b", "echo \"unclosed", "echo 'unclosed", "x\\\ny", "\t\vtab\fsep\r",
+        "echo $HOME > out", "\"\"''\"\"", "\"a'b\"'c\"d'", "echo \\'x\\'",
+        "echo \xc3\xa9t\xc3\xa9 \"\xe2\x82\xac\"",
+        "echo a>out", "cmd 2>err", "cmd 2>&1", "cmd >&2 x", "cmd >&-", "cmd >& file", "cmd &>both",
+        "cmd &>>both", "cmd >>log", "cmd >|f", "sort <in >out", "cat <&3", "x 12>f", "x a2>f",
+        "x '2'>f", "x \\2>f", "x >", "x > | y", "x >> >", "x >''", "'' >", "x > \"a b\"", "x >\\>",
+        "x 2>\"\"", "5>a5>b",
+    };
+    bool ok = true;
+    for (const char* line : corpus) {
+        if (!same_tokens(line)) {
+            report_mismatch(report, line);
+            ok = false;
+        }
+    }
+
+    // Random lines over an alphabet dense in special bytes; lengths straddle
+    // the 16- and 32-byte vector widths
+    std::mt19937 rng(12345);
+    const std::string alphabet = "ab  '\"\\|$>`\t\n\x80z0123456789abcdefghijklmnop";
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    std::uniform_int_distribution<size_t> length(0, 80);
+    std::string line;
+    for (int iter = 0; iter < 200000 && ok; ++iter) {
+        line.clear();
+        for (size_t n = length(rng); n > 0; --n) line += alphabet[pick(rng)];
+        if (!same_tokens(line)) {
+            report_mismatch(report, line);
+            ok = false;
+        }
+    }
+
+    std::cerr.rdbuf(saved);
+    return ok;
+}
+
+std::string short_line() { return "ls -la /usr/local/bin"; }
+
+std::string quoted_line() {
+    return "echo 'single quoted arg' \"double quoted $arg\" escaped\\ space "
+           "\"nested 'quotes' and \\\"escapes\\\"\" | grep -v 'pattern with spaces'";
+}
+
+// A long argument list, as produced by globbing a big directory
+std::string huge_line() {
+    std::string line = "rm -f";
+    for (int i = 0; i < 20000; ++i) {
+        line += " build/obj/module_";
+        line += std::to_string(i);
+        line += ".o";
+    }
+    return line;
+}
+
+template <std::string (*MakeLine)()>
+void BM_Reference(benchmark::State& state) {
+    const std::string line = MakeLine();
+    for (auto _ : state) {
+        auto tokens = reference_tokenize(line);
+        benchmark::DoNotOptimize(tokens.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(line.size()));
+}
+
+template <std::string (*MakeLine)()>
+void BM_Tokenize(benchmark::State& state) {
+    const std::string line = MakeLine();
+    Arena arena;
+    std::vector<Token> tokens;
+    for (auto _ : state) {
+        arena.reset();
+        tokenize_command(line, arena, tokens);
+        benchmark::DoNotOptimize(tokens.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(line.size()));
+}
+
+BENCHMARK_TEMPLATE(BM_Reference, short_line);
+BENCHMARK_TEMPLATE(BM_Tokenize, short_line);
+BENCHMARK_TEMPLATE(BM_Reference, quoted_line);
+BENCHMARK_TEMPLATE(BM_Tokenize, quoted_line);
+BENCHMARK_TEMPLATE(BM_Reference, huge_line);
+BENCHMARK_TEMPLATE(BM_Tokenize, huge_line);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!tokenizers_agree()) return 1;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Running `true` over N file names read from standard input: the xargs
+// builtin packs them into as few launches as ARG_MAX allows, and with -P
+// keeps several in flight; parallel, like a loop over the names, launches
+// once per name.
+
+#include "builtins.hpp"
+#include "output.hpp"
+#include "shell.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+Shell& shell() {
+    static Shell s;
+    return s;
+}
+
+// A memfd of names such as /usr/share/doc/package-123/file-123.txt, one per
+// line, rewound before each run
+int names(long count) {
+    const int fd = memfd_create("xargs_bench", MFD_CLOEXEC);
+    std::string text;
+    for (long i = 0; i < count; ++i) {
+        text += "/usr/share/doc/package-" + std::to_string(i % 1000) + "/file-" + std::to_string(i) + ".txt\n";
+    }
+    if (write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void run(benchmark::State& state, std::vector<std::string_view> args) {
+    const long count = state.range(0);
+    const int in = names(count);
+    if (in < 0) return state.SkipWithError("could not write the names");
+    const Builtin* builtin = find_builtin(args[0]);
+    Output out(STDOUT_FILENO);
+    Output err(STDERR_FILENO);
+    BuiltinIO io{in, out, err};
+    for (auto _ : state) {
+        lseek(in, 0, SEEK_SET);
+        benchmark::DoNotOptimize(builtin->run(shell(), args, io));
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    close(in);
+}
+
+void BM_Xargs(benchmark::State& state) {
+    const std::string jobs = std::to_string(state.range(1));
+    run(state, {"xargs", "-P", jobs, "true"});
+}
+
+void BM_Parallel(benchmark::State& state) {
+    const std::string jobs = std::to_string(state.range(1));
+    run(state, {"parallel", "-j", jobs, "true"});
+}
+
+BENCHMARK(BM_Xargs)->ArgNames({"names", "jobs"})->ArgsProduct({{1000, 100000}, {1, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Parallel)->ArgNames({"names", "jobs"})->ArgsProduct({{1000}, {1, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
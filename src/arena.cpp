@@ -0,0 +1,22 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+void Arena::grow(size_t extra) {
+    size_t need = open_ + extra + 1;
+
+    // Reuse the next block when it is big enough, otherwise slot a new one in
+    // before it so the reuse order stays the same after reset()
+    size_t next = blocks_.empty() ? 0 : current_ + 1;
+    if (next >= blocks_.size() || blocks_[next].size < need) {
+        size_t size = std::max(kBlockSize, need * 2);
+        blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(next),
+                       Block{std::make_unique<char[]>(size), size});
+    }
+
+    if (open_ > 0) {
+        std::memcpy(blocks_[next].data.get(), top(), open_);
+    }
+    current_ = next;
+    used_ = 0;
+}
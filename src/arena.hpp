@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for the strings of one command line. reset() rewinds to
+// the first block without freeing anything, so once the blocks have grown
+// to fit the longest line seen, tokenizing costs no allocation at all.
+//
+// Strings are built one at a time: begin(), any number of append(), then
+// finish(), which NUL-terminates the result so views can go straight into
+// an argv array.
+class Arena {
+public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    void reset() {
+        current_ = 0;
+        used_ = 0;
+        open_ = 0;
+    }
+
+    void begin() { open_ = 0; }
+
+    void append(const char* data, size_t n) {
+        if (used_ + open_ + n + 1 > capacity()) grow(n);
+        std::memcpy(top() + open_, data, n);
+        open_ += n;
+    }
+
+    void append(char c) {
+        if (used_ + open_ + 2 > capacity()) grow(1);
+        top()[open_++] = c;
+    }
+
+    // Length of the string being built
+    size_t size() const { return open_; }
+
+    // The string being built so far; valid until the next append
+    std::string_view view() const {
+        return blocks_.empty() ? std::string_view() : std::string_view(blocks_[current_].data.get() + used_, open_);
+    }
+
+    std::string_view finish() {
+        if (used_ + open_ + 1 > capacity()) grow(0);
+        char* s = top();
+        s[open_] = '\0';
+        used_ += open_ + 1;
+        size_t len = open_;
+        open_ = 0;
+        return std::string_view(s, len);
+    }
+
+    // Drop the string being built
+    void discard() { open_ = 0; }
+
+    // Copy s in as a finished string
+    std::string_view store(std::string_view s) {
+        begin();
+        append(s.data(), s.size());
+        return finish();
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_;
+    size_t current_ = 0; // block holding the open string
+    size_t used_ = 0;    // finished bytes in the current block
+    size_t open_ = 0;    // bytes of the open string, starting at used_
+
+    size_t capacity() const { return blocks_.empty() ? 0 : blocks_[current_].size; }
+    char* top() { return blocks_[current_].data.get() + used_; }
+
+    // Move the open string to a block with room for extra more bytes
+    void grow(size_t extra);
+};
@@ -0,0 +1,637 @@
+#include "builtins.hpp"
+#include "coproc.hpp"
+#include "executor.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "placement.hpp"
+#include "shell.hpp"
+#include "trace.hpp"
+#include "utilities.hpp"
+#include "working_directory.hpp"
+#include "xargs.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int builtin_exit(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    int code = 0;
+    if (args.size() > 1) {
+        try {
+            code = std::stoi(std::string(args[1]));
+        } catch (const std::invalid_argument&) {
+            io.err << "exit: invalid number\n";
+            return 1;
+        } catch (const std::out_of_range&) {
+            io.err << "exit: number out of range\n";
+            return 1;
+        }
+    }
+    shell.exit_requested = true;
+    shell.exit_code = code;
+    return code;
+}
+
+// Inside a loop break and continue are compiled into jumps; run as
+// commands they are outside any, and only say so, leaving $? at 0 as bash
+// does whatever the count
+int builtin_break(Shell&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    io.err << args[0] << ": only meaningful in a `for', `while', or `until' loop\n";
+    return 0;
+}
+
+int builtin_echo(Shell&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (i > 1) io.out << ' ';
+        io.out << args[i];
+    }
+    io.out << '\n';
+    return 0;
+}
+
+int builtin_type(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() < 2) {
+        io.err << "type: missing argument\n";
+        return 1;
+    }
+
+    const auto& target = args[1];
+    if (find_builtin(target)) {
+        io.out << target << " is a shell builtin\n";
+        return 0;
+    }
+
+    auto path = shell.path_cache.find(std::string(target));
+    if (path.empty()) {
+        io.err << target << ": not found\n";
+        return 1;
+    }
+    io.out << target << " is " << path.string() << '\n';
+    return 0;
+}
+
+// Report PATH index counters, or forget everything with -r
+int builtin_hash(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() > 1 && args[1] == "-r") {
+        shell.path_cache.clear();
+        return 0;
+    }
+    const auto& s = shell.path_cache.stats();
+    io.out << "lookups:    " << s.lookups << '\n'
+           << "cache hits: " << s.cache_hits << '\n'
+           << "index hits: " << s.index_hits << '\n'
+           << "probe hits: " << s.probe_hits << '\n'
+           << "misses:     " << s.misses << '\n'
+           << "sweeps:     " << s.sweeps << '\n'
+           << "rebuilds:   " << s.rebuilds << '\n';
+    return 0;
+}
+
+// pwd [-L|-P]: the logical directory is kept in memory; -P asks the system
+int builtin_pwd(Shell&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    bool physical = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-P" || args[i] == "-L") {
+            physical = args[i] == "-P";
+        } else {
+            io.err << "pwd: " << args[i] << ": invalid option\n";
+            return 2;
+        }
+    }
+    if (!physical) {
+        io.out << working_directory() << '\n';
+        return 0;
+    }
+    try {
+        // Use .string() to get the path as a standard string
+        io.out << fs::current_path().string() << '\n';
+    } catch (const fs::filesystem_error& ex) {
+        // Handle potential errors (e.g., permissions, inaccessible path)
+        io.err << "pwd: error accessing current directory: " << ex.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Handle cd command: cd [-L|-P] [dir|-] with absolute, relative and ~
+// paths. Without dir it goes to $HOME; - goes to $OLDPWD and prints it.
+int builtin_cd(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    bool physical = false;
+    size_t first = 1;
+    for (; first < args.size() && args[first].size() > 1 && args[first][0] == '-'; ++first) {
+        if (args[first] == "--") {
+            ++first;
+            break;
+        }
+        // The last of -L and -P wins
+        for (char c : args[first].substr(1)) {
+            if (c != 'L' && c != 'P') {
+                io.err << "cd: -" << c << ": invalid option\n";
+                return 2;
+            }
+            physical = c == 'P';
+        }
+    }
+    if (args.size() - first > 1) {
+        io.err << "cd: expected 1 argument, got " << (args.size() - first) << '\n';
+        return 1;
+    }
+
+    std::string target_dir = first < args.size() ? std::string(args[first]) : "~";
+    const bool to_previous = target_dir == "-";
+    if (to_previous) {
+        const std::string* previous = shell.vars.get("OLDPWD");
+        if (!previous || previous->empty()) {
+            io.err << "cd: OLDPWD not set\n";
+            return 1;
+        }
+        target_dir = *previous;
+    }
+
+    // Check if the path starts with ~ or is exactly ~
+    if (target_dir == "~" || (target_dir.size() >= 2 && target_dir[0] == '~' && target_dir[1] == '/')) {
+        // Get the HOME environment variable
+        const std::string* home_var = shell.vars.get("HOME");
+        const char* home_cstr = home_var ? home_var->c_str() : nullptr;
+        #ifdef _WIN32
+            // On Windows, HOME might not be set, try USERPROFILE or HOMEDRIVE + HOMEPATH
+            std::string home_win;
+            if (!home_cstr) {
+                home_cstr = std::getenv("USERPROFILE");
+            }
+            if (!home_cstr) {
+                const char* drive = std::getenv("HOMEDRIVE");
+                const char* path = std::getenv("HOMEPATH");
+                if (drive && path) {
+                    home_win = std::string(drive) + path;
+                    home_cstr = home_win.c_str();
+                }
+            }
+        #endif
+
+        if (!home_cstr) {
+            io.err << "cd: HOME not set\n";
+            return 1; // Stay in current directory if HOME is not available
+        }
+
+        std::string home_dir(home_cstr);
+
+        // If target was just "~", use the home directory directly
+        if (target_dir == "~") {
+            target_dir = home_dir;
+        } else {
+            // If target was "~/" or "~/path", replace ~ with home_dir
+            // Remove the leading "~/" and append the rest to home_dir
+            std::string relative_part = target_dir.substr(2); // Remove "~/"
+            // Use fs::path to correctly combine paths (handles trailing / in home_dir correctly)
+            fs::path combined_path(home_dir);
+            combined_path /= relative_part;
+            target_dir = combined_path.string();
+        }
+    }
+
+    // An empty operand leaves the directory alone
+    if (target_dir.empty()) return 0;
+
+    const std::string previous = working_directory();
+    if (int err = change_working_directory(target_dir, physical)) {
+        io.err << "cd: " << (first < args.size() ? args[first] : std::string_view(target_dir)) << ": "
+               << std::strerror(err) << '\n';
+        return 1;
+    }
+    shell.vars.set("OLDPWD", previous);
+    shell.vars.set("PWD", working_directory(), true);
+    if (to_previous) io.out << working_directory() << '\n';
+    return 0;
+}
+
+// Print a value so the shell reads it back unchanged
+void print_quoted(Output& out, std::string_view value) {
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\' || c == '$' || c == '`') out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+// export [-p] [name[=value]...]; with no names, list the exported variables
+int builtin_export(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    size_t i = 1;
+    if (i < args.size() && args[i] == "-p") ++i;
+    if (i == args.size()) {
+        for (const auto& [name, var] : shell.vars.sorted()) {
+            if (!var->exported) continue;
+            io.out << "export " << name << '=';
+            print_quoted(io.out, var->value);
+            io.out << '\n';
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (; i < args.size(); ++i) {
+        const auto& arg = args[i];
+        auto name = arg.substr(0, arg.find('='));
+        if (!is_valid_name(name)) {
+            io.err << "export: `" << arg << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        if (name.size() < arg.size()) shell.vars.assign(arg);
+        shell.vars.export_name(name);
+    }
+    return status;
+}
+
+// unset [-v] name...
+int builtin_unset(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    size_t i = 1;
+    if (i < args.size() && args[i] == "-v") ++i;
+    int status = 0;
+    for (; i < args.size(); ++i) {
+        if (!is_valid_name(args[i])) {
+            io.err << "unset: `" << args[i] << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        shell.vars.unset(args[i]);
+    }
+    return status;
+}
+
+#ifndef _WIN32
+// List jobs; -l adds the pid of each job's first process, -p prints only that
+int builtin_jobs(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    bool with_pids = false;
+    bool pids_only = false;
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+        for (char c : args[i].substr(1)) {
+            if (c == 'l') {
+                with_pids = true;
+            } else if (c == 'p') {
+                pids_only = true;
+            } else {
+                io.err << "jobs: -" << c << ": invalid option\n";
+                return 2;
+            }
+        }
+    }
+
+    shell.jobs.reap();
+    int status = 0;
+    std::vector<int> ids;
+    if (i == args.size()) {
+        // A foreground pipeline running this very builtin is not a job yet
+        for (const auto& [id, job] : shell.jobs.jobs()) {
+            if (job.background) ids.push_back(id);
+        }
+    }
+    for (; i < args.size(); ++i) {
+        Job* job = shell.jobs.resolve(args[i]);
+        if (!job) {
+            io.err << "jobs: " << args[i] << ": no such job\n";
+            status = 1;
+            continue;
+        }
+        ids.push_back(job->id);
+    }
+
+    for (int id : ids) {
+        auto it = shell.jobs.jobs().find(id);
+        if (it == shell.jobs.jobs().end()) continue;
+        Job& job = it->second;
+        if (pids_only) {
+            io.out << job.procs.front().pid << '\n';
+            continue;
+        }
+        shell.jobs.describe(io.out, job, with_pids);
+        // Listing a finished job is its report
+        if (job.state() == JobState::Done) shell.jobs.remove(job);
+    }
+    return status;
+}
+
+// Wait for every background job, or for the given jobs and pids, returning
+// the status of the last one
+int builtin_wait(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    auto& jobs = shell.jobs;
+    if (args.size() < 2) {
+        std::vector<int> done;
+        for (auto& [id, job] : jobs.jobs()) {
+            jobs.wait(job);
+            if (job.state() == JobState::Done) done.push_back(id);
+        }
+        for (int id : done) jobs.remove(jobs.jobs().at(id));
+        return 0;
+    }
+
+    int status = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const auto& arg = args[i];
+        Job* job = nullptr;
+        pid_t pid = -1;
+        if (arg[0] == '%') {
+            job = jobs.resolve(arg);
+            if (!job) {
+                io.err << "wait: " << arg << ": no such job\n";
+                status = 127;
+                continue;
+            }
+        } else {
+            auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), pid);
+            if (ec != std::errc{} || ptr != arg.data() + arg.size() || pid <= 0) {
+                io.err << "wait: `" << arg << "': not a pid or valid job spec\n";
+                status = 2;
+                continue;
+            }
+            job = jobs.find_by_pid(pid);
+            if (!job) {
+                io.err << "wait: pid " << arg << " is not a child of this shell\n";
+                status = 127;
+                continue;
+            }
+        }
+
+        jobs.wait(*job);
+        status = job->status();
+        if (pid > 0) {
+            for (const auto& proc : job->procs) {
+                if (proc.pid == pid) status = decode_wait_status(proc.wait_status);
+            }
+        }
+        if (job->state() == JobState::Done) jobs.remove(*job);
+    }
+    return status;
+}
+
+// Shared by fg and bg: the job named by the argument, or the current one
+Job* job_argument(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (!shell.jobs.job_control()) {
+        io.err << args[0] << ": no job control\n";
+        return nullptr;
+    }
+    std::string_view spec = args.size() > 1 ? args[1] : std::string_view{};
+    Job* job = shell.jobs.resolve(spec);
+    if (!job) {
+        io.err << args[0] << ": " << (spec.empty() ? "current" : spec) << ": no such job\n";
+        return nullptr;
+    }
+    if (job->state() == JobState::Done) {
+        io.err << args[0] << ": job has terminated\n";
+        shell.jobs.remove(*job);
+        return nullptr;
+    }
+    return job;
+}
+
+int builtin_fg(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    Job* job = job_argument(shell, args, io);
+    if (!job) return 1;
+    io.out << job->command << '\n';
+    io.out.flush();
+    return shell.jobs.foreground(*job, true);
+}
+
+int builtin_bg(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    Job* job = job_argument(shell, args, io);
+    if (!job) return 1;
+    if (job->state() == JobState::Running) {
+        io.err << "bg: job " << job->id << " already in background\n";
+        return 0;
+    }
+    shell.jobs.resume_background(*job);
+    io.out << '[' << job->id << "]+ " << job->command << " &\n";
+    return 0;
+}
+
+// time [-p] command [args...]: the builtin is reached when `time` is not in
+// front of a pipeline of its own (it is a later stage, or follows
+// assignments); it times the one command
+int builtin_time(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    bool posix = false;
+    size_t i = 1;
+    for (; i < args.size() && args[i] == "-p"; ++i) posix = true;
+
+    // The timed command gets the stage's ends, or a here-string's pipe, as
+    // its stdin and stdout; the shell's own are put back afterwards
+    io.out.flush();
+    ShellDescriptors fds;
+    if (io.in != STDIN_FILENO) fds.point(STDIN_FILENO, io.in);
+    if (io.out.fd() >= 0 && io.out.fd() != STDOUT_FILENO) fds.point(STDOUT_FILENO, io.out.fd());
+
+    Pipeline stages;
+    if (i < args.size()) stages.push_back({{}, {args.begin() + static_cast<std::ptrdiff_t>(i), args.end()}});
+    run_timed(shell, stages, posix);
+    return shell.last_status;
+}
+
+// trace [on|off|clear]: switch the phase trace, or report its state
+// trace json|chrome [file]: write the events recorded so far
+int builtin_trace(Shell&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() < 2) {
+        io.out << "trace: " << (tracing() ? "on" : "off") << ", "
+               << static_cast<unsigned long>(trace_buffer().snapshot().size()) << " events\n";
+        return 0;
+    }
+    const auto& cmd = args[1];
+    if (cmd == "on" || cmd == "off") {
+        set_tracing(cmd == "on");
+        return 0;
+    }
+    if (cmd == "clear") {
+        trace_buffer().clear();
+        return 0;
+    }
+    if ((cmd != "json" && cmd != "chrome") || args.size() > 3) {
+        io.err << "trace: usage: trace [on|off|clear] | trace json|chrome [file]\n";
+        return 2;
+    }
+
+    const auto events = trace_buffer().snapshot();
+    auto write = [&](Output& out) {
+        if (cmd == "json") {
+            write_trace_json(out, events);
+        } else {
+            write_chrome_trace(out, events);
+        }
+    };
+    if (args.size() == 2) {
+        write(io.out);
+        return 0;
+    }
+    const std::string file(args[2]);
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        io.err << "trace: " << file << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+    bool ok;
+    {
+        Output out(fd);
+        write(out);
+        ok = out.flush();
+    }
+    close(fd);
+    return ok ? 0 : 1;
+}
+
+void print_history_entry(Output& out, size_t n, std::string_view line) {
+    char num[24];
+    std::snprintf(num, sizeof(num), "%5zu  ", n + 1);
+    out << num << line << '\n';
+}
+
+// List the history, or its last N entries; -g TEXT lists every entry
+// containing TEXT, through the history's index
+int builtin_history(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    auto& history = shell.history;
+    if (!history.is_open()) {
+        // Scripts and -c never open it for themselves
+        auto file = History::default_location(shell.vars);
+        if (!file || !history.open(*file)) return 0;
+    }
+
+    if (args.size() > 1 && args[1] == "-g") {
+        if (args.size() != 3) {
+            io.err << "history: usage: history -g text\n";
+            return 2;
+        }
+        bool found = false;
+        history.search_all(args[2], [&](size_t n, std::string_view line) {
+            print_history_entry(io.out, n, line);
+            found = true;
+        });
+        return found ? 0 : 1;
+    }
+
+    size_t count = SIZE_MAX;
+    if (args.size() > 1) {
+        const auto& arg = args[1];
+        auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), count);
+        if (ec != std::errc{} || ptr != arg.data() + arg.size()) {
+            io.err << "history: " << arg << ": numeric argument required\n";
+            return 2;
+        }
+    }
+    const size_t total = history.size();
+    const auto lines = history.recent(std::min(count, total));
+    for (size_t i = 0; i < lines.size(); ++i) {
+        print_history_entry(io.out, total - lines.size() + i, lines[i]);
+    }
+    return 0;
+}
+#endif
+
+constexpr Builtin kBuiltins[] = {
+    {"echo", builtin_echo, true},
+    {"exit", builtin_exit, false},
+    {"break", builtin_break, true},
+    {"continue", builtin_break, true},
+    {"type", builtin_type, true},
+    {"pwd", builtin_pwd, true},
+    {"cd", builtin_cd, false},
+    {"hash", builtin_hash, true},
+    {"true", builtin_true, true},
+    {"false", builtin_false, true},
+    {"printf", builtin_printf, true},
+    {"export", builtin_export, false},
+    {"unset", builtin_unset, false},
+#ifndef _WIN32
+    {"test", builtin_test, true},
+    {"[", builtin_bracket, true},
+    {"cat", builtin_cat, true},
+    {"jobs", builtin_jobs, true},
+    {"wait", builtin_wait, false},
+    {"fg", builtin_fg, false},
+    {"bg", builtin_bg, false},
+    {"parallel", builtin_parallel, true},
+    {"xargs", builtin_xargs, true},
+    {"coproc", builtin_coproc, true},
+    {"history", builtin_history, true},
+    {"time", builtin_time, false},
+    {"launch", builtin_launch, false},
+    {"trace", builtin_trace, true},
+#endif
+};
+
+constexpr size_t kBuiltinCount = sizeof(kBuiltins) / sizeof(kBuiltins[0]);
+
+// Dispatch goes through a perfect hash found at compile time: the seed is
+// searched for until every name lands in its own slot, so a lookup is one
+// hash of the name, one table load and one comparison.
+constexpr size_t kSlots = std::bit_ceil(kBuiltinCount * 4);
+
+constexpr uint32_t name_hash(std::string_view name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (char c : name) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+constexpr bool seed_is_perfect(uint32_t seed) {
+    std::array<bool, kSlots> used{};
+    for (const auto& b : kBuiltins) {
+        size_t slot = name_hash(b.name, seed) & (kSlots - 1);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_seed() {
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        if (seed_is_perfect(seed)) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t kSeed = find_seed();
+static_assert(kSeed != UINT32_MAX, "no perfect hash seed for the builtin names");
+
+constexpr auto kSlotTable = [] {
+    std::array<int8_t, kSlots> table{};
+    table.fill(-1);
+    for (size_t i = 0; i < kBuiltinCount; ++i) {
+        table[name_hash(kBuiltins[i].name, kSeed) & (kSlots - 1)] = static_cast<int8_t>(i);
+    }
+    return table;
+}();
+
+} // namespace
+
+std::span<const Builtin> all_builtins() {
+    return kBuiltins;
+}
+
+const Builtin* find_builtin(std::string_view name) {
+    int idx = kSlotTable[name_hash(name, kSeed) & (kSlots - 1)];
+    if (idx < 0 || name != kBuiltins[idx].name) return nullptr;
+    return &kBuiltins[idx];
+}
+
+bool parse_count(std::string_view text, size_t& count) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), count);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+class Output;
+struct Shell;
+
+// Where a builtin reads and writes: the shell's own 0/1/2 for a plain
+// command, pipe ends when it is a pipeline stage
+struct BuiltinIO {
+    int in;
+    Output& out;
+    Output& err;
+#ifndef _WIN32
+    // Process group of the job the builtin is a stage of, for the children
+    // it starts; -1 keeps them in the shell's own
+    pid_t pgroup = -1;
+#endif
+};
+
+using BuiltinFn = int (*)(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+struct Builtin {
+    const char* name;
+    BuiltinFn run;
+    // Touches nothing but its own descriptors, so it may run inside the shell
+    // process as a pipeline stage. cd and exit change shell state and run in
+    // a child there, as in other shells.
+    bool pipeline_safe;
+};
+
+const Builtin* find_builtin(std::string_view name);
+
+// Every builtin, in table order
+std::span<const Builtin> all_builtins();
+
+// A count given to an option, such as -j N: decimal digits and nothing else
+bool parse_count(std::string_view text, size_t& count);
@@ -0,0 +1,141 @@
+#include "command_index.hpp"
+
+#ifndef _WIN32
+
+#include "builtins.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Up to this many changes are applied with insert and erase
+constexpr size_t kInPlaceLimit = 16;
+
+} // namespace
+
+void CommandIndex::replace_source(Source& source, std::vector<std::string> names) {
+    // PathCache keeps its lists sorted already
+    if (!std::is_sorted(names.begin(), names.end())) std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    // Both lists are sorted, so the differences fall out of one walk
+    auto old_it = source.names.begin();
+    auto new_it = names.begin();
+    while (old_it != source.names.end() || new_it != names.end()) {
+        if (new_it == names.end() || (old_it != source.names.end() && *old_it < *new_it)) {
+            pending.emplace_back(std::move(*old_it++), -1);
+        } else if (old_it == source.names.end() || *new_it < *old_it) {
+            pending.emplace_back(*new_it++, +1);
+        } else {
+            ++old_it;
+            ++new_it;
+        }
+    }
+    source.names = std::move(names);
+}
+
+void CommandIndex::apply_pending() {
+    if (pending.empty()) return;
+    std::sort(pending.begin(), pending.end());
+
+    // A program or two installed or removed: shifting the tail of the array
+    // per name is cheaper than rebuilding all of it
+    if (pending.size() <= kInPlaceLimit) {
+        for (auto& [name, delta] : pending) {
+            auto it = std::lower_bound(entries.begin(), entries.end(), name,
+                                       [](const Entry& e, const std::string& n) { return e.name < n; });
+            if (it != entries.end() && it->name == name) {
+                int count = static_cast<int>(it->sources) + delta;
+                if (count > 0) {
+                    it->sources = static_cast<uint32_t>(count);
+                } else {
+                    entries.erase(it);
+                }
+            } else if (delta > 0) {
+                entries.insert(it, {std::move(name), static_cast<uint32_t>(delta)});
+            }
+        }
+        pending.clear();
+        return;
+    }
+
+    std::vector<Entry> merged;
+    merged.reserve(entries.size() + pending.size());
+    auto it = entries.begin();
+    for (size_t p = 0; p < pending.size();) {
+        // Sum the changes to one name
+        std::string& name = pending[p].first;
+        int delta = 0;
+        size_t q = p;
+        for (; q < pending.size() && pending[q].first == name; ++q) delta += pending[q].second;
+
+        while (it != entries.end() && it->name < name) merged.push_back(std::move(*it++));
+        if (it != entries.end() && it->name == name) {
+            int count = static_cast<int>(it->sources) + delta;
+            if (count > 0) merged.push_back({std::move(it->name), static_cast<uint32_t>(count)});
+            ++it;
+        } else if (delta > 0) {
+            merged.push_back({std::move(name), static_cast<uint32_t>(delta)});
+        }
+        p = q;
+    }
+    std::move(it, entries.end(), std::back_inserter(merged));
+    entries = std::move(merged);
+    pending.clear();
+}
+
+void CommandIndex::update(PathCache& cache) {
+    if (!have_builtins) {
+        std::vector<std::string> names;
+        for (const auto& builtin : all_builtins()) names.emplace_back(builtin.name);
+        sources.push_back({{}, 1, {}});
+        replace_source(sources.back(), std::move(names));
+        have_builtins = true;
+    }
+
+    cache.refresh();
+
+    // Line the sources up with PATH as it is now. A directory keeps its
+    // source, and its names are only looked at again if its version moved.
+    std::vector<Source> current;
+    current.reserve(cache.directory_count() + 1);
+    current.push_back(std::move(sources[0]));
+    for (size_t i = 0; i < cache.directory_count(); ++i) {
+        const fs::path& dir = cache.directory(i);
+        auto found = std::find_if(sources.begin() + 1, sources.end(),
+                                  [&](const Source& s) { return !s.dir.empty() && s.dir == dir; });
+        Source source;
+        if (found != sources.end()) {
+            source = std::move(*found);
+            found->dir.clear(); // taken; a repeated directory gets a source of its own
+        } else {
+            source.dir = dir;
+            source.version = 0;
+        }
+        const uint64_t version = cache.directory_version(i);
+        if (source.version != version) {
+            std::vector<std::string> names;
+            cache.directory_names(i, names);
+            replace_source(source, std::move(names));
+            source.version = version;
+        }
+        current.push_back(std::move(source));
+    }
+    // Directories that left PATH take their names with them
+    for (size_t s = 1; s < sources.size(); ++s) {
+        if (!sources[s].dir.empty()) replace_source(sources[s], {});
+    }
+    sources = std::move(current);
+    apply_pending();
+}
+
+std::span<const CommandIndex::Entry> CommandIndex::complete(std::string_view prefix) const {
+    auto first = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                  [](const Entry& e, std::string_view p) { return e.name < p; });
+    auto last = std::partition_point(first, entries.end(),
+                                     [&](const Entry& e) { return e.name.starts_with(prefix); });
+    return {first, last};
+}
+
+#endif
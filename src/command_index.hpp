@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path_cache.hpp"
+
+// Every command name the shell can run (the builtins and the executables of
+// the PATH directories) as one sorted array, so the names starting with a
+// prefix are a binary search away. Each source's names are remembered along
+// with the version they came from: an update re-diffs only the directories
+// whose version moved, and applies all the differences in one merge pass.
+class CommandIndex {
+public:
+    struct Entry {
+        std::string name;
+        uint32_t sources; // how many sources provide it
+    };
+
+private:
+    struct Source {
+        fs::path dir;      // empty for the builtins
+        uint64_t version;
+        std::vector<std::string> names; // sorted, unique
+    };
+
+    std::vector<Entry> entries; // sorted by name
+    std::vector<Source> sources;
+    bool have_builtins = false;
+
+    // +1 / -1 per name, applied together
+    std::vector<std::pair<std::string, int>> pending;
+
+    void replace_source(Source& source, std::vector<std::string> names);
+    void apply_pending();
+
+public:
+    // Refresh the cache's directories and fold in whatever changed
+    void update(PathCache& cache);
+
+    // The names starting with prefix, in order
+    std::span<const Entry> complete(std::string_view prefix) const;
+
+    size_t size() const { return entries.size(); }
+};
+
+#endif
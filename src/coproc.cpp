@@ -0,0 +1,417 @@
+#include "coproc.hpp"
+
+#ifndef _WIN32
+
+#include "builtins.hpp"
+#include "jobs.hpp"
+#include "launcher.hpp"
+#include "output.hpp"
+#include "platform.hpp"
+#include "shell.hpp"
+#include "trace.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+
+// Unanswered requests allowed per worker before standard input is left
+// unread, which bounds what is buffered for a slow or stuck worker
+constexpr size_t kMaxWaitingPerWorker = 256;
+
+constexpr size_t kReadSize = 64 * 1024;
+
+// Move a pipe end out of the way of redirections, closed across exec and
+// never blocking the shell; -1 if that fails
+int private_pipe_end(int fd, bool nonblocking) {
+    const int moved = private_fd(fd);
+    if (moved >= 0 && nonblocking) fcntl(moved, F_SETFL, fcntl(moved, F_GETFL) | O_NONBLOCK);
+    return moved;
+}
+
+void close_worker(CoprocWorker& worker) {
+    if (worker.to >= 0) close(worker.to);
+    if (worker.from >= 0) close(worker.from);
+    worker.to = worker.from = -1;
+}
+
+// Status of a worker once its pipes are closed, whether or not the job
+// table reaped it first
+int wait_worker(JobTable& jobs, const CoprocWorker& worker) {
+    return decode_wait_status(jobs.collect(worker.pid));
+}
+
+// A pool of workers, started together; false after reporting, with none of
+// it left running
+bool start(Shell& shell, Coproc& coproc, size_t count, const std::vector<std::string_view>& command,
+           BuiltinIO& io) {
+    auto path = shell.path_cache.find(std::string(command[0]));
+    if (path.empty()) {
+        io.err << "coproc: " << command[0] << ": command not found\n";
+        return false;
+    }
+
+    auto argv = make_argv(command);
+    auto env = shell.vars.environment();
+
+    for (size_t k = 0; k < count; ++k) {
+        int to[2], from[2];
+        if (pipe2(to, O_CLOEXEC) != 0) break;
+        if (pipe2(from, O_CLOEXEC) != 0) {
+            close(to[0]);
+            close(to[1]);
+            break;
+        }
+        LaunchRequest req;
+        req.program = path.c_str();
+        req.argv = argv.data();
+        req.envp = env->envp();
+        req.fd_actions.push_back({FdAction::Kind::Dup, STDIN_FILENO, to[0]});
+        req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, from[1]});
+        // In a group of its own, so ^C at the prompt leaves it running
+        if (shell.jobs.job_control()) req.pgroup = 0;
+
+        CoprocWorker worker;
+        {
+            TraceSpan span(TracePhase::Spawn, command[0]);
+            worker.pid = launch_process(req);
+        }
+        const int launch_error = errno;
+        if (worker.pid > 0) shell.jobs.adopt(worker.pid);
+        close(to[0]);
+        close(from[1]);
+        worker.to = private_pipe_end(to[1], true);
+        worker.from = private_pipe_end(from[0], true);
+        if (worker.pid < 0 || worker.to < 0 || worker.from < 0) {
+            io.err << "coproc: " << command[0] << ": " << std::strerror(worker.pid < 0 ? launch_error : errno)
+                   << '\n';
+            close_worker(worker);
+            if (worker.pid > 0) wait_worker(shell.jobs, worker);
+            break;
+        }
+        coproc.workers.push_back(std::move(worker));
+    }
+
+    if (coproc.workers.size() == count) return true;
+    for (auto& worker : coproc.workers) {
+        close_worker(worker);
+        wait_worker(shell.jobs, worker);
+    }
+    coproc.workers.clear();
+    return false;
+}
+
+// Feeds requests to a pool and hands back the answers in request order.
+// Everything is non-blocking and driven by one poll, so a worker stalled on
+// a full stdout pipe is drained while others are still being written to.
+class Exchange {
+public:
+    Exchange(Coproc& coproc, std::string_view name, BuiltinIO& io)
+        : coproc_(coproc), name_(name), io_(io), sent_(coproc.requests), printed_(coproc.requests) {}
+
+    // The words as one request
+    int run(std::string request) {
+        input_ = std::move(request);
+        input_ += '\n';
+        return loop(-1);
+    }
+
+    // Each line of fd as one
+    int run(int fd) { return loop(fd); }
+
+private:
+    Coproc& coproc_;
+    std::string_view name_;
+    BuiltinIO& io_;
+    std::string input_;     // request text not yet dispatched
+    size_t input_pos_ = 0;
+    // Requests below printed_ that a worker still owes an answer belong to
+    // an earlier exchange, cut short, and their answers are dropped
+    uint64_t sent_;
+    uint64_t printed_;
+    // The answers to requests printed_ onwards, as they arrive
+    std::deque<std::optional<std::string>> answers_;
+    std::vector<pollfd> fds_;
+    int status_ = 0;
+
+    size_t live_workers() const {
+        size_t live = 0;
+        for (const auto& worker : coproc_.workers) live += !worker.gone;
+        return live;
+    }
+
+    CoprocWorker* pick() {
+        auto& workers = coproc_.workers;
+        CoprocWorker* best = nullptr;
+        for (size_t k = 0; k < workers.size(); ++k) {
+            CoprocWorker& worker = workers[(coproc_.next + k) % workers.size()];
+            if (worker.gone) continue;
+            if (!coproc_.least_busy) {
+                best = &worker;
+                break;
+            }
+            if (!best || worker.waiting.size() < best->waiting.size()) best = &worker;
+        }
+        if (best) coproc_.next = static_cast<size_t>(best - workers.data()) + 1;
+        return best;
+    }
+
+    // Send the complete lines of input_, while there is room
+    void dispatch() {
+        const size_t room = live_workers() * kMaxWaitingPerWorker;
+        while (sent_ - printed_ < room) {
+            const size_t end = input_.find('\n', input_pos_);
+            if (end == std::string::npos) break;
+            CoprocWorker* worker = pick();
+            if (!worker) break;
+            worker->unsent.append(input_, input_pos_, end + 1 - input_pos_);
+            worker->waiting.push_back(sent_++);
+            answers_.emplace_back();
+            input_pos_ = end + 1;
+        }
+        coproc_.requests = sent_;
+        input_.erase(0, input_pos_);
+        input_pos_ = 0;
+        // One write for everything a worker was just given
+        for (auto& worker : coproc_.workers) {
+            if (!worker.gone) write_unsent(worker);
+        }
+    }
+
+    void write_unsent(CoprocWorker& worker) {
+        while (!worker.unsent.empty()) {
+            const ssize_t n = write(worker.to, worker.unsent.data(), worker.unsent.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) lose(worker);
+                return;
+            }
+            worker.unsent.erase(0, static_cast<size_t>(n));
+        }
+    }
+
+    void read_answers(CoprocWorker& worker) {
+        char buf[kReadSize];
+        while (true) {
+            const ssize_t n = read(worker.from, buf, sizeof(buf));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) lose(worker);
+                return;
+            }
+            if (n == 0) {
+                lose(worker);
+                return;
+            }
+            worker.partial.append(buf, static_cast<size_t>(n));
+            size_t start = 0;
+            for (size_t end; (end = worker.partial.find('\n', start)) != std::string::npos; start = end + 1) {
+                // Lines nobody asked for, or asked for by an earlier
+                // exchange, are dropped
+                if (worker.waiting.empty()) continue;
+                const uint64_t request = worker.waiting.front();
+                worker.waiting.pop_front();
+                if (request < printed_) continue;
+                answers_[request - printed_].emplace(worker.partial, start, end + 1 - start);
+            }
+            worker.partial.erase(0, start);
+        }
+    }
+
+    // A worker that went away: what it still owed is answered with an empty
+    // line, so later answers keep their places
+    void lose(CoprocWorker& worker) {
+        if (worker.gone) return;
+        worker.gone = true;
+        if (!worker.waiting.empty()) {
+            io_.err << "coproc: " << name_ << ": worker " << static_cast<long>(worker.pid)
+                    << " exited with requests unanswered\n";
+            status_ = 1;
+        }
+        for (uint64_t request : worker.waiting) {
+            if (request >= printed_) answers_[request - printed_].emplace("\n");
+        }
+        worker.waiting.clear();
+        worker.unsent.clear();
+    }
+
+    void print_ready() {
+        while (!answers_.empty() && answers_.front()) {
+            io_.out << *answers_.front();
+            answers_.pop_front();
+            ++printed_;
+        }
+    }
+
+    int loop(int in_fd) {
+        bool input_done = in_fd < 0;
+        while (true) {
+            // Printing first frees room in the window for dispatch
+            print_ready();
+            dispatch();
+            const bool stranded = input_.find('\n') != std::string::npos && live_workers() == 0;
+            if (stranded) {
+                io_.err << "coproc: " << name_ << ": no worker left\n";
+                return 1;
+            }
+            if (input_done && input_.empty() && printed_ == sent_) break;
+
+            fds_.clear();
+            const bool want_input = !input_done && sent_ - printed_ < live_workers() * kMaxWaitingPerWorker;
+            if (want_input) fds_.push_back({in_fd, POLLIN, 0});
+            for (const auto& worker : coproc_.workers) {
+                if (worker.gone) continue;
+                if (!worker.waiting.empty()) fds_.push_back({worker.from, POLLIN, 0});
+                if (!worker.unsent.empty()) fds_.push_back({worker.to, POLLOUT, 0});
+            }
+            // Whatever is ready goes out before waiting on more
+            io_.out.flush();
+            if (poll(fds_.data(), fds_.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                io_.err << "coproc: poll: " << std::strerror(errno) << '\n';
+                return 1;
+            }
+
+            size_t i = 0;
+            if (want_input) {
+                if (fds_[0].revents) input_done = !read_input(in_fd);
+                ++i;
+            }
+            for (; i < fds_.size(); ++i) {
+                if (!fds_[i].revents) continue;
+                for (auto& worker : coproc_.workers) {
+                    if (worker.gone) continue;
+                    if (fds_[i].fd == worker.from) read_answers(worker);
+                    if (fds_[i].fd == worker.to) write_unsent(worker);
+                }
+            }
+        }
+        return status_;
+    }
+
+    // Append what fd has; false at its end, after closing off a last line
+    // with no newline
+    bool read_input(int fd) {
+        char buf[kReadSize];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) < 0 && errno == EINTR) {}
+        if (n > 0) {
+            input_.append(buf, static_cast<size_t>(n));
+            return true;
+        }
+        if (n < 0) {
+            io_.err << "coproc: read error: " << std::strerror(errno) << '\n';
+            status_ = 1;
+        }
+        if (!input_.empty() && input_.back() != '\n') input_ += '\n';
+        return false;
+    }
+};
+
+void list(const CoprocTable& coprocs, Output& out) {
+    for (const auto& [name, coproc] : coprocs) {
+        out << name << ':';
+        for (const auto& worker : coproc.workers) out << ' ' << static_cast<long>(worker.pid);
+        out << "  " << coproc.command << '\n';
+    }
+}
+
+} // namespace
+
+int builtin_coproc(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    auto& coprocs = shell.coprocs;
+    if (args.size() == 1) {
+        list(coprocs, io.out);
+        return 0;
+    }
+
+    if (args[1] == "-r" || args[1] == "-k") {
+        auto it = args.size() > 2 ? coprocs.find(args[2]) : coprocs.end();
+        if (it == coprocs.end()) {
+            io.err << "coproc: " << (args.size() > 2 ? args[2] : std::string_view("")) << ": no such coprocess\n";
+            return 1;
+        }
+        if (args[1] == "-r") {
+            Exchange exchange(it->second, it->first, io);
+            if (args.size() == 3) return exchange.run(io.in);
+            std::string request;
+            for (size_t i = 3; i < args.size(); ++i) {
+                if (i > 3) request += ' ';
+                request += args[i];
+            }
+            return exchange.run(std::move(request));
+        }
+        if (args.size() > 3) {
+            io.err << "coproc: -k takes one name\n";
+            return 2;
+        }
+        // End of input is the signal to finish
+        int status = 0;
+        for (auto& worker : it->second.workers) close_worker(worker);
+        for (const auto& worker : it->second.workers) {
+            const int worker_status = wait_worker(shell.jobs, worker);
+            if (status == 0) status = worker_status;
+        }
+        shell.vars.unset(it->first + "_PID");
+        coprocs.erase(it);
+        return status;
+    }
+
+    size_t count = 1;
+    bool least_busy = false;
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+        const auto& arg = args[i];
+        if (arg == "--") {
+            ++i;
+            break;
+        }
+        if (arg == "--least-busy") {
+            least_busy = true;
+        } else if (arg == "-j") {
+            if (i + 1 >= args.size() || !parse_count(args[i + 1], count) || count == 0) {
+                io.err << "coproc: -j: expected a number of workers\n";
+                return 2;
+            }
+            ++i;
+        } else if (!(arg.starts_with("-j") && parse_count(arg.substr(2), count) && count > 0)) {
+            io.err << "coproc: " << arg << ": invalid option\n";
+            return 2;
+        }
+    }
+    if (args.size() - i < 2) {
+        io.err << "coproc: usage: coproc [-j N] [--least-busy] NAME command [args...]\n";
+        return 2;
+    }
+    const std::string_view name = args[i];
+    if (!is_valid_name(name)) {
+        io.err << "coproc: `" << name << "': not a valid identifier\n";
+        return 1;
+    }
+    if (coprocs.find(name) != coprocs.end()) {
+        io.err << "coproc: " << name << ": already running\n";
+        return 1;
+    }
+
+    const std::vector<std::string_view> command(args.begin() + static_cast<std::ptrdiff_t>(i) + 1, args.end());
+    Coproc coproc;
+    coproc.least_busy = least_busy;
+    for (const auto& word : command) {
+        if (!coproc.command.empty()) coproc.command += ' ';
+        coproc.command += word;
+    }
+    if (!start(shell, coproc, count, command, io)) return 1;
+    shell.vars.set(std::string(name) + "_PID", std::to_string(coproc.workers.front().pid));
+    coprocs.emplace(name, std::move(coproc));
+    return 0;
+}
+
+#endif
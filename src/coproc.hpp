@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "builtins.hpp"
+
+// One child of a coprocess, talked to over a pair of pipes. Requests and
+// responses are lines, one response line for every request line, so the
+// requests it has been sent but not answered are all it has to remember.
+struct CoprocWorker {
+    pid_t pid = -1;
+    int to = -1;   // its stdin; non-blocking
+    int from = -1; // its stdout; non-blocking
+    std::string unsent;   // request bytes the pipe had no room for yet
+    std::string partial;  // response bytes short of a newline
+    std::deque<uint64_t> waiting; // requests sent, oldest first
+    bool gone = false;    // its stdout reached EOF
+};
+
+// Named, long-lived children started by the coproc builtin, kept for the
+// life of the shell; each is a pool of one or more identical workers. Their
+// descriptors sit above those scripts name in redirections and are closed
+// across exec, so only the shell and its subshells hold them.
+struct Coproc {
+    std::string command; // as given, for listing
+    bool least_busy = false;
+    size_t next = 0;     // round-robin cursor
+    // Requests numbered so far. Numbers carry on from one exchange to the
+    // next, so answers owed to one that was given up on are told apart.
+    uint64_t requests = 0;
+    std::vector<CoprocWorker> workers;
+};
+
+using CoprocTable = std::map<std::string, Coproc, std::less<>>;
+
+// coproc [-j N] [--least-busy] NAME command [args...]
+// coproc -r NAME [request...]
+// coproc -k NAME
+// coproc
+//
+// Start NAME as N copies of command (1 by default), each reading requests
+// on its stdin and writing one line in answer to each, and set NAME_PID to
+// the first one's pid. -r sends the words as one request, or every line of
+// standard input as one, and prints the answers in request order; requests
+// go to the workers in turn, or with --least-busy to the one with the
+// fewest unanswered. -k closes NAME's pipes and waits for its workers.
+// Alone it lists the running coprocesses.
+int builtin_coproc(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+#endif
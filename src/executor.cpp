@@ -0,0 +1,956 @@
+#include "executor.hpp"
+#include "builtins.hpp"
+#include "output.hpp"
+#include "platform.hpp"
+#include "shell.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef STDIN_FILENO
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#endif
+#else
+#include "jobs.hpp"
+#include "launcher.hpp"
+#include "plan.hpp"
+#include "trace.hpp"
+
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+std::optional<Pipeline> parse_pipeline(std::span<const Token> tokens) {
+    Pipeline stages(1);
+    auto empty = [](const Command& cmd) {
+        return cmd.assignments.empty() && cmd.args.empty() && !cmd.input && cmd.redirections.empty();
+    };
+    for (const auto& token : tokens) {
+        if (token.kind == TokenKind::Pipe) {
+            if (empty(stages.back())) {
+                std::cerr << "syntax error near unexpected token `|'\n";
+                return std::nullopt;
+            }
+            stages.emplace_back();
+            continue;
+        }
+        // NAME=value counts as an assignment until the command name
+        Command& cmd = stages.back();
+        if (token.substituted) cmd.substituted = true;
+        if (token.kind == TokenKind::HereDocument || token.kind == TokenKind::HereDocumentStrip ||
+            token.kind == TokenKind::HereString) {
+            cmd.input = token.text;
+            continue;
+        }
+        if (token.kind == TokenKind::Redirect) {
+            cmd.redirections.push_back({token.fd, token.redirect, token.text});
+            continue;
+        }
+        if (token.assignment && cmd.args.empty()) {
+            cmd.assignments.push_back(token.text);
+        } else {
+            cmd.args.push_back(token.text);
+        }
+    }
+    if (empty(stages.back())) {
+        std::cerr << "syntax error near unexpected token `|'\n";
+        return std::nullopt;
+    }
+    return stages;
+}
+
+namespace {
+
+// The assignments in front of a builtin hold while it runs, exported, and
+// the variables they replaced come back afterwards
+class TemporaryAssignments {
+    Variables& vars;
+    std::vector<std::pair<std::string_view, std::optional<Variables::Variable>>> saved;
+
+public:
+    TemporaryAssignments(Variables& vars, const std::vector<std::string_view>& words) : vars(vars) {
+        saved.reserve(words.size());
+        for (const auto& word : words) {
+            auto eq = word.find('=');
+            auto name = word.substr(0, eq);
+            const Variables::Variable* old = vars.find(name);
+            saved.emplace_back(name, old ? std::make_optional(*old) : std::nullopt);
+            vars.set(name, word.substr(eq + 1), true);
+        }
+    }
+
+    ~TemporaryAssignments() {
+        for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+            if (it->second) {
+                vars.set(it->first, it->second->value, it->second->exported);
+            } else {
+                vars.unset(it->first);
+            }
+        }
+    }
+
+    TemporaryAssignments(const TemporaryAssignments&) = delete;
+    TemporaryAssignments& operator=(const TemporaryAssignments&) = delete;
+};
+
+// Run a builtin writing to out; pgroup is the job's, when it is the
+// in-process stage of one
+int run_builtin(Shell& shell, const Builtin& builtin, const Command& cmd, int in, Output& out,
+                pid_t pgroup = -1) {
+    TemporaryAssignments scope(shell.vars, cmd.assignments);
+    const auto& args = cmd.args;
+#ifndef _WIN32
+    TraceSpan span(TracePhase::Builtin, args[0]);
+#endif
+    Output err_buf(STDERR_FILENO);
+    BuiltinIO io{in, out, err_buf};
+#ifndef _WIN32
+    io.pgroup = pgroup;
+#else
+    (void)pgroup;
+#endif
+    int status = builtin.run(shell, args, io);
+    // A failed write (say, the reader went away) fails the builtin
+    if (!out.flush() && status == 0) status = 1;
+    err_buf.flush();
+    return status;
+}
+
+#ifndef _WIN32
+// A command's redirections, with the files they name opened by the shell so
+// that a bad one is reported before anything starts. Each step then points
+// fd at source, or closes fd when source is -1, in the order written.
+class OpenRedirections {
+public:
+    struct Step {
+        int fd;
+        int source;
+    };
+
+    explicit OpenRedirections(const std::vector<Redirection>& redirections) {
+        steps_.reserve(redirections.size());
+        for (const auto& r : redirections) {
+            if (r.op == RedirectOp::Duplicate) {
+                if (r.target == "-") {
+                    steps_.push_back({r.fd, -1});
+                    continue;
+                }
+                int source = -1;
+                auto [ptr, ec] = std::from_chars(r.target.data(), r.target.data() + r.target.size(), source);
+                if (ec != std::errc{} || ptr != r.target.data() + r.target.size() || !usable(source)) {
+                    std::cerr << r.target << ": Bad file descriptor\n";
+                    ok_ = false;
+                    return;
+                }
+                steps_.push_back({r.fd, source});
+                continue;
+            }
+            const int flags = r.op == RedirectOp::Input    ? O_RDONLY
+                              : r.op == RedirectOp::Append ? O_WRONLY | O_CREAT | O_APPEND
+                                                           : O_WRONLY | O_CREAT | O_TRUNC;
+            // Opened out of the way of the descriptors a redirection can name
+            const int fd = private_fd(open(r.target.data(), flags | O_CLOEXEC, 0666));
+            if (fd < 0) {
+                std::cerr << r.target << ": " << std::strerror(errno) << '\n';
+                ok_ = false;
+                return;
+            }
+            opened_.push_back(fd);
+            steps_.push_back({r.fd, fd});
+        }
+    }
+
+    ~OpenRedirections() {
+        for (int fd : opened_) close(fd);
+    }
+
+    OpenRedirections(const OpenRedirections&) = delete;
+    OpenRedirections& operator=(const OpenRedirections&) = delete;
+
+    // False when a file could not be opened or a descriptor named is not
+    // open; the command must not run
+    bool ok() const { return ok_; }
+    const std::vector<Step>& steps() const { return steps_; }
+
+    // For a launched child, after its pipe ends
+    void add_to(std::vector<FdAction>& actions) const {
+        for (const auto& step : steps_) {
+            if (step.source < 0) {
+                actions.push_back({FdAction::Kind::Close, step.fd});
+            } else {
+                actions.push_back({FdAction::Kind::Dup, step.fd, step.source});
+            }
+        }
+    }
+
+private:
+    std::vector<int> opened_;
+    std::vector<Step> steps_;
+    bool ok_ = true;
+
+    // Open in the shell, or made so by an earlier step
+    bool usable(int fd) const {
+        for (auto it = steps_.rbegin(); it != steps_.rend(); ++it) {
+            if (it->fd == fd) return it->source >= 0;
+        }
+        return fcntl(fd, F_GETFD) >= 0;
+    }
+};
+#endif
+
+// Run a builtin with its output batched for the given descriptor, after
+// its redirections
+int run_builtin(Shell& shell, const Builtin& builtin, const Command& cmd, int in, int out, pid_t pgroup = -1) {
+#ifndef _WIN32
+    if (!cmd.redirections.empty()) {
+        OpenRedirections files(cmd.redirections);
+        if (!files.ok()) return 1;
+        ShellDescriptors fds;
+        if (in != STDIN_FILENO) fds.point(STDIN_FILENO, in);
+        if (out != STDOUT_FILENO) fds.point(STDOUT_FILENO, out);
+        for (const auto& step : files.steps()) fds.point(step.fd, step.source);
+        Output out_buf(STDOUT_FILENO);
+        return run_builtin(shell, builtin, cmd, STDIN_FILENO, out_buf, pgroup);
+    }
+#endif
+    Output out_buf(out);
+    return run_builtin(shell, builtin, cmd, in, out_buf, pgroup);
+}
+
+} // namespace
+
+#ifndef _WIN32
+ShellDescriptors::ShellDescriptors() {
+    // Bytes buffered for the terminal must not land in the file
+    std::cout.flush();
+    std::cerr.flush();
+}
+
+void ShellDescriptors::point(int fd, int source) {
+    const bool known = std::any_of(saved.begin(), saved.end(), [fd](const auto& s) { return s.first == fd; });
+    if (!known) saved.emplace_back(fd, fcntl(fd, F_DUPFD_CLOEXEC, kFirstPrivateFd));
+    if (source < 0) {
+        close(fd);
+    } else if (source != fd) {
+        dup2(source, fd);
+    }
+}
+
+ShellDescriptors::~ShellDescriptors() {
+    std::cerr.flush();
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+        if (it->second >= 0) {
+            dup2(it->second, it->first);
+            close(it->second);
+        } else {
+            close(it->first);
+        }
+    }
+}
+#endif
+
+#ifdef _WIN32
+std::wstring quote_windows_arg(const std::wstring& arg) {
+    if (arg.find_first_of(L" \t\"") == std::wstring::npos && 
+        arg.find_first_of(L'\n') == std::wstring::npos) {
+        return arg;
+    }
+    
+    std::wstring quoted = L"\"";
+    size_t backslash_count = 0;
+    
+    for (wchar_t wc : arg) {
+        if (wc == L'\\') {
+            backslash_count++;
+        } else if (wc == L'"') {
+            quoted.append(backslash_count * 2, L'\\');
+            quoted += L"\\\"";
+            backslash_count = 0;
+        } else {
+            quoted.append(backslash_count, L'\\');
+            quoted += wc;
+            backslash_count = 0;
+        }
+    }
+    
+    quoted.append(backslash_count * 2, L'\\');
+    quoted += L'"';
+    return quoted;
+}
+#endif
+
+#ifdef _WIN32
+void execute_command(Shell& shell, const fs::path& program, const std::vector<std::string_view>& args) {
+    // Build full command line including argv[0]
+    std::wstring full = quote_windows_arg(program.wstring());
+    for (size_t i = 1; i < args.size(); ++i) {
+        full += L' ';
+        full += quote_windows_arg(utf8_to_wide(std::string(args[i])));
+    }
+
+    STARTUPINFOW si{};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pi{};
+
+    std::vector<wchar_t> mutable_cmd(full.begin(), full.end());
+    mutable_cmd.push_back(L'\0');
+
+    if (!CreateProcessW(
+            nullptr,                    // let Windows parse argv[0] from command line
+            mutable_cmd.data(),         // MUST be mutable
+            nullptr, nullptr,
+            FALSE,                      // don't inherit handles unless needed
+            0,
+            nullptr,
+            nullptr,
+            &si, &pi)) {
+        DWORD err = GetLastError();
+        LPWSTR msg = nullptr;
+        FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
+                       nullptr, err, 0, (LPWSTR)&msg, 0, nullptr);
+        std::string error_msg = msg ? wide_to_utf8(msg) : "Unknown error";
+        std::cerr << "Execute failed (" << err << "): " << error_msg << std::endl;
+        if (msg) LocalFree(msg);
+        return;
+    }
+
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+}
+
+bool tail_exec(Shell&, Pipeline&) {
+    return false;
+}
+#else
+namespace {
+
+// A here-document or here-string body in a sealed memfd, positioned at its
+// start. Written once and never through a pipe, a body of any size cannot
+// block the shell, and the command reads a regular file it may mmap or
+// sendfile from. Returns -1 after reporting a failure.
+int open_input(std::string_view body) {
+    const int fd = memfd_create("here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        perror("here-document");
+        return -1;
+    }
+    for (size_t done = 0; done < body.size();) {
+        const ssize_t n = write(fd, body.data() + done, body.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("here-document");
+            close(fd);
+            return -1;
+        }
+        done += static_cast<size_t>(n);
+    }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// Pipe buffer size requested through SHELL_PIPE_SIZE (bytes), 0 for the default
+int requested_pipe_size() {
+    auto value = get_env("SHELL_PIPE_SIZE");
+    if (!value) return 0;
+    int size = 0;
+    auto [ptr, ec] = std::from_chars(value->data(), value->data() + value->size(), size);
+    if (ec != std::errc{} || ptr != value->data() + value->size() || size < 0) return 0;
+    return size;
+}
+
+// A builtin stage that cannot run in the shell itself runs in a forked copy
+// of it, writing straight into its pipe. pgroup and foreground_tty mean
+// what they do in a LaunchRequest.
+pid_t fork_builtin(Shell& shell, const Builtin& builtin, const Command& cmd, int in, int out, const std::vector<int>& pipe_fds,
+                   pid_t pgroup, int foreground_tty) {
+    // Anything still buffered would otherwise be written twice
+    std::cout.flush();
+    std::cerr.flush();
+
+    TraceSpan span(TracePhase::Spawn, cmd.args[0]);
+    pid_t pid = fork();
+    if (pid > 0 && pgroup >= 0) setpgid(pid, pgroup == 0 ? pid : pgroup);
+    if (pid != 0) return pid;
+
+    if (pgroup >= 0) {
+        setpgid(0, pgroup);
+        if (pgroup == 0 && foreground_tty >= 0) tcsetpgrp(foreground_tty, getpgrp());
+    }
+    reset_child_signals();
+    // Without an exec O_CLOEXEC does nothing, and a stray write end would
+    // keep some reader from ever seeing EOF
+    for (int fd : pipe_fds) {
+        if (fd != in && fd != out) close(fd);
+    }
+    _exit(run_builtin(shell, builtin, cmd, in, out));
+}
+
+// The program a command runs, looked up with the PATH its own assignments
+// give it, if any
+fs::path find_program(Shell& shell, const Command& cmd) {
+    TraceSpan span(TracePhase::Resolve, cmd.args[0]);
+    const bool sets_path = std::any_of(cmd.assignments.begin(), cmd.assignments.end(),
+                                       [](std::string_view w) { return w.starts_with("PATH="); });
+    if (!sets_path && cmd.resolved) {
+        ResolvedProgram& known = *cmd.resolved;
+        const uint64_t cwd_generation = working_directory_generation();
+        if (!known.path.empty() && known.path_generation == shell.path_cache.generation() &&
+            known.cwd_generation == cwd_generation && known.name == cmd.args[0]) {
+            return known.path;
+        }
+        known.name.assign(cmd.args[0]);
+        known.path = shell.path_cache.find(known.name);
+        // Taken after the lookup, which may itself have dropped entries
+        known.path_generation = shell.path_cache.generation();
+        known.cwd_generation = cwd_generation;
+        return known.path;
+    }
+    if (!sets_path) return shell.path_cache.find(std::string(cmd.args[0]));
+    TemporaryAssignments scope(shell.vars, cmd.assignments);
+    return shell.path_cache.find(std::string(cmd.args[0]));
+}
+
+} // namespace
+
+bool tail_exec(Shell& shell, Pipeline& stages) {
+    if (stages.size() != 1 || stages[0].args.empty() || stages[0].input || !stages[0].redirections.empty() ||
+        find_builtin(stages[0].args[0])) {
+        return false;
+    }
+    auto path = find_program(shell, stages[0]);
+    if (path.empty()) return false;
+
+    auto argv = make_argv(stages[0].args);
+    auto env = shell.vars.environment();
+    auto envp = env->overlay(stages[0].assignments);
+    std::cout.flush();
+    std::cerr.flush();
+    // exec keeps ignored signals ignored and blocked ones blocked; the
+    // program expects neither
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    signal(SIGPIPE, SIG_DFL);
+    sigprocmask(SIG_UNBLOCK, &chld, nullptr);
+    // The shell becomes the program, so it takes on the launch defaults
+    // itself, as a child would
+    const char* failed = apply_launch_attributes(launch_defaults());
+    if (!failed) {
+        execve(path.c_str(), argv.data(), envp.data());
+        failed = "exec failed";
+    }
+
+    perror(failed);
+    signal(SIGPIPE, SIG_IGN);
+    sigprocmask(SIG_BLOCK, &chld, nullptr);
+    shell.last_status = 127;
+    shell.exit_requested = true;
+    shell.exit_code = 127;
+    return true;
+}
+
+#endif
+
+void run_pipeline(Shell& shell, Pipeline& stages, bool background) {
+    if (stages.empty()) return;
+
+#ifndef _WIN32
+    // The time builtin would only see the first stage; as a prefix it takes
+    // the whole pipeline, as in other shells
+    auto& first = stages[0];
+    if (!background && first.assignments.empty() && !first.args.empty() && first.args[0] == "time") {
+        bool posix = false;
+        size_t skip = 1;
+        for (; skip < first.args.size() && first.args[skip] == "-p"; ++skip) posix = true;
+        first.args.erase(first.args.begin(), first.args.begin() + static_cast<std::ptrdiff_t>(skip));
+        // Assignments after `time` belong to the command
+        while (!first.args.empty() && is_assignment(first.args.front())) {
+            first.assignments.push_back(first.args.front());
+            first.args.erase(first.args.begin());
+        }
+        if (first.args.empty() && first.assignments.empty() && !first.input && stages.size() > 1) {
+            std::cerr << "syntax error near unexpected token `|'\n";
+            shell.last_status = 2;
+            return;
+        }
+        if (first.args.empty() && first.assignments.empty() && !first.input) stages.clear();
+        run_timed(shell, stages, posix);
+        return;
+    }
+#endif
+
+    if (stages.size() == 1 && !background) {
+        auto& cmd = stages[0];
+        auto& args = cmd.args;
+        if (args.empty()) {
+            for (const auto& word : cmd.assignments) shell.vars.assign(word);
+            // x=$(cmd) takes the status of the substitution
+            if (!cmd.substituted) shell.last_status = 0;
+#ifndef _WIN32
+            // `> file` alone creates or empties it
+            if (!cmd.redirections.empty() && !OpenRedirections(cmd.redirections).ok()) shell.last_status = 1;
+#endif
+            return;
+        }
+        if (const Builtin* builtin = find_builtin(args[0])) {
+#ifndef _WIN32
+            if (cmd.input) {
+                const int in = open_input(*cmd.input);
+                shell.last_status = in < 0 ? 1 : run_builtin(shell, *builtin, cmd, in, STDOUT_FILENO);
+                if (in >= 0) close(in);
+                return;
+            }
+#endif
+            shell.last_status = run_builtin(shell, *builtin, cmd, STDIN_FILENO, STDOUT_FILENO);
+            return;
+        }
+#ifdef _WIN32
+        if (!cmd.redirections.empty()) {
+            std::cerr << "redirections are not supported on Windows\n";
+            shell.last_status = 1;
+            return;
+        }
+        if (cmd.input) {
+            std::cerr << "here-documents are not supported on Windows\n";
+            shell.last_status = 1;
+            return;
+        }
+        auto path = shell.path_cache.find(std::string(args[0]));
+        if (path.empty()) {
+            std::cerr << args[0] << ": command not found\n";
+            shell.last_status = 127;
+            return;
+        }
+        execute_command(shell, path, args);
+        return;
+#endif
+    }
+
+#ifdef _WIN32
+    std::cerr << (background ? "background jobs" : "pipelines") << " are not supported on Windows\n";
+    shell.last_status = 1;
+#else
+    const size_t n = stages.size();
+
+    // A here-document replaces the stdin its stage would have had
+    std::vector<int> input_fds(n, -1);
+    for (size_t i = 0; i < n; ++i) {
+        if (stages[i].input && (input_fds[i] = open_input(*stages[i].input)) < 0) {
+            for (int fd : input_fds) {
+                if (fd >= 0) close(fd);
+            }
+            shell.last_status = 1;
+            return;
+        }
+    }
+
+    // pipe_fds[2i] is read by stage i+1, pipe_fds[2i+1] written by stage i
+    std::vector<int> pipe_fds(2 * (n - 1), -1);
+    const int pipe_size = requested_pipe_size();
+    for (size_t i = 0; i + 1 < n; ++i) {
+        if (pipe2(&pipe_fds[2 * i], O_CLOEXEC) != 0) {
+            perror("pipe");
+            for (int fd : pipe_fds) {
+                if (fd >= 0) close(fd);
+            }
+            for (int fd : input_fds) {
+                if (fd >= 0) close(fd);
+            }
+            shell.last_status = 1;
+            return;
+        }
+        // A bigger buffer lets a fast producer run further ahead of its
+        // reader; unprivileged requests are capped at fs.pipe-max-size
+        if (pipe_size > 0) fcntl(pipe_fds[2 * i + 1], F_SETPIPE_SZ, pipe_size);
+    }
+
+    // Without job control nothing can hand the terminal to a background job,
+    // so it reads from /dev/null instead of competing with the shell
+    const bool job_control = shell.jobs.job_control();
+    int null_in = -1;
+    if (background && !job_control) null_in = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    auto stage_in = [&](size_t i) {
+        if (input_fds[i] >= 0) return input_fds[i];
+        if (i > 0) return pipe_fds[2 * (i - 1)];
+        return null_in >= 0 ? null_in : STDIN_FILENO;
+    };
+    auto stage_out = [&](size_t i) { return i + 1 == n ? STDOUT_FILENO : pipe_fds[2 * i + 1]; };
+
+    // At most one builtin runs inside the shell, and only the last one: every
+    // stage after it is then already running and draining its output, so it
+    // cannot fill a pipe nobody reads yet. A background job runs entirely in
+    // child processes.
+    std::vector<const Builtin*> builtins(n);
+    for (size_t i = 0; i < n; ++i) {
+        builtins[i] = stages[i].args.empty() ? nullptr : find_builtin(stages[i].args[0]);
+    }
+    size_t in_process = n;
+    for (size_t i = n; !background && i-- > 0;) {
+        if (builtins[i]) {
+            if (builtins[i]->pipeline_safe) in_process = i;
+            break;
+        }
+    }
+
+    // With job control each job gets a process group of its own, led by its
+    // first process; a foreground job also gets the terminal
+    pid_t pgid = job_control ? 0 : -1;
+    const int tty = job_control && !background ? shell.jobs.terminal() : -1;
+
+    // One snapshot of the exported variables serves every stage
+    auto env = shell.vars.environment();
+
+    std::vector<pid_t> pids(n, -1);
+    std::vector<int> statuses(n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        // A stage of bare assignments changes nothing outside its own
+        // subshell, so it has nothing to run beyond creating its files
+        if (i == in_process) continue;
+        if (stages[i].args.empty()) {
+            if (!OpenRedirections(stages[i].redirections).ok()) statuses[i] = 1;
+            continue;
+        }
+        const int in = stage_in(i);
+        const int out = stage_out(i);
+
+        if (builtins[i]) {
+            pids[i] = fork_builtin(shell, *builtins[i], stages[i], in, out, pipe_fds, pgid, tty);
+            if (pids[i] < 0) {
+                perror("fork failed");
+                statuses[i] = 1;
+            }
+        } else {
+            const auto& args = stages[i].args;
+            OpenRedirections files(stages[i].redirections);
+            if (!files.ok()) {
+                statuses[i] = 1;
+                continue;
+            }
+            auto path = find_program(shell, stages[i]);
+            if (path.empty()) {
+                std::cerr << args[0] << ": command not found\n";
+                statuses[i] = 127;
+                continue;
+            }
+
+            auto argv = make_argv(args);
+            std::vector<char*> envp;
+            if (!stages[i].assignments.empty()) envp = env->overlay(stages[i].assignments);
+            LaunchRequest req;
+            req.program = path.c_str();
+            req.argv = argv.data();
+            req.envp = envp.empty() ? env->envp() : envp.data();
+            req.pgroup = pgid;
+            req.foreground_tty = tty;
+            if (in != STDIN_FILENO) req.fd_actions.push_back({FdAction::Kind::Dup, STDIN_FILENO, in});
+            if (out != STDOUT_FILENO) req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, out});
+            files.add_to(req.fd_actions);
+
+            {
+                TraceSpan span(TracePhase::Spawn, args[0]);
+                pids[i] = launch_process(req);
+            }
+            if (pids[i] < 0) {
+                perror("exec failed");
+                statuses[i] = 127;
+            }
+        }
+        if (pids[i] > 0 && pgid == 0) pgid = pids[i];
+    }
+
+    // Every child has its own copies now; keep only the ends the in-process
+    // stage uses, so readers see EOF as soon as their writers finish
+    const bool have_in_process = in_process < n;
+    const int keep_in = have_in_process ? stage_in(in_process) : -1;
+    const int keep_out = have_in_process ? stage_out(in_process) : -1;
+    for (int fd : pipe_fds) {
+        if (fd != keep_in && fd != keep_out) close(fd);
+    }
+    for (int fd : input_fds) {
+        if (fd >= 0 && fd != keep_in) close(fd);
+    }
+    if (null_in >= 0) close(null_in);
+
+    std::vector<pid_t> launched;
+    launched.reserve(n);
+    for (pid_t pid : pids) {
+        if (pid > 0) launched.push_back(pid);
+    }
+    Job* job = nullptr;
+    if (!launched.empty()) {
+        std::string command;
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0) command += " | ";
+            bool first = true;
+            for (const auto* words : {&stages[i].assignments, &stages[i].args}) {
+                for (const auto& word : *words) {
+                    if (!first) command += ' ';
+                    command += word;
+                    first = false;
+                }
+            }
+        }
+        job = &shell.jobs.add(std::move(command), pgid > 0 ? pgid : 0, launched, background);
+    }
+
+    if (background) {
+        if (job && job_control) std::cerr << '[' << job->id << "] " << launched.back() << '\n';
+        shell.last_status = 0;
+        return;
+    }
+
+    if (have_in_process) {
+        statuses[in_process] = run_builtin(shell, *builtins[in_process], stages[in_process],
+                                           keep_in, keep_out, pgid > 0 ? pgid : -1);
+        if (keep_in != STDIN_FILENO) close(keep_in);
+        if (keep_out != STDOUT_FILENO) close(keep_out);
+    }
+
+    // The job's status is that of its last process, which is the final
+    // stage's unless that stage never started or ran in the shell
+    int job_status = 0;
+    if (job) {
+        TraceSpan span(TracePhase::Wait, job->command);
+        job_status = shell.jobs.foreground(*job, false);
+    }
+    shell.last_status = pids[n - 1] > 0 ? job_status : statuses[n - 1];
+#endif
+}
+
+#ifndef _WIN32
+namespace {
+
+double seconds(const struct timeval& tv) {
+    return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+}
+
+double cpu_seconds(const struct timeval& children, const struct timeval& self_after,
+                   const struct timeval& self_before) {
+    return seconds(children) + seconds(self_after) - seconds(self_before);
+}
+
+// 1m2.345s
+void write_minutes(Output& out, const char* name, double secs) {
+    char buf[64];
+    const int minutes = static_cast<int>(secs / 60);
+    std::snprintf(buf, sizeof(buf), "%s\t%dm%.3fs\n", name, minutes, secs - minutes * 60.0);
+    out << buf;
+}
+
+} // namespace
+
+void run_timed(Shell& shell, Pipeline& stages, bool posix) {
+    struct rusage self_before{};
+    getrusage(RUSAGE_SELF, &self_before);
+    shell.jobs.take_finished_usage();
+    struct timespec start{};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (stages.empty()) {
+        shell.last_status = 0;
+    } else {
+        run_pipeline(shell, stages);
+    }
+
+    struct timespec end{};
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    struct rusage self_after{};
+    getrusage(RUSAGE_SELF, &self_after);
+    // Every process of the pipeline was reaped through wait4 with its own
+    // usage; the shell's share covers builtins and its own overhead
+    const struct rusage children = shell.jobs.take_finished_usage();
+
+    const double real = static_cast<double>(end.tv_sec - start.tv_sec) +
+                        static_cast<double>(end.tv_nsec - start.tv_nsec) / 1e9;
+    const double user = cpu_seconds(children.ru_utime, self_after.ru_utime, self_before.ru_utime);
+    const double sys = cpu_seconds(children.ru_stime, self_after.ru_stime, self_before.ru_stime);
+    // Nothing was started, so the shell itself was the only process
+    const long maxrss = children.ru_maxrss > 0 ? children.ru_maxrss : self_after.ru_maxrss;
+    const long voluntary = children.ru_nvcsw + self_after.ru_nvcsw - self_before.ru_nvcsw;
+    const long involuntary = children.ru_nivcsw + self_after.ru_nivcsw - self_before.ru_nivcsw;
+
+    Output err(STDERR_FILENO);
+    char buf[96];
+    if (posix) {
+        std::snprintf(buf, sizeof(buf), "real %.2f\nuser %.2f\nsys %.2f\n", real, user, sys);
+        err << buf;
+    } else {
+        err << '\n';
+        write_minutes(err, "real", real);
+        write_minutes(err, "user", user);
+        write_minutes(err, "sys", sys);
+    }
+    std::snprintf(buf, sizeof(buf), "maxrss%c%ldK\nctxsw%c%ld voluntary, %ld involuntary\n",
+                  posix ? ' ' : '\t', maxrss, posix ? ' ' : '\t', voluntary, involuntary);
+    err << buf;
+}
+#endif
+
+#ifndef _WIN32
+namespace {
+
+std::string substitute(void* context, std::string_view command) {
+    return substitute_command(*static_cast<Shell*>(context), command);
+}
+
+// A lone external command: started directly with its stdout on a pipe,
+// which is read until the command closes it
+int capture_program(Shell& shell, const Command& cmd, Output& out) {
+    OpenRedirections files(cmd.redirections);
+    if (!files.ok()) return 1;
+    auto path = find_program(shell, cmd);
+    if (path.empty()) {
+        std::cerr << cmd.args[0] << ": command not found\n";
+        return 127;
+    }
+    const int in = cmd.input ? open_input(*cmd.input) : STDIN_FILENO;
+    if (in < 0) return 1;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        perror("pipe");
+        if (in != STDIN_FILENO) close(in);
+        return 1;
+    }
+
+    auto argv = make_argv(cmd.args);
+    auto env = shell.vars.environment();
+    std::vector<char*> envp;
+    if (!cmd.assignments.empty()) envp = env->overlay(cmd.assignments);
+    LaunchRequest req;
+    req.program = path.c_str();
+    req.argv = argv.data();
+    req.envp = envp.empty() ? env->envp() : envp.data();
+    req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, fds[1]});
+    if (in != STDIN_FILENO) req.fd_actions.push_back({FdAction::Kind::Dup, STDIN_FILENO, in});
+    files.add_to(req.fd_actions);
+    pid_t pid;
+    {
+        TraceSpan span(TracePhase::Spawn, cmd.args[0]);
+        pid = launch_process(req);
+    }
+    close(fds[1]);
+    if (in != STDIN_FILENO) close(in);
+    if (pid < 0) {
+        perror("exec failed");
+        close(fds[0]);
+        return 127;
+    }
+    out.splice_from(fds[0]);
+    close(fds[0]);
+
+    // Not a job: it never stops, and nothing else waits for it
+    TraceSpan span(TracePhase::Wait, cmd.args[0]);
+    return decode_wait_status(wait_child(pid));
+}
+
+// Anything else: a forked copy of the shell runs the whole plan with its
+// stdout on a pipe, so cd, exit and assignments stay inside it. stages is
+// the plan's lone pipeline when that was already expanded, so that its
+// substitutions do not run twice.
+int capture_subshell(Shell& shell, Plan& plan, Pipeline* stages, Output& out) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    // Anything still buffered would otherwise be written twice
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t pid;
+    {
+        TraceSpan span(TracePhase::Spawn, "$(...)");
+        pid = fork();
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        reset_child_signals();
+        shell.jobs.disable_job_control();
+        if (stages) {
+            run_pipeline(shell, *stages);
+        } else {
+            plan.run(shell);
+        }
+        std::cout.flush();
+        _exit(shell.exit_requested ? shell.exit_code : shell.last_status);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        perror("fork failed");
+        close(fds[0]);
+        return 1;
+    }
+    out.splice_from(fds[0]);
+    close(fds[0]);
+
+    TraceSpan span(TracePhase::Wait, "$(...)");
+    return decode_wait_status(wait_child(pid));
+}
+
+} // namespace
+
+std::string substitute_command(Shell& shell, std::string_view command) {
+    std::string output;
+    Plan plan;
+    // Nothing follows a substitution to read here-documents from
+    if (!plan.compile(command, nullptr, nullptr)) {
+        shell.last_status = 2;
+        return output;
+    }
+
+    Output out(output);
+    Pipeline stages;
+    if (plan.empty()) {
+        shell.last_status = 0;
+    } else if (!plan.lone_pipeline(shell, stages)) {
+        shell.last_status = capture_subshell(shell, plan, nullptr, out);
+    } else if (stages.size() > 1) {
+        shell.last_status = capture_subshell(shell, plan, &stages, out);
+    } else if (!stages.empty()) {
+        const Command& cmd = stages.front();
+        const Builtin* builtin = cmd.args.empty() ? nullptr : find_builtin(cmd.args[0]);
+        // parallel and xargs hand their output descriptor to their children,
+        // and redirections need one to point elsewhere, so those need a real one
+        if (builtin && builtin->pipeline_safe && cmd.args[0] != "parallel" && cmd.args[0] != "xargs" &&
+            cmd.redirections.empty()) {
+            const int in = cmd.input ? open_input(*cmd.input) : STDIN_FILENO;
+            shell.last_status = in < 0 ? 1 : run_builtin(shell, *builtin, cmd, in, out);
+            if (in >= 0 && in != STDIN_FILENO) close(in);
+        } else if (!builtin && !cmd.args.empty()) {
+            shell.last_status = capture_program(shell, cmd, out);
+        } else {
+            shell.last_status = capture_subshell(shell, plan, &stages, out);
+        }
+    }
+
+    const size_t end = output.find_last_not_of('\n');
+    output.resize(end == std::string::npos ? 0 : end + 1);
+    return output;
+}
+
+Expansion shell_expansion(Shell& shell) {
+    return {shell.vars, shell.last_status, substitute, &shell};
+}
+#else
+Expansion shell_expansion(Shell& shell) {
+    return {shell.vars, shell.last_status};
+}
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "tokenizer.hpp"
+
+namespace fs = std::filesystem;
+
+struct Shell;
+
+// One redirection of a command. Applied in the order written, each one
+// points fd at a file, or at whatever another descriptor points at by then.
+struct Redirection {
+    int fd;
+    RedirectOp op;
+    std::string_view target;
+};
+
+// What a command name resolved to, kept by a compiled plan between runs.
+// It answers again only while the name and both generations still match.
+struct ResolvedProgram {
+    std::string name;
+    fs::path path;
+    uint64_t path_generation = 0;
+    uint64_t cwd_generation = 0;
+};
+
+// One stage of a pipeline: the NAME=value words written before the command,
+// then its argument vector (empty for a bare assignment). Both are views of
+// NUL-terminated strings, normally the tokens in the line's Arena.
+struct Command {
+    std::vector<std::string_view> assignments;
+    std::vector<std::string_view> args;
+    // A command substitution ran while its words were expanded
+    bool substituted = false;
+    // The body of a here-document or here-string, which becomes its stdin;
+    // the last one written wins
+    std::optional<std::string_view> input;
+    // Applied after the stage's pipe ends and input
+    std::vector<Redirection> redirections;
+    // Where a plan keeps this stage's program between runs, if anywhere
+    ResolvedProgram* resolved = nullptr;
+};
+
+// The stages of `a | b | c`, in order
+using Pipeline = std::vector<Command>;
+
+// Group tokens into pipeline stages; reports and returns nullopt on an
+// empty stage such as `a || b` or a trailing `|`
+std::optional<Pipeline> parse_pipeline(std::span<const Token> tokens);
+
+#ifdef _WIN32
+// Run a program to completion with the shell's descriptors, setting last_status
+void execute_command(Shell& shell, const fs::path& program, const std::vector<std::string_view>& args);
+#endif
+
+// Replace the shell with the command when nothing runs after it (the last
+// command of -c). Returns false, doing nothing, unless the pipeline is a
+// single external program; if the exec itself fails the shell is marked
+// to exit with 127.
+bool tail_exec(Shell& shell, Pipeline& stages);
+
+// Run every stage concurrently, connected by pipes, as one job. In the
+// foreground last_status becomes the status of the final stage once all of
+// them have been reaped (or the job stops); a background job is left
+// running and last_status is 0. A lone stage of assignments only sets shell
+// variables; in front of a command they are exported to it alone.
+// `time` in front of a foreground pipeline times all of it.
+void run_pipeline(Shell& shell, Pipeline& stages, bool background = false);
+
+// What the shell's command lines expand with: its variables and $?, and on
+// POSIX systems command substitution through substitute_command
+Expansion shell_expansion(Shell& shell);
+
+#ifndef _WIN32
+// $(command): run it and return its output with the trailing newlines
+// removed, setting last_status to its status. A lone builtin that may run in
+// the shell writes straight into the returned string, with no fork and no
+// pipe; a lone external program is started directly and read through a
+// pipe; anything else runs in a forked subshell, so cd, exit and
+// assignments inside do not reach the shell.
+std::string substitute_command(Shell& shell, std::string_view command);
+
+// The shell's own descriptors pointed elsewhere for a while, as for a
+// builtin running in the shell with redirections: each one changed is put
+// back when this goes, so the shell reads and writes where it did before
+class ShellDescriptors {
+    // Each descriptor changed, with a copy of what it was (-1: not open)
+    std::vector<std::pair<int, int>> saved;
+
+public:
+    ShellDescriptors();
+    ~ShellDescriptors();
+
+    ShellDescriptors(const ShellDescriptors&) = delete;
+    ShellDescriptors& operator=(const ShellDescriptors&) = delete;
+
+    // Point fd at what source points at, or close it if source is -1
+    void point(int fd, int source);
+};
+
+// Run a pipeline in the foreground, then report on stderr its elapsed time,
+// the CPU time of its processes and of the shell meanwhile, the largest
+// resident set among them and their context switches. posix selects the
+// `time -p` layout.
+void run_timed(Shell& shell, Pipeline& stages, bool posix);
+#endif
@@ -0,0 +1,461 @@
+#include "glob.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#ifdef _WIN32
+#include <filesystem>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+constexpr uint64_t bit(size_t k) { return uint64_t{1} << k; }
+
+// [:name:] inside a bracket expression, in the C locale
+bool add_named_class(std::string_view name, std::bitset<256>& set) {
+    static constexpr struct {
+        std::string_view name;
+        int (*test)(int);
+    } kClasses[] = {
+        {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+        {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+        {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+    };
+    for (const auto& c : kClasses) {
+        if (c.name != name) continue;
+        for (int b = 0; b < 128; ++b) {
+            if (c.test(b)) set.set(static_cast<size_t>(b));
+        }
+        return true;
+    }
+    return false;
+}
+
+// The bracket expression starting at p[i] (a '['); returns the index just
+// past its ']', or i when it is unclosed and the '[' is literal
+size_t parse_bracket(std::string_view p, size_t i, std::bitset<256>& set) {
+    size_t j = i + 1;
+    bool negate = false;
+    if (j < p.size() && (p[j] == '!' || p[j] == '^')) {
+        negate = true;
+        ++j;
+    }
+    bool first = true;
+    while (j < p.size() && (first || p[j] != ']')) {
+        first = false;
+        if (p[j] == '[' && j + 1 < p.size() && p[j + 1] == ':') {
+            size_t end = p.find(":]", j + 2);
+            if (end != std::string_view::npos && add_named_class(p.substr(j + 2, end - j - 2), set)) {
+                j = end + 2;
+                continue;
+            }
+        }
+        unsigned char lo = static_cast<unsigned char>(p[j]);
+        if (lo == '\\' && j + 1 < p.size()) lo = static_cast<unsigned char>(p[++j]);
+        ++j;
+        unsigned char hi = lo;
+        if (j + 1 < p.size() && p[j] == '-' && p[j + 1] != ']') {
+            hi = static_cast<unsigned char>(p[j + 1]);
+            j += 2;
+            if (hi == '\\' && j < p.size()) hi = static_cast<unsigned char>(p[j++]);
+        }
+        for (unsigned c = lo; c <= hi; ++c) set.set(c);
+    }
+    if (j >= p.size()) return i;
+    if (negate) set.flip();
+    return j + 1;
+}
+
+} // namespace
+
+GlobMatcher::GlobMatcher(std::string_view pattern) {
+    size_t stars = 0;
+    bool wildcards = false;
+    for (size_t i = 0; i < pattern.size();) {
+        const char c = pattern[i];
+        if (c == '*') {
+            // Runs of stars match what one does
+            if (elements_.empty() || elements_.back().type != Element::Type::Star) {
+                elements_.push_back({Element::Type::Star});
+                ++stars;
+            }
+            wildcards = true;
+            ++i;
+        } else if (c == '?') {
+            elements_.push_back({Element::Type::Any});
+            wildcards = true;
+            ++i;
+        } else if (c == '[') {
+            std::bitset<256> set;
+            size_t end = parse_bracket(pattern, i, set);
+            if (end == i) {
+                elements_.push_back({Element::Type::Byte, '['});
+                ++i;
+            } else {
+                elements_.push_back({Element::Type::Class, 0, static_cast<uint16_t>(classes_.size())});
+                classes_.push_back(set);
+                wildcards = true;
+                i = end;
+            }
+        } else {
+            if (c == '\\' && i + 1 < pattern.size()) ++i;
+            elements_.push_back({Element::Type::Byte, static_cast<uint8_t>(pattern[i])});
+            ++i;
+        }
+    }
+
+    hidden_ = !elements_.empty() && elements_[0].type == Element::Type::Byte && elements_[0].byte == '.';
+
+    // The literal text on either side of the wildcards
+    size_t lead = 0;
+    while (lead < elements_.size() && elements_[lead].type == Element::Type::Byte) {
+        prefix_ += static_cast<char>(elements_[lead++].byte);
+    }
+    if (!wildcards) {
+        kind_ = Kind::Literal;
+        return;
+    }
+    size_t trail = elements_.size();
+    while (trail > lead && elements_[trail - 1].type == Element::Type::Byte) --trail;
+    for (size_t k = trail; k < elements_.size(); ++k) suffix_ += static_cast<char>(elements_[k].byte);
+
+    if (stars == 1 && trail == lead + 1 && elements_[lead].type == Element::Type::Star) {
+        kind_ = Kind::Star;
+    } else if (elements_.size() <= kMaxDfaElements) {
+        kind_ = Kind::Dfa;
+        sets_.push_back(0);
+        next_.emplace_back();
+        next_.back().fill(0);
+        state_id(closure(bit(0)));
+    } else {
+        kind_ = Kind::Backtrack;
+    }
+}
+
+bool GlobMatcher::element_matches(const Element& e, unsigned char c) const {
+    switch (e.type) {
+    case Element::Type::Byte:
+        return e.byte == c;
+    case Element::Type::Any:
+        return true;
+    case Element::Type::Class:
+        return classes_[e.cls].test(c);
+    case Element::Type::Star:
+        break;
+    }
+    return false;
+}
+
+// Add the positions reachable by letting stars match nothing; one pass in
+// order covers runs of them
+uint64_t GlobMatcher::closure(uint64_t set) const {
+    for (size_t k = 0; k < elements_.size(); ++k) {
+        if ((set & bit(k)) && elements_[k].type == Element::Type::Star) set |= bit(k + 1);
+    }
+    return set;
+}
+
+uint64_t GlobMatcher::step(uint64_t set, unsigned char c) const {
+    uint64_t next = 0;
+    for (size_t k = 0; k < elements_.size(); ++k) {
+        if (!(set & bit(k))) continue;
+        const Element& e = elements_[k];
+        if (e.type == Element::Type::Star) {
+            next |= bit(k);
+        } else if (element_matches(e, c)) {
+            next |= bit(k + 1);
+        }
+    }
+    return closure(next);
+}
+
+int32_t GlobMatcher::state_id(uint64_t set) const {
+    if (set == 0) return 0;
+    auto [it, added] = ids_.try_emplace(set, static_cast<int32_t>(sets_.size()));
+    if (added) {
+        sets_.push_back(set);
+        next_.emplace_back();
+        next_.back().fill(-1);
+    }
+    return it->second;
+}
+
+bool GlobMatcher::match_dfa(std::string_view name) const {
+    int32_t state = 1;
+    for (char ch : name) {
+        const auto c = static_cast<unsigned char>(ch);
+        int32_t to = next_[static_cast<size_t>(state)][c];
+        if (to < 0) {
+            // A pathological pattern would grow the table without bound
+            if (sets_.size() >= kMaxStates) return match_backtrack(name);
+            to = state_id(step(sets_[static_cast<size_t>(state)], c));
+            next_[static_cast<size_t>(state)][c] = to;
+        }
+        if (to == 0) return false;
+        state = to;
+    }
+    return (sets_[static_cast<size_t>(state)] & bit(elements_.size())) != 0;
+}
+
+// Every element but '*' takes exactly one byte, so on a mismatch only the
+// latest star needs to take one more
+bool GlobMatcher::match_backtrack(std::string_view name) const {
+    const size_t m = elements_.size();
+    size_t n = 0, e = 0;
+    size_t star = m, star_n = 0;
+    while (n < name.size()) {
+        if (e < m && elements_[e].type == Element::Type::Star) {
+            star = e++;
+            star_n = n;
+        } else if (e < m && element_matches(elements_[e], static_cast<unsigned char>(name[n]))) {
+            ++e;
+            ++n;
+        } else if (star < m) {
+            e = star + 1;
+            n = ++star_n;
+        } else {
+            return false;
+        }
+    }
+    while (e < m && elements_[e].type == Element::Type::Star) ++e;
+    return e == m;
+}
+
+bool GlobMatcher::matches(std::string_view name) const {
+    if (kind_ == Kind::Literal) return name == prefix_;
+    if (name.size() < prefix_.size() + suffix_.size() || !name.starts_with(prefix_) ||
+        !name.ends_with(suffix_)) {
+        return false;
+    }
+    switch (kind_) {
+    case Kind::Star:
+        return true;
+    case Kind::Dfa:
+        return match_dfa(name);
+    default:
+        return match_backtrack(name);
+    }
+}
+
+namespace {
+
+enum class EntryType { Directory, Link, Other, Unknown };
+
+#ifndef _WIN32
+// getdents64 fills this much per call, so even a directory of half a million
+// entries takes a few dozen syscalls
+constexpr size_t kDirentBuffer = 256 * 1024;
+
+// Calls each(name, type) for every entry of dir but . and ..; false if it
+// cannot be read. depth picks a buffer, so scans may nest.
+template <typename Each>
+bool scan_directory(const std::string& dir, size_t depth, Each&& each) {
+    thread_local std::vector<std::unique_ptr<char[]>> buffers;
+    while (buffers.size() <= depth) buffers.push_back(std::make_unique<char[]>(kDirentBuffer));
+    char* buf = buffers[depth].get();
+
+    int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buf, kDirentBuffer);
+        if (n <= 0) break;
+        for (long off = 0; off < n;) {
+            // The kernel's linux_dirent64 is glibc's dirent64
+            const auto* d = reinterpret_cast<const struct dirent64*>(buf + off);
+            off += d->d_reclen;
+            const char* name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            EntryType type = d->d_type == DT_DIR   ? EntryType::Directory
+                             : d->d_type == DT_LNK ? EntryType::Link
+                             : d->d_type == DT_UNKNOWN ? EntryType::Unknown
+                                                       : EntryType::Other;
+            each(std::string_view(name), type);
+        }
+    }
+    close(fd);
+    return true;
+}
+
+// Whether path names a directory; follow decides for symlinks
+bool is_directory(const std::string& path, EntryType type, bool follow) {
+    if (type == EntryType::Directory) return true;
+    if (type == EntryType::Other || (type == EntryType::Link && !follow)) return false;
+    struct stat st{};
+    const int rc = follow ? stat(path.c_str(), &st) : lstat(path.c_str(), &st);
+    return rc == 0 && S_ISDIR(st.st_mode);
+}
+
+bool exists(const std::string& path) {
+    struct stat st{};
+    return lstat(path.c_str(), &st) == 0;
+}
+#else
+template <typename Each>
+bool scan_directory(const std::string& dir, size_t, Each&& each) {
+    std::error_code ec;
+    std::filesystem::directory_iterator it(dir.empty() ? "." : dir, ec);
+    if (ec) return false;
+    for (const auto& entry : it) {
+        const std::string name = entry.path().filename().string();
+        each(std::string_view(name), entry.is_directory(ec) ? EntryType::Directory : EntryType::Other);
+    }
+    return true;
+}
+
+bool is_directory(const std::string&, EntryType type, bool) {
+    return type == EntryType::Directory;
+}
+
+bool exists(const std::string& path) {
+    std::error_code ec;
+    return std::filesystem::exists(path, ec);
+}
+#endif
+
+struct Component {
+    GlobMatcher matcher;
+    bool globstar;
+};
+
+class Expander {
+    std::vector<Component> components_;
+    bool dirs_only_ = false;
+    std::vector<std::string>& out_;
+    // Directory scans open at once, each with a buffer of its own
+    size_t depth_ = 0;
+
+public:
+    Expander(std::vector<Component> components, bool dirs_only, std::vector<std::string>& out)
+        : components_(std::move(components)), dirs_only_(dirs_only), out_(out) {}
+
+    void expand(std::string& path, size_t k) {
+        const Component& c = components_[k];
+        const bool last = k + 1 == components_.size();
+        const size_t base = path.size();
+
+        if (c.globstar) {
+            if (last) {
+                // The directory itself comes first, as dir/
+                if (!path.empty() && path.back() != '/' && is_directory(path, EntryType::Unknown, true)) {
+                    out_.push_back(path + '/');
+                }
+                walk(path, k, true);
+            } else {
+                expand(path, k + 1);
+                walk(path, k, false);
+            }
+            return;
+        }
+
+        if (c.matcher.literal()) {
+            join(path, c.matcher.text());
+            if (!last) {
+                expand(path, k + 1);
+            } else if (dirs_only_ ? is_directory(path, EntryType::Unknown, true) : exists(path)) {
+                emit(path);
+            }
+            path.resize(base);
+            return;
+        }
+
+        scan(path, [&](std::string_view name, EntryType type) {
+            if (name[0] == '.' && !c.matcher.matches_hidden()) return;
+            if (!c.matcher.matches(name)) return;
+            join(path, name);
+            if (last && !dirs_only_) {
+                emit(path);
+            } else if (is_directory(path, type, true)) {
+                if (last) {
+                    emit(path);
+                } else {
+                    expand(path, k + 1);
+                }
+            }
+            path.resize(base);
+        });
+    }
+
+private:
+    template <typename Each>
+    void scan(const std::string& dir, Each&& each) {
+        scan_directory(dir, depth_++, each);
+        --depth_;
+    }
+
+    void join(std::string& path, std::string_view name) {
+        if (!path.empty() && path.back() != '/') path += '/';
+        path += name;
+    }
+
+    void emit(const std::string& path) {
+        out_.push_back(dirs_only_ ? path + '/' : path);
+    }
+
+    // Below path, the "**" at k: every entry when it ends the pattern, else
+    // every directory, with the rest of the pattern applied to each. Hidden
+    // entries are skipped and symlinks are not followed.
+    void walk(std::string& path, size_t k, bool everything) {
+        const size_t base = path.size();
+        scan(path, [&](std::string_view name, EntryType type) {
+            if (name[0] == '.') return;
+            join(path, name);
+            const bool dir = is_directory(path, type, false);
+            if (everything) {
+                if (dir || !dirs_only_) emit(path);
+            } else if (dir) {
+                expand(path, k + 1);
+            }
+            if (dir) walk(path, k, everything);
+            path.resize(base);
+        });
+    }
+};
+
+} // namespace
+
+std::vector<std::string> expand_glob(std::string_view pattern) {
+    std::vector<std::string> matches;
+    std::string path;
+    if (pattern.starts_with('/')) path = "/";
+    const bool dirs_only = pattern.size() > 1 && pattern.ends_with('/');
+
+    std::vector<Component> components;
+    bool wildcards = false;
+    size_t start = 0;
+    while (start < pattern.size()) {
+        size_t end = pattern.find('/', start);
+        if (end == std::string_view::npos) end = pattern.size();
+        std::string_view text = pattern.substr(start, end - start);
+        start = end + 1;
+        if (text.empty()) continue;
+        const bool globstar = text == "**";
+        components.push_back({GlobMatcher(text), globstar});
+        wildcards = wildcards || globstar || !components.back().matcher.literal();
+    }
+    if (!wildcards) return matches;
+
+    Expander(std::move(components), dirs_only, matches).expand(path, 0);
+    if (matches.size() < 2) return matches;
+
+    // Each match is collated once, into its strxfrm key, and the sort then
+    // compares keys with strcmp instead of calling strcoll n log n times
+    std::vector<std::pair<std::string, std::string>> keyed;
+    keyed.reserve(matches.size());
+    for (auto& match : matches) {
+        std::string key(std::strxfrm(nullptr, match.c_str(), 0) + 1, '\0');
+        key.resize(std::strxfrm(key.data(), match.c_str(), key.size()));
+        keyed.emplace_back(std::move(key), std::move(match));
+    }
+    std::sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (size_t i = 0; i < keyed.size(); ++i) matches[i] = std::move(keyed[i].second);
+    return matches;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One path component of a glob pattern, compiled once and then matched
+// against every name of a directory. A component without wildcards is a
+// literal and needs no directory read at all. One '*' between literal text
+// becomes a prefix and suffix compare; anything else runs a DFA over
+// bytes, built lazily from the pattern's positions as names are matched,
+// after the literal text every match starts and ends with is checked.
+class GlobMatcher {
+public:
+    // A backslash escapes the byte after it
+    explicit GlobMatcher(std::string_view pattern);
+
+    bool literal() const { return kind_ == Kind::Literal; }
+    // The unescaped name a literal component stands for
+    const std::string& text() const { return prefix_; }
+    // Names starting with '.' only match a pattern that starts with one
+    bool matches_hidden() const { return hidden_; }
+
+    bool matches(std::string_view name) const;
+
+private:
+    enum class Kind { Literal, Star, Dfa, Backtrack };
+
+    struct Element {
+        enum class Type : uint8_t { Byte, Any, Class, Star };
+        Type type;
+        uint8_t byte = 0;
+        uint16_t cls = 0; // index into classes_
+    };
+
+    // A state is the set of pattern positions reached, one bit each, so the
+    // DFA takes patterns of up to 63 elements; longer ones backtrack
+    static constexpr size_t kMaxDfaElements = 63;
+    static constexpr size_t kMaxStates = 1024;
+
+    Kind kind_ = Kind::Literal;
+    bool hidden_ = false;
+    std::string prefix_;
+    std::string suffix_;
+    std::vector<Element> elements_;
+    std::vector<std::bitset<256>> classes_;
+
+    // State 0 is dead and state 1 the start; -1 marks a transition not
+    // worked out yet
+    mutable std::vector<uint64_t> sets_;
+    mutable std::vector<std::array<int32_t, 256>> next_;
+    mutable std::unordered_map<uint64_t, int32_t> ids_;
+
+    bool element_matches(const Element& e, unsigned char c) const;
+    uint64_t closure(uint64_t set) const;
+    uint64_t step(uint64_t set, unsigned char c) const;
+    int32_t state_id(uint64_t set) const;
+    bool match_dfa(std::string_view name) const;
+    bool match_backtrack(std::string_view name) const;
+};
+
+// Pathname expansion of a pattern in which '\' escapes the byte after it.
+// '/' separates components, each matched with a GlobMatcher; a component
+// that is exactly "**" matches any number of directories, symlinks not
+// followed, and a trailing '/' keeps only directories. Directories are read
+// with getdents64 in large batches and d_type decides what is a directory,
+// so only symlinks and filesystems without d_type cost a stat. Matches come
+// back sorted in the collation order of LC_COLLATE, as bash sorts them, and
+// empty when nothing matches or the pattern has no wildcards at all.
+std::vector<std::string> expand_glob(std::string_view pattern);
@@ -0,0 +1,231 @@
+#include "history.hpp"
+
+#ifndef _WIN32
+
+#include "platform.hpp"
+#include "variables.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr unsigned kFilterShift = 32 - 12; // 4096 filter bits
+
+// The two filter bits of the trigram at p
+inline void trigram_bits(const char* p, uint32_t& a, uint32_t& b) {
+    const uint32_t key = static_cast<uint32_t>(static_cast<unsigned char>(p[0])) |
+                         static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8 |
+                         static_cast<uint32_t>(static_cast<unsigned char>(p[2])) << 16;
+    a = (key * 0x9e3779b1u) >> kFilterShift;
+    b = (key * 0x85ebca77u) >> kFilterShift;
+}
+
+} // namespace
+
+History::~History() {
+    if (base_) munmap(const_cast<char*>(base_), mapped_);
+    if (fd_ >= 0) close(fd_);
+}
+
+std::optional<std::string> History::default_location(const Variables& vars) {
+    if (const std::string* file = vars.get("HISTFILE")) {
+        if (file->empty()) return std::nullopt;
+        return *file;
+    }
+    if (const std::string* data = vars.get("XDG_DATA_HOME"); data && !data->empty()) {
+        return *data + "/shell/history";
+    }
+    if (const std::string* home = vars.get("HOME"); home && !home->empty()) {
+        return *home + "/.local/share/shell/history";
+    }
+    return std::nullopt;
+}
+
+bool History::open(const std::string& file) {
+    std::error_code ec;
+    fs::create_directories(fs::path(file).parent_path(), ec);
+    // Every write lands at the end of the file, whoever else is appending
+    fd_ = private_fd(::open(file.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600));
+    if (fd_ < 0) return false;
+    path_ = file;
+
+    struct stat st{};
+    if (fstat(fd_, &st) == 0) map_to(static_cast<size_t>(st.st_size));
+    return true;
+}
+
+bool History::index_step(size_t max_bytes) {
+    if (indexed_ + max_bytes < mapped_) {
+        // Stop at a line end, past the limit so a long line still gets done
+        const char* limit = base_ + indexed_ + max_bytes;
+        if (const void* nl = std::memchr(limit, '\n', static_cast<size_t>(base_ + mapped_ - limit))) {
+            index_range(static_cast<size_t>(static_cast<const char*>(nl) - base_) + 1);
+            return true;
+        }
+    }
+    index_range(mapped_);
+    return false;
+}
+
+void History::map_to(size_t size) {
+    if (size == mapped_) return;
+    if (base_) munmap(const_cast<char*>(base_), mapped_);
+    base_ = nullptr;
+    mapped_ = 0;
+    if (size == 0) return;
+    void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) return;
+    base_ = static_cast<const char*>(p);
+    mapped_ = size;
+}
+
+void History::index_range(size_t end) {
+    // Only whole lines: another shell's entry may be half written
+    while (end > indexed_ && base_[end - 1] != '\n') --end;
+
+    size_t pos = indexed_;
+    size_t entries = blocks_.empty() ? 0 : blocks_.back().first + blocks_.back().count;
+    while (pos < end) {
+        const char* line = base_ + pos;
+        const char* nl = static_cast<const char*>(std::memchr(line, '\n', end - pos));
+        const size_t len = static_cast<size_t>(nl - line);
+
+        if (blocks_.empty() || blocks_.back().count == kBlockEntries) {
+            blocks_.push_back({pos, entries});
+        }
+        Block& block = blocks_.back();
+        for (size_t i = 0; i + 3 <= len; ++i) {
+            uint32_t a, b;
+            trigram_bits(line + i, a, b);
+            block.filter[a / 64] |= uint64_t{1} << (a % 64);
+            block.filter[b / 64] |= uint64_t{1} << (b % 64);
+        }
+        ++block.count;
+        ++entries;
+        pos += len + 1;
+    }
+    indexed_ = end;
+}
+
+void History::catch_up() {
+    if (fd_ < 0) return;
+
+    struct stat ours{};
+    if (fstat(fd_, &ours) != 0) return;
+
+    // Another shell may have replaced the file rather than appended to it
+    struct stat on_disk{};
+    if (stat(path_.c_str(), &on_disk) == 0 &&
+        (on_disk.st_dev != ours.st_dev || on_disk.st_ino != ours.st_ino)) {
+        int fd = private_fd(::open(path_.c_str(), O_RDWR | O_APPEND | O_CLOEXEC));
+        if (fd >= 0) {
+            map_to(0);
+            close(fd_);
+            fd_ = fd;
+            blocks_.clear();
+            indexed_ = 0;
+            if (fstat(fd_, &ours) != 0) return;
+        }
+    }
+
+    const size_t size = static_cast<size_t>(ours.st_size);
+    if (size < indexed_) {
+        // Truncated: start over
+        blocks_.clear();
+        indexed_ = 0;
+    }
+    map_to(size);
+    if (mapped_ > indexed_) index_range(mapped_);
+}
+
+void History::add(std::string_view line) {
+    if (fd_ < 0 || line.empty() || line.find('\n') != std::string_view::npos) return;
+    std::string record;
+    record.reserve(line.size() + 1);
+    record.append(line).append(1, '\n');
+    // One write, so concurrent shells never interleave inside an entry
+    while (write(fd_, record.data(), record.size()) < 0 && errno == EINTR) {}
+}
+
+std::vector<std::string_view> History::recent(size_t count) const {
+    std::vector<std::string_view> lines;
+    if (!base_) return lines;
+    size_t end = mapped_;
+    while (end > 0 && base_[end - 1] != '\n') --end;
+    while (end > 0 && lines.size() < count) {
+        size_t start = end - 1;
+        while (start > 0 && base_[start - 1] != '\n') --start;
+        lines.emplace_back(base_ + start, end - 1 - start);
+        end = start;
+    }
+    std::reverse(lines.begin(), lines.end());
+    return lines;
+}
+
+size_t History::size() {
+    catch_up();
+    return blocks_.empty() ? 0 : blocks_.back().first + blocks_.back().count;
+}
+
+std::string_view History::entry(size_t n) {
+    catch_up();
+    const Block& block = blocks_[n / kBlockEntries];
+    const char* p = base_ + block.offset;
+    for (size_t i = n % kBlockEntries; i > 0; --i) {
+        p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(base_ + indexed_ - p))) + 1;
+    }
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(base_ + indexed_ - p)));
+    return {p, static_cast<size_t>(nl - p)};
+}
+
+bool History::block_may_match(const Block& block, std::string_view text) const {
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        uint32_t a, b;
+        trigram_bits(text.data() + i, a, b);
+        if (!(block.filter[a / 64] >> (a % 64) & 1) || !(block.filter[b / 64] >> (b % 64) & 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void History::block_lines(const Block& block, std::vector<std::string_view>& lines) const {
+    lines.clear();
+    const char* p = base_ + block.offset;
+    const char* end = base_ + indexed_;
+    for (uint32_t i = 0; i < block.count; ++i) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        lines.emplace_back(p, static_cast<size_t>(nl - p));
+        p = nl + 1;
+    }
+}
+
+std::optional<size_t> History::search_back(std::string_view text, size_t before) {
+    catch_up();
+    const size_t total = blocks_.empty() ? 0 : blocks_.back().first + blocks_.back().count;
+    before = std::min(before, total);
+    if (before == 0) return std::nullopt;
+
+    std::vector<std::string_view> lines;
+    for (size_t b = (before - 1) / kBlockEntries + 1; b-- > 0;) {
+        const Block& block = blocks_[b];
+        if (!block_may_match(block, text)) continue;
+        block_lines(block, lines);
+        for (size_t i = std::min(lines.size(), before - block.first); i-- > 0;) {
+            if (lines[i].find(text) != std::string_view::npos) return block.first + i;
+        }
+    }
+    return std::nullopt;
+}
+
+#endif
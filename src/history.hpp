@@ -0,0 +1,105 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Variables;
+
+// The command history, shared by every shell of the user: one entry per
+// line of an append-only file. Opening only maps the file; nothing is
+// parsed at startup. Each shell appends its entries
+// with a single O_APPEND write, and picks up whatever other shells appended
+// the next time it looks, by mapping the file's new tail.
+//
+// Searches go through a trigram index: entries are grouped in blocks of
+// kBlockEntries, and each block keeps a Bloom filter of the trigrams in its
+// entries. A search tests the filters and reads only the blocks that may
+// match, so it touches a sliver of a history of millions of lines. The
+// interactive shell builds the index a slice at a time while it waits for
+// input (a thread would not survive the shell's forks); anything still
+// missing when a search starts is indexed then, as is the file's new tail.
+class History {
+public:
+    static constexpr size_t kBlockEntries = 64;
+
+    History() = default;
+    ~History();
+
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
+
+    // $HISTFILE if set (empty disables the file), else
+    // $XDG_DATA_HOME/shell/history, else ~/.local/share/shell/history
+    static std::optional<std::string> default_location(const Variables& vars);
+
+    // Map the file, creating it
+    bool open(const std::string& file);
+    bool is_open() const { return fd_ >= 0; }
+
+    // Index about max_bytes more of the mapped file; false once it is all
+    // indexed
+    bool index_step(size_t max_bytes);
+
+    // Append an entry; empty lines and lines with a newline are not kept
+    void add(std::string_view line);
+
+    // The last count entries, oldest first, read back from the end of the
+    // mapped file without the index
+    std::vector<std::string_view> recent(size_t count) const;
+
+    // Number of entries, including any other shells have appended. Views
+    // handed out stay valid until the next call that looks for new entries.
+    size_t size();
+    std::string_view entry(size_t n);
+
+    // The newest entry before `before` containing text
+    std::optional<size_t> search_back(std::string_view text, size_t before);
+    // Every entry containing text, oldest first
+    template <typename F>
+    void search_all(std::string_view text, F&& visit);
+
+private:
+    // Trigram Bloom filter of one block of entries
+    static constexpr size_t kFilterBits = 4096;
+    struct Block {
+        size_t offset;       // of its first entry
+        size_t first;        // number of its first entry
+        uint32_t count = 0;  // entries so far (the last block fills up)
+        std::array<uint64_t, kFilterBits / 64> filter{};
+    };
+
+    std::string path_;
+    int fd_ = -1;
+    const char* base_ = nullptr;
+    size_t mapped_ = 0;      // bytes mapped
+    size_t indexed_ = 0;     // bytes folded into blocks, always at a line end
+    std::vector<Block> blocks_;
+
+    void map_to(size_t size);
+    void catch_up();
+    void index_range(size_t end);
+    bool block_may_match(const Block& block, std::string_view text) const;
+    // Line starts of a block's entries
+    void block_lines(const Block& block, std::vector<std::string_view>& lines) const;
+};
+
+template <typename F>
+void History::search_all(std::string_view text, F&& visit) {
+    catch_up();
+    std::vector<std::string_view> lines;
+    for (const auto& block : blocks_) {
+        if (!block_may_match(block, text)) continue;
+        block_lines(block, lines);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (lines[i].find(text) != std::string_view::npos) visit(block.first + i, lines[i]);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,475 @@
+#include "jobs.hpp"
+
+#ifndef _WIN32
+
+#include "output.hpp"
+#include "platform.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+namespace {
+
+// Signals an interactive shell ignores so that only its foreground job
+// receives them
+constexpr int kJobControlSignals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+void add_timeval(struct timeval& into, const struct timeval& tv) {
+    into.tv_sec += tv.tv_sec;
+    into.tv_usec += tv.tv_usec;
+    if (into.tv_usec >= 1000000) {
+        into.tv_usec -= 1000000;
+        ++into.tv_sec;
+    }
+}
+
+// Fold one process's usage into a job's
+void add_usage(struct rusage& into, const struct rusage& usage) {
+    add_timeval(into.ru_utime, usage.ru_utime);
+    add_timeval(into.ru_stime, usage.ru_stime);
+    if (usage.ru_maxrss > into.ru_maxrss) into.ru_maxrss = usage.ru_maxrss;
+    into.ru_nvcsw += usage.ru_nvcsw;
+    into.ru_nivcsw += usage.ru_nivcsw;
+}
+
+double seconds(const struct timeval& tv) {
+    return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+}
+
+double seconds_between(const struct timespec& from, const struct timespec& to) {
+    return static_cast<double>(to.tv_sec - from.tv_sec) +
+           static_cast<double>(to.tv_nsec - from.tv_nsec) / 1e9;
+}
+
+// "Done", "Exit 3", "Killed", "Running", ...
+std::string state_text(const Job& job) {
+    switch (job.state()) {
+    case JobState::Running:
+        return "Running";
+    case JobState::Stopped:
+        return "Stopped";
+    case JobState::Done:
+        break;
+    }
+    int status = job.procs.back().wait_status;
+    if (WIFSIGNALED(status)) {
+        std::string text = strsignal(WTERMSIG(status));
+        if (WCOREDUMP(status)) text += " (core dumped)";
+        return text;
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        return "Exit " + std::to_string(WEXITSTATUS(status));
+    }
+    return "Done";
+}
+
+} // namespace
+
+int decode_wait_status(int status) {
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    return 1;
+}
+
+int wait_child(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return status;
+}
+
+void reset_child_signals() {
+    signal(SIGPIPE, SIG_DFL);
+    for (int sig : kJobControlSignals) signal(sig, SIG_DFL);
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &chld, nullptr);
+}
+
+JobState Job::state() const {
+    if (live == 0) return JobState::Done;
+    if (stopped == live) return JobState::Stopped;
+    return JobState::Running;
+}
+
+int Job::status() const {
+    return procs.empty() ? 0 : decode_wait_status(procs.back().wait_status);
+}
+
+JobTable::JobTable() {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved_mask_);
+
+    // Kept where no redirection reaches them: `>&3` must not find them
+    signal_fd_ = private_fd(signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC));
+    epoll_fd_ = private_fd(epoll_create1(EPOLL_CLOEXEC));
+    if (signal_fd_ >= 0 && epoll_fd_ >= 0) {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = signal_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &ev);
+    }
+}
+
+JobTable::~JobTable() {
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (signal_fd_ >= 0) close(signal_fd_);
+    sigprocmask(SIG_SETMASK, &saved_mask_, nullptr);
+}
+
+bool JobTable::enable_job_control(int tty) {
+    if (!isatty(tty)) return false;
+
+    // Started in the background of a job-control shell: wait to be brought
+    // to the foreground rather than fight over the terminal
+    pid_t pgrp;
+    while (tcgetpgrp(tty) != (pgrp = getpgrp())) kill(-pgrp, SIGTTIN);
+
+    for (int sig : kJobControlSignals) signal(sig, SIG_IGN);
+
+    shell_pgid_ = getpid();
+    if (getpgrp() != shell_pgid_ && setpgid(0, shell_pgid_) < 0) {
+        perror("setpgid");
+        return false;
+    }
+    tcsetpgrp(tty, shell_pgid_);
+    tcgetattr(tty, &shell_tmodes_);
+    tty_ = tty;
+    return true;
+}
+
+Job& JobTable::add(std::string command, pid_t pgid, const std::vector<pid_t>& pids, bool background) {
+    const int id = jobs_.empty() ? 1 : jobs_.rbegin()->first + 1;
+    Job& job = jobs_[id];
+    job.id = id;
+    job.pgid = pgid;
+    job.command = std::move(command);
+    job.background = background;
+    job.procs.reserve(pids.size());
+    for (pid_t pid : pids) {
+        by_pid_[pid] = {id, static_cast<uint32_t>(job.procs.size())};
+        job.procs.push_back({pid});
+    }
+    job.live = pids.size();
+    clock_gettime(CLOCK_MONOTONIC, &job.started);
+    if (background) make_current(id);
+    return job;
+}
+
+void JobTable::remove(Job& job) {
+    const int id = job.id;
+    for (const auto& proc : job.procs) by_pid_.erase(proc.pid);
+    jobs_.erase(id);
+
+    // The most recent remaining jobs take over as current and previous
+    auto latest_except = [&](int skip) {
+        for (auto it = jobs_.rbegin(); it != jobs_.rend(); ++it) {
+            if (it->first != skip) return it->first;
+        }
+        return 0;
+    };
+    if (current_ == id) current_ = previous_ ? previous_ : latest_except(0);
+    if (previous_ == id || previous_ == current_) previous_ = latest_except(current_);
+}
+
+void JobTable::make_current(int id) {
+    if (current_ == id) return;
+    previous_ = current_;
+    current_ = id;
+}
+
+Job* JobTable::resolve(std::string_view spec) {
+    auto by_id = [&](int id) -> Job* {
+        auto it = jobs_.find(id);
+        return it == jobs_.end() ? nullptr : &it->second;
+    };
+
+    if (spec.empty() || spec == "%" || spec == "%%" || spec == "%+") return by_id(current_);
+    if (spec == "%-") return by_id(previous_);
+    if (spec[0] != '%') return nullptr;
+    spec.remove_prefix(1);
+
+    if (spec.find_first_not_of("0123456789") == std::string_view::npos) {
+        int id = 0;
+        for (char c : spec) id = id * 10 + (c - '0');
+        return by_id(id);
+    }
+    const bool anywhere = spec[0] == '?';
+    if (anywhere) spec.remove_prefix(1);
+    // Like bash, the most recent match wins
+    for (auto it = jobs_.rbegin(); it != jobs_.rend(); ++it) {
+        std::string_view command = it->second.command;
+        if (anywhere ? command.find(spec) != std::string_view::npos : command.starts_with(spec)) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+Job* JobTable::find_by_pid(pid_t pid) {
+    auto it = by_pid_.find(pid);
+    if (it == by_pid_.end()) return nullptr;
+    return &jobs_.at(it->second.first);
+}
+
+void JobTable::adopt(pid_t pid) {
+    adopted_[pid].reset();
+}
+
+int JobTable::collect(pid_t pid) {
+    auto it = adopted_.find(pid);
+    int status = 0;
+    if (it != adopted_.end() && it->second) {
+        status = *it->second;
+    } else {
+        pid_t reaped;
+        while ((reaped = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+        // Somebody else reaped it; all that can be said is that it is gone
+        if (reaped < 0) status = 127 << 8;
+    }
+    if (it != adopted_.end()) adopted_.erase(it);
+    return status;
+}
+
+void JobTable::record(pid_t pid, int status, const struct rusage& usage) {
+    auto it = by_pid_.find(pid);
+    if (it == by_pid_.end()) {
+        auto adopted = adopted_.find(pid);
+        if (adopted != adopted_.end() && !WIFSTOPPED(status) && !WIFCONTINUED(status)) adopted->second = status;
+        return;
+    }
+    Job& job = jobs_.at(it->second.first);
+    JobProcess& proc = job.procs[it->second.second];
+    if (proc.exited) return;
+
+    const JobState before = job.state();
+    if (WIFSTOPPED(status)) {
+        proc.wait_status = status;
+        if (!proc.stopped) {
+            proc.stopped = true;
+            ++job.stopped;
+        }
+    } else if (WIFCONTINUED(status)) {
+        if (proc.stopped) {
+            proc.stopped = false;
+            --job.stopped;
+        }
+    } else {
+        proc.wait_status = status;
+        proc.exited = true;
+        if (proc.stopped) {
+            proc.stopped = false;
+            --job.stopped;
+        }
+        --job.live;
+        add_usage(job.usage, usage);
+        if (job.live == 0) clock_gettime(CLOCK_MONOTONIC, &job.finished);
+    }
+
+    const JobState after = job.state();
+    if (job.background && after != before && after != JobState::Running && !job.changed) {
+        job.changed = true;
+        changed_.push_back(job.id);
+    }
+}
+
+void JobTable::reap() {
+    while (true) {
+        int status = 0;
+        struct rusage usage{};
+        pid_t pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage);
+        if (pid > 0) {
+            record(pid, status, usage);
+            continue;
+        }
+        if (pid < 0 && errno == EINTR) continue;
+        return;
+    }
+}
+
+void JobTable::wait(Job& job) {
+    while (job.state() == JobState::Running) {
+        int status = 0;
+        struct rusage usage{};
+        pid_t pid = wait4(-1, &status, WUNTRACED | WCONTINUED, &usage);
+        if (pid > 0) {
+            record(pid, status, usage);
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != ECHILD) perror("wait4");
+        // Somebody else reaped them; all that can be said is that they are gone
+        for (auto& proc : job.procs) {
+            if (!proc.exited) {
+                proc.exited = true;
+                proc.stopped = false;
+                proc.wait_status = 127 << 8;
+            }
+        }
+        job.live = 0;
+        job.stopped = 0;
+        clock_gettime(CLOCK_MONOTONIC, &job.finished);
+    }
+}
+
+void JobTable::continue_job(Job& job) {
+    for (auto& proc : job.procs) proc.stopped = false;
+    job.stopped = 0;
+    if (job.pgid > 0) {
+        kill(-job.pgid, SIGCONT);
+        return;
+    }
+    for (const auto& proc : job.procs) {
+        if (!proc.exited) kill(proc.pid, SIGCONT);
+    }
+}
+
+int JobTable::foreground(Job& job, bool resume) {
+    if (job_control() && job.pgid > 0) {
+        tcsetpgrp(tty_, job.pgid);
+        if (resume && job.has_tmodes) tcsetattr(tty_, TCSADRAIN, &job.tmodes);
+    }
+    job.background = false;
+    job.changed = false;
+    if (resume) continue_job(job);
+
+    wait(job);
+
+    const bool stopped = job.state() == JobState::Stopped;
+    if (job_control()) {
+        tcsetpgrp(tty_, shell_pgid_);
+        if (stopped) {
+            job.has_tmodes = tcgetattr(tty_, &job.tmodes) == 0;
+        }
+        tcsetattr(tty_, TCSADRAIN, &shell_tmodes_);
+    }
+
+    if (stopped) {
+        int status = 0;
+        for (const auto& proc : job.procs) {
+            if (proc.stopped) status = decode_wait_status(proc.wait_status);
+        }
+        job.background = true;
+        make_current(job.id);
+        Output err(STDERR_FILENO);
+        err << '\n';
+        describe(err, job, false);
+        return status;
+    }
+
+    for (const auto& proc : job.procs) {
+        // A reader closing a pipe early is routine, not worth a message, and
+        // neither is the ^C the user just typed
+        const int sig = WIFSIGNALED(proc.wait_status) ? WTERMSIG(proc.wait_status) : 0;
+        if (sig != 0 && sig != SIGPIPE && sig != SIGINT) {
+            std::cerr << "terminated by signal " << sig << "\n";
+        }
+    }
+    int status = job.status();
+    add_usage(finished_usage_, job.usage);
+    remove(job);
+    return status;
+}
+
+struct rusage JobTable::take_finished_usage() {
+    struct rusage usage = finished_usage_;
+    finished_usage_ = {};
+    return usage;
+}
+
+void JobTable::resume_background(Job& job) {
+    job.background = true;
+    job.changed = false;
+    make_current(job.id);
+    continue_job(job);
+}
+
+void JobTable::wait_readable(int fd) {
+    if (epoll_fd_ < 0 || signal_fd_ < 0) return;
+    if (fd != watched_fd_) {
+        if (watched_fd_ >= 0) epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, watched_fd_, nullptr);
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        // Regular files cannot be watched, and are always readable anyway
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            watched_fd_ = -1;
+            return;
+        }
+        watched_fd_ = fd;
+    }
+
+    while (true) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epoll_fd_, events, 2, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        bool readable = false;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd != signal_fd_) {
+                readable = true;
+                continue;
+            }
+            // Several exits can share one SIGCHLD; reap() finds them all
+            struct signalfd_siginfo info[16];
+            while (read(signal_fd_, info, sizeof(info)) > 0) {}
+            reap();
+        }
+        if (readable) return;
+    }
+}
+
+void JobTable::describe(Output& out, const Job& job, bool with_pids) const {
+    const char mark = job.id == current_ ? '+' : job.id == previous_ ? '-' : ' ';
+    out << '[' << job.id << ']' << mark << "  ";
+    if (with_pids) out << job.procs.front().pid << ' ';
+
+    std::string state = state_text(job);
+    out << state;
+    for (size_t pad = state.size(); pad < 24; ++pad) out << ' ';
+    out << job.command;
+
+    switch (job.state()) {
+    case JobState::Running:
+        if (job.background) out << " &";
+        break;
+    case JobState::Stopped:
+        break;
+    case JobState::Done: {
+        char buf[96];
+        std::snprintf(buf, sizeof(buf), "  (real %.3fs user %.3fs sys %.3fs maxrss %ldK)",
+                      seconds_between(job.started, job.finished), seconds(job.usage.ru_utime),
+                      seconds(job.usage.ru_stime), job.usage.ru_maxrss);
+        out << buf;
+        break;
+    }
+    }
+    out << '\n';
+}
+
+void JobTable::notify(Output& out) {
+    if (changed_.empty()) return;
+    for (int id : changed_) {
+        auto it = jobs_.find(id);
+        if (it == jobs_.end() || !it->second.changed) continue;
+        Job& job = it->second;
+        job.changed = false;
+        describe(out, job, false);
+        if (job.state() == JobState::Done) remove(job);
+    }
+    changed_.clear();
+}
+
+#endif
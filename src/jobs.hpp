@@ -0,0 +1,155 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+class Output;
+
+// Turn a raw wait status into a shell exit status
+int decode_wait_status(int status);
+
+// Wait for a child its starter waits for itself, outside any job, and
+// return its raw wait status. Only that child is waited for, so every
+// other child of the shell is left to the job table.
+int wait_child(pid_t pid);
+
+// Undo, in a forked copy of the shell, the signal setup that only makes
+// sense for the shell itself
+void reset_child_signals();
+
+enum class JobState { Running, Stopped, Done };
+
+struct JobProcess {
+    pid_t pid = -1;
+    int wait_status = 0; // last status reported by wait4
+    bool exited = false;
+    bool stopped = false;
+};
+
+// The processes of one pipeline, started together and waited for together
+struct Job {
+    int id = 0;
+    pid_t pgid = 0;      // 0 when the job shares the shell's process group
+    std::string command;
+    std::vector<JobProcess> procs;
+    size_t live = 0;     // processes not reaped yet
+    size_t stopped = 0;  // live processes that are stopped
+    bool background = false;
+    bool changed = false; // finished or stopped since last reported
+
+    struct timespec started{};
+    struct timespec finished{};
+    // Summed over the processes reaped so far, but for ru_maxrss, which is
+    // the largest of them
+    struct rusage usage{};
+
+    struct termios tmodes{}; // terminal modes saved when the job stopped
+    bool has_tmodes = false;
+
+    JobState state() const;
+    // Status of the last process in the pipeline
+    int status() const;
+};
+
+// Every child the shell starts belongs to a job here, and all reaping goes
+// through wait4(-1), so each exit costs one syscall and one hash lookup no
+// matter how many children are running. SIGCHLD is blocked and read from a
+// signalfd; while the shell waits for input that signalfd and the input
+// share an epoll set, so background children are reaped the moment they
+// exit and never linger as zombies.
+class JobTable {
+public:
+    JobTable();
+    ~JobTable();
+
+    JobTable(const JobTable&) = delete;
+    JobTable& operator=(const JobTable&) = delete;
+
+    // Put the shell in its own process group in the foreground of tty and
+    // ignore the job control signals. False if tty is not a terminal.
+    bool enable_job_control(int tty);
+    bool job_control() const { return tty_ >= 0; }
+    // In a subshell: its jobs stay in the shell's process group and never
+    // take the terminal
+    void disable_job_control() { tty_ = -1; }
+    int terminal() const { return tty_; }
+
+    Job& add(std::string command, pid_t pgid, const std::vector<pid_t>& pids, bool background);
+    void remove(Job& job);
+    bool empty() const { return jobs_.empty(); }
+
+    // %N, %%, %+, %-, %prefix and %?substring; an empty spec is the current job
+    Job* resolve(std::string_view spec);
+    Job* find_by_pid(pid_t pid);
+    std::map<int, Job>& jobs() { return jobs_; }
+
+    // A child the shell waits for itself, outside any job (a coprocess
+    // worker); should wait4(-1) reap it first, its status is kept here
+    void adopt(pid_t pid);
+    // The wait status of an adopted child, waiting for it unless it was
+    // reaped already, after which it is forgotten
+    int collect(pid_t pid);
+
+    // Record every child that changed state, without blocking
+    void reap();
+    // Block until the job is no longer running, recording whatever else
+    // exits in the meantime
+    void wait(Job& job);
+    // Run the job in the foreground until it finishes or stops, giving it
+    // the terminal; resume sends SIGCONT first. A finished job is removed.
+    // Returns its status.
+    int foreground(Job& job, bool resume);
+    // SIGCONT a stopped job and leave it running in the background
+    void resume_background(Job& job);
+    // Usage of the jobs that finished in the foreground since the last call,
+    // combined as within a job
+    struct rusage take_finished_usage();
+
+    // Block until fd has input, reaping children as they exit meanwhile
+    void wait_readable(int fd);
+
+    // Report jobs that finished or stopped since the last call, forgetting
+    // the finished ones
+    void notify(Output& out);
+    // One `jobs` line
+    void describe(Output& out, const Job& job, bool with_pids) const;
+
+private:
+    std::map<int, Job> jobs_;
+    // pid -> (job id, index in its procs)
+    std::unordered_map<pid_t, std::pair<int, uint32_t>> by_pid_;
+    // Adopted pid -> its wait status, once reaped
+    std::unordered_map<pid_t, std::optional<int>> adopted_;
+    std::vector<int> changed_;
+    int current_ = 0;
+    int previous_ = 0;
+    struct rusage finished_usage_{};
+
+    int signal_fd_ = -1;
+    int epoll_fd_ = -1;
+    int watched_fd_ = -1;
+    sigset_t saved_mask_{};
+
+    int tty_ = -1;
+    pid_t shell_pgid_ = 0;
+    struct termios shell_tmodes_{};
+
+    void record(pid_t pid, int status, const struct rusage& usage);
+    void continue_job(Job& job);
+    void make_current(int id);
+};
+
+#endif
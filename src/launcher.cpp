@@ -0,0 +1,313 @@
+#include "launcher.hpp"
+
+#ifndef _WIN32
+
+#include "platform.hpp"
+
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/ioprio.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+extern char** environ;
+
+namespace {
+
+LaunchBackend backend_from_env() {
+    auto value = get_env("SHELL_LAUNCHER");
+    if (!value) return LaunchBackend::Auto;
+    if (*value == "spawn") return LaunchBackend::Spawn;
+    if (*value == "fork") return LaunchBackend::Fork;
+    return LaunchBackend::Auto;
+}
+
+LaunchBackend& current_backend() {
+    static LaunchBackend backend = backend_from_env();
+    return backend;
+}
+
+LaunchAttributes& current_defaults() {
+    static LaunchAttributes defaults;
+    return defaults;
+}
+
+pid_t spawn_child(const LaunchRequest& req, char* const* envp) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    err = posix_spawnattr_init(&attr);
+    if (err != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        errno = err;
+        return -1;
+    }
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_USEVFORK;
+    if (err == 0 && req.pgroup >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        err = posix_spawnattr_setpgroup(&attr, req.pgroup);
+        if (err == 0 && req.pgroup == 0 && req.foreground_tty >= 0) {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+            // Runs with every signal blocked, so SIGTTOU cannot stop the child.
+            // It comes before the descriptor actions, which may replace the
+            // terminal's descriptor (stdin, most often) with a file or pipe.
+            err = posix_spawn_file_actions_addtcsetpgrp_np(&actions, req.foreground_tty);
+#else
+            err = ENOTSUP;
+#endif
+        }
+    }
+
+    for (size_t i = 0; err == 0 && i < req.fd_actions.size(); ++i) {
+        const FdAction& action = req.fd_actions[i];
+        switch (action.kind) {
+        case FdAction::Kind::Dup:
+            // dup2 onto itself clears FD_CLOEXEC, as with a plain dup2 in a child
+            err = posix_spawn_file_actions_adddup2(&actions, action.source, action.fd);
+            break;
+        case FdAction::Kind::Open:
+            err = posix_spawn_file_actions_addopen(&actions, action.fd, action.path.c_str(),
+                                                   action.flags, action.mode);
+            break;
+        case FdAction::Kind::Close:
+            err = posix_spawn_file_actions_addclose(&actions, action.fd);
+            break;
+        }
+    }
+
+    // The child starts with default dispositions and an empty signal mask,
+    // whatever the shell itself ignores or blocks
+    sigset_t all, none;
+    sigfillset(&all);
+    sigemptyset(&none);
+    if (err == 0) err = posix_spawnattr_setsigdefault(&attr, &all);
+    if (err == 0) err = posix_spawnattr_setsigmask(&attr, &none);
+    if (err == 0) err = posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid = -1;
+    if (err == 0) err = posix_spawn(&pid, req.program, &actions, &attr, req.argv, envp);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Launches from threads of their own, with the attributes set on the thread
+// first, for the child to inherit as posix_spawn clones it. applied is
+// false, with nothing launched, when the thread could not be started or
+// could not take the attributes on.
+pid_t spawn_with_attributes(const LaunchRequest& req, const LaunchAttributes& attributes, char* const* envp,
+                            bool& applied) {
+    pid_t pid = -1;
+    int error = 0;
+    applied = false;
+    try {
+        std::thread([&] {
+            if (apply_launch_attributes(attributes)) return;
+            applied = true;
+            pid = spawn_child(req, envp);
+            error = errno;
+        }).join();
+    } catch (const std::system_error&) {
+        return -1;
+    }
+    errno = error;
+    return pid;
+}
+
+// strerror's text for each errno, made before any fork: between fork and
+// exec a child may make async-signal-safe calls only, which strerror and
+// stdio are not
+constexpr int kErrorTexts = 256;
+
+const std::array<std::string, kErrorTexts>& error_texts() {
+    static const std::array<std::string, kErrorTexts> texts = [] {
+        std::array<std::string, kErrorTexts> all;
+        for (int error = 0; error < kErrorTexts; ++error) all[error] = std::strerror(error);
+        return all;
+    }();
+    return texts;
+}
+
+// perror, in the child, with write alone
+[[noreturn]] void child_fail(const std::array<std::string, kErrorTexts>& texts, const char* what) {
+    const int error = errno;
+    const std::string_view text = error > 0 && error < kErrorTexts ? std::string_view(texts[error]) : "Unknown error";
+    const std::string_view parts[] = {what, ": ", text, "\n"};
+    for (const std::string_view part : parts) {
+        if (write(STDERR_FILENO, part.data(), part.size()) < 0) break;
+    }
+    _exit(127);
+}
+
+pid_t fork_child(const LaunchRequest& req, const LaunchAttributes& attributes, char* const* envp) {
+    const auto& texts = error_texts();
+    // Every signal back to its default action, with no call that allocates
+    struct sigaction default_action{};
+    default_action.sa_handler = SIG_DFL;
+    sigemptyset(&default_action.sa_mask);
+
+    pid_t pid = fork();
+    if (pid > 0 && req.pgroup >= 0) {
+        // Also done by the child; whichever runs first wins the race with
+        // anything that signals the group
+        setpgid(pid, req.pgroup == 0 ? pid : req.pgroup);
+    }
+    if (pid != 0) return pid; // parent, or -1 with errno set
+
+    if (req.pgroup >= 0) {
+        setpgid(0, req.pgroup);
+        // SIGTTOU is still ignored here, as it is in the shell
+        if (req.pgroup == 0 && req.foreground_tty >= 0) tcsetpgrp(req.foreground_tty, getpgrp());
+    }
+
+    for (const auto& action : req.fd_actions) {
+        switch (action.kind) {
+        case FdAction::Kind::Dup:
+            if (action.source == action.fd) {
+                int flags = fcntl(action.fd, F_GETFD);
+                if (flags < 0 || fcntl(action.fd, F_SETFD, flags & ~FD_CLOEXEC) < 0) {
+                    child_fail(texts, "dup2");
+                }
+            } else if (dup2(action.source, action.fd) < 0) {
+                child_fail(texts, "dup2");
+            }
+            break;
+        case FdAction::Kind::Open: {
+            int fd = open(action.path.c_str(), action.flags, action.mode);
+            if (fd < 0) child_fail(texts, action.path.c_str());
+            if (fd != action.fd) {
+                if (dup2(fd, action.fd) < 0) child_fail(texts, "dup2");
+                close(fd);
+            }
+            break;
+        }
+        case FdAction::Kind::Close:
+            close(action.fd);
+            break;
+        }
+    }
+
+    if (const char* failed = apply_launch_attributes(attributes)) child_fail(texts, failed);
+
+    for (int sig = 1; sig < NSIG; ++sig) sigaction(sig, &default_action, nullptr);
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+
+    execve(req.program, req.argv, envp);
+    child_fail(texts, "exec failed");
+}
+
+} // namespace
+
+const char* apply_launch_attributes(const LaunchAttributes& attributes) {
+    // Only raw system calls, as this runs between fork and exec
+    if (attributes.cpus && sched_setaffinity(0, sizeof(cpu_set_t), &*attributes.cpus) != 0) {
+        return "sched_setaffinity";
+    }
+    if (attributes.policy) {
+        sched_param param{};
+        if (sched_setscheduler(0, *attributes.policy, &param) != 0) return "sched_setscheduler";
+    }
+    if (attributes.nice) {
+        errno = 0;
+        const int current = getpriority(PRIO_PROCESS, 0);
+        if (errno != 0 || setpriority(PRIO_PROCESS, 0, current + *attributes.nice) != 0) return "setpriority";
+    }
+    if (attributes.io_priority &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, *attributes.io_priority) != 0) {
+        return "ioprio_set";
+    }
+    if (attributes.memory_policy &&
+        syscall(SYS_set_mempolicy, *attributes.memory_policy, attributes.memory_nodes.data(),
+                LaunchAttributes::kMaxNodes + 1) != 0) {
+        return "set_mempolicy";
+    }
+    return nullptr;
+}
+
+pid_t launch_process(const LaunchRequest& req, LaunchBackend backend) {
+    char* const* envp = req.envp ? req.envp : environ;
+    const LaunchAttributes& attributes = req.attributes ? *req.attributes : current_defaults();
+
+    if (backend == LaunchBackend::Fork) return fork_child(req, attributes, envp);
+
+    bool applied = true;
+    pid_t pid = attributes.empty() ? spawn_child(req, envp) : spawn_with_attributes(req, attributes, envp, applied);
+    // The child made by fork tries again, and reports what failed
+    if (!applied) return fork_child(req, attributes, envp);
+    if (pid >= 0 || backend == LaunchBackend::Spawn) return pid;
+
+    // Exec failures are final; anything else means this libc or kernel could
+    // not set up the spawn, so retry the classic way
+    switch (errno) {
+    case ENOSYS:
+    case EINVAL:
+    case ENOTSUP:
+        return fork_child(req, attributes, envp);
+    default:
+        return -1;
+    }
+}
+
+void append_argv(std::vector<char*>& argv, const std::vector<std::string_view>& words) {
+    for (const auto& word : words) argv.push_back(const_cast<char*>(word.data()));
+}
+
+std::vector<char*> make_argv(const std::vector<std::string_view>& words) {
+    std::vector<char*> argv;
+    argv.reserve(words.size() + 1);
+    append_argv(argv, words);
+    argv.push_back(nullptr);
+    return argv;
+}
+
+pid_t launch_process(const LaunchRequest& req) {
+    return launch_process(req, current_backend());
+}
+
+LaunchBackend launch_backend() {
+    return current_backend();
+}
+
+void set_launch_backend(LaunchBackend backend) {
+    current_backend() = backend;
+}
+
+const LaunchAttributes& launch_defaults() {
+    return current_defaults();
+}
+
+void set_launch_defaults(const LaunchAttributes& attributes) {
+    current_defaults() = attributes;
+}
+
+const char* launch_backend_name(LaunchBackend backend) {
+    switch (backend) {
+    case LaunchBackend::Auto: return "auto";
+    case LaunchBackend::Spawn: return "spawn";
+    case LaunchBackend::Fork: return "fork";
+    }
+    return "auto";
+}
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sched.h>
+#include <sys/types.h>
+
+// How external programs are started. Spawn goes through posix_spawn, which
+// glibc implements with clone(CLONE_VM | CLONE_VFORK): the child borrows the
+// shell's address space until exec, so launch cost does not grow with the
+// shell's RSS the way fork's page-table copy does. Fork is the fallback for
+// anything spawn cannot express.
+enum class LaunchBackend { Auto, Spawn, Fork };
+
+// One step of the child's descriptor setup, applied in order before exec
+struct FdAction {
+    enum class Kind { Dup, Open, Close };
+    Kind kind;
+    int fd;              // descriptor in the child
+    int source = -1;     // Dup: descriptor to copy onto fd
+    std::string path;    // Open: file to open onto fd
+    int flags = 0;
+    mode_t mode = 0;
+};
+
+// Where and how a child runs, beyond what it inherits from the shell.
+// posix_spawn can express none of it (glibc takes no policy but
+// SCHED_OTHER, FIFO and RR), but a child inherits all of it from the thread
+// that starts it, so the spawn backend sets it on a short-lived thread of
+// its own and spawns from there. The fork backend, and the fork fallback
+// when that thread cannot take it on, set it up in the child between fork
+// and exec.
+struct LaunchAttributes {
+    static constexpr int kMaxNodes = 1024;
+    using NodeMask = std::array<unsigned long, kMaxNodes / (8 * sizeof(unsigned long))>;
+
+    std::optional<cpu_set_t> cpus;
+    std::optional<int> nice;        // added to the shell's, as by nice(1)
+    std::optional<int> policy;      // SCHED_OTHER, SCHED_BATCH or SCHED_IDLE
+    std::optional<int> io_priority; // an ioprio_set value: class and level
+    // A set_mempolicy mode (MPOL_*) and the nodes it applies to
+    std::optional<int> memory_policy;
+    NodeMask memory_nodes{};
+
+    bool empty() const { return !cpus && !nice && !policy && !io_priority && !memory_policy; }
+};
+
+// Apply attributes to the calling process, as a child does before exec.
+// Returns the name of the call that failed, with errno set, or nullptr.
+const char* apply_launch_attributes(const LaunchAttributes& attributes);
+
+struct LaunchRequest {
+    const char* program = nullptr;
+    char* const* argv = nullptr;
+    char* const* envp = nullptr; // nullptr means the shell's environ
+    std::vector<FdAction> fd_actions;
+    // Process group to put the child in: -1 leaves it in the shell's, 0 makes
+    // it the leader of a new one, anything else joins that group
+    pid_t pgroup = -1;
+    // With a new group, hand it this terminal before exec so a foreground
+    // job can read from it at once
+    int foreground_tty = -1;
+    // nullptr means the shell-wide defaults
+    const LaunchAttributes* attributes = nullptr;
+};
+
+// Point argv at each word for exec, which never writes through argv, so
+// the words themselves serve; they must be NUL-terminated, as tokens and
+// arena strings are. append_argv adds no terminating null.
+void append_argv(std::vector<char*>& argv, const std::vector<std::string_view>& words);
+std::vector<char*> make_argv(const std::vector<std::string_view>& words);
+
+// Start a child; returns its pid, or -1 with errno set. With the spawn
+// backend exec failures are reported here rather than by the child.
+pid_t launch_process(const LaunchRequest& req);
+pid_t launch_process(const LaunchRequest& req, LaunchBackend backend);
+
+// Shell-wide backend choice, seeded from SHELL_LAUNCHER=auto|spawn|fork
+LaunchBackend launch_backend();
+void set_launch_backend(LaunchBackend backend);
+const char* launch_backend_name(LaunchBackend backend);
+
+// Shell-wide attributes for every child without its own, set by the launch
+// builtin; empty at startup
+const LaunchAttributes& launch_defaults();
+void set_launch_defaults(const LaunchAttributes& attributes);
+
+#endif
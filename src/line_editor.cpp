@@ -0,0 +1,203 @@
+#include "line_editor.hpp"
+
+#ifndef _WIN32
+
+#include "shell.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+
+#include <poll.h>
+#include <unistd.h>
+#include <readline/history.h>
+#include <readline/readline.h>
+
+namespace {
+
+// Entries of the history file handed to readline for the arrow keys
+constexpr size_t kRecallEntries = 1000;
+// History indexed per idle pass; small enough not to delay a key press
+constexpr size_t kIndexSlice = 1 << 20;
+
+constexpr int kCtrlG = 7;
+constexpr int kCtrlR = 18;
+
+LineEditor* active = nullptr;
+
+// The line handed over by the callback interface
+struct {
+    std::string* line = nullptr;
+    bool done = false;
+    bool eof = false;
+} pending;
+
+// Candidates of the completion in progress
+std::span<const CommandIndex::Entry> candidates;
+
+// Whether the word starting at start is a command name: nothing but blanks
+// between it and the start of the line or an operator
+bool command_position(int start) {
+    for (int i = start - 1; i >= 0; --i) {
+        char c = rl_line_buffer[i];
+        if (c == ' ' || c == '\t') continue;
+        return c == '|' || c == '&' || c == ';';
+    }
+    return true;
+}
+
+bool input_waiting() {
+    struct pollfd pfd{STDIN_FILENO, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// Put text in the line with the cursor on the first occurrence of query
+void show_match(std::string_view text, std::string_view query) {
+    std::string line(text);
+    rl_replace_line(line.c_str(), 0);
+    auto at = text.find(query);
+    rl_point = at == std::string_view::npos ? 0 : static_cast<int>(at);
+}
+
+} // namespace
+
+LineEditor::LineEditor(Shell& shell) : shell(shell) {
+    active = this;
+    rl_readline_name = "shell";
+    rl_attempted_completion_function = complete;
+    rl_bind_key(kCtrlR, reverse_search);
+
+    if (auto file = History::default_location(shell.vars); file && shell.history.open(*file)) {
+        for (auto entry : shell.history.recent(kRecallEntries)) add_history(std::string(entry).c_str());
+        indexing = true;
+    }
+}
+
+LineEditor::~LineEditor() {
+    rl_attempted_completion_function = nullptr;
+    active = nullptr;
+}
+
+char* LineEditor::next_command(const char*, int state) {
+    static size_t next;
+    if (state == 0) next = 0;
+    if (next >= candidates.size()) return nullptr;
+    return strdup(candidates[next++].name.c_str());
+}
+
+char** LineEditor::complete(const char* text, int start, int) {
+    if (!active || !command_position(start) || std::strchr(text, '/')) return nullptr;
+
+    // Catches up with any directory that changed since the last completion;
+    // an unchanged PATH costs one stat per directory
+    active->commands.update(active->shell.path_cache);
+    candidates = active->commands.complete(text);
+    if (candidates.empty()) return nullptr; // fall back to file names
+
+    rl_attempted_completion_over = 1;
+    char** matches = rl_completion_matches(text, next_command);
+    candidates = {};
+    return matches;
+}
+
+int LineEditor::reverse_search(int, int) {
+    if (!active || !active->shell.history.is_open()) return 0;
+    History& history = active->shell.history;
+
+    const std::string original(rl_line_buffer);
+    const int original_point = rl_point;
+    std::string query;
+    size_t match = 0;
+    bool matched = false;
+    bool failed = false;
+
+    rl_save_prompt();
+    while (true) {
+        const std::string prompt = std::string(failed ? "(failed " : "(") + "reverse-i-search)`" + query + "': ";
+        rl_set_prompt(prompt.c_str());
+        rl_redisplay();
+
+        // Where the search resumes: below the current match for another
+        // Ctrl-R, at it (it may still match) when the query grows, from the
+        // newest entry when it shrinks
+        const int key = rl_read_key();
+        size_t before;
+        if (key == kCtrlR) {
+            if (query.empty()) continue;
+            before = matched ? match : history.size();
+        } else if (key == RUBOUT || key == '\b') {
+            if (!query.empty()) query.pop_back();
+            before = history.size();
+        } else if (key == kCtrlG) {
+            rl_replace_line(original.c_str(), 0);
+            rl_point = original_point;
+            break;
+        } else if (key >= ' ' && key != RUBOUT) {
+            query += static_cast<char>(key);
+            before = matched ? match + 1 : history.size();
+        } else {
+            // Anything else ends the search on the match and does its usual
+            // job, Enter running the line
+            rl_execute_next(key);
+            break;
+        }
+
+        if (query.empty()) {
+            matched = false;
+            failed = false;
+            rl_replace_line(original.c_str(), 0);
+            rl_point = original_point;
+            continue;
+        }
+        auto found = history.search_back(query, before);
+        // Another Ctrl-R skips entries the same as the one shown
+        if (key == kCtrlR) {
+            const std::string shown(rl_line_buffer);
+            while (found && history.entry(*found) == shown) found = history.search_back(query, *found);
+        }
+        if (found) {
+            match = *found;
+            matched = true;
+            failed = false;
+            show_match(history.entry(*found), query);
+        } else {
+            failed = true;
+        }
+    }
+    rl_restore_prompt();
+    rl_redisplay();
+    return 0;
+}
+
+void LineEditor::line_ready(char* text) {
+    rl_callback_handler_remove();
+    if (!text) {
+        pending.eof = true;
+    } else {
+        pending.line->assign(text);
+        if (*text) {
+            add_history(text);
+            if (active) active->shell.history.add(text);
+        }
+        std::free(text);
+    }
+    pending.done = true;
+}
+
+bool LineEditor::read(const char* prompt, std::string& line) {
+    pending.line = &line;
+    pending.done = false;
+    pending.eof = false;
+    rl_callback_handler_install(prompt, line_ready);
+    while (!pending.done) {
+        while (indexing && !input_waiting()) indexing = shell.history.index_step(kIndexSlice);
+        // Sleep in epoll rather than read(), so children exiting while the
+        // user types are reaped straight away
+        shell.jobs.wait_readable(STDIN_FILENO);
+        rl_callback_read_char();
+    }
+    return !pending.eof;
+}
+
+#endif
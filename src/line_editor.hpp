@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <string>
+
+#include "command_index.hpp"
+
+struct Shell;
+
+// Interactive input through readline: line editing, history, and tab
+// completion. A word in command position completes from the CommandIndex,
+// anything else (or a word with a '/') as a file name. Every line goes into
+// the shared History; the arrow keys recall the latest of it, and Ctrl-R
+// searches all of it through its index. Lines are read through readline's
+// callback interface, so the shell keeps reaping jobs while the user types
+// and indexes the history while the user is idle. readline is global, so
+// there is at most one editor.
+class LineEditor {
+    Shell& shell;
+    CommandIndex commands;
+    bool indexing = false; // history index still being built
+
+    static char** complete(const char* text, int start, int end);
+    static char* next_command(const char* text, int state);
+    static void line_ready(char* text);
+    static int reverse_search(int count, int key);
+
+public:
+    explicit LineEditor(Shell& shell);
+    ~LineEditor();
+
+    LineEditor(const LineEditor&) = delete;
+    LineEditor& operator=(const LineEditor&) = delete;
+
+    // Prompt for a line; false at end of input
+    bool read(const char* prompt, std::string& line);
+};
+
+#endif
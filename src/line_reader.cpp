@@ -0,0 +1,132 @@
+#include "line_reader.hpp"
+#include "platform.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+constexpr size_t kBlockSize = 1 << 20;
+
+} // namespace
+
+LineReader::LineReader(std::string_view text) : text_(text) {}
+
+LineReader::LineReader(int fd, bool owns_fd) : owns_fd_(owns_fd) {
+#ifndef _WIN32
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // Start from the current offset so `shell < file` after a partial
+        // read by someone else still sees the rest
+        off_t start = lseek(fd, 0, SEEK_CUR);
+        if (start < 0) start = 0;
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size == 0 || static_cast<size_t>(start) >= size) {
+            if (owns_fd_) close(fd);
+            owns_fd_ = false;
+            return; // empty text
+        }
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, size, MADV_SEQUENTIAL);
+            mapping_ = p;
+            mapping_size_ = size;
+            text_ = std::string_view(static_cast<const char*>(p), size);
+            pos_ = static_cast<size_t>(start);
+            if (owns_fd_) close(fd);
+            owns_fd_ = false;
+            return;
+        }
+    }
+#endif
+    fd_ = fd;
+    buf_.resize(kBlockSize);
+}
+
+LineReader::~LineReader() {
+#ifndef _WIN32
+    if (mapping_) munmap(mapping_, mapping_size_);
+    if (owns_fd_ && fd_ >= 0) close(fd_);
+#else
+    if (owns_fd_ && fd_ >= 0) _close(fd_);
+#endif
+}
+
+std::unique_ptr<LineReader> LineReader::open(const char* path) {
+#ifdef _WIN32
+    int fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+    int fd = private_fd(::open(path, O_RDONLY | O_CLOEXEC));
+#endif
+    if (fd < 0) return nullptr;
+    return std::make_unique<LineReader>(fd, true);
+}
+
+bool LineReader::next(std::string_view& line) {
+    if (fd_ >= 0) return next_block_line(line);
+
+    if (pos_ >= text_.size()) return false;
+    const char* start = text_.data() + pos_;
+    size_t left = text_.size() - pos_;
+    const void* nl = std::memchr(start, '\n', left);
+    size_t len = nl ? static_cast<size_t>(static_cast<const char*>(nl) - start) : left;
+    line = std::string_view(start, len);
+    pos_ += nl ? len + 1 : len;
+    return true;
+}
+
+bool LineReader::next_block_line(std::string_view& line) {
+    while (true) {
+        if (begin_ < end_) {
+            const char* start = buf_.data() + begin_;
+            if (const void* nl = std::memchr(start, '\n', end_ - begin_)) {
+                size_t len = static_cast<size_t>(static_cast<const char*>(nl) - start);
+                line = std::string_view(start, len);
+                begin_ += len + 1;
+                return true;
+            }
+        }
+        if (eof_) {
+            if (begin_ >= end_) return false;
+            line = std::string_view(buf_.data() + begin_, end_ - begin_);
+            begin_ = end_;
+            return true;
+        }
+
+        // Move the partial line to the front, growing only for a line
+        // longer than the whole buffer
+        if (begin_ > 0) {
+            std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buf_.size()) buf_.resize(buf_.size() * 2);
+
+#ifdef _WIN32
+        int n = _read(fd_, buf_.data() + end_, static_cast<unsigned>(buf_.size() - end_));
+#else
+        ssize_t n = read(fd_, buf_.data() + end_, buf_.size() - end_);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            eof_ = true;
+            continue;
+        }
+        end_ += static_cast<size_t>(n);
+    }
+}
+
+bool LineReader::exhausted() const {
+    if (fd_ >= 0) return false;
+    return text_.find_first_not_of(" \t\r\n", pos_) == std::string_view::npos;
+}
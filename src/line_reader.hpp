@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Hands out the lines of a script as views into one buffer, with no copy or
+// allocation per line. Regular files are mapped whole; pipes and other
+// unmappable input are read in large blocks.
+class LineReader {
+public:
+    // Text already in memory, such as a -c string; it must outlive the reader
+    explicit LineReader(std::string_view text);
+    // Map fd if it is a regular file, otherwise read it in blocks. The reader
+    // closes fd only when owns_fd is set.
+    LineReader(int fd, bool owns_fd);
+    ~LineReader();
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    // Open a script file; nullptr with errno set on failure
+    static std::unique_ptr<LineReader> open(const char* path);
+
+    // The next line without its newline. The view stays valid until the
+    // following call.
+    bool next(std::string_view& line);
+
+    // True when only blank lines remain. Block-read input cannot see ahead
+    // and always answers false.
+    bool exhausted() const;
+
+private:
+    std::string_view text_;          // mapped file or borrowed text
+    size_t pos_ = 0;
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+
+    int fd_ = -1;                    // block mode when >= 0
+    bool owns_fd_ = false;
+    bool eof_ = false;
+    std::vector<char> buf_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+
+    bool next_block_line(std::string_view& line);
+};
@@ -0,0 +1,300 @@
+#include "output.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+namespace {
+
+// Blocks flushed with a plain write are kept for the next builtin; blocks
+// given away with vmsplice are not, as the pipe still references their pages
+constexpr size_t kPoolLimit = 8;
+// Flush once this many blocks are pending so big outputs stream
+constexpr size_t kMaxPendingBlocks = 16;
+
+thread_local std::vector<char*> block_pool;
+
+char* acquire_block() {
+    if (!block_pool.empty()) {
+        char* b = block_pool.back();
+        block_pool.pop_back();
+        return b;
+    }
+#ifdef _WIN32
+    char* b = static_cast<char*>(std::malloc(Output::kBlockSize));
+    if (!b) std::abort();
+    return b;
+#else
+    void* b = mmap(nullptr, Output::kBlockSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED) std::abort();
+    return static_cast<char*>(b);
+#endif
+}
+
+void free_block(char* b) {
+#ifdef _WIN32
+    std::free(b);
+#else
+    munmap(b, Output::kBlockSize);
+#endif
+}
+
+#ifndef _WIN32
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+#endif
+
+void release_block(char* b) {
+    if (block_pool.size() < kPoolLimit) {
+        block_pool.push_back(b);
+    } else {
+        free_block(b);
+    }
+}
+
+} // namespace
+
+Output::Output(int fd) : fd_(fd) {}
+
+Output::Output(std::string& capture) : fd_(-1), capture_(&capture) {}
+
+Output::~Output() {
+    flush();
+    for (auto& b : blocks_) release_block(b.data);
+}
+
+Output::Block& Output::writable_block() {
+    if (blocks_.empty() || blocks_.back().used == kBlockSize) {
+        blocks_.push_back({acquire_block(), 0});
+    }
+    return blocks_.back();
+}
+
+void Output::write(std::string_view s) {
+    if (capture_) {
+        capture_->append(s);
+        return;
+    }
+    while (!s.empty()) {
+        Block& b = writable_block();
+        size_t n = std::min(s.size(), kBlockSize - b.used);
+        std::memcpy(b.data + b.used, s.data(), n);
+        b.used += n;
+        pending_ += n;
+        s.remove_prefix(n);
+        if (blocks_.size() >= kMaxPendingBlocks && blocks_.back().used == kBlockSize) flush();
+    }
+}
+
+Output& Output::operator<<(long long n) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), n);
+    write(std::string_view(buf, res.ptr - buf));
+    return *this;
+}
+
+Output& Output::operator<<(unsigned long long n) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), n);
+    write(std::string_view(buf, res.ptr - buf));
+    return *this;
+}
+
+bool Output::flush() {
+    if (capture_) return true;
+    if (pending_ == 0) return !failed_;
+
+    bool ok = false;
+    if (failed_) {
+        for (auto& b : blocks_) release_block(b.data);
+        blocks_.clear();
+    } else {
+#ifndef _WIN32
+        if (pending_ >= kBlockSize && !pipe_checked_) {
+            struct stat st{};
+            is_pipe_ = fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode);
+            pipe_checked_ = true;
+        }
+        ok = (is_pipe_ && pending_ >= kBlockSize) ? vmsplice_blocks() : write_blocks();
+#else
+        ok = write_blocks();
+#endif
+    }
+    pending_ = 0;
+    if (!ok) failed_ = true;
+    return ok;
+}
+
+bool Output::write_blocks() {
+    bool ok = true;
+#ifdef _WIN32
+    for (auto& b : blocks_) {
+        size_t off = 0;
+        while (ok && off < b.used) {
+            int n = _write(fd_, b.data + off, static_cast<unsigned>(b.used - off));
+            if (n < 0) ok = false; else off += n;
+        }
+    }
+#else
+    std::vector<struct iovec> iov;
+    iov.reserve(blocks_.size());
+    for (auto& b : blocks_) {
+        if (b.used) iov.push_back({b.data, b.used});
+    }
+    size_t first = 0;
+    while (first < iov.size()) {
+        ssize_t n = writev(fd_, iov.data() + first,
+                           static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX)));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        // Skip whatever went out, possibly ending inside a block
+        size_t done = static_cast<size_t>(n);
+        while (first < iov.size() && done >= iov[first].iov_len) {
+            done -= iov[first].iov_len;
+            ++first;
+        }
+        if (first < iov.size()) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+            iov[first].iov_len -= done;
+        }
+    }
+#endif
+    for (auto& b : blocks_) release_block(b.data);
+    blocks_.clear();
+    return ok;
+}
+
+#ifndef _WIN32
+bool Output::vmsplice_blocks() {
+    bool ok = true;
+    size_t b = 0;
+    for (; ok && b < blocks_.size(); ++b) {
+        struct iovec iov{blocks_[b].data, blocks_[b].used};
+        while (iov.iov_len > 0) {
+            ssize_t n = vmsplice(fd_, &iov, 1, SPLICE_F_GIFT);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                // Not spliceable after all: send this block's remainder and
+                // the blocks after it the normal way
+                if (errno == EINVAL || errno == ENOSYS) {
+                    is_pipe_ = false;
+                    bool rest_ok = write_all(fd_, static_cast<const char*>(iov.iov_base), iov.iov_len);
+                    free_block(blocks_[b].data);
+                    blocks_.erase(blocks_.begin(), blocks_.begin() + b + 1);
+                    return write_blocks() && rest_ok;
+                }
+                ok = false;
+                break;
+            }
+            iov.iov_base = static_cast<char*>(iov.iov_base) + n;
+            iov.iov_len -= static_cast<size_t>(n);
+        }
+        // The pipe holds its own references to these pages; unmapping only
+        // drops ours, and the block must never be written again
+        free_block(blocks_[b].data);
+    }
+    for (; b < blocks_.size(); ++b) release_block(blocks_[b].data);
+    blocks_.clear();
+    return ok;
+}
+#endif
+
+bool Output::splice_from(int in_fd) {
+    if (!flush()) return false;
+
+#ifndef _WIN32
+    if (capture_) {
+        // Read straight into the string, as much as its capacity allows, so
+        // reads grow as the string does
+        while (true) {
+            const size_t old = capture_->size();
+            const size_t room = std::max(kBlockSize, capture_->capacity() - old);
+            ssize_t n = 0;
+            capture_->resize_and_overwrite(old + room, [&](char* data, size_t) {
+                do {
+                    n = read(in_fd, data + old, room);
+                } while (n < 0 && errno == EINTR);
+                return old + static_cast<size_t>(std::max<ssize_t>(n, 0));
+            });
+            if (n == 0) return true;
+            if (n < 0) return false;
+        }
+    }
+
+    struct stat in_st{}, out_st{};
+    if (fstat(in_fd, &in_st) != 0 || fstat(fd_, &out_st) != 0) return false;
+
+    bool moved_any = false;
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+        while (true) {
+            ssize_t n = splice(in_fd, nullptr, fd_, nullptr, 1 << 20, SPLICE_F_MOVE);
+            if (n > 0) { moved_any = true; continue; }
+            if (n == 0) return true;
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && !moved_any) break; // fall back below
+            if (errno == EPIPE) failed_ = true;
+            return false;
+        }
+    } else if (S_ISREG(in_st.st_mode)) {
+        while (true) {
+            ssize_t n = sendfile(fd_, in_fd, nullptr, 1 << 20);
+            if (n > 0) { moved_any = true; continue; }
+            if (n == 0) return true;
+            if (errno == EINTR) continue;
+            if ((errno == EINVAL || errno == ENOSYS) && !moved_any) break;
+            if (errno == EPIPE) failed_ = true;
+            return false;
+        }
+    }
+
+    // Plain copy through one of our blocks
+    while (true) {
+        Block& b = writable_block();
+        ssize_t n = read(in_fd, b.data + b.used, kBlockSize - b.used);
+        if (n == 0) return true;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        b.used += static_cast<size_t>(n);
+        pending_ += static_cast<size_t>(n);
+        if (!flush()) return false;
+    }
+#else
+    char buf[4096];
+    while (true) {
+        int n = _read(in_fd, buf, sizeof(buf));
+        if (n == 0) return true;
+        if (n < 0) return false;
+        write(std::string_view(buf, n));
+    }
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Batched writer the builtins use instead of std::cout. Bytes collect in
+// page-aligned blocks and go out with one writev per flush. When the target
+// is a pipe and at least a full block is pending, the blocks are handed to
+// the pipe with vmsplice instead, so the payload is never copied through
+// the kernel; those pages then belong to the pipe and are not reused.
+//
+// An Output made over a string captures instead: everything written is
+// appended to the string and flushing does nothing. fd() is then -1.
+class Output {
+public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    explicit Output(int fd);
+    explicit Output(std::string& capture);
+    ~Output();
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void write(std::string_view s);
+    Output& operator<<(std::string_view s) { write(s); return *this; }
+    Output& operator<<(const std::string& s) { write(s); return *this; }
+    Output& operator<<(const char* s) { write(s); return *this; }
+    Output& operator<<(char c) { write(std::string_view(&c, 1)); return *this; }
+    Output& operator<<(long long n);
+    Output& operator<<(unsigned long long n);
+    Output& operator<<(int n) { return *this << static_cast<long long>(n); }
+    Output& operator<<(long n) { return *this << static_cast<long long>(n); }
+    Output& operator<<(unsigned long n) { return *this << static_cast<unsigned long long>(n); }
+
+    // Copy everything readable from in_fd to the target: splice when either
+    // side is a pipe, sendfile from regular files, read/write otherwise
+    bool splice_from(int in_fd);
+
+    // Push pending bytes to the descriptor; false once a write has failed
+    bool flush();
+    // Flush and return the descriptor, for children that are to write to it
+    // too: what was written so far then comes out ahead of their output.
+    // -1 when capturing.
+    int flush_for_children() {
+        flush();
+        return fd_;
+    }
+
+    bool failed() const { return failed_; }
+    int fd() const { return fd_; }
+
+private:
+    struct Block {
+        char* data;
+        size_t used;
+    };
+
+    int fd_;
+    std::string* capture_ = nullptr;
+    bool is_pipe_ = false;
+    bool pipe_checked_ = false;
+    bool failed_ = false;
+    std::vector<Block> blocks_;
+    size_t pending_ = 0;
+
+    Block& writable_block();
+    bool write_blocks();
+    bool vmsplice_blocks();
+};
@@ -0,0 +1,337 @@
+#include "parallel.hpp"
+
+#ifndef _WIN32
+
+#include "builtins.hpp"
+#include "jobs.hpp"
+#include "launcher.hpp"
+#include "line_reader.hpp"
+#include "output.hpp"
+#include "placement.hpp"
+#include "shell.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+namespace {
+
+// Failed-job counts are reported like GNU parallel's, which stops at 101
+constexpr int kMaxFailureStatus = 101;
+// A job killed by ^C stops the run, which then reports what the shell
+// reports for any interrupted command
+constexpr int kInterrupted = 128 + SIGINT;
+
+// One worker's queue of input indices. The owner takes from the front;
+// a worker that runs dry steals the back half of someone else's, so the
+// load evens out however long the individual commands take. A lock per
+// queue is plenty: every item costs a process launch.
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<size_t> items;
+};
+
+bool next_item(std::deque<WorkQueue>& queues, size_t self, size_t& item) {
+    {
+        std::lock_guard guard(queues[self].lock);
+        if (!queues[self].items.empty()) {
+            item = queues[self].items.front();
+            queues[self].items.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t k = 1; k < queues.size(); ++k) {
+        WorkQueue& victim = queues[(self + k) % queues.size()];
+        std::deque<size_t> stolen;
+        {
+            std::lock_guard guard(victim.lock);
+            size_t take = (victim.items.size() + 1) / 2;
+            if (take == 0) continue;
+            stolen.assign(victim.items.end() - static_cast<std::ptrdiff_t>(take), victim.items.end());
+            victim.items.resize(victim.items.size() - take);
+        }
+        item = stolen.front();
+        stolen.pop_front();
+        if (!stolen.empty()) {
+            std::lock_guard guard(queues[self].lock);
+            queues[self].items.insert(queues[self].items.end(), stolen.begin(), stolen.end());
+        }
+        return true;
+    }
+    return false;
+}
+
+struct JobResult {
+    int status = 0;
+    int error = 0;     // errno from a launch that failed
+    int output = -1;   // memfd holding the job's output, with -k
+    bool done = false;
+};
+
+struct ParallelRun {
+    std::string program;                    // resolved once, up front
+    std::shared_ptr<const Environment> environment;
+    std::vector<std::string_view> command;  // the template
+    std::vector<std::string> inputs;
+    bool has_placeholder = false;
+    bool keep_order = false;
+    // With --spread-nodes, one per node; input i runs with i's modulo
+    std::vector<LaunchAttributes> placements;
+    int out_fd = STDOUT_FILENO;
+    int null_fd = -1;
+    pid_t pgroup = -1; // the job's, so that ^C reaches the children
+
+    // Set once a job dies of SIGINT; no input is dealt out after that
+    std::atomic<bool> interrupted{false};
+
+    std::deque<WorkQueue> queues; // a deque, as mutexes cannot move
+    std::vector<JobResult> results;
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+};
+
+void replace_placeholders(std::string_view arg, std::string_view input, std::string& out) {
+    size_t pos = 0;
+    while (true) {
+        size_t hit = arg.find("{}", pos);
+        if (hit == std::string_view::npos) break;
+        out.append(arg.substr(pos, hit - pos));
+        out.append(input);
+        pos = hit + 2;
+    }
+    out.append(arg.substr(pos));
+}
+
+void run_one(ParallelRun& run, size_t index) {
+    const std::string& input = run.inputs[index];
+    JobResult result;
+
+    std::vector<std::string> words;
+    words.reserve(run.command.size() + 1);
+    for (const auto& arg : run.command) {
+        words.emplace_back();
+        if (run.has_placeholder) {
+            replace_placeholders(arg, input, words.back());
+        } else {
+            words.back().assign(arg);
+        }
+    }
+    if (!run.has_placeholder) words.push_back(input);
+
+    std::vector<char*> argv;
+    argv.reserve(words.size() + 1);
+    for (auto& word : words) argv.push_back(word.data());
+    argv.push_back(nullptr);
+
+    LaunchRequest req;
+    req.program = run.program.c_str();
+    req.argv = argv.data();
+    req.envp = run.environment->envp();
+    if (!run.placements.empty()) req.attributes = &run.placements[index % run.placements.size()];
+    // The inputs may be arriving on stdin; the jobs must not eat them
+    if (run.null_fd >= 0) req.fd_actions.push_back({FdAction::Kind::Dup, STDIN_FILENO, run.null_fd});
+    req.pgroup = run.pgroup;
+    if (run.keep_order) {
+        // A memfd never fills up, so a chatty job cannot stall waiting for
+        // its turn to be printed
+        result.output = memfd_create("parallel", MFD_CLOEXEC);
+        if (result.output >= 0) {
+            req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, result.output});
+        }
+    } else if (run.out_fd != STDOUT_FILENO) {
+        req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, run.out_fd});
+    }
+
+    pid_t pid;
+    {
+        TraceSpan span(TracePhase::Spawn, words.front());
+        pid = launch_process(req);
+    }
+    if (pid < 0) {
+        result.error = errno;
+        result.status = 127;
+    } else {
+        TraceSpan span(TracePhase::Wait, words.front());
+        const int status = wait_child(pid);
+        result.status = decode_wait_status(status);
+        if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) run.interrupted = true;
+    }
+
+    std::lock_guard guard(run.done_lock);
+    result.done = true;
+    run.results[index] = result;
+    if (run.keep_order) run.done_cv.notify_one();
+}
+
+void worker(ParallelRun& run, size_t self) {
+    size_t item;
+    while (!run.interrupted && next_item(run.queues, self, item)) run_one(run, item);
+}
+
+} // namespace
+
+size_t usable_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        int n = CPU_COUNT(&set);
+        if (n > 0) return static_cast<size_t>(n);
+    }
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? static_cast<size_t>(n) : 1;
+}
+
+int builtin_parallel(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    ParallelRun run;
+    size_t jobs = usable_cpus();
+    bool spread = false;
+
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+        const auto& arg = args[i];
+        if (arg == "--") {
+            ++i;
+            break;
+        }
+        if (arg == "-k" || arg == "--keep-order") {
+            run.keep_order = true;
+        } else if (arg == "--spread-nodes") {
+            spread = true;
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (i + 1 >= args.size() || !parse_count(args[i + 1], jobs)) {
+                io.err << "parallel: " << arg << ": expected a number of jobs\n";
+                return 2;
+            }
+            ++i;
+        } else if (arg.starts_with("-j") && parse_count(arg.substr(2), jobs)) {
+            // -j8
+        } else {
+            io.err << "parallel: " << arg << ": invalid option\n";
+            return 2;
+        }
+    }
+
+    const size_t command_begin = i;
+    while (i < args.size() && args[i] != ":::") ++i;
+    run.command.assign(args.begin() + static_cast<std::ptrdiff_t>(command_begin),
+                       args.begin() + static_cast<std::ptrdiff_t>(i));
+    if (run.command.empty()) {
+        io.err << "parallel: usage: parallel [-j N] [-k] [--spread-nodes] command [args...] [::: inputs...]\n";
+        return 2;
+    }
+    if (i < args.size()) {
+        for (++i; i < args.size(); ++i) run.inputs.emplace_back(args[i]);
+    } else {
+        LineReader reader(io.in, false);
+        std::string_view line;
+        while (reader.next(line)) run.inputs.emplace_back(line);
+    }
+    if (run.inputs.empty()) return 0;
+
+    for (const auto& arg : run.command) {
+        if (arg.find("{}") != std::string_view::npos) run.has_placeholder = true;
+    }
+    if (run.command[0].find("{}") != std::string_view::npos) {
+        io.err << "parallel: the command name cannot contain {}\n";
+        return 2;
+    }
+    auto path = shell.path_cache.find(std::string(run.command[0]));
+    if (path.empty()) {
+        io.err << "parallel: " << run.command[0] << ": command not found\n";
+        return 127;
+    }
+    run.program = path.string();
+    run.environment = shell.vars.environment();
+    if (spread) run.placements = spread_over_nodes(launch_defaults());
+
+    run.out_fd = io.out.flush_for_children();
+    run.pgroup = io.pgroup;
+    run.null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    if (jobs == 0 || jobs > run.inputs.size()) jobs = run.inputs.size();
+    for (size_t w = 0; w < jobs; ++w) run.queues.emplace_back();
+    run.results.resize(run.inputs.size());
+    // Deal the inputs round-robin, so jobs finish roughly in input order
+    // and -k output can stream instead of piling up behind one worker
+    for (size_t item = 0; item < run.inputs.size(); ++item) {
+        run.queues[item % jobs].items.push_back(item);
+    }
+
+    // Worker 0 is this thread; the rest launch their children concurrently,
+    // so launch throughput grows with the number of cores. Should the
+    // system refuse a thread (say, under ulimit -v), the workers already
+    // running steal the queues of those that never started.
+    std::vector<std::thread> threads;
+    threads.reserve(jobs - 1);
+    try {
+        for (size_t w = 1; w < jobs; ++w) threads.emplace_back(worker, std::ref(run), w);
+    } catch (const std::system_error&) {
+    }
+
+    if (run.keep_order) {
+        // Print each job's output as soon as it and every job before it are
+        // done; a spare thread runs jobs meanwhile, or without one this
+        // thread runs them all first
+        std::thread own;
+        try {
+            own = std::thread(worker, std::ref(run), 0);
+        } catch (const std::system_error&) {
+            worker(run, 0);
+        }
+        for (size_t item = 0; item < run.results.size(); ++item) {
+            int fd;
+            {
+                std::unique_lock guard(run.done_lock);
+                run.done_cv.wait(guard, [&] { return run.results[item].done || run.interrupted; });
+                if (!run.results[item].done) break;
+                fd = run.results[item].output;
+                run.results[item].output = -1;
+            }
+            if (fd < 0) continue;
+            lseek(fd, 0, SEEK_SET);
+            io.out.splice_from(fd);
+            close(fd);
+        }
+        if (own.joinable()) own.join();
+    } else {
+        worker(run, 0);
+    }
+    for (auto& t : threads) t.join();
+    if (run.null_fd >= 0) close(run.null_fd);
+    if (run.interrupted) {
+        // Output held back for jobs after the interrupted one goes unprinted
+        for (const JobResult& result : run.results) {
+            if (result.output >= 0) close(result.output);
+        }
+        return kInterrupted;
+    }
+
+    int failed = 0;
+    for (size_t item = 0; item < run.results.size(); ++item) {
+        const JobResult& result = run.results[item];
+        if (result.error) {
+            io.err << "parallel: " << run.command[0] << ": " << std::strerror(result.error) << '\n';
+        }
+        if (result.status != 0) ++failed;
+    }
+    return std::min(failed, kMaxFailureStatus);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "builtins.hpp"
+
+// Processors the shell may run on: its affinity mask, or failing that
+// every online one
+size_t usable_cpus();
+
+// parallel [-j N] [-k] [--spread-nodes] command [args...] [::: inputs...]
+//
+// Run command once per input, {} in an argument standing for the input
+// (which is appended when no argument has one). Inputs come after :::, or
+// one per line from standard input. N children are kept in flight, by
+// default one per CPU the shell may run on. Output is interleaved as the
+// children write it, or with -k held back and emitted in input order.
+// --spread-nodes deals the children round-robin over the NUMA nodes, each
+// on its node's CPUs and preferring its memory.
+// Returns the number of jobs that failed, capped at 101, or 130 once a job
+// killed by ^C has stopped the rest.
+int builtin_parallel(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+#endif
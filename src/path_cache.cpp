@@ -0,0 +1,612 @@
+#include "path_cache.hpp"
+#include "platform.hpp"
+#include "variables.hpp"
+#include "working_directory.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+#ifndef _WIN32
+#include "statx_batch.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#endif
+
+bool PathCache::environment_changed() {
+#ifdef _WIN32
+    auto path_val = get_wenv(L"PATH");
+    auto pathext_val = get_wenv(L"PATHEXT");
+    bool changed = (!path_val || wide_to_utf8(*path_val) != last_path_value) ||
+                  (!pathext_val || wide_to_utf8(*pathext_val) != last_pathext_value);
+    if (changed) {
+        last_path_value = path_val ? wide_to_utf8(*path_val) : "";
+        last_pathext_value = pathext_val ? wide_to_utf8(*pathext_val) : "";
+        path_directories = get_path_directories();
+        executable_extensions = get_executable_extensions();
+        forget_resolved();
+    }
+    return changed;
+#else
+    std::optional<std::string> path_val;
+    if (!variables) {
+        path_val = get_env("PATH");
+    } else if (const std::string* value = variables->get("PATH"); value && !value->empty()) {
+        path_val = *value;
+    }
+    bool changed = (!path_val || *path_val != last_path_value);
+    if (changed) {
+        last_path_value = path_val ? *path_val : "";
+        path_directories = get_path_directories(last_path_value);
+        executable_extensions = get_executable_extensions();
+        forget_resolved();
+
+        // Snapshots are read lazily by the first sweep
+        snapshots.clear();
+        snapshots.resize(path_directories.size());
+        for (size_t i = 0; i < path_directories.size(); ++i) {
+            snapshots[i].dir = path_directories[i];
+        }
+        index.clear();
+        index_built = false;
+
+        // A saved index is for one PATH; look again under the new one
+        persisted.close();
+        persisted_checked = false;
+        use_persisted = false;
+    }
+    return changed;
+#endif
+}
+
+#ifndef _WIN32
+namespace {
+
+// What a sweep needs to know of a directory, and of a candidate program
+constexpr unsigned kStatxMask = STATX_TYPE | STATX_MODE | STATX_INO | STATX_MTIME;
+
+// Whether a directory no longer matches its snapshot, given a fresh statx
+bool stale(const DirSnapshot& snap, const StatxResult& now) {
+    if (now.error != 0 || !S_ISDIR(now.st.stx_mode)) return snap.present;
+    return !snap.present || snap.racy ||
+           makedev(now.st.stx_dev_major, now.st.stx_dev_minor) != snap.dev || now.st.stx_ino != snap.ino ||
+           now.st.stx_mtime.tv_sec != snap.mtime.tv_sec ||
+           now.st.stx_mtime.tv_nsec != static_cast<uint32_t>(snap.mtime.tv_nsec);
+}
+
+// Filesystems where a stat goes to a server: NFS, SMB/CIFS, FUSE, 9p,
+// Ceph, AFS and Lustre
+bool network_filesystem(const struct statfs& fs) {
+    switch (static_cast<unsigned long>(fs.f_type)) {
+    case 0x6969:     // NFS
+    case 0x517b:     // SMB
+    case 0xff534d42: // CIFS
+    case 0xfe534d42: // SMB2
+    case 0x65735546: // FUSE
+    case 0x01021997: // 9p
+    case 0x00c36400: // Ceph
+    case 0x5346414f: // AFS
+    case 0x6b414653: // kAFS
+    case 0x0bd00bd0: // Lustre
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether a candidate's statx shows a regular file we may execute
+bool executable(const StatxResult& now, const std::string& path) {
+    if (now.error != 0 || !S_ISREG(now.st.stx_mode) || (now.st.stx_mode & 0111) == 0) return false;
+    return (now.st.stx_mode & 0111) == 0111 || access(path.c_str(), X_OK) == 0;
+}
+
+} // namespace
+
+std::vector<std::string> PathCache::rebuild_snapshot(DirSnapshot& snap) {
+    ++counters.rebuilds;
+    snap.present = false;
+    snap.racy = false;
+    std::vector<std::string> previous = std::move(snap.executables);
+    snap.executables.clear();
+    read_directory(snap);
+    // Sorted, so that the lists of one directory diff in a single walk
+    std::sort(snap.executables.begin(), snap.executables.end());
+    // A racy directory is re-read on every sweep; its version only moves
+    // if something in it did
+    if (snap.version == 0 || snap.executables != previous) snap.version = ++last_version;
+    return previous;
+}
+
+void PathCache::read_directory(DirSnapshot& snap) {
+    int dfd = open(snap.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return;
+
+    // Take the identity before reading so a concurrent change shows up as a
+    // newer mtime on the next sweep rather than being lost
+    struct stat st{};
+    if (fstat(dfd, &st) != 0) {
+        close(dfd);
+        return;
+    }
+    snap.dev = st.st_dev;
+    snap.ino = st.st_ino;
+    snap.mtime = st.st_mtim;
+    snap.present = true;
+    struct statfs sfs{};
+    snap.remote = fstatfs(dfd, &sfs) == 0 && network_filesystem(sfs);
+
+    // A change landing in the same timestamp tick as this read would leave
+    // the mtime untouched, so a freshly modified directory is re-read once more
+    struct timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    snap.racy = now.tv_sec - snap.mtime.tv_sec <= 1;
+
+    DIR* d = fdopendir(dfd);
+    if (!d) {
+        close(dfd);
+        return;
+    }
+    while (struct dirent* e = readdir(d)) {
+        const char* name = e->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        // Only regular files (or links that may point at one) can be executables
+        if (e->d_type != DT_REG && e->d_type != DT_LNK && e->d_type != DT_UNKNOWN) continue;
+
+        struct stat est{};
+        if (fstatat(dfd, name, &est, 0) != 0 || !S_ISREG(est.st_mode)) continue;
+        if ((est.st_mode & 0111) == 0) continue;
+        // Executable by everyone needs no permission check against our ids
+        if ((est.st_mode & 0111) != 0111 && faccessat(dfd, name, X_OK, 0) != 0) continue;
+
+        snap.executables.emplace_back(name);
+    }
+    closedir(d); // also closes dfd
+}
+
+bool PathCache::snapshot_stale(const DirSnapshot& snap) const {
+    StatxResult now;
+    if (statx(AT_FDCWD, snap.dir.c_str(), 0, kStatxMask, &now.st) != 0) now.error = errno;
+    return stale(snap, now);
+}
+
+bool PathCache::refresh_snapshot(size_t pos) {
+    if (!snapshot_stale(snapshots[pos])) return false;
+    if (use_persisted) drop_persisted();
+    auto previous = rebuild_snapshot(snapshots[pos]);
+    if (index_built) {
+        update_index(static_cast<uint32_t>(pos), previous);
+    } else {
+        rebuild_index();
+    }
+    save_persisted();
+    return true;
+}
+
+bool PathCache::sweep(const std::string* cmd, fs::path* found) {
+    ++counters.sweeps;
+    // A local directory answers a stat from memory, sooner than a batch is
+    // handed out. On a network filesystem each stat is a round trip, and in
+    // one batch they overlap instead of adding up.
+    const size_t n = snapshots.size();
+    const bool batched = std::any_of(snapshots.begin(), snapshots.end(),
+                                     [](const DirSnapshot& snap) { return snap.remote; });
+    std::vector<StatxResult> results;
+    if (batched) {
+        std::vector<std::string> candidates;
+        std::vector<const char*> paths;
+        paths.reserve(cmd ? 2 * n : n);
+        for (const auto& snap : snapshots) paths.push_back(snap.dir.c_str());
+        if (cmd) {
+            candidates.reserve(n);
+            for (const auto& snap : snapshots) candidates.push_back((snap.dir / *cmd).string());
+            for (const auto& candidate : candidates) paths.push_back(candidate.c_str());
+        }
+        results.resize(paths.size());
+        statx_batch(paths, kStatxMask, results);
+
+        // The first hit in PATH order, even in a directory whose listing
+        // has not changed (a program made executable in place)
+        for (size_t pos = 0; cmd && found && pos < n; ++pos) {
+            if (!executable(results[n + pos], candidates[pos])) continue;
+            try {
+                *found = fs::weakly_canonical(candidates[pos]);
+            } catch (const fs::filesystem_error&) {}
+            break;
+        }
+    }
+
+    bool changed = false;
+    for (uint32_t pos = 0; pos < n; ++pos) {
+        if (batched ? stale(snapshots[pos], results[pos]) : snapshot_stale(snapshots[pos])) {
+            if (use_persisted) drop_persisted();
+            auto previous = rebuild_snapshot(snapshots[pos]);
+            if (index_built) update_index(pos, previous);
+            changed = true;
+        }
+    }
+    if (changed) {
+        if (!index_built) rebuild_index();
+        save_persisted();
+    }
+    return changed;
+}
+
+void PathCache::load_persisted() {
+    persisted_checked = true;
+    auto location = PathIndexFile::default_location();
+    if (!location || !persisted.open(*location)) return;
+
+    // Adopt every directory whose identity and mtime still match its record.
+    // The stat here is the same one a sweep would make; nothing is read.
+    const bool same_path = persisted.path_value() == last_path_value &&
+                           persisted.dir_count() == snapshots.size();
+    bool all_adopted = same_path;
+    std::vector<size_t> adopted(snapshots.size(), SIZE_MAX);
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        DirSnapshot& snap = snapshots[i];
+        const std::string dir = snap.dir.string();
+        size_t rec = SIZE_MAX;
+        if (same_path) {
+            if (persisted.dir(i).dir == dir) rec = i;
+        } else {
+            for (size_t r = 0; r < persisted.dir_count(); ++r) {
+                if (persisted.dir(r).dir == dir) {
+                    rec = r;
+                    break;
+                }
+            }
+        }
+
+        if (rec == SIZE_MAX) {
+            all_adopted = false;
+            continue;
+        }
+        auto record = persisted.dir(rec);
+        struct stat st{};
+        if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            // Still missing is as good as unchanged
+            if (record.present) all_adopted = false;
+            else adopted[i] = rec;
+            continue;
+        }
+        if (!record.present || st.st_dev != record.dev || st.st_ino != record.ino ||
+            st.st_mtim.tv_sec != record.mtime.tv_sec || st.st_mtim.tv_nsec != record.mtime.tv_nsec) {
+            all_adopted = false;
+            continue;
+        }
+        snap.dev = record.dev;
+        snap.ino = record.ino;
+        snap.mtime = record.mtime;
+        snap.present = true;
+        snap.remote = record.remote;
+        snap.racy = false;
+        snap.version = ++last_version;
+        adopted[i] = rec;
+    }
+
+    if (all_adopted) {
+        use_persisted = true;
+        return;
+    }
+
+    // Some directories changed, or PATH did: keep the names of the ones
+    // that did not and read only the others. This has to happen now, as an
+    // unread directory early in PATH may shadow any adopted one.
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        if (adopted[i] != SIZE_MAX) copy_persisted_names(adopted[i], snapshots[i].executables);
+    }
+    persisted.close();
+    if (!sweep()) rebuild_index();
+}
+
+void PathCache::refresh() {
+    sync_environment();
+    if (!persisted_checked) load_persisted();
+    sweep();
+}
+
+void PathCache::directory_names(size_t i, std::vector<std::string>& out) const {
+    if (use_persisted) {
+        persisted.names(i, out);
+    } else {
+        out.insert(out.end(), snapshots[i].executables.begin(), snapshots[i].executables.end());
+    }
+}
+
+void PathCache::drop_persisted() {
+    // Copy the names out before any directory is re-read
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        snapshots[i].executables.clear();
+        copy_persisted_names(i, snapshots[i].executables);
+    }
+    persisted.close();
+    use_persisted = false;
+}
+
+void PathCache::copy_persisted_names(size_t rec, std::vector<std::string>& out) const {
+    persisted.names(rec, out);
+    // Files are written from sorted snapshots, but nothing stops an older
+    // one from being around
+    if (!std::is_sorted(out.begin(), out.end())) std::sort(out.begin(), out.end());
+}
+
+void PathCache::save_persisted() {
+    if (auto location = PathIndexFile::default_location()) {
+        PathIndexFile::write(*location, last_path_value, snapshots);
+    }
+}
+
+void PathCache::rebuild_index() {
+    index.clear();
+    size_t total = 0;
+    for (const auto& snap : snapshots) total += snap.executables.size();
+    index.reserve(total);
+    // Earlier PATH directories win, so only the first occurrence is kept
+    for (uint32_t pos = 0; pos < snapshots.size(); ++pos) {
+        for (const auto& name : snapshots[pos].executables) {
+            index.emplace(name, pos);
+        }
+    }
+    index_built = true;
+    // Resolved paths may now be shadowed by another directory
+    forget_resolved();
+}
+
+void PathCache::update_index(uint32_t pos, const std::vector<std::string>& previous) {
+    const auto& current = snapshots[pos].executables;
+    bool changed = false;
+
+    // Both lists are sorted; walk them together for what came and went
+    auto old_it = previous.begin();
+    auto new_it = current.begin();
+    while (old_it != previous.end() || new_it != current.end()) {
+        if (new_it == current.end() || (old_it != previous.end() && *old_it < *new_it)) {
+            // Gone from here: the next directory that has it takes over
+            const std::string& name = *old_it++;
+            auto it = index.find(name);
+            if (it == index.end() || it->second != pos) continue;
+            changed = true;
+            uint32_t next = pos + 1;
+            while (next < snapshots.size() &&
+                   !std::binary_search(snapshots[next].executables.begin(),
+                                       snapshots[next].executables.end(), name)) {
+                ++next;
+            }
+            if (next < snapshots.size()) {
+                it->second = next;
+            } else {
+                index.erase(it);
+            }
+        } else if (old_it == previous.end() || *new_it < *old_it) {
+            // New here: it wins over any later directory
+            auto [it, inserted] = index.try_emplace(*new_it++, pos);
+            if (!inserted && it->second > pos) it->second = pos;
+            changed = true;
+        } else {
+            ++old_it;
+            ++new_it;
+        }
+    }
+    if (changed) forget_resolved();
+}
+
+fs::path PathCache::probe_index(const std::string& cmd) {
+    uint32_t pos;
+    if (use_persisted) {
+        auto hit = persisted.lookup(cmd);
+        if (!hit) return {};
+        pos = *hit;
+    } else {
+        auto it = index.find(cmd);
+        if (it == index.end()) return {};
+        pos = it->second;
+    }
+
+    // The snapshot may predate a removal; confirm the hosting directory is
+    // unchanged (one stat) before handing the path out
+    if (refresh_snapshot(pos)) {
+        auto it = index.find(cmd);
+        if (it == index.end()) return {};
+        pos = it->second;
+    }
+
+    try {
+        return fs::weakly_canonical(snapshots[pos].dir / cmd);
+    } catch (const fs::filesystem_error&) {
+        return {};
+    }
+}
+#endif
+
+namespace {
+
+// p, made canonical, if it is an executable regular file
+fs::path executable_at(const fs::path& p) {
+    try {
+        if (fs::exists(p) && fs::is_regular_file(p)) {
+#ifdef _WIN32
+            return fs::weakly_canonical(p);
+#else
+            if (access(p.string().c_str(), X_OK) == 0) {
+                return fs::weakly_canonical(p);
+            }
+#endif
+        }
+    } catch (const fs::filesystem_error&) {}
+    return {};
+}
+
+} // namespace
+
+fs::path PathCache::find_in_working_directory(const std::string& cmd) const {
+    const fs::path cwd(working_directory());
+#ifdef _WIN32
+    if (fs::path(cmd).has_extension()) {
+        if (auto p = executable_at(cwd / cmd); !p.empty()) return p;
+    }
+#endif
+    for (const auto& ext : executable_extensions) {
+        if (auto p = executable_at(cwd / (cmd + ext)); !p.empty()) return p;
+    }
+    return {};
+}
+
+fs::path PathCache::resolve_path_internal(const std::string& cmd, bool direct_path) {
+    if (direct_path) {
+        // Relative to the remembered directory, so canonicalizing never
+        // has to ask for the current one
+        fs::path candidate(cmd);
+        if (candidate.is_relative()) candidate = fs::path(working_directory()) / candidate;
+        try {
+            if (fs::exists(candidate) && fs::is_regular_file(candidate)) {
+#ifdef _WIN32
+                return fs::weakly_canonical(candidate);
+#else
+                if (access(candidate.string().c_str(), X_OK) == 0) {
+                    return fs::weakly_canonical(candidate);
+                }
+#endif
+            }
+        } catch (const fs::filesystem_error&) {
+            // File disappeared - skip
+        }
+        return {};
+    }
+
+#ifdef _WIN32
+    bool has_ext = fs::path(cmd).has_extension();
+
+    for (const auto& dir : path_directories) {
+        if (has_ext) {
+            if (auto p = executable_at(dir / cmd); !p.empty()) return p;
+        }
+        for (const auto& ext : executable_extensions) {
+            if (auto p = executable_at(dir / (cmd + ext)); !p.empty()) return p;
+        }
+    }
+#else
+    if (!persisted_checked) load_persisted();
+
+    // A single probe of the merged index answers most lookups. On a miss,
+    // re-stat the PATH directories so anything installed since the last
+    // sweep is picked up without touching PATH.
+    if (auto p = probe_index(cmd); !p.empty()) {
+        ++counters.index_hits;
+        return p;
+    }
+    fs::path found;
+    const bool changed = sweep(&cmd, &found);
+    if (!found.empty()) {
+        ++counters.probe_hits;
+        return found;
+    }
+    if (changed) {
+        if (auto p = probe_index(cmd); !p.empty()) {
+            ++counters.index_hits;
+            return p;
+        }
+    }
+#endif
+
+    return {};
+}
+
+void PathCache::sync_environment() {
+    if (!variables) {
+        environment_changed();
+    } else if (variables->generation() != seen_generation) {
+        seen_generation = variables->generation();
+        environment_changed();
+    }
+}
+
+void PathCache::follow(const Variables& vars) {
+    variables = &vars;
+    seen_generation = vars.generation() - 1;
+}
+
+fs::path PathCache::find(const std::string& cmd) {
+    if (cmd.empty()) return {};
+    ++counters.lookups;
+
+    sync_environment();
+
+#ifdef _WIN32
+    std::string cache_key = cmd;
+    std::transform(cache_key.begin(), cache_key.end(), cache_key.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+#else
+    const std::string& cache_key = cmd;
+#endif
+
+    const uint64_t cwd_generation = working_directory_generation();
+    if (auto it = cache.find(cache_key); it != cache.end()) {
+        CachedPath& entry = it->second;
+        if (entry.cwd_generation == cwd_generation || entry.origin == CachedPath::Origin::Absolute) {
+            ++counters.cache_hits;
+            return entry.path.value_or(fs::path{});
+        }
+        if (entry.origin == CachedPath::Origin::Path) {
+            ++counters.cache_hits;
+            if (auto p = find_in_working_directory(cmd); !p.empty()) {
+                entry = {p, cwd_generation, CachedPath::Origin::WorkingDirectory};
+                return p;
+            }
+            entry.cwd_generation = cwd_generation;
+            return entry.path.value_or(fs::path{});
+        }
+        cache.erase(it);
+        ++generation_;
+    }
+
+    bool direct_path = (cmd.find('/') != std::string::npos ||
+                       cmd.find('\\') != std::string::npos ||
+                       (cmd.size() >= 2 && cmd[1] == ':'));
+
+    // A bare name is looked for in the current directory first
+    auto origin = CachedPath::Origin::WorkingDirectory;
+    fs::path path;
+    if (direct_path) {
+        if (fs::path(cmd).is_absolute()) origin = CachedPath::Origin::Absolute;
+        path = resolve_path_internal(cmd, true);
+    } else if (path = find_in_working_directory(cmd); path.empty()) {
+        origin = CachedPath::Origin::Path;
+        path = resolve_path_internal(cmd, false);
+    }
+    if (path.empty()) ++counters.misses;
+#ifdef _WIN32
+    cache[cache_key] = {path.empty() ? std::nullopt : std::make_optional(path), cwd_generation, origin};
+#else
+    // Misses are not cached: the next lookup sweeps the directories again,
+    // so a negative answer expires as soon as a directory changes
+    if (!path.empty()) cache[cache_key] = {path, cwd_generation, origin};
+#endif
+    return path;
+}
+
+void PathCache::forget_resolved() {
+    cache.clear();
+    ++generation_;
+}
+
+uint64_t PathCache::generation() {
+    sync_environment();
+    return generation_;
+}
+
+void PathCache::clear() {
+    // Forcing a PATH mismatch drops the cache and every snapshot
+    last_path_value.clear();
+    last_pathext_value.clear();
+    forget_resolved();
+    environment_changed();
+#ifndef _WIN32
+    // Rescan for real rather than trusting the saved index again
+    persisted_checked = true;
+#endif
+}
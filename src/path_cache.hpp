@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include "path_index_file.hpp"
+#endif
+
+class Variables;
+
+namespace fs = std::filesystem;
+
+// Counters reported by the `hash` builtin
+struct PathCacheStats {
+    uint64_t lookups = 0;      // calls to find()
+    uint64_t cache_hits = 0;   // answered from the resolved-path cache
+    uint64_t index_hits = 0;   // answered by one probe of the directory index
+    uint64_t probe_hits = 0;   // found by a sweep's stat of every PATH candidate
+    uint64_t misses = 0;       // not found anywhere, even after a sweep
+    uint64_t sweeps = 0;       // passes that re-stat every PATH directory
+    uint64_t rebuilds = 0;     // directory snapshots re-read from disk
+};
+
+class PathCache {
+    // A resolved name, and the working directory generation it was checked
+    // against. The current directory is searched before PATH, so after a cd
+    // an entry from PATH is confirmed with one probe of the new directory,
+    // and an entry found in the old one (or a relative path) is dropped.
+    struct CachedPath {
+        std::optional<fs::path> path;
+        uint64_t cwd_generation = 0;
+        enum class Origin : uint8_t { Absolute, WorkingDirectory, Path } origin = Origin::Path;
+    };
+    std::unordered_map<std::string, CachedPath> cache;
+    std::string last_path_value;
+    std::string last_pathext_value;
+    std::vector<fs::path> path_directories;
+    std::vector<std::string> executable_extensions;
+    PathCacheStats counters;
+    // PATH comes from here when set, else from the process environment
+    const Variables* variables = nullptr;
+    uint64_t seen_generation = 0;
+    // Moves whenever a resolved path is dropped, so what find() answered
+    // before may no longer be its answer
+    uint64_t generation_ = 1;
+    void forget_resolved();
+
+#ifndef _WIN32
+    std::vector<DirSnapshot> snapshots;
+    // Executable name -> position of the first PATH directory that has it
+    std::unordered_map<std::string, uint32_t> index;
+
+    // Re-read a directory; returns the names it held before
+    std::vector<std::string> rebuild_snapshot(DirSnapshot& snap);
+    void read_directory(DirSnapshot& snap);
+    bool snapshot_stale(const DirSnapshot& snap) const;
+    bool refresh_snapshot(size_t pos);
+    // Re-stat every PATH directory and re-read those that changed. When
+    // any of them is on a network filesystem the stats go out as one
+    // batch, and given a name, dir/name for every directory goes with
+    // them; found is then set to the first of those that is executable.
+    bool sweep(const std::string* cmd = nullptr, fs::path* found = nullptr);
+    // Whether index covers every snapshot; while the saved index answers
+    // lookups it does not
+    bool index_built = false;
+    void rebuild_index();
+    // Fold one re-read directory into the index, given its previous names
+    void update_index(uint32_t pos, const std::vector<std::string>& previous);
+    fs::path probe_index(const std::string& cmd);
+    uint64_t last_version = 0;
+
+    // Index saved by an earlier shell. While every PATH directory still
+    // matches it, lookups probe the mapped file directly and the directory
+    // names are never copied out of it.
+    PathIndexFile persisted;
+    bool persisted_checked = false;
+    bool use_persisted = false;
+    void load_persisted();
+    void drop_persisted();
+    void copy_persisted_names(size_t rec, std::vector<std::string>& out) const;
+    void save_persisted();
+#endif
+
+    bool environment_changed();
+    void sync_environment();
+    fs::path find_in_working_directory(const std::string& cmd) const;
+    fs::path resolve_path_internal(const std::string& cmd, bool direct_path);
+
+public:
+    // Nothing is read until the first lookup
+    PathCache() = default;
+
+    // Take PATH from the shell's variables. It is then only looked at again
+    // after some variable changed, rather than on every lookup.
+    void follow(const Variables& vars);
+
+    fs::path find(const std::string& cmd);
+
+    // Until this changes (or the working directory generation does), find()
+    // keeps giving the same answer for any name it has found; callers that
+    // remember answers, such as compiled plans, compare it rather than look
+    // again. PATH is checked for changes first.
+    uint64_t generation();
+
+    // Forget every resolved path and directory snapshot (`hash -r`)
+    void clear();
+
+    const PathCacheStats& stats() const { return counters; }
+
+#ifndef _WIN32
+    // Bring every directory up to date for PATH as it is now: one stat each,
+    // re-reading only those that changed
+    void refresh();
+
+    // The PATH directories and the executables found in each. A directory's
+    // version moves only when its list does, so a consumer keeping its own
+    // copy (the completion index) can skip the ones it already has.
+    size_t directory_count() const { return snapshots.size(); }
+    const fs::path& directory(size_t i) const { return snapshots[i].dir; }
+    uint64_t directory_version(size_t i) const { return snapshots[i].version; }
+    void directory_names(size_t i, std::vector<std::string>& out) const;
+#endif
+};
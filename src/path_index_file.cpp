@@ -0,0 +1,304 @@
+#include "path_index_file.hpp"
+
+#ifndef _WIN32
+
+#include "platform.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'H', 'P', 'A', 'T', 'H', 'I', 'X'};
+// Bump whenever the layout below changes; native byte order and alignment
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t file_size;
+    uint32_t path_offset, path_len;
+    uint32_t dirs_offset, dir_count;
+    uint32_t refs_offset, ref_count;
+    uint32_t slots_offset, slot_count; // slot_count is a power of two
+    uint32_t strings_offset, strings_size;
+};
+
+struct DirEntry {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t path_offset, path_len; // into the string area
+    uint32_t first_ref, ref_count;  // this directory's names
+    uint32_t present;               // 0 if the directory did not exist
+    uint32_t remote;                // was reserved, so 0 in older files
+};
+
+struct NameRef {
+    uint32_t offset, len;           // into the string area
+};
+
+struct Slot {
+    uint32_t hash;
+    uint32_t ref;                   // NameRef index + 1, 0 for an empty slot
+    uint32_t dir;
+};
+
+uint32_t name_hash(std::string_view s) {
+    uint32_t h = 2166136261u;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <typename T>
+uint32_t append_array(std::string& buf, const std::vector<T>& items) {
+    // Every section starts 8-byte aligned
+    buf.resize((buf.size() + 7) & ~size_t{7});
+    uint32_t offset = static_cast<uint32_t>(buf.size());
+    buf.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+    return offset;
+}
+
+bool within(uint64_t offset, uint64_t len, uint64_t limit) {
+    return offset <= limit && len <= limit - offset;
+}
+
+bool write_file(const std::string& file, const std::string& data) {
+    fs::path target(file);
+    std::error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+
+    // Write a private copy and rename it over the old file, so concurrent
+    // shells only ever map a complete index
+    std::string tmp = file + ".tmp." + std::to_string(getpid());
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    ::close(fd);
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+PathIndexFile::~PathIndexFile() {
+    close();
+}
+
+std::optional<std::string> PathIndexFile::default_location() {
+    if (auto custom = get_env("SHELL_PATH_INDEX")) {
+        if (custom->empty() || *custom == "off") return std::nullopt;
+        return *custom;
+    }
+    if (auto cache = get_env("XDG_CACHE_HOME"); cache && !cache->empty()) {
+        return *cache + "/shell/path-index";
+    }
+    if (auto home = get_env("HOME"); home && !home->empty()) {
+        return *home + "/.cache/shell/path-index";
+    }
+    return std::nullopt;
+}
+
+bool PathIndexFile::open(const std::string& file) {
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    base_ = static_cast<const char*>(p);
+    size_ = static_cast<size_t>(st.st_size);
+
+    // Everything is checked once here, so lookups can trust every offset
+    const Header& h = *at<Header>(0);
+    bool ok = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.version == kVersion &&
+              h.file_size == size_ &&
+              within(h.strings_offset, h.strings_size, size_) &&
+              within(h.path_offset, h.path_len, h.strings_size) &&
+              within(h.dirs_offset, uint64_t{h.dir_count} * sizeof(DirEntry), size_) &&
+              within(h.refs_offset, uint64_t{h.ref_count} * sizeof(NameRef), size_) &&
+              within(h.slots_offset, uint64_t{h.slot_count} * sizeof(Slot), size_) &&
+              std::has_single_bit(h.slot_count) &&
+              h.dirs_offset % 8 == 0 && h.refs_offset % 8 == 0 && h.slots_offset % 8 == 0;
+    for (uint32_t i = 0; ok && i < h.dir_count; ++i) {
+        const DirEntry& d = at<DirEntry>(h.dirs_offset)[i];
+        ok = within(d.path_offset, d.path_len, h.strings_size) &&
+             within(d.first_ref, d.ref_count, h.ref_count);
+    }
+    for (uint32_t i = 0; ok && i < h.ref_count; ++i) {
+        const NameRef& r = at<NameRef>(h.refs_offset)[i];
+        ok = within(r.offset, r.len, h.strings_size);
+    }
+    for (uint32_t i = 0; ok && i < h.slot_count; ++i) {
+        const Slot& s = at<Slot>(h.slots_offset)[i];
+        ok = s.ref <= h.ref_count && (s.ref == 0 || s.dir < h.dir_count);
+    }
+    if (!ok) close();
+    return ok;
+}
+
+void PathIndexFile::close() {
+    if (base_) munmap(const_cast<char*>(base_), size_);
+    base_ = nullptr;
+    size_ = 0;
+}
+
+std::string_view PathIndexFile::path_value() const {
+    const Header& h = *at<Header>(0);
+    return {base_ + h.strings_offset + h.path_offset, h.path_len};
+}
+
+size_t PathIndexFile::dir_count() const {
+    return at<Header>(0)->dir_count;
+}
+
+PathIndexFile::DirRecord PathIndexFile::dir(size_t i) const {
+    const Header& h = *at<Header>(0);
+    const DirEntry& d = at<DirEntry>(h.dirs_offset)[i];
+    DirRecord rec;
+    rec.dir = {base_ + h.strings_offset + d.path_offset, d.path_len};
+    rec.dev = static_cast<dev_t>(d.dev);
+    rec.ino = static_cast<ino_t>(d.ino);
+    rec.mtime.tv_sec = static_cast<time_t>(d.mtime_sec);
+    rec.mtime.tv_nsec = static_cast<long>(d.mtime_nsec);
+    rec.present = d.present != 0;
+    rec.remote = d.remote != 0;
+    return rec;
+}
+
+void PathIndexFile::names(size_t i, std::vector<std::string>& out) const {
+    const Header& h = *at<Header>(0);
+    const DirEntry& d = at<DirEntry>(h.dirs_offset)[i];
+    const NameRef* refs = at<NameRef>(h.refs_offset);
+    const char* strings = base_ + h.strings_offset;
+    out.reserve(out.size() + d.ref_count);
+    for (uint32_t r = d.first_ref; r < d.first_ref + d.ref_count; ++r) {
+        out.emplace_back(strings + refs[r].offset, refs[r].len);
+    }
+}
+
+std::optional<uint32_t> PathIndexFile::lookup(std::string_view name) const {
+    const Header& h = *at<Header>(0);
+    const Slot* slots = at<Slot>(h.slots_offset);
+    const NameRef* refs = at<NameRef>(h.refs_offset);
+    const char* strings = base_ + h.strings_offset;
+    const uint32_t hash = name_hash(name);
+    const uint32_t mask = h.slot_count - 1;
+    for (uint32_t i = hash & mask, probes = 0; probes < h.slot_count; i = (i + 1) & mask, ++probes) {
+        const Slot& s = slots[i];
+        if (s.ref == 0) return std::nullopt;
+        if (s.hash != hash) continue;
+        const NameRef& r = refs[s.ref - 1];
+        if (std::string_view(strings + r.offset, r.len) == name) return s.dir;
+    }
+    return std::nullopt;
+}
+
+bool PathIndexFile::write(const std::string& file, std::string_view path_value,
+                          std::span<const DirSnapshot> snapshots) {
+    std::string strings;
+    auto add_string = [&](std::string_view s) {
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings.append(s);
+        return offset;
+    };
+
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.path_offset = add_string(path_value);
+    h.path_len = static_cast<uint32_t>(path_value.size());
+
+    std::vector<DirEntry> dirs;
+    std::vector<NameRef> refs;
+    std::vector<Slot> slots;
+    std::unordered_map<std::string_view, uint32_t> first_ref; // name -> ref index, first dir wins
+    std::vector<uint32_t> ref_dir;
+
+    for (uint32_t pos = 0; pos < snapshots.size(); ++pos) {
+        const DirSnapshot& snap = snapshots[pos];
+        const std::string dir = snap.dir.string();
+        DirEntry d{};
+        d.present = snap.present;
+        d.remote = snap.remote;
+        if (snap.present && !snap.racy) {
+            d.dev = snap.dev;
+            d.ino = snap.ino;
+            d.mtime_sec = snap.mtime.tv_sec;
+            d.mtime_nsec = snap.mtime.tv_nsec;
+        } else if (snap.present) {
+            // No directory has this mtime, so the next shell re-reads it
+            d.mtime_nsec = -1;
+        }
+        d.path_offset = add_string(dir);
+        d.path_len = static_cast<uint32_t>(dir.size());
+        d.first_ref = static_cast<uint32_t>(refs.size());
+        d.ref_count = static_cast<uint32_t>(snap.executables.size());
+        for (const auto& name : snap.executables) {
+            first_ref.emplace(name, static_cast<uint32_t>(refs.size()));
+            refs.push_back({add_string(name), static_cast<uint32_t>(name.size())});
+            ref_dir.push_back(pos);
+        }
+        dirs.push_back(d);
+    }
+    if (strings.size() > UINT32_MAX / 2) return false;
+
+    // At most half full, so probe sequences stay short
+    slots.resize(std::bit_ceil(std::max<size_t>(first_ref.size() * 2, 16)));
+    const uint32_t mask = static_cast<uint32_t>(slots.size() - 1);
+    for (const auto& [name, ref] : first_ref) {
+        const uint32_t hash = name_hash(name);
+        uint32_t i = hash & mask;
+        while (slots[i].ref != 0) i = (i + 1) & mask;
+        slots[i] = {hash, ref + 1, ref_dir[ref]};
+    }
+
+    std::string buf(sizeof(Header), '\0');
+    h.dirs_offset = append_array(buf, dirs);
+    h.dir_count = static_cast<uint32_t>(dirs.size());
+    h.refs_offset = append_array(buf, refs);
+    h.ref_count = static_cast<uint32_t>(refs.size());
+    h.slots_offset = append_array(buf, slots);
+    h.slot_count = static_cast<uint32_t>(slots.size());
+    h.strings_offset = static_cast<uint32_t>(buf.size());
+    h.strings_size = static_cast<uint32_t>(strings.size());
+    buf += strings;
+    h.file_size = static_cast<uint32_t>(buf.size());
+    std::memcpy(buf.data(), &h, sizeof(h));
+
+    return write_file(file, buf);
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+#include <time.h>
+
+namespace fs = std::filesystem;
+
+// The executables of one PATH directory, read with a single pass over the
+// directory. The snapshot stays valid while the directory's identity and
+// mtime are unchanged, since adding, removing or renaming an entry always
+// bumps the directory mtime.
+struct DirSnapshot {
+    fs::path dir;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    struct timespec mtime{};
+    bool present = false;
+    bool racy = false; // mtime too close to the read to trust it
+    bool remote = false; // on a network filesystem, where each stat is a round trip
+    std::vector<std::string> executables;
+    // Changes whenever executables does; 0 until the directory is first read
+    uint64_t version = 0;
+};
+
+// PATH index saved between shells, so that a new shell whose PATH
+// directories are unchanged answers lookups without reading any of them.
+// The file is mapped read-only and used in place: a header, one record per
+// directory (its identity and mtime, and the names it held), and an
+// open-addressed hash table from each name to the first directory that
+// has it, for the PATH the file was written for.
+class PathIndexFile {
+public:
+    PathIndexFile() = default;
+    ~PathIndexFile();
+
+    PathIndexFile(const PathIndexFile&) = delete;
+    PathIndexFile& operator=(const PathIndexFile&) = delete;
+
+    // $SHELL_PATH_INDEX if set ("off" disables the file), else
+    // $XDG_CACHE_HOME/shell/path-index, else ~/.cache/shell/path-index
+    static std::optional<std::string> default_location();
+
+    // Map and sanity-check a file; false (and closed) if it is missing or
+    // not one of ours
+    bool open(const std::string& file);
+    void close();
+    bool is_open() const { return base_ != nullptr; }
+
+    // The PATH value the hash table was built for
+    std::string_view path_value() const;
+
+    struct DirRecord {
+        std::string_view dir;
+        dev_t dev;
+        ino_t ino;
+        struct timespec mtime;
+        bool present; // false: the directory did not exist
+        bool remote;
+    };
+    size_t dir_count() const;
+    DirRecord dir(size_t i) const;
+    // Names recorded for directory i
+    void names(size_t i, std::vector<std::string>& out) const;
+
+    // Position in path_value() of the first directory holding name
+    std::optional<uint32_t> lookup(std::string_view name) const;
+
+    // Write snapshots (in PATH order) and their merged table, atomically
+    // replacing the file. Racy snapshots are stored so they never validate.
+    static bool write(const std::string& file, std::string_view path_value,
+                      std::span<const DirSnapshot> snapshots);
+
+private:
+    const char* base_ = nullptr;
+    size_t size_ = 0;
+
+    template <typename T>
+    const T* at(uint32_t offset) const { return reinterpret_cast<const T*>(base_ + offset); }
+};
+
+#endif
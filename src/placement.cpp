@@ -0,0 +1,371 @@
+#include "placement.hpp"
+
+#ifndef _WIN32
+
+#include "executor.hpp"
+#include "output.hpp"
+#include "shell.hpp"
+
+#include <charconv>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/ioprio.h>
+#include <linux/mempolicy.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+
+void add_node(LaunchAttributes::NodeMask& mask, int node) {
+    mask[node / kBitsPerWord] |= 1UL << (node % kBitsPerWord);
+}
+
+bool has_node(const LaunchAttributes::NodeMask& mask, int node) {
+    return mask[node / kBitsPerWord] & (1UL << (node % kBitsPerWord));
+}
+
+bool parse_int(std::string_view text, int& value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
+// A list in the kernel's format, such as 0-3,8,10-11, calling add for
+// each number; false if it is malformed or reaches limit
+template <typename Add>
+bool parse_list(std::string_view text, int limit, Add add) {
+    if (text.empty()) return false;
+    while (!text.empty()) {
+        const size_t comma = text.find(',');
+        const std::string_view range = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+        const size_t dash = range.find('-');
+        int first, last;
+        if (!parse_int(range.substr(0, dash), first)) return false;
+        last = first;
+        if (dash != std::string_view::npos && !parse_int(range.substr(dash + 1), last)) return false;
+        if (first < 0 || last < first || last >= limit) return false;
+        for (int n = first; n <= last; ++n) add(n);
+    }
+    return true;
+}
+
+// The other way round, for printing
+template <typename Has>
+void print_list(Output& out, int limit, Has has) {
+    bool first = true;
+    for (int n = 0; n < limit; ++n) {
+        if (!has(n)) continue;
+        int last = n;
+        while (last + 1 < limit && has(last + 1)) ++last;
+        if (!first) out << ',';
+        first = false;
+        out << n;
+        if (last > n) out << '-' << last;
+        n = last;
+    }
+}
+
+// A small sysfs file, without its trailing newline
+std::string read_small_file(const char* path) {
+    std::string text;
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return text;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) text.append(buf, static_cast<size_t>(n));
+    close(fd);
+    while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) text.pop_back();
+    return text;
+}
+
+std::vector<NumaNode> read_numa_nodes() {
+    std::vector<NumaNode> nodes;
+    parse_list(read_small_file("/sys/devices/system/node/online"), LaunchAttributes::kMaxNodes, [&](int id) {
+        NumaNode node{id, {}};
+        CPU_ZERO(&node.cpus);
+        const std::string path = "/sys/devices/system/node/node" + std::to_string(id) + "/cpulist";
+        // Memory-only nodes have an empty list
+        parse_list(read_small_file(path.c_str()), CPU_SETSIZE, [&](int cpu) { CPU_SET(cpu, &node.cpus); });
+        if (CPU_COUNT(&node.cpus) > 0) nodes.push_back(node);
+    });
+    if (nodes.empty()) {
+        NumaNode node{0, {}};
+        CPU_ZERO(&node.cpus);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &node.cpus);
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+bool is_online_node(int id) {
+    for (const NumaNode& node : numa_nodes()) {
+        if (node.id == id) return true;
+    }
+    return false;
+}
+
+// The CPUs children may be given: those of the defaults, or the shell's own
+cpu_set_t allowed_cpus(const LaunchAttributes& attributes) {
+    if (attributes.cpus) return *attributes.cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &set);
+    }
+    return set;
+}
+
+bool parse_nodes(std::string_view text, LaunchAttributes::NodeMask& mask) {
+    mask = {};
+    bool online = true;
+    const bool ok = parse_list(text, LaunchAttributes::kMaxNodes, [&](int node) {
+        online = online && is_online_node(node);
+        add_node(mask, node);
+    });
+    return ok && online;
+}
+
+bool parse_io_priority(std::string_view text, int& value) {
+    const size_t colon = text.find(':');
+    const std::string_view name = text.substr(0, colon);
+    int level = 4; // the kernel's default within a class
+    if (colon != std::string_view::npos &&
+        (!parse_int(text.substr(colon + 1), level) || level < 0 || level >= IOPRIO_NR_LEVELS)) {
+        return false;
+    }
+    int klass;
+    if (name == "none" && colon == std::string_view::npos) {
+        klass = IOPRIO_CLASS_NONE;
+        level = 0;
+    } else if (name == "idle" && colon == std::string_view::npos) {
+        klass = IOPRIO_CLASS_IDLE;
+        level = 0;
+    } else if (name == "best-effort") {
+        klass = IOPRIO_CLASS_BE;
+    } else if (name == "realtime") {
+        klass = IOPRIO_CLASS_RT;
+    } else {
+        return false;
+    }
+    value = IOPRIO_PRIO_VALUE(klass, level);
+    return true;
+}
+
+bool parse_memory_policy(std::string_view text, LaunchAttributes& attributes) {
+    const size_t colon = text.find(':');
+    const std::string_view name = text.substr(0, colon);
+    if (colon == std::string_view::npos) {
+        if (name != "default" && name != "local") return false;
+        attributes.memory_policy = name == "default" ? MPOL_DEFAULT : MPOL_LOCAL;
+        attributes.memory_nodes = {};
+        return true;
+    }
+    int mode;
+    if (name == "bind") {
+        mode = MPOL_BIND;
+    } else if (name == "preferred") {
+        mode = MPOL_PREFERRED;
+    } else if (name == "interleave") {
+        mode = MPOL_INTERLEAVE;
+    } else {
+        return false;
+    }
+    if (!parse_nodes(text.substr(colon + 1), attributes.memory_nodes)) return false;
+    if (mode == MPOL_PREFERRED) {
+        int count = 0;
+        for (int node = 0; node < LaunchAttributes::kMaxNodes; ++node) count += has_node(attributes.memory_nodes, node);
+        if (count != 1) return false;
+    }
+    attributes.memory_policy = mode;
+    return true;
+}
+
+// Apply one option and its value; false after reporting what was wrong
+bool parse_option(std::string_view option, std::string_view value, LaunchAttributes& attributes, BuiltinIO& io) {
+    bool ok = false;
+    if (option == "-c") {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        ok = parse_list(value, CPU_SETSIZE, [&](int cpu) { CPU_SET(cpu, &set); });
+        // The kernel refuses a set with none of the CPUs the shell may use
+        const cpu_set_t usable = allowed_cpus({});
+        CPU_AND(&set, &set, &usable);
+        if (ok && CPU_COUNT(&set) == 0) {
+            io.err << "launch: -c " << value << ": none of these CPUs is available\n";
+            return false;
+        }
+        if (ok) attributes.cpus = set;
+    } else if (option == "-N") {
+        LaunchAttributes::NodeMask nodes;
+        ok = parse_nodes(value, nodes);
+        if (ok) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (const NumaNode& node : numa_nodes()) {
+                if (has_node(nodes, node.id)) CPU_OR(&set, &set, &node.cpus);
+            }
+            attributes.cpus = set;
+            attributes.memory_policy = MPOL_BIND;
+            attributes.memory_nodes = nodes;
+        }
+    } else if (option == "-n") {
+        int nice;
+        ok = parse_int(value, nice);
+        if (ok) attributes.nice = nice;
+    } else if (option == "-s") {
+        ok = true;
+        if (value == "other") {
+            attributes.policy = SCHED_OTHER;
+        } else if (value == "batch") {
+            attributes.policy = SCHED_BATCH;
+        } else if (value == "idle") {
+            attributes.policy = SCHED_IDLE;
+        } else {
+            ok = false;
+        }
+    } else if (option == "-i") {
+        int priority;
+        ok = parse_io_priority(value, priority);
+        if (ok) attributes.io_priority = priority;
+    } else if (option == "-m") {
+        ok = parse_memory_policy(value, attributes);
+    } else {
+        io.err << "launch: " << option << ": invalid option\n";
+        return false;
+    }
+    if (!ok) io.err << "launch: " << option << " " << value << ": invalid value\n";
+    return ok;
+}
+
+// The defaults as the options that set them
+void print_defaults(Output& out, const LaunchAttributes& attributes) {
+    if (attributes.empty()) return;
+    out << "launch -d";
+    if (attributes.cpus) {
+        out << " -c ";
+        print_list(out, CPU_SETSIZE, [&](int cpu) { return CPU_ISSET(cpu, &*attributes.cpus); });
+    }
+    if (attributes.nice) out << " -n " << *attributes.nice;
+    if (attributes.policy) {
+        out << " -s " << (*attributes.policy == SCHED_BATCH ? "batch" : *attributes.policy == SCHED_IDLE ? "idle" : "other");
+    }
+    if (attributes.io_priority) {
+        const int klass = IOPRIO_PRIO_CLASS(*attributes.io_priority);
+        const int level = IOPRIO_PRIO_DATA(*attributes.io_priority);
+        out << " -i ";
+        if (klass == IOPRIO_CLASS_NONE) {
+            out << "none";
+        } else if (klass == IOPRIO_CLASS_IDLE) {
+            out << "idle";
+        } else {
+            out << (klass == IOPRIO_CLASS_RT ? "realtime:" : "best-effort:") << level;
+        }
+    }
+    if (attributes.memory_policy) {
+        out << " -m ";
+        switch (*attributes.memory_policy) {
+        case MPOL_DEFAULT: out << "default"; break;
+        case MPOL_LOCAL: out << "local"; break;
+        case MPOL_BIND: out << "bind:"; break;
+        case MPOL_PREFERRED: out << "preferred:"; break;
+        case MPOL_INTERLEAVE: out << "interleave:"; break;
+        }
+        print_list(out, LaunchAttributes::kMaxNodes, [&](int node) { return has_node(attributes.memory_nodes, node); });
+    }
+    out << '\n';
+}
+
+// The defaults in force while a prefixed command runs
+class ScopedDefaults {
+    LaunchAttributes saved_ = launch_defaults();
+
+public:
+    explicit ScopedDefaults(const LaunchAttributes& attributes) { set_launch_defaults(attributes); }
+    ~ScopedDefaults() { set_launch_defaults(saved_); }
+};
+
+} // namespace
+
+const std::vector<NumaNode>& numa_nodes() {
+    static const std::vector<NumaNode> nodes = read_numa_nodes();
+    return nodes;
+}
+
+std::vector<LaunchAttributes> spread_over_nodes(const LaunchAttributes& base) {
+    std::vector<LaunchAttributes> spread;
+    const cpu_set_t allowed = allowed_cpus(base);
+    for (const NumaNode& node : numa_nodes()) {
+        LaunchAttributes attributes = base;
+        cpu_set_t cpus;
+        CPU_AND(&cpus, &node.cpus, &allowed);
+        if (CPU_COUNT(&cpus) == 0) continue;
+        attributes.cpus = cpus;
+        if (!base.memory_policy) {
+            attributes.memory_policy = MPOL_PREFERRED;
+            attributes.memory_nodes = {};
+            add_node(attributes.memory_nodes, node.id);
+        }
+        spread.push_back(attributes);
+    }
+    return spread;
+}
+
+int builtin_launch(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() == 2 && args[1] == "-r") {
+        set_launch_defaults({});
+        return 0;
+    }
+
+    bool set_defaults = false;
+    LaunchAttributes attributes = launch_defaults();
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+        const auto& arg = args[i];
+        if (arg == "--") {
+            ++i;
+            break;
+        }
+        if (arg == "-d") {
+            set_defaults = true;
+            continue;
+        }
+        // Each takes a value, attached or following
+        std::string_view value = arg.substr(2);
+        if (value.empty() && i + 1 < args.size()) value = args[++i];
+        if (!parse_option(arg.substr(0, 2), value, attributes, io)) return 2;
+    }
+
+    if (set_defaults || args.size() == 1) {
+        if (i < args.size()) {
+            io.err << "launch: -d takes no command\n";
+            return 2;
+        }
+        if (set_defaults) {
+            set_launch_defaults(attributes);
+        } else {
+            print_defaults(io.out, attributes);
+        }
+        return 0;
+    }
+    if (i == args.size()) {
+        io.err << "launch: usage: launch [options] command [args...] | launch -d [options] | launch [-r]\n";
+        return 2;
+    }
+
+    // The command gets the stage's ends, or a here-string's pipe, as its
+    // stdin and stdout; the shell's own are put back once it is done
+    io.out.flush();
+    ShellDescriptors fds;
+    if (io.in != STDIN_FILENO) fds.point(STDIN_FILENO, io.in);
+    if (io.out.fd() >= 0 && io.out.fd() != STDOUT_FILENO) fds.point(STDOUT_FILENO, io.out.fd());
+
+    ScopedDefaults scope(attributes);
+    Pipeline stages;
+    stages.push_back({{}, {args.begin() + static_cast<std::ptrdiff_t>(i), args.end()}});
+    run_pipeline(shell, stages);
+    return shell.last_status;
+}
+
+#endif
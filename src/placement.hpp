@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <string_view>
+#include <vector>
+
+#include <sched.h>
+
+#include "builtins.hpp"
+#include "launcher.hpp"
+
+// A NUMA node and the CPUs on it
+struct NumaNode {
+    int id;
+    cpu_set_t cpus;
+};
+
+// The online nodes that have CPUs, read once from sysfs. Without node
+// information the machine is one node holding every CPU.
+const std::vector<NumaNode>& numa_nodes();
+
+// One set of attributes per node for fanning children out over the
+// machine: base narrowed to the node's CPUs (those of them the shell may
+// use) with, unless base has a memory policy, memory preferred from the
+// node. Nodes left with no CPU are skipped.
+std::vector<LaunchAttributes> spread_over_nodes(const LaunchAttributes& base);
+
+// launch [options] command [args...]
+// launch -d [options]
+// launch [-r]
+//
+// Run command with its external programs placed and scheduled as the
+// options say, on top of the shell-wide defaults; with -d, make the options
+// part of those defaults instead. Alone it prints the defaults, and -r
+// clears them.
+//   -c CPUS           run on these CPUs, a list such as 0-3,8
+//   -N NODES          run on the CPUs of these NUMA nodes, memory bound to them
+//   -n N              add N to the nice value
+//   -s other|batch|idle
+//                     scheduling policy
+//   -i none|idle|best-effort[:LEVEL]|realtime[:LEVEL]
+//                     I/O scheduling class, as by ionice
+//   -m default|local|bind:NODES|preferred:NODE|interleave:NODES
+//                     NUMA memory policy
+int builtin_launch(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+#endif
@@ -0,0 +1,617 @@
+#include "plan.hpp"
+#include "shell.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <iostream>
+#include <optional>
+
+#ifndef _WIN32
+#include "trace.hpp"
+#endif
+
+namespace {
+
+// Reserved words that end a list inside a compound command
+bool ends_list(std::string_view word) {
+    return word == "then" || word == "elif" || word == "else" || word == "fi" || word == "do" || word == "done";
+}
+
+// Something in a loop's words is replaced when it starts: a parameter, a
+// command substitution or a wildcard. Quoted ones count too; they only
+// cost a tokenize per start.
+bool needs_expansion(std::string_view text) {
+    return text.find_first_of("$`*?[") != std::string_view::npos;
+}
+
+bool is_here_document(const Token& token) {
+    return token.kind == TokenKind::HereDocument || token.kind == TokenKind::HereDocumentStrip;
+}
+
+std::string_view trim_blanks(std::string_view text) {
+    const size_t first = text.find_first_not_of(" \t");
+    return first == std::string_view::npos ? std::string_view() : text.substr(first);
+}
+
+// Here-document lines as they are read while compiling, kept for replay
+struct LineRecorder {
+    NextLine next_line;
+    void* context;
+    Arena& arena;
+    std::vector<std::string_view>& lines;
+};
+
+bool record_line(void* context, std::string& line) {
+    auto& recorder = *static_cast<LineRecorder*>(context);
+    if (!recorder.next_line || !recorder.next_line(recorder.context, line)) return false;
+    recorder.lines.push_back(recorder.arena.store(line));
+    return true;
+}
+
+struct LineReplay {
+    const std::vector<std::string_view>& lines;
+    size_t next = 0;
+};
+
+bool replay_line(void* context, std::string& line) {
+    auto& replay = *static_cast<LineReplay*>(context);
+    if (replay.next >= replay.lines.size()) return false;
+    line.assign(replay.lines[replay.next++]);
+    return true;
+}
+
+// The number of loops a break or continue with these arguments leaves: 1
+// without a count. 0 after reporting a count that is no number of loops,
+// or too many arguments.
+size_t loop_count(const std::vector<std::string_view>& args) {
+    if (args.size() > 2) {
+        std::cerr << args[0] << ": too many arguments\n";
+        return 0;
+    }
+    if (args.size() < 2) return 1;
+    size_t levels = 0;
+    const std::string_view count = args[1];
+    auto [ptr, ec] = std::from_chars(count.data(), count.data() + count.size(), levels);
+    if (ec != std::errc{} || ptr != count.data() + count.size()) {
+        std::cerr << args[0] << ": " << count << ": numeric argument required\n";
+        return 0;
+    }
+    if (levels == 0) std::cerr << args[0] << ": " << count << ": loop count out of range\n";
+    return levels;
+}
+
+// The lines compile reads: those of the text it was given, which may hold
+// several (a command substitution's does), then those from next_line
+struct LineSource {
+    std::optional<std::string_view> rest;
+    NextLine next_line;
+    void* context;
+};
+
+bool source_line(void* context, std::string& line) {
+    auto& source = *static_cast<LineSource*>(context);
+    if (!source.rest) return source.next_line && source.next_line(source.context, line);
+    const size_t end = source.rest->find('\n');
+    line.assign(source.rest->substr(0, end));
+    if (end == std::string_view::npos || end + 1 == source.rest->size()) {
+        source.rest.reset();
+    } else {
+        source.rest = source.rest->substr(end + 1);
+    }
+    return true;
+}
+
+// The command was killed by ^C, which stops the rest of the line too
+bool interrupted(int status) {
+#ifdef _WIN32
+    (void)status;
+    return false;
+#else
+    return status == 128 + SIGINT;
+#endif
+}
+
+} // namespace
+
+bool Plan::compile(std::string_view line, NextLine next_line, void* context) {
+    arena_.reset();
+    pieces_.clear();
+    parsed_.clear();
+    LineSource source{line, next_line, context};
+    std::string more;
+    source_line(&source, more);
+    bool complete = add_line(more, source_line, &source);
+    while (complete) {
+        // Every line of the text given goes in before any is parsed
+        if (source.rest) {
+            source_line(&source, more);
+            pieces_.push_back({PieceKind::Separator, "\n"});
+            complete = add_line(more, source_line, &source);
+            continue;
+        }
+        code_.clear();
+        pipelines_.clear();
+        loops_.clear();
+        saved_.clear();
+        loop_stack_.clear();
+        pos_ = 0;
+        last_lone_ = -1;
+        bool ran_any = false;
+        const Status status = parse_list(true, ran_any);
+        if (status == Status::Ok) return true;
+        if (status == Status::Failed) break;
+        // Reparsed from the top with the next line added; compound commands
+        // are seldom long enough for that to matter
+        if (!source_line(&source, more)) {
+            std::cerr << "syntax error: unexpected end of file\n";
+            break;
+        }
+        pieces_.push_back({PieceKind::Separator, "\n"});
+        complete = add_line(more, source_line, &source);
+    }
+    code_.clear();
+    return false;
+}
+
+// Split one more line, tokenize its pieces, split those that never change
+// into stages and read the bodies of its here-documents, which come
+// straight after it. A line ending inside a command substitution is joined
+// with the lines after it until the substitution ends.
+bool Plan::add_line(std::string& line, NextLine next_line, void* context) {
+#ifndef _WIN32
+    TraceSpan span(TracePhase::Parse, line);
+#endif
+    std::string more;
+    while (ends_in_substitution(line)) {
+        if (!next_line || !next_line(context, more)) {
+            std::cerr << "syntax error: unexpected end of file\n";
+            return false;
+        }
+        line += '\n';
+        line += more;
+    }
+    // Reading on may reuse the buffer line points into
+    const std::string_view text = arena_.store(line);
+    const size_t first = pieces_.size();
+    split_line(text, pieces_);
+    parsed_.resize(pieces_.size());
+    for (size_t i = first; i < pieces_.size(); ++i) {
+        if (pieces_[i].kind != PieceKind::Command) continue;
+        Parsed& parsed = parsed_[i];
+        if (!tokenize_command(pieces_[i].text, arena_, parsed.tokens, nullptr, &parsed.sites)) return false;
+        const bool here = std::any_of(parsed.tokens.begin(), parsed.tokens.end(), is_here_document);
+        if (here) {
+            // Read into a copy: the delimiters are needed again to replay them
+            run_tokens_ = parsed.tokens;
+            LineRecorder recorder{next_line, context, arena_, parsed.here_lines};
+            read_here_documents(run_tokens_, arena_, nullptr, record_line, &recorder);
+        }
+        parsed.expand = here || !parsed.sites.empty();
+        if (parsed.expand || parsed.tokens.empty()) continue;
+        auto stages = parse_pipeline(parsed.tokens);
+        if (!stages) return false;
+        parsed.stages = std::move(*stages);
+    }
+    return true;
+}
+
+uint32_t Plan::emit(Op op, uint32_t arg, uint32_t target) {
+    code_.push_back({op, arg, target});
+    return static_cast<uint32_t>(code_.size() - 1);
+}
+
+void Plan::skip_newlines() {
+    while (pos_ < pieces_.size() && pieces_[pos_].kind == PieceKind::Separator && pieces_[pos_].text == "\n") {
+        ++pos_;
+    }
+}
+
+Plan::Status Plan::unexpected() {
+    const std::string_view text = pos_ < pieces_.size() ? pieces_[pos_].text : "\n";
+    std::cerr << "syntax error near unexpected token `" << (text == "\n" ? "newline" : text) << "'\n";
+    return Status::Failed;
+}
+
+// Commands separated by ;, & or newlines, up to a reserved word that ends
+// the list (left for the caller) or the end of the input
+Plan::Status Plan::parse_list(bool top, bool& ran_any) {
+    while (true) {
+        skip_newlines();
+        if (pos_ >= pieces_.size()) return top ? Status::Ok : Status::Incomplete;
+        const Piece& piece = pieces_[pos_];
+        if (piece.kind == PieceKind::Reserved && ends_list(piece.text)) return top ? unexpected() : Status::Ok;
+        if (piece.kind == PieceKind::Separator) return unexpected();
+
+        last_lone_ = -1;
+        if (Status status = parse_and_or(); status != Status::Ok) return status;
+        ran_any = true;
+        if (pos_ >= pieces_.size()) return top ? Status::Ok : Status::Incomplete;
+
+        const Piece& next = pieces_[pos_];
+        if (next.kind == PieceKind::Separator && (next.text == ";" || next.text == "\n")) {
+            ++pos_;
+        } else if (next.kind == PieceKind::Separator && next.text == "&") {
+            if (last_lone_ < 0) {
+                std::cerr << "only a single pipeline can run in the background\n";
+                return Status::Failed;
+            }
+            pipelines_[static_cast<size_t>(last_lone_)].background = true;
+            ++pos_;
+        } else if (next.kind == PieceKind::Command) {
+            // Only fi or done leave a command where an operator belongs
+            std::cerr << "`" << next.text << "' after a compound command is not supported\n";
+            return Status::Failed;
+        } else {
+            return unexpected();
+        }
+    }
+}
+
+// Commands joined by && and ||, which bind left to right: each one after
+// the first is skipped unless the status so far says otherwise
+Plan::Status Plan::parse_and_or() {
+    if (Status status = parse_item(); status != Status::Ok) return status;
+    while (pos_ < pieces_.size() && pieces_[pos_].kind == PieceKind::Separator &&
+           (pieces_[pos_].text == "&&" || pieces_[pos_].text == "||")) {
+        const bool and_if = pieces_[pos_].text == "&&";
+        ++pos_;
+        skip_newlines();
+        if (pos_ >= pieces_.size()) return Status::Incomplete;
+        last_lone_ = -1;
+        const uint32_t skip = emit(and_if ? Op::JumpIfFailed : Op::JumpIfSucceeded);
+        if (Status status = parse_item(); status != Status::Ok) return status;
+        code_[skip].target = static_cast<uint32_t>(code_.size());
+        last_lone_ = -1;
+    }
+    return Status::Ok;
+}
+
+Plan::Status Plan::parse_item() {
+    const Piece& piece = pieces_[pos_];
+    if (piece.kind == PieceKind::Separator) return unexpected();
+    if (piece.kind == PieceKind::Command) return parse_command();
+
+    Status status;
+    if (piece.text == "!") {
+        ++pos_;
+        if (pos_ >= pieces_.size()) return Status::Incomplete;
+        status = parse_item();
+        if (status == Status::Ok) emit(Op::Negate);
+    } else if (piece.text == "if") {
+        status = parse_if();
+    } else if (piece.text == "while" || piece.text == "until") {
+        status = parse_while(piece.text == "until");
+    } else if (piece.text == "for") {
+        status = parse_for();
+    } else {
+        return unexpected();
+    }
+    last_lone_ = -1;
+    return status;
+}
+
+Plan::Status Plan::parse_command() {
+    const size_t index = pos_++;
+    const Parsed& parsed = parsed_[index];
+
+    // break and continue inside a loop are jumps; like the builtins they
+    // stand for, they leave $? at 0
+    if (!loop_stack_.empty() && !parsed.expand && parsed.stages.size() == 1) {
+        const Command& cmd = parsed.stages[0];
+        if (cmd.assignments.empty() && cmd.redirections.empty() && !cmd.input && !cmd.args.empty() &&
+            cmd.args.size() <= 2 && (cmd.args[0] == "break" || cmd.args[0] == "continue")) {
+            const size_t levels = loop_count(cmd.args);
+            if (levels == 0) return Status::Failed;
+            LoopContext& loop = loop_stack_[loop_stack_.size() - std::min(levels, loop_stack_.size())];
+            emit(Op::SetStatus, 0);
+            (cmd.args[0] == "break" ? loop.breaks : loop.continues).push_back(emit(Op::Jump));
+            return Status::Ok;
+        }
+    }
+
+    PlannedPipeline planned;
+    planned.source = pieces_[index].text;
+    planned.expand = parsed.expand;
+    planned.stages = parsed.stages;
+    if (planned.expand) {
+        planned.tokens = parsed.tokens;
+        planned.sites = parsed.sites;
+    }
+    planned.here_lines = parsed.here_lines;
+
+    // With a count known only when it runs (break $n), the count is
+    // expanded first and then one jump per enclosing loop is tried, the
+    // outermost taking any count beyond the loops there are
+    const auto& tokens = parsed.tokens;
+    if (!loop_stack_.empty() && parsed.expand && parsed.here_lines.empty() && tokens.size() == 2 &&
+        tokens[0].kind == TokenKind::Word && !tokens[0].assignment &&
+        (tokens[0].text == "break" || tokens[0].text == "continue") && parsed.sites.size() == 1 &&
+        parsed.sites[0].first == 1) {
+        const bool is_break = tokens[0].text == "break";
+        emit(Op::LoopCount, static_cast<uint32_t>(pipelines_.size()));
+        pipelines_.push_back(std::move(planned));
+        for (size_t levels = 1; levels <= loop_stack_.size(); ++levels) {
+            LoopContext& loop = loop_stack_[loop_stack_.size() - levels];
+            const uint32_t most = levels == loop_stack_.size() ? UINT32_MAX : static_cast<uint32_t>(levels);
+            (is_break ? loop.breaks : loop.continues).push_back(emit(Op::JumpIfCount, most));
+        }
+        return Status::Ok;
+    }
+
+    last_lone_ = static_cast<int64_t>(pipelines_.size());
+    emit(Op::Run, static_cast<uint32_t>(pipelines_.size()));
+    pipelines_.push_back(std::move(planned));
+    return Status::Ok;
+}
+
+// A list of at least one command, then the reserved word end
+Plan::Status Plan::body(std::string_view end) {
+    bool ran_any = false;
+    if (Status status = parse_list(false, ran_any); status != Status::Ok) return status;
+    if (!ran_any || pieces_[pos_].text != end) return unexpected();
+    ++pos_;
+    return Status::Ok;
+}
+
+// if A; then B; elif C; then D; else E; fi
+//
+//     A; JumpIfFailed L1; B; Jump END
+// L1: C; JumpIfFailed L2; D; Jump END
+// L2: E
+// END:
+//
+// Without an else, L2 sets $? to 0: no branch ran.
+Plan::Status Plan::parse_if() {
+    ++pos_;
+    std::vector<uint32_t> to_end;
+    while (true) {
+        if (Status status = body("then"); status != Status::Ok) return status;
+        const uint32_t skip = emit(Op::JumpIfFailed);
+        bool ran_any = false;
+        if (Status status = parse_list(false, ran_any); status != Status::Ok) return status;
+        const std::string_view word = pieces_[pos_].text;
+        if (!ran_any || (word != "elif" && word != "else" && word != "fi")) return unexpected();
+        to_end.push_back(emit(Op::Jump));
+        code_[skip].target = static_cast<uint32_t>(code_.size());
+        ++pos_;
+        if (word == "elif") continue;
+        if (word == "else") {
+            if (Status status = body("fi"); status != Status::Ok) return status;
+        } else {
+            emit(Op::SetStatus, 0);
+        }
+        break;
+    }
+    for (uint32_t jump : to_end) code_[jump].target = static_cast<uint32_t>(code_.size());
+    return Status::Ok;
+}
+
+// while A; do B; done
+//
+//       ClearStatus s
+// TOP:  A; JumpIfFailed EXIT; B
+// NEXT: SaveStatus s; Jump TOP
+// EXIT: RestoreStatus s
+//
+// so the loop's status is that of the last B to run, or 0. continue goes
+// to NEXT and break past EXIT, both with $? at 0.
+Plan::Status Plan::parse_while(bool until) {
+    ++pos_;
+    const auto slot = static_cast<uint32_t>(saved_.size());
+    saved_.push_back(0);
+    emit(Op::ClearStatus, slot);
+    const auto top = static_cast<uint32_t>(code_.size());
+    if (Status status = body("do"); status != Status::Ok) return status;
+    const uint32_t exit = emit(until ? Op::JumpIfSucceeded : Op::JumpIfFailed);
+    loop_stack_.emplace_back();
+    if (Status status = body("done"); status != Status::Ok) return status;
+    const uint32_t next = emit(Op::SaveStatus, slot);
+    emit(Op::Jump, 0, top);
+    code_[exit].target = emit(Op::RestoreStatus, slot);
+
+    const LoopContext& loop = loop_stack_.back();
+    for (uint32_t jump : loop.continues) code_[jump].target = next;
+    for (uint32_t jump : loop.breaks) code_[jump].target = static_cast<uint32_t>(code_.size());
+    loop_stack_.pop_back();
+    return Status::Ok;
+}
+
+// for NAME in WORDS; do B; done
+//
+//      ForStart l
+// TOP: ForNext l (to END); B; Jump TOP
+// END:
+//
+// The words are expanded once, by ForStart, unless they are all literal,
+// in which case they were split when compiled.
+Plan::Status Plan::parse_for() {
+    ++pos_;
+    if (pos_ >= pieces_.size()) return Status::Incomplete;
+    if (pieces_[pos_].kind != PieceKind::Command) return unexpected();
+    const std::string_view header = pieces_[pos_].text;
+    const size_t blank = header.find_first_of(" \t");
+    const std::string_view name = header.substr(0, blank);
+    if (!is_valid_name(name)) {
+        std::cerr << "for: `" << name << "': not a valid identifier\n";
+        return Status::Failed;
+    }
+    // Without `in` the loop is over the positional parameters, of which
+    // this shell has none
+    std::string_view words = trim_blanks(blank == std::string_view::npos ? "" : header.substr(blank));
+    if (!words.empty()) {
+        if (!words.starts_with("in") || (words.size() > 2 && words[2] != ' ' && words[2] != '\t')) {
+            std::cerr << "syntax error near unexpected token `" << words.substr(0, words.find_first_of(" \t"))
+                      << "'\n";
+            return Status::Failed;
+        }
+        words = trim_blanks(words.substr(2));
+    }
+    ++pos_;
+    if (pos_ < pieces_.size() && pieces_[pos_].kind == PieceKind::Separator && pieces_[pos_].text == ";") ++pos_;
+    skip_newlines();
+    if (pos_ >= pieces_.size()) return Status::Incomplete;
+    if (pieces_[pos_].kind != PieceKind::Reserved || pieces_[pos_].text != "do") return unexpected();
+    ++pos_;
+
+    const auto slot = static_cast<uint32_t>(loops_.size());
+    ForLoop& loop = loops_.emplace_back();
+    loop.name = name;
+    loop.words = words;
+    loop.expand = needs_expansion(words);
+    if (!loop.expand && !tokenize_command(words, loop.arena, loop.items)) return Status::Failed;
+
+    emit(Op::ForStart, slot);
+    const uint32_t top = emit(Op::ForNext, slot);
+    loop_stack_.emplace_back();
+    if (Status status = body("done"); status != Status::Ok) return status;
+    emit(Op::Jump, 0, top);
+    code_[top].target = static_cast<uint32_t>(code_.size());
+
+    const LoopContext& context = loop_stack_.back();
+    for (uint32_t jump : context.continues) code_[jump].target = top;
+    for (uint32_t jump : context.breaks) code_[jump].target = static_cast<uint32_t>(code_.size());
+    loop_stack_.pop_back();
+    return Status::Ok;
+}
+
+// The stages of a pipeline, put together now from its compiled tokens and
+// its expansion sites if it has any, each pointed at the program it
+// resolved to last time. False when there is nothing to run.
+bool Plan::expand_pipeline(Shell& shell, PlannedPipeline& planned, Pipeline& out) {
+    out.clear();
+    if (!planned.expand) {
+        out = planned.stages;
+    } else {
+        run_arena_.reset();
+        const Expansion expansion = shell_expansion(shell);
+        const auto copy_tokens = [&](size_t from, size_t to) {
+            run_tokens_.insert(run_tokens_.end(), planned.tokens.begin() + static_cast<ptrdiff_t>(from),
+                               planned.tokens.begin() + static_cast<ptrdiff_t>(to));
+        };
+        run_tokens_.clear();
+        // A line of assignments alone makes each before the next is
+        // expanded, so `a=1 b=$a` sets b to 1
+        const bool assigns_only = std::all_of(planned.tokens.begin(), planned.tokens.end(),
+                                              [](const Token& token) { return token.assignment; });
+        size_t assigned = 0;
+        size_t next = 0;
+        for (const ExpansionSite& site : planned.sites) {
+            copy_tokens(next, site.first);
+            next = site.first + site.count;
+            for (; assigns_only && assigned < run_tokens_.size(); ++assigned) {
+                shell.vars.assign(run_tokens_[assigned].text);
+            }
+#ifndef _WIN32
+            TraceSpan span(TracePhase::Parse, site.text);
+#endif
+            if (!tokenize_command(site.text, run_arena_, site_tokens_, &expansion)) {
+                shell.last_status = 2;
+                return false;
+            }
+            run_tokens_.insert(run_tokens_.end(), site_tokens_.begin(), site_tokens_.end());
+        }
+        copy_tokens(next, planned.tokens.size());
+        if (!planned.here_lines.empty()) {
+            LineReplay replay{planned.here_lines};
+            read_here_documents(run_tokens_, run_arena_, &expansion, replay_line, &replay);
+        }
+        // Everything expanded to nothing; $? stays that of any substitution
+        if (run_tokens_.empty()) return false;
+        auto stages = parse_pipeline(run_tokens_);
+        if (!stages) {
+            shell.last_status = 2;
+            return false;
+        }
+        out = std::move(*stages);
+    }
+    if (out.empty()) return false;
+    if (planned.programs.size() < out.size()) planned.programs.resize(out.size());
+    for (size_t i = 0; i < out.size(); ++i) out[i].resolved = &planned.programs[i];
+    return true;
+}
+
+// Whether nothing but forward jumps lies between ip and the end
+bool Plan::last_to_run(size_t ip) const {
+    while (ip < code_.size() && code_[ip].op == Op::Jump && code_[ip].target > ip) ip = code_[ip].target;
+    return ip >= code_.size();
+}
+
+void Plan::run(Shell& shell, bool tail) {
+    Pipeline stages;
+    for (size_t ip = 0; ip < code_.size();) {
+        const Instruction& in = code_[ip++];
+        switch (in.op) {
+        case Op::Run: {
+            PlannedPipeline& planned = pipelines_[in.arg];
+            if (!expand_pipeline(shell, planned, stages)) break;
+            if (tail && !planned.background && last_to_run(ip) && tail_exec(shell, stages)) return;
+            run_pipeline(shell, stages, planned.background);
+            if (shell.exit_requested || interrupted(shell.last_status)) return;
+            break;
+        }
+        case Op::Jump:
+            ip = in.target;
+            break;
+        case Op::JumpIfFailed:
+            if (shell.last_status != 0) ip = in.target;
+            break;
+        case Op::JumpIfSucceeded:
+            if (shell.last_status == 0) ip = in.target;
+            break;
+        case Op::SetStatus:
+            shell.last_status = static_cast<int>(in.arg);
+            break;
+        case Op::Negate:
+            shell.last_status = shell.last_status == 0 ? 1 : 0;
+            break;
+        case Op::ForStart: {
+            ForLoop& loop = loops_[in.arg];
+            loop.next = 0;
+            shell.last_status = 0;
+            if (loop.expand) {
+                loop.arena.reset();
+                const Expansion expansion = shell_expansion(shell);
+                if (!tokenize_command(loop.words, loop.arena, loop.items, &expansion)) shell.last_status = 2;
+            }
+            break;
+        }
+        case Op::ForNext: {
+            ForLoop& loop = loops_[in.arg];
+            // Redirections and the like among the words are no words
+            while (loop.next < loop.items.size() && loop.items[loop.next].kind != TokenKind::Word) ++loop.next;
+            if (loop.next >= loop.items.size()) {
+                ip = in.target;
+                break;
+            }
+            shell.vars.set(loop.name, loop.items[loop.next++].text);
+            break;
+        }
+        case Op::ClearStatus:
+            saved_[in.arg] = 0;
+            break;
+        case Op::SaveStatus:
+            saved_[in.arg] = shell.last_status;
+            break;
+        case Op::RestoreStatus:
+            shell.last_status = saved_[in.arg];
+            break;
+        case Op::LoopCount: {
+            count_ = 0;
+            if (!expand_pipeline(shell, pipelines_[in.arg], stages)) break;
+            count_ = stages.size() == 1 ? loop_count(stages[0].args) : 0;
+            shell.last_status = count_ == 0 ? 1 : 0;
+            break;
+        }
+        case Op::JumpIfCount:
+            if (count_ != 0 && count_ <= in.arg) ip = in.target;
+            break;
+        }
+    }
+}
+
+bool Plan::lone_pipeline(Shell& shell, Pipeline& out) {
+    if (code_.size() != 1 || code_[0].op != Op::Run || pipelines_[code_[0].arg].background) return false;
+    if (!expand_pipeline(shell, pipelines_[code_[0].arg], out)) out.clear();
+    return true;
+}
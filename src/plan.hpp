@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+#include "executor.hpp"
+#include "tokenizer.hpp"
+
+struct Shell;
+
+// A command line compiled for running. Lists (`;`, `&`, `&&`, `||`) and
+// compound commands (if, while, until and for, with break and continue)
+// are lowered to a flat list of instructions with jumps, which run() walks;
+// each pipeline in it is kept as written.
+//
+// Every pipeline is tokenized once, when compiled, and one with nothing to
+// expand is split into its stages then too. In any other only the words
+// with something to expand are tokenized again, with expansion, each time
+// it runs, so a loop body is compiled once however often it goes round. Every stage also remembers the program its
+// name resolved to, which is used again until the PathCache or working
+// directory generation moves.
+//
+// A plan is reused from line to line; compiling resets it.
+class Plan {
+public:
+    // Compile line, reading more lines through next_line while a compound
+    // command, a command substitution or a list ending in && or || is
+    // unfinished (interactively, at the "> " prompt) and for the bodies of
+    // its here-documents. line may hold several lines itself, which are read
+    // first. Returns false after reporting a syntax error.
+    bool compile(std::string_view line, NextLine next_line, void* context);
+
+    // Nothing to run: the line was blank or a comment
+    bool empty() const { return code_.empty(); }
+
+    // Run from the top, setting last_status as each command finishes; stops
+    // early once the shell is asked to exit or a command is interrupted.
+    // With tail set, a plain external command that is the last thing to
+    // run replaces the shell instead of being forked.
+    void run(Shell& shell, bool tail = false);
+
+    // When the plan is one foreground pipeline and nothing else, expand it
+    // into out as run() would and return true; out is left empty when
+    // nothing remains of it or expansion failed (last_status is then 2).
+    // The views in out last until the plan is run or compiled again.
+    bool lone_pipeline(Shell& shell, Pipeline& out);
+
+private:
+    enum class Op : uint8_t {
+        Run,             // run pipelines_[arg]
+        Jump,            // continue at target
+        JumpIfFailed,    // continue at target unless $? is 0
+        JumpIfSucceeded, // continue at target if $? is 0
+        SetStatus,       // $? = arg
+        Negate,          // $? = !$?
+        ForStart,        // expand the words of loops_[arg]; $? = 0
+        ForNext,         // set its variable to the next word, or continue at target
+        ClearStatus,     // saved_[arg] = 0
+        SaveStatus,      // saved_[arg] = $?
+        RestoreStatus,   // $? = saved_[arg]
+        LoopCount,       // expand the break or continue pipelines_[arg] into count_
+        JumpIfCount,     // continue at target if count_ is 1 to arg
+    };
+
+    struct Instruction {
+        Op op;
+        uint32_t arg = 0;
+        uint32_t target = 0;
+    };
+
+    struct PlannedPipeline {
+        std::string_view source;
+        bool background = false;
+        // Has words to expand or here-documents to read, so its stages are
+        // put together again on every run
+        bool expand = false;
+        // Split into stages when compiled, unless expand is set
+        Pipeline stages;
+        // With expand set: its tokens as compiled, and the words among them
+        // to tokenize again
+        std::vector<Token> tokens;
+        std::vector<ExpansionSite> sites;
+        // The lines read for its here-documents, delimiters included,
+        // handed to read_here_documents again on every run
+        std::vector<std::string_view> here_lines;
+        std::vector<ResolvedProgram> programs;
+    };
+
+    struct ForLoop {
+        std::string_view name;
+        std::string_view words;
+        bool expand = false;
+        Arena arena;
+        std::vector<Token> items;
+        size_t next = 0;
+    };
+
+    // What the parser knows of a split line: each piece, and for a Command
+    // piece its here-document lines, its tokens and expansion sites and, if
+    // it has nothing to expand, its stages
+    struct Parsed {
+        std::vector<std::string_view> here_lines;
+        bool expand = false;
+        std::vector<Token> tokens;
+        std::vector<ExpansionSite> sites;
+        Pipeline stages;
+    };
+
+    // A loop being compiled: the jumps its break and continue left, to be
+    // pointed at their places once its end is known
+    struct LoopContext {
+        std::vector<uint32_t> breaks;
+        std::vector<uint32_t> continues;
+    };
+
+    enum class Status { Ok, Incomplete, Failed };
+
+    Arena arena_;
+    std::vector<Piece> pieces_;
+    std::vector<Parsed> parsed_;
+    std::vector<Instruction> code_;
+    std::vector<PlannedPipeline> pipelines_;
+    std::vector<ForLoop> loops_;
+    std::vector<int> saved_;
+    // Loops the last break or continue with an expanded count leaves; 0
+    // when the count was bad
+    size_t count_ = 0;
+    // Parser state
+    size_t pos_ = 0;
+    std::vector<LoopContext> loop_stack_;
+    // The pipeline the last and-or list consisted of, for a trailing '&'
+    int64_t last_lone_ = -1;
+    // Scratch space for expanding pipelines as they run
+    Arena run_arena_;
+    std::vector<Token> run_tokens_;
+    std::vector<Token> site_tokens_;
+
+    bool add_line(std::string& line, NextLine next_line, void* context);
+    Status parse_list(bool top, bool& ran_any);
+    Status parse_and_or();
+    Status parse_item();
+    Status parse_if();
+    Status parse_while(bool until);
+    Status parse_for();
+    Status parse_command();
+    Status body(std::string_view end);
+    Status unexpected();
+    uint32_t emit(Op op, uint32_t arg = 0, uint32_t target = 0);
+    void skip_newlines();
+
+    bool expand_pipeline(Shell& shell, PlannedPipeline& planned, Pipeline& out);
+    bool last_to_run(size_t ip) const;
+};
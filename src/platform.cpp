@@ -0,0 +1,139 @@
+#include "platform.hpp"
+
+#include <sstream>
+#include <unordered_set>
+#include <cctype>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Safe trim functions
+void trim(std::string& s) {
+    auto first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) { s.clear(); return; }
+    auto last = s.find_last_not_of(" \t");
+    s.erase(last + 1);
+    s.erase(0, first);
+}
+
+void trim(std::wstring& s) {
+    auto first = s.find_first_not_of(L" \t");
+    if (first == std::wstring::npos) { s.clear(); return; }
+    auto last = s.find_last_not_of(L" \t");
+    s.erase(last + 1);
+    s.erase(0, first);
+}
+
+// Platform-specific environment access
+#ifdef _WIN32
+std::optional<std::wstring> get_wenv(const wchar_t* name) {
+    const wchar_t* val = _wgetenv(name);
+    if (!val || *val == L'\0') return std::nullopt;
+    return std::wstring(val);
+}
+
+std::string wide_to_utf8(const std::wstring& wstr) {
+    if (wstr.empty()) return "";
+    
+    int size_needed = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    if (size_needed <= 0) return "";
+    
+    std::vector<char> buffer(size_needed, 0);
+    WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, buffer.data(), size_needed, nullptr, nullptr);
+    return std::string(buffer.data());
+}
+
+std::wstring utf8_to_wide(const std::string& s) {
+    if (s.empty()) return L"";
+    int n = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, nullptr, 0);
+    if (n <= 0) return L"";
+    std::wstring w(n-1, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, w.data(), n);
+    return w;
+}
+#else
+std::optional<std::string> get_env(const char* name) {
+    const char* val = std::getenv(name);
+    if (!val || *val == '\0') return std::nullopt;
+    return std::string(val);
+}
+#endif
+
+std::vector<fs::path> get_path_directories() {
+#ifdef _WIN32
+    auto path_env = get_wenv(L"PATH");
+    if (!path_env) return {};
+    
+    std::vector<fs::path> dirs;
+    dirs.reserve(16); // Pre-allocate for common case
+    std::wstringstream ss(*path_env);
+    std::wstring dir;
+    while (std::getline(ss, dir, L';')) {
+        trim(dir);
+        if (!dir.empty()) dirs.push_back(fs::path(dir));
+    }
+    return dirs;
+#else
+    auto path_env = get_env("PATH");
+    if (!path_env) return {};
+    return get_path_directories(*path_env);
+#endif
+}
+
+#ifndef _WIN32
+std::vector<fs::path> get_path_directories(const std::string& path_value) {
+    if (path_value.empty()) return {};
+
+    std::vector<fs::path> dirs;
+    dirs.reserve(16);
+    std::stringstream ss(path_value);
+    std::string dir;
+    while (std::getline(ss, dir, ':')) {
+        if (dir.empty()) {
+            dirs.push_back(fs::path("."));
+        } else {
+            trim(dir);
+            if (!dir.empty()) dirs.push_back(fs::path(dir));
+        }
+    }
+    return dirs;
+}
+
+int private_fd(int fd) {
+    if (fd < 0 || fd >= kFirstPrivateFd) return fd;
+    const int moved = fcntl(fd, F_DUPFD_CLOEXEC, kFirstPrivateFd);
+    const int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return moved;
+}
+#endif
+
+std::vector<std::string> get_executable_extensions() {
+#ifdef _WIN32
+    auto pathext_env = get_wenv(L"PATHEXT");
+    if (pathext_env && !pathext_env->empty()) {
+        std::vector<std::string> exts;
+        std::unordered_set<std::string> seen;
+        std::wstringstream ss(*pathext_env);
+        std::wstring ext;
+        while (std::getline(ss, ext, L';')) {
+            trim(ext);
+            if (ext.empty()) continue;
+            if (ext[0] != L'.') ext = L'.' + ext;
+            auto u8 = wide_to_utf8(ext);
+            for (auto& c : u8) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if (seen.insert(u8).second) exts.push_back(std::move(u8));
+        }
+        if (!exts.empty()) return exts;
+    }
+    return {".exe", ".bat", ".cmd", ".com"};
+#else
+    return {""};
+#endif
+}
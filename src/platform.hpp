@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Safe trim functions
+void trim(std::string& s);
+void trim(std::wstring& s);
+
+// Platform-specific environment access
+#ifdef _WIN32
+std::optional<std::wstring> get_wenv(const wchar_t* name);
+std::string wide_to_utf8(const std::wstring& wstr);
+std::wstring utf8_to_wide(const std::string& s);
+#else
+std::optional<std::string> get_env(const char* name);
+#endif
+
+std::vector<fs::path> get_path_directories();
+#ifndef _WIN32
+// The directories of a PATH value
+std::vector<fs::path> get_path_directories(const std::string& path_value);
+
+// Descriptors from here up are the shell's own, out of the way of those a
+// redirection can name (`>&3`), as in other shells
+constexpr int kFirstPrivateFd = 10;
+
+// Move fd, unless it is there already, to the lowest free descriptor from
+// kFirstPrivateFd up, close-on-exec; the original is closed. -1 if fd is,
+// or if it cannot be moved.
+int private_fd(int fd);
+#endif
+std::vector<std::string> get_executable_extensions();
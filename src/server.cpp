@@ -0,0 +1,383 @@
+#include "server.hpp"
+
+#ifndef _WIN32
+
+#include "line_reader.hpp"
+#include "shell.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace {
+
+// Largest message either side sends: the hello (working directory and
+// environment) or one piece of script. SOCK_SEQPACKET keeps each message
+// whole, and this stays under the default socket buffer size.
+constexpr size_t kMaxMessage = 64 * 1024;
+
+// The first byte of each message after the hello. A script too long for one
+// message is sent in pieces, cut anywhere, and run once the last arrives, so
+// compound commands and here-documents may straddle pieces.
+enum class Request : char {
+    More = 'm',  // a piece of script with more to come
+    Run = 'r',   // the last piece; run the whole script
+    Input = 'i', // run the script on the client's standard input
+};
+
+// The session's answer to each piece of script
+struct Reply {
+    int32_t status;
+    int32_t exited; // the script ran `exit`; the session is over
+};
+
+bool make_address(const char* path, struct sockaddr_un& addr) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    std::strcpy(addr.sun_path, path);
+    return true;
+}
+
+// Listen on path, taking over a socket file left by a server that died but
+// not one a live server still answers on
+int listen_on(const char* path) {
+    struct sockaddr_un addr;
+    if (!make_address(path, addr)) return -1;
+    auto* sa = reinterpret_cast<struct sockaddr*>(&addr);
+
+    struct stat st{};
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        const bool live = probe >= 0 && connect(probe, sa, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    // Sessions run as the server's user, so only that user may connect
+    const mode_t old_mask = umask(077);
+    const int rc = bind(fd, sa, sizeof(addr));
+    umask(old_mask);
+    if (rc != 0 || listen(fd, SOMAXCONN) != 0) {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// The hello: payload plus the client's descriptors 0-2
+ssize_t receive_hello(int conn, std::vector<char>& buf, int (&fds)[3]) {
+    struct iovec iov{buf.data(), buf.size()};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    while ((n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    if (n <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) return -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        return -1;
+    }
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    return n;
+}
+
+// One client's session, in a process forked from the server
+[[noreturn]] void run_session(Shell& shell, int conn, ScriptRunner run) {
+    std::vector<char> buf(kMaxMessage);
+    int fds[3];
+    const ssize_t n = receive_hello(conn, buf, fds);
+    if (n < 0) _exit(1);
+
+    // The commands use the client's descriptors as their own
+    for (int target = 0; target < 3; ++target) {
+        dup2(fds[target], target);
+    }
+    for (int fd : fds) {
+        if (fd > 2) close(fd);
+    }
+
+    // cwd, then NAME=value entries, each NUL-terminated. They stay in hello
+    // for the life of the session, which is what environ needs.
+    std::string hello(buf.data(), static_cast<size_t>(n));
+    std::vector<char*> env;
+    const size_t cwd_end = hello.find('\0');
+    for (size_t pos = cwd_end + 1; pos < hello.size();) {
+        const size_t end = hello.find('\0', pos);
+        if (end == std::string::npos) break;
+        env.push_back(hello.data() + pos);
+        pos = end + 1;
+    }
+    env.push_back(nullptr);
+    if (cwd_end == std::string::npos || chdir(hello.c_str()) != 0) {
+        std::cerr << "shell: " << hello.c_str() << ": " << std::strerror(errno) << '\n';
+    }
+    environ = env.data();
+    shell.vars.clear();
+    shell.vars.import_environment();
+    sync_working_directory(std::getenv("PWD"));
+    shell.vars.set("PWD", working_directory(), true);
+    shell.last_status = 0;
+
+    std::string script;
+    while (true) {
+        // With MSG_TRUNC the full length comes back even when it did not fit
+        ssize_t len;
+        while ((len = recv(conn, buf.data(), buf.size(), MSG_TRUNC)) < 0 && errno == EINTR) {}
+        if (len <= 0 || static_cast<size_t>(len) > buf.size()) break;
+
+        const auto request = static_cast<Request>(buf[0]);
+        script.append(buf.data() + 1, static_cast<size_t>(len) - 1);
+        if (request == Request::More) continue;
+
+        Reply reply{};
+        if (request == Request::Input) {
+            LineReader reader(STDIN_FILENO, false);
+            reply.status = run(shell, reader);
+        } else {
+            LineReader reader{std::string_view(script)};
+            reply.status = run(shell, reader);
+        }
+        reply.exited = shell.exit_requested;
+        script.clear();
+        std::cout.flush();
+        std::cerr.flush();
+        if (send(conn, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) break;
+        if (shell.exit_requested) break;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    _exit(shell.exit_requested ? shell.exit_code : shell.last_status);
+}
+
+} // namespace
+
+int serve(Shell& shell, const char* socket_path, ScriptRunner run) {
+    const int listener = listen_on(socket_path);
+    if (listener < 0) {
+        std::cerr << "shell: --serve: " << socket_path << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    // Session exits and the stop signals arrive through the same epoll set
+    // as new connections
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigset_t saved_mask;
+    sigprocmask(SIG_BLOCK, &signals, &saved_mask);
+    const int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    for (int fd : {listener, signal_fd}) {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    // Read PATH once here rather than in every session
+    shell.path_cache.refresh();
+
+    bool stopping = signal_fd < 0 || epoll_fd < 0;
+    while (!stopping) {
+        struct epoll_event events[4];
+        const int ready = epoll_wait(epoll_fd, events, 4, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int e = 0; e < ready; ++e) {
+            if (events[e].data.fd == signal_fd) {
+                struct signalfd_siginfo info[16];
+                ssize_t n;
+                while ((n = read(signal_fd, info, sizeof(info))) > 0) {
+                    for (size_t i = 0; i < static_cast<size_t>(n) / sizeof(info[0]); ++i) {
+                        if (info[i].ssi_signo != SIGCHLD) stopping = true;
+                    }
+                }
+                // Several exits can share one SIGCHLD
+                while (waitpid(-1, nullptr, WNOHANG) > 0) {}
+                continue;
+            }
+
+            int conn;
+            while ((conn = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+                // One stat per directory picks up programs installed since
+                shell.path_cache.refresh();
+                std::cout.flush();
+                std::cerr.flush();
+                const pid_t pid = fork();
+                if (pid == 0) {
+                    close(listener);
+                    close(epoll_fd);
+                    close(signal_fd);
+                    sigset_t stop;
+                    sigemptyset(&stop);
+                    sigaddset(&stop, SIGINT);
+                    sigaddset(&stop, SIGTERM);
+                    sigprocmask(SIG_UNBLOCK, &stop, nullptr);
+                    run_session(shell, conn, run);
+                }
+                if (pid < 0) perror("fork");
+                close(conn);
+            }
+        }
+    }
+
+    close(listener);
+    unlink(socket_path);
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (signal_fd >= 0) close(signal_fd);
+    sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+    return 0;
+}
+
+ServerConnection::~ServerConnection() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool ServerConnection::open(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (!make_address(socket_path, addr)) return false;
+    fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) return false;
+    if (connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) return false;
+
+    std::string hello;
+    char cwd[PATH_MAX];
+    hello += getcwd(cwd, sizeof(cwd)) ? cwd : "/";
+    hello += '\0';
+    for (char** env = environ; env && *env; ++env) {
+        hello += *env;
+        hello += '\0';
+    }
+    if (hello.size() > kMaxMessage) {
+        errno = E2BIG;
+        return false;
+    }
+
+    // A closed standard descriptor cannot be passed; the session gets
+    // /dev/null there instead
+    int fds[3];
+    int opened[3] = {-1, -1, -1};
+    for (int i = 0; i < 3; ++i) {
+        fds[i] = i;
+        if (fcntl(i, F_GETFD) < 0) fds[i] = opened[i] = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+    }
+
+    struct iovec iov{hello.data(), hello.size()};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t n;
+    while ((n = sendmsg(fd_, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    const int err = errno;
+    for (int fd : opened) {
+        if (fd >= 0) close(fd);
+    }
+    errno = err;
+    return n == static_cast<ssize_t>(hello.size());
+}
+
+bool ServerConnection::run(std::string_view script, int& status, bool& exited) {
+    std::string message;
+    message.reserve(std::min(script.size() + 1, kMaxMessage));
+    do {
+        const std::string_view piece = script.substr(0, kMaxMessage - 1);
+        script.remove_prefix(piece.size());
+        message.assign(1, static_cast<char>(script.empty() ? Request::Run : Request::More));
+        message += piece;
+        if (send(fd_, message.data(), message.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(message.size())) {
+            return false;
+        }
+    } while (!script.empty());
+    return wait_reply(status, exited);
+}
+
+bool ServerConnection::run_input(int& status, bool& exited) {
+    const char request = static_cast<char>(Request::Input);
+    if (send(fd_, &request, 1, MSG_NOSIGNAL) != 1) return false;
+    return wait_reply(status, exited);
+}
+
+bool ServerConnection::wait_reply(int& status, bool& exited) {
+    Reply reply{};
+    ssize_t n;
+    while ((n = recv(fd_, &reply, sizeof(reply), 0)) < 0 && errno == EINTR) {}
+    if (n != sizeof(reply)) {
+        if (n >= 0) errno = ECONNRESET;
+        return false;
+    }
+    status = reply.status;
+    exited = reply.exited;
+    return true;
+}
+
+int run_client(const char* socket_path, const char* script) {
+    ServerConnection conn;
+    if (!conn.open(socket_path)) {
+        std::cerr << "shell: --connect: " << socket_path << ": " << std::strerror(errno) << '\n';
+        return 127;
+    }
+    auto lost = [] {
+        std::cerr << "shell: --connect: " << std::strerror(errno) << '\n';
+        return 1;
+    };
+
+    int status = 0;
+    bool exited = false;
+    // The session reads standard input itself, through the descriptor it was
+    // handed, so it sees whole commands and here-documents just as a shell
+    // reading a pipe does
+    if (!(script ? conn.run(script, status, exited) : conn.run_input(status, exited))) return lost();
+    return status;
+}
+
+#endif
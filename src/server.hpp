@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <string_view>
+
+class LineReader;
+struct Shell;
+
+// Runs the lines of a script as a script is run; returns its status
+using ScriptRunner = int (*)(Shell& shell, LineReader& script);
+
+// shell --serve SOCKET
+//
+// One resident shell that orchestrators hand command lines to instead of
+// starting a shell per task. It listens on a Unix-domain socket and runs an
+// epoll loop over it and SIGCHLD; each client that connects gets a session
+// forked from the server, so it starts with the PATH index and directory
+// snapshots the server has already read and never pays for exec, dynamic
+// linking or a PATH scan. The server refreshes its snapshots (one stat per
+// directory) before forking, so sessions see what was installed meanwhile.
+// A session takes the client's working directory and environment, and the
+// client's own stdin, stdout and stderr, passed over the socket with
+// SCM_RIGHTS: the commands read and write the client's descriptors
+// directly, and nothing is copied through the server. Sessions run
+// concurrently, each in its own process, so one client's long command never
+// holds up another's. SIGINT or SIGTERM stops the server and removes the
+// socket; sessions still running finish on their own.
+int serve(Shell& shell, const char* socket_path, ScriptRunner run);
+
+// A client's session with a serving shell
+class ServerConnection {
+public:
+    ServerConnection() = default;
+    ~ServerConnection();
+
+    ServerConnection(const ServerConnection&) = delete;
+    ServerConnection& operator=(const ServerConnection&) = delete;
+
+    // Connect and hand over the working directory, the environment and
+    // descriptors 0-2; false with errno set
+    bool open(const char* socket_path);
+
+    // Run script text in the session, parsed whole there however many
+    // messages it takes to send. False if the session went away; exited is
+    // set when the script ran `exit`, which ends the session.
+    bool run(std::string_view script, int& status, bool& exited);
+
+    // Have the session read and run the script on the standard input handed
+    // over at open, as a shell runs one piped into it
+    bool run_input(int& status, bool& exited);
+
+private:
+    int fd_ = -1;
+
+    bool wait_reply(int& status, bool& exited);
+};
+
+// shell --connect SOCKET [-c script]: run the script, or the one on
+// standard input, in a session of the shell serving SOCKET
+int run_client(const char* socket_path, const char* script);
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "coproc.hpp"
+#include "history.hpp"
+#include "jobs.hpp"
+#include "path_cache.hpp"
+#include "variables.hpp"
+#include "working_directory.hpp"
+
+// State shared by the REPL, the builtins and the executor
+struct Shell {
+    Variables vars;
+    PathCache path_cache;
+#ifndef _WIN32
+    JobTable jobs;
+    History history;
+    CoprocTable coprocs;
+#endif
+    int last_status = 0;
+
+    // Set by the exit builtin; the REPL stops after the current line
+    bool exit_requested = false;
+    int exit_code = 0;
+
+    Shell() {
+        vars.import_environment();
+        vars.set("PWD", working_directory(), true);
+        path_cache.follow(vars);
+    }
+    // path_cache points at vars
+    Shell(const Shell&) = delete;
+    Shell& operator=(const Shell&) = delete;
+};
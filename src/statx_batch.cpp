@@ -0,0 +1,241 @@
+#include "statx_batch.hpp"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace {
+
+// Threads the fallback starts for one batch, the calling thread included
+constexpr size_t kMaxThreads = 16;
+
+void statx_one(const char* path, unsigned mask, StatxResult& result) {
+    result.error = statx(AT_FDCWD, path, 0, mask, &result.st) == 0 ? 0 : errno;
+}
+
+void statx_serial(std::span<const char* const> paths, unsigned mask, std::span<StatxResult> results) {
+    for (size_t i = 0; i < paths.size(); ++i) statx_one(paths[i], mask, results[i]);
+}
+
+// Each thread takes the next path until none are left, so one slow path
+// holds up only the thread waiting on it
+void statx_threads(std::span<const char* const> paths, unsigned mask, std::span<StatxResult> results) {
+    if (paths.empty()) return;
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < paths.size();) {
+            statx_one(paths[i], mask, results[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    const size_t count = std::min(kMaxThreads, paths.size());
+    threads.reserve(count - 1);
+    for (size_t t = 1; t < count; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+// A submission and completion queue pair set up with the raw system calls,
+// since statx is all it is used for. Opened on first use; a forked child
+// sets up its own rather than sharing its parent's.
+class Ring {
+public:
+    static constexpr unsigned kEntries = 128;
+
+    ~Ring() { close_ring(); }
+
+    // Whether the ring can be used in this process, opening it if need be
+    bool ready() {
+        if (fd_ >= 0 && owner_ == getpid()) return true;
+        close_ring();
+        if (failed_ && owner_ == getpid()) return false;
+        owner_ = getpid();
+        failed_ = !open_ring();
+        if (failed_) close_ring();
+        return !failed_;
+    }
+
+    // At most kEntries statx calls, submitted together and waited for
+    bool run(std::span<const char* const> paths, unsigned mask, std::span<StatxResult> results) {
+        unsigned tail = *sq_tail_;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            const unsigned slot = tail & *sq_mask_;
+            io_uring_sqe& sqe = sqes_[slot];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_STATX;
+            sqe.fd = AT_FDCWD;
+            sqe.addr = reinterpret_cast<uintptr_t>(paths[i]);
+            sqe.len = mask;
+            sqe.off = reinterpret_cast<uintptr_t>(&results[i].st);
+            sqe.user_data = i;
+            sq_array_[slot] = slot;
+            ++tail;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+        const unsigned count = static_cast<unsigned>(paths.size());
+        unsigned to_submit = count;
+        unsigned completed = 0;
+        while (completed < count) {
+            const long n = syscall(__NR_io_uring_enter, fd_, to_submit, count - completed,
+                                   IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                // The ring is given up for good, but calls already submitted
+                // still write into results; the completion queue is watched
+                // directly until every one of them is in
+                for (const unsigned submitted = count - to_submit; completed < submitted;) {
+                    const unsigned reaped = reap(results);
+                    if (reaped == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    completed += reaped;
+                }
+                failed_ = true;
+                close_ring();
+                return false;
+            }
+            to_submit -= std::min(to_submit, static_cast<unsigned>(n));
+            completed += reap(results);
+        }
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+    pid_t owner_ = 0;
+    bool failed_ = false;
+    void* sq_ring_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = MAP_FAILED;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    // Record the completions posted so far; returns how many there were
+    unsigned reap(std::span<StatxResult> results) {
+        unsigned head = *cq_head_;
+        const unsigned ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        const unsigned reaped = ready - head;
+        for (; head != ready; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            results[cqe.user_data].error = cqe.res < 0 ? -cqe.res : 0;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return reaped;
+    }
+
+    bool open_ring() {
+        io_uring_params params{};
+        const long fd = syscall(__NR_io_uring_setup, kEntries, &params);
+        if (fd < 0) return false;
+        fd_ = static_cast<int>(fd);
+        // Closed across exec like the shell's other descriptors
+        fcntl(fd_, F_SETFD, FD_CLOEXEC);
+        // statx blocks in a kernel worker, and by default there are only
+        // four per CPU of them; a batch should wait on one round trip, not
+        // on its share of a few workers
+        unsigned workers[2] = {kEntries, 0};
+        syscall(__NR_io_uring_register, fd_, IORING_REGISTER_IOWQ_MAX_WORKERS, workers, 2);
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                        IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) return false;
+        if (!single) {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                            IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) return false;
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                          IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_ring_);
+        char* cq = static_cast<char*>(single ? sq_ring_ : cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void close_ring() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ring_ != MAP_FAILED) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        sqes_ = nullptr;
+        cq_ring_ = sq_ring_ = MAP_FAILED;
+    }
+};
+
+Ring& ring() {
+    static Ring r;
+    return r;
+}
+
+bool statx_io_uring(std::span<const char* const> paths, unsigned mask, std::span<StatxResult> results) {
+    Ring& r = ring();
+    if (!r.ready()) return false;
+    for (size_t start = 0; start < paths.size(); start += Ring::kEntries) {
+        const size_t count = std::min<size_t>(Ring::kEntries, paths.size() - start);
+        if (!r.run(paths.subspan(start, count), mask, results.subspan(start, count))) {
+            // The rest, including this chunk again, by thread
+            statx_threads(paths.subspan(start), mask, results.subspan(start));
+            return true;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+StatxBackend statx_batch(std::span<const char* const> paths, unsigned mask, std::span<StatxResult> results,
+                         StatxBackend backend) {
+    // A single path gains nothing from either
+    if (backend == StatxBackend::Auto && paths.size() <= 1) backend = StatxBackend::Serial;
+    switch (backend) {
+    case StatxBackend::Auto:
+    case StatxBackend::IoUring:
+        if (statx_io_uring(paths, mask, results)) return StatxBackend::IoUring;
+        [[fallthrough]];
+    case StatxBackend::Threads:
+        statx_threads(paths, mask, results);
+        return StatxBackend::Threads;
+    case StatxBackend::Serial:
+        break;
+    }
+    statx_serial(paths, mask, results);
+    return StatxBackend::Serial;
+}
+
+#endif
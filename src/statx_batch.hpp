@@ -0,0 +1,28 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <span>
+
+#include <sys/stat.h>
+
+// The outcome of one statx: error is 0 or an errno value
+struct StatxResult {
+    int error = 0;
+    struct statx st{};
+};
+
+// How a batch is carried out. Auto takes io_uring when the kernel allows
+// it and threads otherwise; the rest force one way, for comparison.
+enum class StatxBackend { Auto, IoUring, Threads, Serial };
+
+// statx every path at once, following symlinks; results[i] is for
+// paths[i]. Through io_uring the whole batch is one submission the kernel
+// works through concurrently, so on a network filesystem it costs about
+// one round trip rather than one per path. Where io_uring is missing or
+// disabled a few threads share the paths instead. Returns the backend
+// that ran.
+StatxBackend statx_batch(std::span<const char* const> paths, unsigned mask, std::span<StatxResult> results,
+                         StatxBackend backend = StatxBackend::Auto);
+
+#endif
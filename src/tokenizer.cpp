@@ -0,0 +1,1003 @@
+#include "tokenizer.hpp"
+#include "glob.hpp"
+#include "variables.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SHELL_TOKENIZER_SSE2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define SHELL_TOKENIZER_AVX2 1
+#endif
+#endif
+
+namespace {
+
+// Bytes that end a plain run outside quotes: whitespace, quotes, backslash
+// and the operator characters, '$', '`' and the wildcards.
+constexpr std::array<bool, 256> make_table(std::string_view chars) {
+    std::array<bool, 256> t{};
+    for (char c : chars) t[static_cast<unsigned char>(c)] = true;
+    return t;
+}
+
+constexpr auto kUnquotedStop = make_table(" \t\n\v\f\r'\"\\|&$<>`*?[");
+// Inside double quotes only the closing quote and escapes matter
+constexpr auto kDoubleQuotedStop = make_table("\"\\$`");
+
+#ifdef SHELL_TOKENIZER_SSE2
+inline unsigned unquoted_mask_sse2(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // \t \n \v \f \r are 0x09..0x0d; bytes >= 0x80 compare negative and drop out
+    __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x08)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8(0x0e)));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('?')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+inline unsigned double_quoted_mask_sse2(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+inline unsigned first_bit(unsigned m) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctz(m));
+#else
+    unsigned long idx;
+    _BitScanForward(&idx, m);
+    return static_cast<unsigned>(idx);
+#endif
+}
+#endif
+
+#ifdef SHELL_TOKENIZER_AVX2
+__attribute__((target("avx2")))
+size_t scan_unquoted_avx2(const char* p, size_t i, size_t n) {
+    const __m256i lo = _mm256_set1_epi8(0x08), hi = _mm256_set1_epi8(0x0e);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i m = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('?')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')));
+        if (unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(m))) {
+            return i + static_cast<unsigned>(__builtin_ctz(bits));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t scan_double_quoted_avx2(const char* p, size_t i, size_t n) {
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')));
+        if (unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(m))) {
+            return i + static_cast<unsigned>(__builtin_ctz(bits));
+        }
+    }
+    return i;
+}
+
+const bool have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+// Index of the first byte at or after i that stops a plain run, or n. Whole
+// vectors are only loaded while they fit inside the line.
+size_t scan_unquoted(const char* p, size_t i, size_t n) {
+#ifdef SHELL_TOKENIZER_AVX2
+    if (have_avx2) {
+        i = scan_unquoted_avx2(p, i, n);
+        if (i + 32 <= n) return i;
+    }
+#endif
+#ifdef SHELL_TOKENIZER_SSE2
+    for (; i + 16 <= n; i += 16) {
+        if (unsigned m = unquoted_mask_sse2(p + i)) return i + first_bit(m);
+    }
+#endif
+    while (i < n && !kUnquotedStop[static_cast<unsigned char>(p[i])]) ++i;
+    return i;
+}
+
+size_t scan_double_quoted(const char* p, size_t i, size_t n) {
+#ifdef SHELL_TOKENIZER_AVX2
+    if (have_avx2) {
+        i = scan_double_quoted_avx2(p, i, n);
+        if (i + 32 <= n) return i;
+    }
+#endif
+#ifdef SHELL_TOKENIZER_SSE2
+    for (; i + 16 <= n; i += 16) {
+        if (unsigned m = double_quoted_mask_sse2(p + i)) return i + first_bit(m);
+    }
+#endif
+    while (i < n && !kDoubleQuotedStop[static_cast<unsigned char>(p[i])]) ++i;
+    return i;
+}
+
+bool is_blank(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool is_wildcard(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// The parameter named after the '$' at p[i]: NAME, ${NAME}, ?, $ or a
+// single digit. Returns the index past it, or i when the '$' is literal
+// (set bad for an unterminated or malformed ${...}).
+size_t parameter_name(const char* p, size_t i, size_t n, std::string_view& name, bool& bad) {
+    size_t j = i + 1;
+    if (j >= n) return i;
+    if (p[j] == '{') {
+        const void* close = std::memchr(p + j, '}', n - j);
+        if (!close) {
+            bad = true;
+            return i;
+        }
+        size_t end = static_cast<size_t>(static_cast<const char*>(close) - p);
+        name = {p + j + 1, end - j - 1};
+        bad = !(name == "?" || name == "$" || is_valid_name(name) ||
+                (name.size() == 1 && name[0] >= '0' && name[0] <= '9'));
+        return end + 1;
+    }
+    if (p[j] == '?' || p[j] == '$' || (p[j] >= '0' && p[j] <= '9')) {
+        name = {p + j, 1};
+        return j + 1;
+    }
+    if (!is_name_char(p[j])) return i;
+    size_t end = j;
+    while (end < n && is_name_char(p[end])) ++end;
+    name = {p + j, end - j};
+    return end;
+}
+
+size_t substitution_end(const char* p, size_t i, size_t n);
+
+// Index of the '`' closing the one at p[i], or n; a backslash escapes the
+// byte after it
+size_t backquote_end(const char* p, size_t i, size_t n) {
+    for (size_t j = i + 1; j < n; ++j) {
+        if (p[j] == '\\') {
+            ++j;
+        } else if (p[j] == '`') {
+            return j;
+        }
+    }
+    return n;
+}
+
+// Index of the '"' closing the one at p[i], or n, stepping over the
+// substitutions inside
+size_t double_quote_end(const char* p, size_t i, size_t n) {
+    for (size_t j = i + 1; j < n; ++j) {
+        switch (p[j]) {
+        case '\\':
+            ++j;
+            break;
+        case '"':
+            return j;
+        case '`':
+            j = backquote_end(p, j, n);
+            break;
+        case '$':
+            if (j + 1 < n && p[j + 1] == '(') j = substitution_end(p, j, n);
+            break;
+        }
+    }
+    return n;
+}
+
+// Index of the ')' closing the $( at p[i], or n. A ')' that is quoted,
+// escaped, inside a nested substitution or matching a '(' of the command's
+// own does not count.
+size_t substitution_end(const char* p, size_t i, size_t n) {
+    size_t depth = 0;
+    for (size_t j = i + 2; j < n; ++j) {
+        switch (p[j]) {
+        case '\\':
+            ++j;
+            break;
+        case '\'': {
+            const void* q = std::memchr(p + j + 1, '\'', n - j - 1);
+            if (!q) return n;
+            j = static_cast<size_t>(static_cast<const char*>(q) - p);
+            break;
+        }
+        case '"':
+            j = double_quote_end(p, j, n);
+            break;
+        case '`':
+            j = backquote_end(p, j, n);
+            break;
+        case '$':
+            if (j + 1 < n && p[j + 1] == '(') j = substitution_end(p, j, n);
+            break;
+        case '(':
+            ++depth;
+            break;
+        case ')':
+            if (depth == 0) return j;
+            --depth;
+            break;
+        }
+    }
+    return n;
+}
+
+// The command inside `...`: a backslash before '`', '\\' or '$' only
+// escapes it
+std::string backquoted_command(std::string_view text) {
+    std::string command;
+    command.reserve(text.size());
+    for (size_t j = 0; j < text.size(); ++j) {
+        if (text[j] == '\\' && j + 1 < text.size() &&
+            (text[j + 1] == '`' || text[j + 1] == '\\' || text[j + 1] == '$')) {
+            ++j;
+        }
+        command += text[j];
+    }
+    return command;
+}
+
+// The value of a parameter; numbers are formatted into buf
+std::string_view parameter_value(const Expansion& expansion, std::string_view name, char (&buf)[24]) {
+    long number;
+    if (name == "?") {
+        number = expansion.last_status;
+    } else if (name == "$") {
+#ifdef _WIN32
+        number = _getpid();
+#else
+        number = getpid();
+#endif
+    } else {
+        const std::string* value = expansion.vars.get(name);
+        return value ? std::string_view(*value) : std::string_view();
+    }
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), number);
+    return {buf, static_cast<size_t>(end - buf)};
+}
+
+// A here-document body with parameters and command substitutions replaced.
+// Unclosed or malformed ones are copied as they are.
+std::string expand_here_body(std::string_view body, const Expansion& expansion) {
+    std::string out;
+    out.reserve(body.size());
+    const char* p = body.data();
+    const size_t n = body.size();
+    size_t i = 0;
+    while (i < n) {
+        size_t stop = body.find_first_of("\\$`", i);
+        if (stop == std::string_view::npos) stop = n;
+        out.append(p + i, stop - i);
+        i = stop;
+        if (i >= n) break;
+        const char c = p[i];
+
+        if (c == '\\') {
+            if (i + 1 < n && (p[i + 1] == '$' || p[i + 1] == '`' || p[i + 1] == '\\' || p[i + 1] == '\n')) {
+                if (p[i + 1] != '\n') out += p[i + 1];
+                i += 2;
+            } else {
+                out += c;
+                ++i;
+            }
+            continue;
+        }
+
+        const bool backquoted = c == '`';
+        if (backquoted || (i + 1 < n && p[i + 1] == '(' && !(i + 2 < n && p[i + 2] == '('))) {
+            const size_t end = backquoted ? backquote_end(p, i, n) : substitution_end(p, i, n);
+            if (!expansion.substitute || end >= n) {
+                out += c;
+                ++i;
+                continue;
+            }
+            const size_t skip = backquoted ? 1 : 2;
+            std::string_view text = body.substr(i + skip, end - i - skip);
+            out += backquoted ? expansion.substitute(expansion.context, backquoted_command(text))
+                              : expansion.substitute(expansion.context, text);
+            i = end + 1;
+            continue;
+        }
+
+        std::string_view name;
+        bool bad = false;
+        const size_t end = parameter_name(p, i, n, name, bad);
+        if (bad || end == i) {
+            out += c;
+            ++i;
+            continue;
+        }
+        char buf[24];
+        out += parameter_value(expansion, name, buf);
+        i = end;
+    }
+    return out;
+}
+
+} // namespace
+
+bool tokenize_command(std::string_view line, Arena& arena, std::vector<Token>& tokens,
+                      const Expansion* expansion, std::vector<ExpansionSite>* sites) {
+    tokens.clear();
+    if (sites) sites->clear();
+    const bool record = sites && !expansion;
+    const char* p = line.data();
+    const size_t n = line.size();
+    size_t i = 0;
+    bool in_double_quotes = false;
+    bool in_single_quotes = false;
+    // Whether the next unquoted byte starts a word, and if the current word
+    // began as NAME=
+    bool word_start = true;
+    bool assignment = false;
+    bool substituted = false;
+    // Offsets in the current word of the wildcards that were not quoted
+    std::vector<size_t> wildcards;
+    bool bad_substitution = false;
+    bool unclosed_substitution = false;
+    // The here-document or here-string operator the next word belongs to,
+    // or Word. That word may be empty but must be there: it has begun once
+    // anything in it was quoted, escaped or expanded.
+    TokenKind operand = TokenKind::Word;
+    bool operand_quoted = false;
+    bool operand_expanded = false;
+    // The first operator met where an operand was missing
+    std::string_view unexpected;
+    // Where the current word began in line, and for a redirection operand
+    // the descriptor and operation it is for
+    size_t word_begin = 0;
+    int redirect_fd = -1;
+    RedirectOp redirect_op = RedirectOp::Output;
+    // The site the current word would be: where it, or the operator it is
+    // the operand of, began, its first token and whether it expands at all
+    size_t site_begin = 0;
+    size_t site_first = 0;
+    bool site_expands = false;
+
+    // Replace the word being built by the paths it matches; false, leaving
+    // it alone, when nothing does. Quoted wildcards (and backslashes) are
+    // escaped in the pattern so they match only themselves.
+    auto expand_pathnames = [&] {
+        const std::string_view word = arena.view();
+        std::string pattern;
+        pattern.reserve(word.size() + 8);
+        size_t next = 0;
+        for (size_t j = 0; j < word.size(); ++j) {
+            if (next < wildcards.size() && wildcards[next] == j) {
+                ++next;
+            } else if (is_wildcard(word[j]) || word[j] == '\\') {
+                pattern += '\\';
+            }
+            pattern += word[j];
+        }
+        auto matches = expand_glob(pattern);
+        if (matches.empty()) return false;
+        arena.discard();
+        for (const auto& path : matches) tokens.push_back({arena.store(path), TokenKind::Word});
+        return true;
+    };
+
+    // The word just ended at i; record it if it had something to expand
+    auto close_site = [&] {
+        if (site_expands) {
+            sites->push_back({line.substr(site_begin, i - site_begin), site_first, tokens.size() - site_first});
+        }
+        site_expands = false;
+    };
+
+    // Empty words (such as a bare '') are dropped, as they always have been.
+    // Assignments are not globbed.
+    auto end_word = [&] {
+        if (operand != TokenKind::Word) {
+            if (arena.size() == 0 && !operand_quoted && !operand_expanded) return;
+            if (operand == TokenKind::HereString) arena.append('\n');
+            const std::string_view text = arena.finish();
+            if (operand != TokenKind::Redirect) {
+                tokens.push_back({text, operand, false, substituted, operand_quoted});
+            } else if (redirect_op == RedirectOp::Duplicate && redirect_fd == 1 && text != "-" &&
+                       text.find_first_not_of("0123456789") != std::string_view::npos) {
+                // >&file sends both outputs to the file, as &> does
+                tokens.push_back({text, operand, false, substituted, false, 1, RedirectOp::Output});
+                tokens.push_back({"1", operand, false, false, false, 2, RedirectOp::Duplicate});
+            } else if (redirect_fd < 0) {
+                tokens.push_back({text, operand, false, substituted, false, 1, redirect_op});
+                tokens.push_back({"1", operand, false, false, false, 2, RedirectOp::Duplicate});
+            } else {
+                tokens.push_back({text, operand, false, substituted, false, redirect_fd, redirect_op});
+            }
+            close_site();
+            operand = TokenKind::Word;
+            operand_quoted = false;
+            operand_expanded = false;
+            arena.begin();
+            word_start = true;
+            assignment = false;
+            substituted = false;
+            return;
+        }
+        // Quotes in this word say nothing of an operand that follows it
+        operand_quoted = false;
+        if (!wildcards.empty()) {
+            const bool replaced = !assignment && expand_pathnames();
+            wildcards.clear();
+            if (replaced) {
+                arena.begin();
+                word_start = true;
+                assignment = false;
+                substituted = false;
+                return;
+            }
+        }
+        if (arena.size() > 0) {
+            tokens.push_back({arena.finish(), TokenKind::Word, assignment, substituted});
+        }
+        close_site();
+        arena.begin();
+        word_start = true;
+        assignment = false;
+        substituted = false;
+    };
+
+    // Add an expanded value to the word, splitting it at blanks unless quoted
+    auto insert = [&](std::string_view value, bool quoted) {
+        if (operand != TokenKind::Word) operand_expanded = true;
+        if (quoted || assignment || operand != TokenKind::Word) {
+            if (!value.empty()) arena.append(value.data(), value.size());
+            return;
+        }
+        for (char c : value) {
+            if (is_blank(c)) {
+                end_word();
+                // A word that starts inside a value is never an assignment
+                word_start = false;
+            } else {
+                if (is_wildcard(c)) wildcards.push_back(arena.size());
+                arena.append(c);
+            }
+        }
+    };
+
+    // A here-document delimiter is taken as written
+    auto literal = [&] {
+        return operand == TokenKind::HereDocument || operand == TokenKind::HereDocumentStrip;
+    };
+
+    // Run the command substitution at p[i] (a "$(" or '`'); false if it is
+    // to be copied literally
+    auto substitute = [&](bool quoted) {
+        if (!expansion || !expansion->substitute || literal()) return false;
+        const bool backquoted = p[i] == '`';
+        size_t end = backquoted ? backquote_end(p, i, n) : substitution_end(p, i, n);
+        if (end >= n) {
+            unclosed_substitution = true;
+            i = n;
+            return true;
+        }
+        std::string_view text = line.substr(i + (backquoted ? 1 : 2), end - i - (backquoted ? 1 : 2));
+        std::string output = backquoted
+            ? expansion->substitute(expansion->context, backquoted_command(text))
+            : expansion->substitute(expansion->context, text);
+        insert(output, quoted);
+        substituted = true;
+        i = end + 1;
+        return true;
+    };
+
+    // Recording sites, without an expansion: note whether the '$' or '`' at
+    // p[i] would be expanded, and copy a command substitution or ${...}
+    // into the word whole. False when nothing was copied.
+    auto step_over = [&] {
+        if (literal()) return false;
+        size_t end;
+        if (p[i] == '`') {
+            end = backquote_end(p, i, n);
+        } else if (i + 1 < n && p[i + 1] == '(') {
+            if (i + 2 < n && p[i + 2] == '(') return false;
+            end = substitution_end(p, i, n);
+        } else if (i + 1 < n && p[i + 1] == '{') {
+            const void* close = std::memchr(p + i, '}', n - i);
+            end = close ? static_cast<size_t>(static_cast<const char*>(close) - p) : n;
+        } else {
+            std::string_view name;
+            bool bad = false;
+            if (parameter_name(p, i, n, name, bad) != i) site_expands = true;
+            return false;
+        }
+        site_expands = true;
+        end = std::min(end + 1, n);
+        arena.append(p + i, end - i);
+        i = end;
+        return true;
+    };
+
+    // Substitute the parameter or command at p[i] (a '$'); false if the '$'
+    // is literal. $((...)) is arithmetic, which is not supported, and stays.
+    auto expand = [&](bool quoted) {
+        if (literal()) return false;
+        if (i + 1 < n && p[i + 1] == '(') return !(i + 2 < n && p[i + 2] == '(') && substitute(quoted);
+        std::string_view name;
+        bool bad = false;
+        size_t end = parameter_name(p, i, n, name, bad);
+        if (bad) {
+            bad_substitution = true;
+            i = n;
+            return true;
+        }
+        if (end == i) return false;
+        char buf[24];
+        insert(parameter_value(*expansion, name, buf), quoted);
+        i = end;
+        return true;
+    };
+
+    // A redirection operator at p[i]: '<' or '>', then '>', '&' or '|'. A
+    // single digit written as a word of its own right before it is the
+    // descriptor, else it is fd.
+    auto redirect = [&](int fd) {
+        size_t begin = i;
+        if (arena.size() == 1 && word_begin + 1 == i && p[i - 1] >= '0' && p[i - 1] <= '9' &&
+            wildcards.empty() && !substituted) {
+            fd = p[i - 1] - '0';
+            begin = i - 1;
+            arena.discard();
+        }
+        end_word();
+        site_begin = begin;
+        site_first = tokens.size();
+        const char next = i + 1 < n ? p[i + 1] : '\0';
+        size_t len = 1;
+        if (next == '&') {
+            redirect_op = RedirectOp::Duplicate;
+            len = 2;
+        } else if (p[i] == '<') {
+            redirect_op = RedirectOp::Input;
+        } else if (next == '>' || next == '|') {
+            redirect_op = next == '>' ? RedirectOp::Append : RedirectOp::Output;
+            len = 2;
+        } else {
+            redirect_op = RedirectOp::Output;
+        }
+        if (operand != TokenKind::Word && unexpected.empty()) unexpected = line.substr(i, len);
+        operand = TokenKind::Redirect;
+        redirect_fd = fd;
+        i += len;
+    };
+
+    arena.begin();
+    while (i < n) {
+        if (word_start && !in_double_quotes && !in_single_quotes && !is_blank(p[i])) {
+            word_start = false;
+            word_begin = i;
+            assignment = is_assignment(line.substr(i, line.find_first_of(" \t\n\v\f\r\"'\\|&", i) - i));
+            if (operand == TokenKind::Word) {
+                site_begin = i;
+                site_first = tokens.size();
+            }
+        }
+
+        if (in_single_quotes) {
+            // Everything up to the closing quote is literal
+            const void* q = std::memchr(p + i, '\'', n - i);
+            if (!q) {
+                arena.append(p + i, n - i);
+                i = n;
+                break;
+            }
+            size_t end = static_cast<size_t>(static_cast<const char*>(q) - p);
+            arena.append(p + i, end - i);
+            i = end + 1;
+            in_single_quotes = false;
+            continue;
+        }
+
+        // Copy the plain run in one go, then deal with the byte that ended it
+        size_t stop = in_double_quotes ? scan_double_quoted(p, i, n) : scan_unquoted(p, i, n);
+        if (stop > i) arena.append(p + i, stop - i);
+        i = stop;
+        if (i >= n) break;
+        const char c = p[i];
+
+        if (in_double_quotes) {
+            if (c == '"') {
+                in_double_quotes = false;
+                ++i;
+            } else if (c == '\\' && i + 1 < n) {
+#ifdef _WIN32
+                const bool escapable = p[i + 1] == '"' || p[i + 1] == '\\';
+#else
+                // Inside double quotes, only specific chars are escapable
+                const bool escapable = p[i + 1] == '"' || p[i + 1] == '\\' ||
+                                       p[i + 1] == '$' || p[i + 1] == '`';
+#endif
+                if (escapable) {
+                    arena.append(p[i + 1]);
+                    i += 2;
+                } else {
+                    // Otherwise, add the backslash literally inside double quotes
+                    arena.append('\\');
+                    ++i;
+                }
+            } else if ((c == '$' || c == '`') && record && step_over()) {
+                // Copied whole, to be expanded when the site is
+            } else if (c == '$' && expansion) {
+                if (!expand(true)) {
+                    arena.append(c);
+                    ++i;
+                }
+            } else if (c == '`' && substitute(true)) {
+                // Replaced by the command's output
+            } else {
+                arena.append(c);
+                ++i;
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            in_double_quotes = true;
+            operand_quoted = true;
+            ++i;
+            break;
+#ifndef _WIN32
+        case '\'':
+            in_single_quotes = true;
+            operand_quoted = true;
+            ++i;
+            break;
+        case '\\':
+            operand_quoted = true;
+            if (i + 1 < n) {
+                // Line continuation disappears; anything else is taken literally
+                if (p[i + 1] != '\n') arena.append(p[i + 1]);
+                i += 2;
+            } else {
+                // A trailing backslash stays
+                arena.append('\\');
+                ++i;
+            }
+            break;
+#endif
+        case '|':
+            // An unquoted '|' ends the word and separates pipeline stages
+            end_word();
+            if (operand != TokenKind::Word && unexpected.empty()) unexpected = "|";
+            tokens.push_back({"|", TokenKind::Pipe});
+            ++i;
+            break;
+        case '&':
+            if (i + 1 < n && p[i + 1] == '>') {
+                // &>word and &>>word: both outputs to one file
+                end_word();
+                site_begin = i;
+                site_first = tokens.size();
+                if (operand != TokenKind::Word && unexpected.empty()) unexpected = line.substr(i, 2);
+                const bool append = i + 2 < n && p[i + 2] == '>';
+                operand = TokenKind::Redirect;
+                redirect_fd = -1;
+                redirect_op = append ? RedirectOp::Append : RedirectOp::Output;
+                i += append ? 3 : 2;
+                break;
+            }
+            // An unquoted '&' ends the pipeline before it, which runs as a
+            // background job
+            end_word();
+            if (operand != TokenKind::Word && unexpected.empty()) unexpected = "&";
+            tokens.push_back({"&", TokenKind::Background});
+            ++i;
+            break;
+        case '<': {
+            // "<<" and "<<-" start a here-document and "<<<" a here-string;
+            // the word after them is their operand
+            size_t len = 1;
+            while (len < 3 && i + len < n && p[i + len] == '<') ++len;
+            if (len == 1) {
+                redirect(0);
+                break;
+            }
+            end_word();
+            site_begin = i;
+            site_first = tokens.size();
+            if (operand != TokenKind::Word && unexpected.empty()) unexpected = line.substr(i, len);
+            if (len == 3) {
+                operand = TokenKind::HereString;
+            } else if (i + 2 < n && p[i + 2] == '-') {
+                operand = TokenKind::HereDocumentStrip;
+                len = 3;
+            } else {
+                operand = TokenKind::HereDocument;
+            }
+            i += len;
+            break;
+        }
+        case '>':
+            redirect(1);
+            break;
+        case '$':
+            if (record && step_over()) break;
+            if (!expansion || !expand(false)) {
+                arena.append(c);
+                ++i;
+            }
+            break;
+        case '`':
+            if (record && step_over()) break;
+            if (!substitute(false)) {
+                arena.append(c);
+                ++i;
+            }
+            break;
+        case '*':
+        case '?':
+        case '[':
+            // Pathnames are expanded along with everything else
+            if (expansion && operand == TokenKind::Word) wildcards.push_back(arena.size());
+            if (record && operand == TokenKind::Word) site_expands = true;
+            arena.append(c);
+            ++i;
+            break;
+        default:
+            if (is_blank(c)) {
+                end_word();
+            } else {
+                arena.append(c);
+            }
+            ++i;
+            break;
+        }
+    }
+
+    // Check for unclosed quotes
+    if (in_double_quotes || in_single_quotes) {
+        arena.discard();
+        tokens.clear();
+        std::cerr << "Error: unclosed quote\n";
+        return false;
+    }
+    if (bad_substitution) {
+        arena.discard();
+        tokens.clear();
+        std::cerr << "Error: bad substitution\n";
+        return false;
+    }
+    if (unclosed_substitution) {
+        arena.discard();
+        tokens.clear();
+        std::cerr << "Error: unclosed command substitution\n";
+        return false;
+    }
+
+    end_word();
+    if (operand != TokenKind::Word && unexpected.empty()) unexpected = "newline";
+    if (!unexpected.empty()) {
+        arena.discard();
+        tokens.clear();
+        std::cerr << "syntax error near unexpected token `" << unexpected << "'\n";
+        return false;
+    }
+    return true;
+}
+
+void read_here_documents(std::vector<Token>& tokens, Arena& arena, const Expansion* expansion,
+                         NextLine next_line, void* context) {
+    std::string body;
+    std::string line;
+    for (Token& token : tokens) {
+        if (token.kind != TokenKind::HereDocument && token.kind != TokenKind::HereDocumentStrip) continue;
+        body.clear();
+        bool closed = false;
+        while (next_line && next_line(context, line)) {
+            std::string_view text = line;
+            if (token.kind == TokenKind::HereDocumentStrip) {
+                text.remove_prefix(std::min(text.find_first_not_of('\t'), text.size()));
+            }
+            if (text == token.text) {
+                closed = true;
+                break;
+            }
+            body += text;
+            body += '\n';
+        }
+        if (!closed) {
+            std::cerr << "warning: here-document delimited by end-of-file (wanted `" << token.text << "')\n";
+        }
+        token.text = arena.store(expansion && !token.quoted ? expand_here_body(body, *expansion) : body);
+    }
+}
+
+namespace {
+
+// Bytes that may end a command piece or hide one of its operators
+constexpr auto kSplitStop = make_table(" \t\n\v\f\r'\"\\`$;&|#");
+
+constexpr std::string_view kReservedWords[] = {"if", "then", "elif", "else", "fi", "for",
+                                                "while", "until", "do", "done", "!"};
+
+bool is_reserved(std::string_view word) {
+    return std::find(std::begin(kReservedWords), std::end(kReservedWords), word) != std::end(kReservedWords);
+}
+
+// Whether what follows the reserved word is a command of its own; after
+// `for` it is the loop's header, and after `fi` or `done` an operator
+bool opens_command(std::string_view word) {
+    return word != "fi" && word != "done" && word != "for";
+}
+
+} // namespace
+
+void split_line(std::string_view line, std::vector<Piece>& pieces) {
+    const char* p = line.data();
+    const size_t n = line.size();
+    size_t i = 0;
+    bool command_position = true;
+    while (i < n) {
+        while (i < n && p[i] != '\n' && is_blank(p[i])) ++i;
+        if (i >= n) break;
+        const char c = p[i];
+        if (c == '#') {
+            while (i < n && p[i] != '\n') ++i;
+            continue;
+        }
+        if (c == '\n' || c == ';' || ((c == '&' || c == '|') && i + 1 < n && p[i + 1] == c) ||
+            (c == '&' && !(i + 1 < n && p[i + 1] == '>'))) {
+            const size_t len = c != '\n' && c != ';' && i + 1 < n && p[i + 1] == c ? 2 : 1;
+            pieces.push_back({PieceKind::Separator, line.substr(i, len)});
+            i += len;
+            command_position = true;
+            continue;
+        }
+
+        if (command_position) {
+            size_t end = i;
+            while (end < n && !kSplitStop[static_cast<unsigned char>(p[end])] && p[end] != '<' && p[end] != '>') {
+                ++end;
+            }
+            const std::string_view word = line.substr(i, end - i);
+            const bool alone = end == n || is_blank(p[end]) || p[end] == ';' || p[end] == '&' || p[end] == '|';
+            if (alone && is_reserved(word)) {
+                pieces.push_back({PieceKind::Reserved, word});
+                command_position = opens_command(word);
+                i = end;
+                continue;
+            }
+        }
+
+        // A command runs to the next separator or comment; quotes and
+        // substitutions are stepped over whole
+        const size_t start = i;
+        size_t last = i;
+        bool word_start = true;
+        while (i < n) {
+            const char b = p[i];
+            if (b == '\n' || b == ';') break;
+            if (is_blank(b)) {
+                word_start = true;
+                ++i;
+                continue;
+            }
+            if (b == '#' && word_start) break;
+            if (b == '&' && (i + 1 >= n || p[i + 1] != '>') && p[i - 1] != '>' && p[i - 1] != '<') break;
+            if (b == '|' && i + 1 < n && p[i + 1] == '|') break;
+            word_start = b == '|';
+            switch (b) {
+            case '\\':
+                i += 2;
+                break;
+            case '\'': {
+                const void* q = i + 1 < n ? std::memchr(p + i + 1, '\'', n - i - 1) : nullptr;
+                i = q ? static_cast<size_t>(static_cast<const char*>(q) - p) + 1 : n;
+                break;
+            }
+            case '"':
+                i = double_quote_end(p, i, n) + 1;
+                break;
+            case '`':
+                i = backquote_end(p, i, n) + 1;
+                break;
+            case '$':
+                if (i + 1 < n && p[i + 1] == '(') {
+                    i = substitution_end(p, i, n) + 1;
+                } else if (i + 1 < n && p[i + 1] == '{') {
+                    const void* close = std::memchr(p + i, '}', n - i);
+                    i = close ? static_cast<size_t>(static_cast<const char*>(close) - p) + 1 : n;
+                } else {
+                    ++i;
+                }
+                break;
+            default:
+                ++i;
+                break;
+            }
+            i = std::min(i, n);
+            last = i;
+        }
+        pieces.push_back({PieceKind::Command, line.substr(start, last - start)});
+        command_position = false;
+    }
+}
+
+bool ends_in_substitution(std::string_view line) {
+    const char* p = line.data();
+    const size_t n = line.size();
+    for (size_t i = 0; i < n; ++i) {
+        switch (p[i]) {
+        case '\\':
+            ++i;
+            break;
+        case '#':
+            if (i == 0 || is_blank(p[i - 1]) || p[i - 1] == '\n' || p[i - 1] == ';') return false;
+            break;
+        case '\'': {
+            // An unclosed quote is reported when the line is tokenized
+            const void* q = i + 1 < n ? std::memchr(p + i + 1, '\'', n - i - 1) : nullptr;
+            if (!q) return false;
+            i = static_cast<size_t>(static_cast<const char*>(q) - p);
+            break;
+        }
+        case '"':
+            i = double_quote_end(p, i, n);
+            break;
+        case '`':
+            i = backquote_end(p, i, n);
+            if (i >= n) return true;
+            break;
+        case '$':
+            if (i + 1 < n && p[i + 1] == '(') {
+                i = substitution_end(p, i, n);
+                if (i >= n) return true;
+            }
+            break;
+        }
+    }
+    return false;
+}
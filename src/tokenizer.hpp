@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+
+class Variables;
+
+enum class TokenKind {
+    Word,
+    Pipe,       // unquoted '|'
+    Background, // unquoted '&'
+    // The word after the operator, as one token: the delimiter until
+    // read_here_documents replaces it with the body
+    HereDocument,      // <<WORD
+    HereDocumentStrip, // <<-WORD, leading tabs removed from the body
+    HereString,        // <<<word, expanded but not split, with a newline added
+    // [n]<word, [n]>word, [n]>>word, [n]>&m or [n]<&m, with the target word
+    // expanded but not split; &>word becomes >word 2>&1
+    Redirect,
+};
+
+enum class RedirectOp : uint8_t {
+    Input,     // <
+    Output,    // > (and >|)
+    Append,    // >>
+    Duplicate, // >& or <&: the target is a descriptor, or '-' to close
+};
+
+// Words point into the line's Arena and are NUL-terminated, so they can be
+// handed to exec as they are; they live until the arena is reset
+struct Token {
+    std::string_view text;
+    TokenKind kind = TokenKind::Word;
+    // Written as NAME=value with the name unquoted; only the words before
+    // a command's name are taken as assignments
+    bool assignment = false;
+    // Holds the output of a command substitution
+    bool substituted = false;
+    // A here-document delimiter with any part quoted or escaped: the body
+    // is taken literally
+    bool quoted = false;
+    // Redirect: the descriptor it applies to and what it does
+    int fd = -1;
+    RedirectOp redirect = RedirectOp::Output;
+};
+
+// A word with something to expand, along with any redirection or
+// here-string operator it is the operand of: tokenizing text on its own,
+// with an expansion, gives what tokens [first, first + count) of the whole
+// line stand for
+struct ExpansionSite {
+    std::string_view text;
+    size_t first = 0;
+    size_t count = 0;
+};
+
+// What $ expansion reads: $NAME and ${NAME} from vars, $? and $$
+struct Expansion {
+    const Variables& vars;
+    int last_status;
+    // Runs the command of a $(...) or `...` and returns its output with the
+    // trailing newlines removed. Without it both are copied literally.
+    std::string (*substitute)(void* context, std::string_view command) = nullptr;
+    void* context = nullptr;
+};
+
+// Split a command line into words and operators, applying quote and escape
+// removal. Plain runs between special bytes are found with SSE2/AVX2 and
+// copied in bulk. tokens is cleared first and keeps its capacity. Returns
+// false, with tokens empty, on unclosed quotes, a bad ${...} or an unclosed
+// $(...) or `...` (after reporting it).
+//
+// With an expansion, parameters and command substitutions are replaced as
+// they are met; outside double quotes (and assignments) the value is split
+// into words at blanks. A word with an unquoted '*', '?' or '[' is then
+// replaced by the paths it matches (see expand_glob), unless none do.
+// Without an expansion all of these are copied literally.
+//
+// A here-document delimiter is never expanded; a here-string or
+// redirection target is expanded but neither split nor globbed.
+//
+// Without an expansion, sites (when given) lists each word that has a
+// parameter, command substitution or unquoted wildcard in it, so a line
+// tokenized once can be expanded again word by word; a substitution or
+// ${...} is then kept whole in its word, whatever it holds.
+bool tokenize_command(std::string_view line, Arena& arena, std::vector<Token>& tokens,
+                      const Expansion* expansion = nullptr, std::vector<ExpansionSite>* sites = nullptr);
+
+// A piece of a command line as split_line sees it
+enum class PieceKind : uint8_t {
+    Command,   // a pipeline as written, from its first word to its last
+    Reserved,  // if, then, elif, else, fi, for, while, until, do, done or !
+    Separator, // ;, newline, &, && or ||
+};
+
+struct Piece {
+    PieceKind kind;
+    std::string_view text;
+};
+
+// Cut a line at its unquoted control operators, outside of any quotes or
+// command substitution, and pick out the reserved words where a command
+// would start. Comments are dropped. Nothing is expanded and nothing is
+// checked: each Command piece goes to tokenize_command later. Pieces are
+// appended and point into line.
+void split_line(std::string_view line, std::vector<Piece>& pieces);
+
+// Whether line ends inside a $(...) or `...` begun outside quotes, which
+// then goes on over the next line
+bool ends_in_substitution(std::string_view line);
+
+// Reads the next line of input, without its newline; false at the end
+using NextLine = bool (*)(void* context, std::string& line);
+
+// Replace the delimiter of each here-document in tokens with its body, the
+// lines from next_line up to the one that is the delimiter (after leading
+// tabs are removed, for <<-). Unless the delimiter was quoted, parameters
+// and command substitutions in the body are expanded and a backslash only
+// escapes '$', '`', '\\' and newline; quotes are ordinary bytes. Input that
+// ends first ends the body, with a warning. Bodies are stored in arena.
+void read_here_documents(std::vector<Token>& tokens, Arena& arena, const Expansion* expansion,
+                         NextLine next_line, void* context);
@@ -0,0 +1,190 @@
+#include "trace.hpp"
+
+#ifndef _WIN32
+
+#include "output.hpp"
+#include "platform.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<bool>& enabled() {
+    static std::atomic<bool> on{get_env("SHELL_TRACE").value_or("") == "on"};
+    return on;
+}
+
+uint32_t this_thread() {
+    static std::atomic<uint32_t> next{0};
+    thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void write_json_string(Output& out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+std::string_view label_of(const TraceEvent& event) {
+    return {event.label.data(), strnlen(event.label.data(), event.label.size())};
+}
+
+// Nanoseconds as microseconds with three decimals
+void write_micros(Output& out, uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%llu.%03llu", static_cast<unsigned long long>(ns / 1000),
+                  static_cast<unsigned long long>(ns % 1000));
+    out << buf;
+}
+
+} // namespace
+
+const char* trace_phase_name(TracePhase phase) {
+    switch (phase) {
+    case TracePhase::Parse:
+        return "parse";
+    case TracePhase::Resolve:
+        return "resolve";
+    case TracePhase::Spawn:
+        return "spawn";
+    case TracePhase::Builtin:
+        return "builtin";
+    case TracePhase::Wait:
+        return "wait";
+    }
+    return "?";
+}
+
+bool tracing() {
+    return enabled().load(std::memory_order_relaxed);
+}
+
+void set_tracing(bool on) {
+    enabled().store(on, std::memory_order_relaxed);
+}
+
+TraceBuffer& trace_buffer() {
+    static TraceBuffer buffer;
+    return buffer;
+}
+
+uint64_t trace_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void TraceBuffer::record(TracePhase phase, uint64_t start_ns, uint64_t end_ns, std::string_view label) {
+    const uint64_t ticket = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[ticket % kCapacity];
+    slot.seq.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    TraceEvent& event = slot.event;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    event.line = current_line_.load(std::memory_order_relaxed);
+    event.thread = this_thread();
+    event.phase = phase;
+    const size_t len = std::min(label.size(), event.label.size() - 1);
+    std::memcpy(event.label.data(), label.data(), len);
+    event.label[len] = '\0';
+
+    slot.seq.store(2 * ticket + 2, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceBuffer::snapshot() const {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const uint64_t first = std::max(head > kCapacity ? head - kCapacity : 0,
+                                    cleared_.load(std::memory_order_relaxed));
+    std::vector<TraceEvent> events;
+    events.reserve(head - std::min(first, head));
+    for (uint64_t ticket = first; ticket < head; ++ticket) {
+        const Slot& slot = slots_[ticket % kCapacity];
+        const uint64_t before = slot.seq.load(std::memory_order_acquire);
+        // Still being written, or already overwritten by a later event
+        if (before != 2 * ticket + 2) continue;
+        TraceEvent copy = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != before) continue;
+        events.push_back(copy);
+    }
+    // Tickets go out as phases end; a line reads better by start
+    std::stable_sort(events.begin(), events.end(),
+                     [](const TraceEvent& a, const TraceEvent& b) { return a.start_ns < b.start_ns; });
+    return events;
+}
+
+void TraceBuffer::clear() {
+    cleared_.store(head_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void TraceBuffer::begin_line() {
+    current_line_.store(line_.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void TraceBuffer::end_line() {
+    current_line_.store(0, std::memory_order_relaxed);
+}
+
+TraceLine::TraceLine() {
+    if (tracing()) trace_buffer().begin_line();
+}
+
+TraceLine::~TraceLine() {
+    if (tracing()) trace_buffer().end_line();
+}
+
+void write_trace_json(Output& out, const std::vector<TraceEvent>& events) {
+    out << "{\"events\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const auto& event = events[i];
+        out << (i ? ",\n" : "\n") << "{\"line\":" << static_cast<unsigned long>(event.line)
+            << ",\"thread\":" << static_cast<unsigned long>(event.thread) << ",\"phase\":\""
+            << trace_phase_name(event.phase) << "\",\"label\":";
+        write_json_string(out, label_of(event));
+        out << ",\"start_us\":";
+        write_micros(out, event.start_ns);
+        out << ",\"dur_us\":";
+        write_micros(out, event.end_ns - event.start_ns);
+        out << '}';
+    }
+    out << "\n]}\n";
+}
+
+void write_chrome_trace(Output& out, const std::vector<TraceEvent>& events) {
+    const long pid = static_cast<long>(getpid());
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const auto& event = events[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << trace_phase_name(event.phase)
+            << "\",\"cat\":\"shell\",\"ph\":\"X\",\"pid\":" << pid
+            << ",\"tid\":" << static_cast<unsigned long>(event.thread) << ",\"ts\":";
+        write_micros(out, event.start_ns);
+        out << ",\"dur\":";
+        write_micros(out, event.end_ns - event.start_ns);
+        out << ",\"args\":{\"line\":" << static_cast<unsigned long>(event.line) << ",\"label\":";
+        write_json_string(out, label_of(event));
+        out << "}}";
+    }
+    out << "\n]}\n";
+}
+
+#endif
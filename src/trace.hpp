@@ -0,0 +1,108 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class Output;
+
+// Where the shell's own time goes while it runs a line
+enum class TracePhase : uint8_t {
+    Parse,   // tokenizing and grouping into pipelines
+    Resolve, // looking the program up in PATH
+    Spawn,   // starting a child
+    Builtin, // running a builtin inside the shell
+    Wait,    // waiting for a foreground job
+};
+
+const char* trace_phase_name(TracePhase phase);
+
+struct TraceEvent {
+    static constexpr size_t kLabelSize = 48;
+
+    uint64_t start_ns = 0; // CLOCK_MONOTONIC
+    uint64_t end_ns = 0;
+    uint32_t line = 0;     // number of the command line it belongs to
+    uint32_t thread = 0;   // numbered by first event; the main thread is 0
+    TracePhase phase = TracePhase::Parse;
+    std::array<char, kLabelSize> label{}; // command or program, truncated
+};
+
+// The last kCapacity phase timings, across every thread of the shell.
+// Recording claims a slot with one fetch_add and publishes it with a
+// per-slot sequence number, so the parallel builtin's launch workers never
+// wait on each other or on a reader; a snapshot skips slots that were being
+// rewritten while it copied them.
+class TraceBuffer {
+public:
+    static constexpr size_t kCapacity = 4096;
+
+    void record(TracePhase phase, uint64_t start_ns, uint64_t end_ns, std::string_view label);
+    // Events still in the ring, oldest first
+    std::vector<TraceEvent> snapshot() const;
+    void clear();
+
+    // Events recorded between these carry the number of a new command line
+    void begin_line();
+    void end_line();
+
+private:
+    struct Slot {
+        // Twice the ticket of the event held, plus one while it is written
+        std::atomic<uint64_t> seq{0};
+        TraceEvent event;
+    };
+
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> cleared_{0}; // tickets below this were cleared
+    std::atomic<uint32_t> line_{0};
+    std::atomic<uint32_t> current_line_{0};
+    std::array<Slot, kCapacity> slots_;
+};
+
+// Tracing is off unless SHELL_TRACE=on or the trace builtin turns it on
+bool tracing();
+void set_tracing(bool on);
+TraceBuffer& trace_buffer();
+
+uint64_t trace_clock();
+
+// Times one phase from construction to destruction, when tracing is on
+class TraceSpan {
+public:
+    TraceSpan(TracePhase phase, std::string_view label)
+        : phase_(phase), label_(label), start_(tracing() ? trace_clock() : 0) {}
+    ~TraceSpan() {
+        if (start_) trace_buffer().record(phase_, start_, trace_clock(), label_);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TracePhase phase_;
+    std::string_view label_;
+    uint64_t start_;
+};
+
+// Marks the events recorded while it lives as belonging to one command line
+class TraceLine {
+public:
+    TraceLine();
+    ~TraceLine();
+
+    TraceLine(const TraceLine&) = delete;
+    TraceLine& operator=(const TraceLine&) = delete;
+};
+
+// {"events":[{"line":..,"phase":..,"label":..,"start_us":..,"dur_us":..},..]}
+void write_trace_json(Output& out, const std::vector<TraceEvent>& events);
+// The Trace Event Format chrome://tracing and Perfetto load: one complete
+// ("X") event per phase, one track per thread
+void write_chrome_trace(Output& out, const std::vector<TraceEvent>& events);
+
+#endif
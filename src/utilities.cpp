@@ -0,0 +1,722 @@
+#include "utilities.hpp"
+#include "output.hpp"
+
+#ifndef _WIN32
+#include "jobs.hpp"
+#include "launcher.hpp"
+#include "shell.hpp"
+#include "trace.hpp"
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
+int builtin_true(Shell&, const std::vector<std::string_view>&, BuiltinIO&) {
+    return 0;
+}
+
+int builtin_false(Shell&, const std::vector<std::string_view>&, BuiltinIO&) {
+    return 1;
+}
+
+#ifndef _WIN32
+
+// --- the system's utilities -----------------------------------------------
+
+namespace {
+
+// Run the system's own utility of the builtin's name on the same arguments,
+// for what the in-process version does not implement, with the builtin's
+// descriptors as its own; output being captured reaches it through a pipe.
+// Under job control it is a foreground job of its own, which ^C and ^Z
+// reach though the shell ignores them. False, with nothing done, when PATH
+// has no such utility.
+bool run_system_utility(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io, int& status) {
+    const auto path = shell.path_cache.find(std::string(args[0]));
+    if (path.empty()) return false;
+
+    auto argv = make_argv(args);
+
+    io.out.flush();
+    io.err.flush();
+    int capture[2] = {-1, -1};
+    if (io.out.fd() < 0 && pipe2(capture, O_CLOEXEC) != 0) {
+        io.err << args[0] << ": pipe: " << std::strerror(errno) << '\n';
+        status = 1;
+        return true;
+    }
+    const int out_fd = io.out.fd() >= 0 ? io.out.fd() : capture[1];
+
+    auto environment = shell.vars.environment();
+    LaunchRequest req;
+    req.program = path.c_str();
+    req.argv = argv.data();
+    req.envp = environment->envp();
+    if (io.in != STDIN_FILENO) req.fd_actions.push_back({FdAction::Kind::Dup, STDIN_FILENO, io.in});
+    if (out_fd != STDOUT_FILENO) req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, out_fd});
+    if (io.err.fd() >= 0 && io.err.fd() != STDERR_FILENO) {
+        req.fd_actions.push_back({FdAction::Kind::Dup, STDERR_FILENO, io.err.fd()});
+    }
+    const bool job_control = shell.jobs.job_control();
+    if (job_control) {
+        req.pgroup = 0;
+        req.foreground_tty = shell.jobs.terminal();
+    }
+    pid_t pid;
+    {
+        TraceSpan span(TracePhase::Spawn, args[0]);
+        pid = launch_process(req);
+    }
+    const int launch_errno = errno;
+    if (capture[1] >= 0) close(capture[1]);
+    if (pid < 0) {
+        if (capture[0] >= 0) close(capture[0]);
+        io.err << args[0] << ": " << path.string() << ": " << std::strerror(launch_errno) << '\n';
+        status = 126;
+        return true;
+    }
+    if (capture[0] >= 0) {
+        io.out.splice_from(capture[0]);
+        close(capture[0]);
+    }
+
+    TraceSpan span(TracePhase::Wait, args[0]);
+    if (job_control) {
+        std::string command;
+        for (const auto& word : args) {
+            if (!command.empty()) command += ' ';
+            command += word;
+        }
+        status = shell.jobs.foreground(shell.jobs.add(std::move(command), pid, {pid}, false), false);
+        return true;
+    }
+    status = decode_wait_status(wait_child(pid));
+    return true;
+}
+
+} // namespace
+
+#endif
+
+// --- printf ---------------------------------------------------------------
+
+namespace {
+
+enum class Escape {
+    Decoded,
+    Stop,    // \c: all output ends
+    Foreign, // one the system's printf decodes differently: \", \u, \U, a bare \x
+};
+
+// Decode the backslash escape at s[i] (s[i] == '\\') into out and advance i.
+// In %b arguments octal escapes are written \0NNN.
+Escape decode_escape(std::string_view s, size_t& i, std::string& out, bool b_arg) {
+    ++i; // the backslash
+    if (i >= s.size()) {
+        out += '\\';
+        return Escape::Decoded;
+    }
+    char c = s[i++];
+    switch (c) {
+    case 'a': out += '\a'; return Escape::Decoded;
+    case 'b': out += '\b'; return Escape::Decoded;
+    case 'e': out += '\x1b'; return Escape::Decoded;
+    case 'f': out += '\f'; return Escape::Decoded;
+    case 'n': out += '\n'; return Escape::Decoded;
+    case 'r': out += '\r'; return Escape::Decoded;
+    case 't': out += '\t'; return Escape::Decoded;
+    case 'v': out += '\v'; return Escape::Decoded;
+    case '\\': out += '\\'; return Escape::Decoded;
+    case 'c': return Escape::Stop;
+    case '"':
+    case 'u':
+    case 'U':
+        return Escape::Foreign;
+    case 'x': {
+        int value = 0, digits = 0;
+        while (digits < 2 && i < s.size() && std::isxdigit(static_cast<unsigned char>(s[i]))) {
+            char h = s[i++];
+            value = value * 16 + (h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+            ++digits;
+        }
+        if (digits == 0) return Escape::Foreign;
+        out += static_cast<char>(value);
+        return Escape::Decoded;
+    }
+    default:
+        break;
+    }
+    if (c >= '0' && c <= '7') {
+        // \NNN in the format; \0NNN in %b, where the leading 0 does not count
+        int max_digits = (b_arg && c == '0') ? 3 : 2;
+        int value = (b_arg && c == '0') ? 0 : c - '0';
+        for (int d = 0; d < max_digits && i < s.size() && s[i] >= '0' && s[i] <= '7'; ++d) {
+            value = value * 8 + (s[i++] - '0');
+        }
+        out += static_cast<char>(value & 0xff);
+        return Escape::Decoded;
+    }
+    // Unknown escapes stay as written
+    out += '\\';
+    out += c;
+    return Escape::Decoded;
+}
+
+template <typename T>
+void format_into(std::string& out, const std::string& spec, T value) {
+    int len = std::snprintf(nullptr, 0, spec.c_str(), value);
+    if (len <= 0) return;
+    size_t start = out.size();
+    out.resize(start + static_cast<size_t>(len) + 1);
+    std::snprintf(out.data() + start, static_cast<size_t>(len) + 1, spec.c_str(), value);
+    out.pop_back();
+}
+
+// A leading quote yields the character code, as POSIX printf requires
+template <typename T, typename Parse>
+bool parse_number(std::string_view arg, T& value, Parse parse) {
+    if (arg.empty()) {
+        value = 0;
+        return true;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        value = arg.size() > 1 ? static_cast<unsigned char>(arg[1]) : 0;
+        return true;
+    }
+    std::string s(arg);
+    char* end = nullptr;
+    errno = 0;
+    value = parse(s.c_str(), &end);
+    return errno == 0 && end != s.c_str() && *end == '\0';
+}
+
+} // namespace
+
+int builtin_printf(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() < 2) {
+        io.err << "printf: usage: printf format [arguments]\n";
+        return 2;
+    }
+
+    const std::string_view fmt = args[1];
+    size_t next = 2;
+    int status = 0;
+    std::string out;
+    std::string errors;
+    std::string spec;
+    // What the format asks for that is left to the system's printf
+    std::string foreign;
+
+    auto next_arg = [&]() -> std::string_view {
+        return next < args.size() ? args[next++] : std::string_view{};
+    };
+    auto bad_number = [&](std::string_view arg) {
+        errors += "printf: ";
+        errors += arg;
+        errors += ": invalid number\n";
+        status = 1;
+    };
+
+    // \c ends the output, and with success whatever went before
+    auto stop = [&] {
+        status = 0;
+        return true;
+    };
+
+    // Everything is formatted before anything is written, so that on meeting
+    // something foreign it can all be handed over untouched. False then.
+    auto format = [&]() -> bool {
+        // The format is reused for as long as it keeps consuming arguments
+        while (true) {
+            const size_t first_arg = next;
+            for (size_t i = 0; i < fmt.size();) {
+                char c = fmt[i];
+                if (c == '\\') {
+                    const size_t start = i;
+                    const Escape escape = decode_escape(fmt, i, out, false);
+                    if (escape == Escape::Stop) return stop();
+                    if (escape == Escape::Foreign) {
+                        foreign.assign(fmt.substr(start, i - start));
+                        return false;
+                    }
+                    continue;
+                }
+                if (c != '%') {
+                    size_t stop = fmt.find_first_of("%\\", i);
+                    if (stop == std::string_view::npos) stop = fmt.size();
+                    out.append(fmt.substr(i, stop - i));
+                    i = stop;
+                    continue;
+                }
+
+                const size_t start = i++;
+                if (i < fmt.size() && fmt[i] == '%') {
+                    out += '%';
+                    ++i;
+                    continue;
+                }
+
+                spec.assign("%");
+                while (i < fmt.size() && std::strchr("-+ #0", fmt[i])) spec += fmt[i++];
+                if (i < fmt.size() && fmt[i] == '*') {
+                    long long width = 0;
+                    auto arg = next_arg();
+                    if (!parse_number(arg, width, [](const char* s, char** e) { return std::strtoll(s, e, 0); })) {
+                        bad_number(arg);
+                    }
+                    spec += std::to_string(width);
+                    ++i;
+                } else {
+                    while (i < fmt.size() && std::isdigit(static_cast<unsigned char>(fmt[i]))) spec += fmt[i++];
+                }
+                if (i < fmt.size() && fmt[i] == '.') {
+                    spec += fmt[i++];
+                    if (i < fmt.size() && fmt[i] == '*') {
+                        long long precision = 0;
+                        auto arg = next_arg();
+                        if (!parse_number(arg, precision, [](const char* s, char** e) { return std::strtoll(s, e, 0); })) {
+                            bad_number(arg);
+                        }
+                        // A negative precision counts as none, as in C
+                        if (precision >= 0) {
+                            spec += std::to_string(precision);
+                        } else {
+                            spec.pop_back();
+                        }
+                        ++i;
+                    } else {
+                        while (i < fmt.size() && std::isdigit(static_cast<unsigned char>(fmt[i]))) spec += fmt[i++];
+                    }
+                }
+                // Length modifiers mean nothing here; every conversion is done at full width
+                while (i < fmt.size() && std::strchr("hlLjzt", fmt[i])) ++i;
+                // A missing or unknown conversion (%q, say) or flag (%'d)
+                if (i >= fmt.size() || !std::strchr("sbcdiuoxXfFeEgGaA", fmt[i])) {
+                    foreign.assign(fmt.substr(start, std::min(i + 1, fmt.size()) - start));
+                    return false;
+                }
+
+                const char conv = fmt[i++];
+                switch (conv) {
+                case 's': {
+                    std::string arg(next_arg());
+                    format_into(out, spec + 's', arg.c_str());
+                    break;
+                }
+                case 'b': {
+                    std::string_view arg = next_arg();
+                    std::string expanded;
+                    Escape escape = Escape::Decoded;
+                    for (size_t j = 0; j < arg.size() && escape == Escape::Decoded;) {
+                        if (arg[j] == '\\') {
+                            const size_t from = j;
+                            escape = decode_escape(arg, j, expanded, true);
+                            if (escape == Escape::Foreign) foreign.assign(arg.substr(from, j - from));
+                        } else {
+                            expanded += arg[j++];
+                        }
+                    }
+                    if (escape == Escape::Foreign) return false;
+                    format_into(out, spec + 's', expanded.c_str());
+                    if (escape == Escape::Stop) return stop();
+                    break;
+                }
+                case 'c': {
+                    std::string_view arg = next_arg();
+                    format_into(out, spec + 'c', arg.empty() ? 0 : static_cast<int>(arg[0]));
+                    break;
+                }
+                case 'd':
+                case 'i': {
+                    long long value = 0;
+                    auto arg = next_arg();
+                    if (!parse_number(arg, value, [](const char* s, char** e) { return std::strtoll(s, e, 0); })) {
+                        bad_number(arg);
+                    }
+                    format_into(out, spec + "lld", value);
+                    break;
+                }
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X': {
+                    unsigned long long value = 0;
+                    auto arg = next_arg();
+                    if (!parse_number(arg, value, [](const char* s, char** e) { return std::strtoull(s, e, 0); })) {
+                        bad_number(arg);
+                    }
+                    format_into(out, spec + "ll" + conv, value);
+                    break;
+                }
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A': {
+                    long double value = 0;
+                    auto arg = next_arg();
+                    if (!parse_number(arg, value, [](const char* s, char** e) { return std::strtold(s, e); })) {
+                        bad_number(arg);
+                    }
+                    format_into(out, spec + 'L' + conv, value);
+                    break;
+                }
+                }
+            }
+
+            if (next >= args.size() || next == first_arg) return true;
+        }
+    };
+
+    if (!format()) {
+#ifndef _WIN32
+        if (run_system_utility(shell, args, io, status)) return status;
+#else
+        (void)shell;
+#endif
+        io.err << "printf: `" << foreign << "': not supported\n";
+        return 1;
+    }
+    io.out << out;
+    io.err << errors;
+    return status;
+}
+
+#ifndef _WIN32
+
+// --- test / [ -------------------------------------------------------------
+
+namespace {
+
+// Evaluated as coreutils' test does. What it cannot evaluate, an operator
+// it does not know included, is an error here, which the builtin then hands
+// to the system's test.
+class TestExpression {
+public:
+    TestExpression(const std::vector<std::string_view>& args, size_t begin, size_t end)
+        : args_(args), begin_(begin), end_(end) {}
+
+    // 0 true, 1 false, 2 error
+    int run() {
+        bool value = evaluate(begin_, end_);
+        return failed_ ? 2 : (value ? 0 : 1);
+    }
+
+    // The first error, as a line ready to print
+    const std::string& error() const { return error_; }
+
+private:
+    const std::vector<std::string_view>& args_;
+    size_t begin_;
+    size_t end_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+    std::string error_;
+
+    bool fail(std::string_view what) {
+        if (!failed_) {
+            error_.assign(args_[0]);
+            error_ += ": ";
+            error_ += what;
+            error_ += '\n';
+        }
+        failed_ = true;
+        return false;
+    }
+
+    static bool is_operator(std::string_view word) {
+        return word.size() == 2 && word[0] == '-';
+    }
+
+    static bool is_unary(std::string_view op) {
+        return is_operator(op) && std::strchr("bcdefghkLnOGprsStuwxz", op[1]);
+    }
+
+    static bool is_binary(std::string_view op) {
+        return op == "=" || op == "==" || op == "!=" ||
+               op == "-eq" || op == "-ne" || op == "-lt" || op == "-le" || op == "-gt" ||
+               op == "-ge" || op == "-nt" || op == "-ot" || op == "-ef";
+    }
+
+    bool integer(std::string_view s, long long& value) {
+        size_t b = s.find_first_not_of(" \t");
+        size_t e = s.find_last_not_of(" \t");
+        std::string trimmed = b == std::string_view::npos ? "" : std::string(s.substr(b, e - b + 1));
+        char* end = nullptr;
+        errno = 0;
+        value = std::strtoll(trimmed.c_str(), &end, 10);
+        if (trimmed.empty() || errno != 0 || *end != '\0') {
+            fail(std::string(s) + ": integer expression expected");
+            return false;
+        }
+        return true;
+    }
+
+    bool unary(std::string_view op, std::string_view operand) {
+        char flag = op[1];
+        if (flag == 'n') return !operand.empty();
+        if (flag == 'z') return operand.empty();
+        if (flag == 't') {
+            long long fd = 0;
+            return integer(operand, fd) && isatty(static_cast<int>(fd));
+        }
+
+        std::string path(operand);
+        struct stat st{};
+        if (flag == 'h' || flag == 'L') {
+            return lstat(path.c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+        }
+        if (stat(path.c_str(), &st) != 0) return false;
+        switch (flag) {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'e': return true;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+        case 'r': return access(path.c_str(), R_OK) == 0;
+        case 'w': return access(path.c_str(), W_OK) == 0;
+        case 'x': return access(path.c_str(), X_OK) == 0;
+        }
+        return false;
+    }
+
+    bool binary(std::string_view lhs, std::string_view op, std::string_view rhs) {
+        if (op == "=" || op == "==") return lhs == rhs;
+        if (op == "!=") return lhs != rhs;
+
+        if (op == "-nt" || op == "-ot" || op == "-ef") {
+            struct stat a{}, b{};
+            bool ha = stat(std::string(lhs).c_str(), &a) == 0;
+            bool hb = stat(std::string(rhs).c_str(), &b) == 0;
+            auto newer = [](const struct stat& x, const struct stat& y) {
+                return x.st_mtim.tv_sec != y.st_mtim.tv_sec ? x.st_mtim.tv_sec > y.st_mtim.tv_sec
+                                                            : x.st_mtim.tv_nsec > y.st_mtim.tv_nsec;
+            };
+            if (op == "-nt") return ha && (!hb || newer(a, b));
+            if (op == "-ot") return hb && (!ha || newer(b, a));
+            return ha && hb && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        }
+
+        long long l = 0, r = 0;
+        if (!integer(lhs, l) || !integer(rhs, r)) return false;
+        if (op == "-eq") return l == r;
+        if (op == "-ne") return l != r;
+        if (op == "-lt") return l < r;
+        if (op == "-le") return l <= r;
+        if (op == "-gt") return l > r;
+        return l >= r; // -ge
+    }
+
+    // POSIX decides by argument count up to four; beyond that, or where the
+    // count rules do not apply, parse with the usual precedence
+    bool evaluate(size_t b, size_t e) {
+        const size_t n = e - b;
+        switch (n) {
+        case 0:
+            return false;
+        case 1:
+            return !args_[b].empty();
+        case 2:
+            if (args_[b] == "!") return !evaluate(b + 1, e);
+            if (is_unary(args_[b])) return unary(args_[b], args_[b + 1]);
+            return fail(std::string(args_[b]) + ": unary operator expected");
+        case 3:
+            if (is_binary(args_[b + 1])) return binary(args_[b], args_[b + 1], args_[b + 2]);
+            if (args_[b] == "!") return !evaluate(b + 1, e);
+            if (args_[b] == "(" && args_[e - 1] == ")") return evaluate(b + 1, e - 1);
+            if (args_[b + 1] == "-a" || args_[b + 1] == "-o") break;
+            return fail(std::string(args_[b + 1]) + ": binary operator expected");
+        case 4:
+            if (args_[b] == "!") return !evaluate(b + 1, e);
+            if (args_[b] == "(" && args_[e - 1] == ")") return evaluate(b + 1, e - 1);
+            break;
+        default:
+            break;
+        }
+
+        pos_ = b;
+        end_ = e;
+        bool value = or_expr();
+        if (!failed_ && pos_ != end_) fail("too many arguments");
+        return value;
+    }
+
+    bool or_expr() {
+        bool value = and_expr();
+        while (!failed_ && pos_ < end_ && args_[pos_] == "-o") {
+            ++pos_;
+            bool rhs = and_expr();
+            value = value || rhs;
+        }
+        return value;
+    }
+
+    bool and_expr() {
+        bool value = not_expr();
+        while (!failed_ && pos_ < end_ && args_[pos_] == "-a") {
+            ++pos_;
+            bool rhs = not_expr();
+            value = value && rhs;
+        }
+        return value;
+    }
+
+    bool not_expr() {
+        if (pos_ < end_ && args_[pos_] == "!") {
+            ++pos_;
+            return !not_expr();
+        }
+        return primary();
+    }
+
+    bool primary() {
+        if (pos_ >= end_) return fail("argument expected");
+        if (args_[pos_] == "(") {
+            ++pos_;
+            bool value = or_expr();
+            if (pos_ >= end_ || args_[pos_] != ")") return fail("`)' expected");
+            ++pos_;
+            return value;
+        }
+        if (end_ - pos_ >= 3 && is_binary(args_[pos_ + 1])) {
+            bool value = binary(args_[pos_], args_[pos_ + 1], args_[pos_ + 2]);
+            pos_ += 3;
+            return value;
+        }
+        if (is_operator(args_[pos_])) {
+            if (!is_unary(args_[pos_])) return fail(std::string(args_[pos_]) + ": unary operator expected");
+            if (end_ - pos_ < 2) return fail(std::string(args_[pos_]) + ": argument expected");
+            bool value = unary(args_[pos_], args_[pos_ + 1]);
+            pos_ += 2;
+            return value;
+        }
+        return !args_[pos_++].empty();
+    }
+};
+
+// An expression the builtin cannot evaluate goes to the system's test, so
+// that scripts get its verdict and its diagnostics
+int evaluate_or_hand_over(Shell& shell, const std::vector<std::string_view>& args, size_t end, BuiltinIO& io) {
+    TestExpression expression(args, 1, end);
+    int status = expression.run();
+    if (status != 2 || run_system_utility(shell, args, io, status)) return status;
+    io.err << expression.error();
+    return 2;
+}
+
+} // namespace
+
+int builtin_test(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    return evaluate_or_hand_over(shell, args, args.size(), io);
+}
+
+int builtin_bracket(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.back() != "]") {
+        int status;
+        if (run_system_utility(shell, args, io, status)) return status;
+        io.err << "[: missing `]'\n";
+        return 2;
+    }
+    return evaluate_or_hand_over(shell, args, args.size() - 1, io);
+}
+
+// --- cat ------------------------------------------------------------------
+
+namespace {
+
+// What may go on until the user interrupts it: anything but a regular file,
+// such as a terminal, /dev/zero or a FIFO
+bool unbounded(int fd) {
+    struct stat st;
+    return fstat(fd, &st) != 0 || !S_ISREG(st.st_mode);
+}
+
+bool unbounded(std::string_view path) {
+    struct stat st;
+    return stat(path.data(), &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+} // namespace
+
+// Files and pipes go to the output through splice/sendfile, so the bytes
+// never pass through a user-space buffer. Options (-n, -A and the rest) are
+// left to the system's cat; only plain operands are copied here. So is
+// anything unbounded at an interactive shell, which ignores ^C itself: there
+// the system's cat runs as a foreground job the user can interrupt.
+int builtin_cat(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    // Options may come after operands, up to a `--`
+    size_t dashes = args.size();
+    for (size_t i = 1; i < args.size() && dashes == args.size(); ++i) {
+        if (args[i] == "--") {
+            dashes = i;
+        } else if (args[i].size() > 1 && args[i][0] == '-') {
+            int status;
+            if (run_system_utility(shell, args, io, status)) return status;
+            io.err << "cat: " << args[i] << ": unsupported option\n";
+            return 1;
+        }
+    }
+
+    const bool from_stdin_only = args.size() - (dashes < args.size() ? 1 : 0) < 2;
+    if (shell.jobs.job_control()) {
+        bool interruptible = from_stdin_only && unbounded(io.in);
+        for (size_t i = 1; i < args.size() && !interruptible; ++i) {
+            if (i != dashes) interruptible = args[i] == "-" ? unbounded(io.in) : unbounded(args[i]);
+        }
+        int status;
+        if (interruptible && run_system_utility(shell, args, io, status)) return status;
+    }
+
+    if (from_stdin_only) {
+        if (io.out.splice_from(io.in)) return 0;
+        if (!io.out.failed()) io.err << "cat: -: " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    int status = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (i == dashes) continue;
+        const bool from_stdin = args[i] == "-";
+        int fd = from_stdin ? io.in : open(args[i].data(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            io.err << "cat: " << args[i] << ": " << std::strerror(errno) << '\n';
+            status = 1;
+            continue;
+        }
+        bool ok = io.out.splice_from(fd);
+        int saved_errno = errno;
+        if (!from_stdin) close(fd);
+        if (!ok) {
+            // The reader went away; nothing more can be written
+            if (io.out.failed()) return 1;
+            io.err << "cat: " << args[i] << ": " << std::strerror(saved_errno) << '\n';
+            status = 1;
+        }
+    }
+    return status;
+}
+
+#endif
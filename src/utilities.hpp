@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "builtins.hpp"
+
+// In-process versions of the small utilities scripts call in tight loops,
+// so they cost neither a PATH lookup nor a fork; options, formats and
+// operators they do not implement run the system's utility instead
+int builtin_true(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+int builtin_false(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+int builtin_printf(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+#ifndef _WIN32
+int builtin_test(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+int builtin_bracket(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+int builtin_cat(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+#endif
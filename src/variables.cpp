@@ -0,0 +1,182 @@
+#include "variables.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+namespace {
+
+bool name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool name_char(char c) {
+    return name_start(c) || (c >= '0' && c <= '9');
+}
+
+#ifdef _WIN32
+// CreateProcess hands children the process environment, so exported
+// variables are mirrored into it
+void mirror(std::string_view name, const std::string* value) {
+    _putenv_s(std::string(name).c_str(), value ? value->c_str() : "");
+}
+#endif
+
+} // namespace
+
+bool is_valid_name(std::string_view name) {
+    if (name.empty() || !name_start(name[0])) return false;
+    return std::all_of(name.begin() + 1, name.end(), name_char);
+}
+
+bool is_assignment(std::string_view word) {
+    auto eq = word.find('=');
+    return eq != std::string_view::npos && is_valid_name(word.substr(0, eq));
+}
+
+std::vector<char*> Environment::overlay(std::span<const std::string_view> assignments) const {
+    std::vector<char*> result(pointers.begin(), pointers.end() - 1);
+    for (const auto& word : assignments) {
+        const size_t prefix = word.find('=') + 1; // "NAME="
+        auto same_name = [&](const char* entry) { return std::strncmp(entry, word.data(), prefix) == 0; };
+        char* text = const_cast<char*>(word.data());
+        if (auto it = std::find_if(result.begin(), result.end(), same_name); it != result.end()) {
+            *it = text;
+        } else {
+            result.push_back(text);
+        }
+    }
+    result.push_back(nullptr);
+    return result;
+}
+
+void Variables::changed(bool exported) {
+    ++generation_;
+    if (exported) environment_.reset();
+}
+
+void Variables::import_environment() {
+#ifdef _WIN32
+    char** env = _environ;
+#else
+    char** env = environ;
+#endif
+    for (; env && *env; ++env) {
+        std::string_view entry(*env);
+        auto eq = entry.find('=');
+        if (eq == std::string_view::npos || eq == 0) continue;
+        auto [it, inserted] = table.try_emplace(std::string(entry.substr(0, eq)));
+        if (!inserted) continue; // the first of duplicate entries wins, as with getenv
+        it->second.value.assign(entry.substr(eq + 1));
+        it->second.exported = true;
+    }
+    changed(true);
+}
+
+void Variables::clear() {
+    table.clear();
+    changed(true);
+}
+
+const Variables::Variable* Variables::find(std::string_view name) const {
+    auto it = table.find(name);
+    return it == table.end() ? nullptr : &it->second;
+}
+
+const std::string* Variables::get(std::string_view name) const {
+    const Variable* var = find(name);
+    return var ? &var->value : nullptr;
+}
+
+void Variables::set(std::string_view name, std::string_view value) {
+    auto it = table.find(name);
+    if (it == table.end()) {
+        table.emplace(std::string(name), Variable{std::string(value), false});
+        changed(false);
+        return;
+    }
+    if (it->second.value == value) return;
+    it->second.value.assign(value);
+    changed(it->second.exported);
+#ifdef _WIN32
+    if (it->second.exported) mirror(name, &it->second.value);
+#endif
+}
+
+void Variables::set(std::string_view name, std::string_view value, bool exported) {
+    auto it = table.find(name);
+    if (it == table.end()) {
+        it = table.emplace(std::string(name), Variable{}).first;
+    } else if (it->second.value == value && it->second.exported == exported) {
+        return;
+    }
+    const bool was_exported = it->second.exported;
+    it->second.value.assign(value);
+    it->second.exported = exported;
+    changed(exported || was_exported);
+#ifdef _WIN32
+    if (exported || was_exported) mirror(name, exported ? &it->second.value : nullptr);
+#endif
+}
+
+void Variables::assign(std::string_view word) {
+    auto eq = word.find('=');
+    set(word.substr(0, eq), word.substr(eq + 1));
+}
+
+void Variables::export_name(std::string_view name) {
+    auto it = table.find(name);
+    if (it == table.end()) {
+        it = table.emplace(std::string(name), Variable{}).first;
+    } else if (it->second.exported) {
+        return;
+    }
+    it->second.exported = true;
+    changed(true);
+#ifdef _WIN32
+    mirror(name, &it->second.value);
+#endif
+}
+
+bool Variables::unset(std::string_view name) {
+    auto it = table.find(name);
+    if (it == table.end()) return false;
+    const bool exported = it->second.exported;
+    table.erase(it);
+    changed(exported);
+#ifdef _WIN32
+    if (exported) mirror(name, nullptr);
+#endif
+    return true;
+}
+
+std::shared_ptr<const Environment> Variables::environment() const {
+    if (environment_) return environment_;
+
+    auto env = std::make_shared<Environment>();
+    for (const auto& [name, var] : table) {
+        if (!var.exported) continue;
+        std::string entry;
+        entry.reserve(name.size() + 1 + var.value.size());
+        entry.append(name).append(1, '=').append(var.value);
+        env->entries.push_back(std::move(entry));
+    }
+    // Pointers are taken only once the strings have stopped moving
+    env->pointers.reserve(env->entries.size() + 1);
+    for (auto& entry : env->entries) env->pointers.push_back(entry.data());
+    env->pointers.push_back(nullptr);
+    environment_ = std::move(env);
+    return environment_;
+}
+
+std::vector<std::pair<std::string_view, const Variables::Variable*>> Variables::sorted() const {
+    std::vector<std::pair<std::string_view, const Variable*>> out;
+    out.reserve(table.size());
+    for (const auto& [name, var] : table) out.emplace_back(name, &var);
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    return out;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The exported variables as exec wants them: a NULL-terminated array of
+// "NAME=value" strings. A snapshot never changes once built, so a child
+// being launched (or a parallel worker) can keep using it while the shell
+// moves on.
+class Environment {
+    std::vector<std::string> entries;
+    std::vector<char*> pointers;
+
+    friend class Variables;
+
+public:
+    char* const* envp() const { return pointers.data(); }
+
+    // The array with NAME=value words (views of NUL-terminated strings, such
+    // as the assignment tokens of `VAR=val cmd`) replacing or joining the
+    // entries. The result points into both, and nothing is copied.
+    std::vector<char*> overlay(std::span<const std::string_view> assignments) const;
+};
+
+// NAME=value: the name is a valid identifier
+bool is_assignment(std::string_view word);
+bool is_valid_name(std::string_view name);
+
+// The shell's variables. Every change bumps a generation counter, so a
+// consumer such as the PATH cache only has to compare one integer to know
+// nothing moved. The exported environment is rebuilt lazily, and only after
+// an exported variable changed.
+class Variables {
+public:
+    struct Variable {
+        std::string value;
+        bool exported = false;
+    };
+
+private:
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    std::unordered_map<std::string, Variable, NameHash, std::equal_to<>> table;
+    uint64_t generation_ = 0;
+    mutable std::shared_ptr<const Environment> environment_; // null when stale
+
+    void changed(bool exported);
+
+public:
+    // Every variable of the process environment, exported
+    void import_environment();
+    // Drop every variable
+    void clear();
+
+    const Variable* find(std::string_view name) const;
+    const std::string* get(std::string_view name) const;
+
+    // Set a value, keeping the variable's export flag (new ones are local)
+    void set(std::string_view name, std::string_view value);
+    void set(std::string_view name, std::string_view value, bool exported);
+    // Set from NAME=value, as is_assignment accepts
+    void assign(std::string_view word);
+    // Mark a variable for export, creating it empty if need be
+    void export_name(std::string_view name);
+    bool unset(std::string_view name);
+
+    uint64_t generation() const { return generation_; }
+
+    // Snapshot of the exported variables; the same one until an exported
+    // variable changes
+    std::shared_ptr<const Environment> environment() const;
+
+    // Every variable, sorted by name
+    std::vector<std::pair<std::string_view, const Variable*>> sorted() const;
+};
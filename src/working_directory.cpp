@@ -0,0 +1,155 @@
+#include "working_directory.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <filesystem>
+#include <system_error>
+#else
+#include <climits>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+struct State {
+    bool known = false;
+    std::string path;
+#ifndef _WIN32
+    dev_t dev = 0;
+    ino_t ino = 0;
+#endif
+    uint64_t generation = 1;
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+#ifdef _WIN32
+void record(std::string path) {
+    State& s = state();
+    if (!s.known || path != s.path) ++s.generation;
+    s.path = std::move(path);
+    s.known = true;
+}
+
+void read_current() {
+    std::error_code ec;
+    record(std::filesystem::current_path(ec).string());
+}
+#else
+// An absolute path with ".", ".." and repeated slashes taken out lexically
+std::string normalize(std::string_view path) {
+    std::string out;
+    size_t i = 0;
+    while (i < path.size()) {
+        while (i < path.size() && path[i] == '/') ++i;
+        size_t end = path.find('/', i);
+        if (end == std::string_view::npos) end = path.size();
+        std::string_view part = path.substr(i, end - i);
+        i = end;
+        if (part.empty() || part == ".") continue;
+        if (part == "..") {
+            const size_t slash = out.rfind('/');
+            out.resize(slash == std::string::npos ? 0 : slash);
+            continue;
+        }
+        out += '/';
+        out += part;
+    }
+    return out.empty() ? "/" : out;
+}
+
+// The process is now in the directory named path
+void record(std::string path) {
+    State& s = state();
+    struct stat st{};
+    if (stat(".", &st) != 0 || !s.known || st.st_dev != s.dev || st.st_ino != s.ino) ++s.generation;
+    s.dev = st.st_dev;
+    s.ino = st.st_ino;
+    s.path = std::move(path);
+    s.known = true;
+}
+
+std::string physical_path() {
+    char buf[PATH_MAX];
+    return getcwd(buf, sizeof(buf)) ? std::string(buf) : std::string();
+}
+
+// $PWD is only trusted while it is absolute, already normalized and the
+// same directory as "."
+void read_current(const char* hint) {
+    if (hint && hint[0] == '/' && normalize(hint) == hint) {
+        struct stat named{}, dot{};
+        if (stat(hint, &named) == 0 && stat(".", &dot) == 0 && named.st_dev == dot.st_dev &&
+            named.st_ino == dot.st_ino) {
+            record(hint);
+            return;
+        }
+    }
+    record(physical_path());
+}
+#endif
+
+const State& current() {
+    State& s = state();
+#ifdef _WIN32
+    if (!s.known) read_current();
+#else
+    if (!s.known) read_current(std::getenv("PWD"));
+#endif
+    return s;
+}
+
+} // namespace
+
+const std::string& working_directory() {
+    return current().path;
+}
+
+uint64_t working_directory_generation() {
+    return current().generation;
+}
+
+int change_working_directory(std::string_view target, bool physical) {
+#ifdef _WIN32
+    (void)physical;
+    std::filesystem::path path(target);
+    if (path.is_relative()) path = std::filesystem::path(current().path) / path;
+    std::error_code ec;
+    std::filesystem::current_path(path.lexically_normal(), ec);
+    if (ec) return ec.value();
+    read_current();
+    return 0;
+#else
+    const std::string given(target);
+    if (!physical) {
+        std::string logical = normalize(given.starts_with('/') ? given : current().path + '/' + given);
+        if (chdir(logical.c_str()) == 0) {
+            record(std::move(logical));
+            return 0;
+        }
+        // The lexical path may cross a symlink's parent that no longer
+        // leads here; the target as written still might
+        const int err = errno;
+        if (chdir(given.c_str()) != 0) return err;
+    } else if (chdir(given.c_str()) != 0) {
+        return errno;
+    }
+    record(physical_path());
+    return 0;
+#endif
+}
+
+void sync_working_directory(const char* pwd_hint) {
+#ifdef _WIN32
+    (void)pwd_hint;
+    read_current();
+#else
+    read_current(pwd_hint);
+#endif
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// The shell's working directory, kept in memory so that pwd and lookups
+// relative to it never call getcwd, which walks up the tree one lookup per
+// component and is slow on network filesystems. The path is the logical
+// one, with the symlinks the user went through, as in $PWD.
+//
+// The generation moves whenever the directory itself changes (not merely
+// its spelling: it compares device and inode), so caches of anything
+// relative to it, such as the PathCache's current-directory lookups, know
+// when to look again by comparing one integer.
+
+// Seeded on first use from $PWD when that names the current directory,
+// else from getcwd
+const std::string& working_directory();
+uint64_t working_directory_generation();
+
+// cd: one chdir, then one stat of "." to tell whether the directory really
+// changed. Logically (the default) ".." drops the last component of the path
+// as written, falling back to the physical target if that path is gone;
+// physical resolves symlinks and takes the path from getcwd. Returns 0, or
+// the errno of the failed chdir.
+int change_working_directory(std::string_view target, bool physical);
+
+// The process changed directory behind the shell's back (a --serve session
+// taking its client's); read it again, preferring pwd_hint (usually $PWD)
+// when it names the same directory
+void sync_working_directory(const char* pwd_hint);
@@ -0,0 +1,312 @@
+#include "xargs.hpp"
+
+#ifndef _WIN32
+
+#include "builtins.hpp"
+#include "jobs.hpp"
+#include "launcher.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "shell.hpp"
+#include "trace.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+namespace {
+
+// GNU xargs's statuses: some run failed, one could not be started, the
+// command is not found
+constexpr int kSomeFailed = 123;
+constexpr int kCannotRun = 126;
+constexpr int kNotFound = 127;
+// Unlike GNU xargs, a command killed by ^C stops the run with the status
+// the shell gives an interrupted command, so the rest of the line stops too
+constexpr int kInterrupted = 128 + SIGINT;
+
+// Left free under ARG_MAX, as POSIX asks of xargs, for whatever the kernel
+// or the program's startup adds
+constexpr size_t kHeadroom = 2048;
+
+constexpr size_t kInitialBuffer = 64 * 1024;
+
+// What a word costs out of ARG_MAX: its bytes, its NUL and its pointer
+size_t argument_cost(size_t size) {
+    return size + 1 + sizeof(char*);
+}
+
+// Room for arguments once the environment and the command's own words are
+// in; 0 when there is none
+size_t argument_space(char* const* envp, const std::vector<std::string_view>& command) {
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0) arg_max = 128 * 1024;
+    size_t used = kHeadroom + sizeof(char*); // argv's terminating null
+    for (char* const* e = envp; *e; ++e) used += argument_cost(std::strlen(*e));
+    used += sizeof(char*);
+    for (const auto& word : command) used += argument_cost(word.size());
+    return static_cast<size_t>(arg_max) > used ? static_cast<size_t>(arg_max) - used : 0;
+}
+
+int pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Reads the arguments in place: each is NUL-terminated where its delimiter
+// was and remembered by offset, so the buffer may grow or be compacted
+// under it. The pending batch is launched straight from the buffer, and
+// nothing is allocated per argument.
+class Batcher {
+public:
+    Batcher(Shell& shell, BuiltinIO& io, std::vector<std::string_view> command, std::string program)
+        : io_(io), command_(std::move(command)), program_(std::move(program)),
+          environment_(shell.vars.environment()) {}
+
+    ~Batcher() {
+        if (null_fd_ >= 0) close(null_fd_);
+    }
+
+    int run(char delimiter, size_t max_args, size_t jobs) {
+        space_ = argument_space(environment_->envp(), command_);
+        if (space_ == 0) {
+            io_.err << "xargs: the environment leaves no room for arguments\n";
+            return 1;
+        }
+        max_args_ = max_args;
+        jobs_ = jobs;
+        delimiter_ = delimiter;
+        out_fd_ = io_.out.flush_for_children();
+        // The arguments are arriving on stdin; the commands must not eat them
+        null_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        running_.reserve(jobs_);
+        poll_fds_.reserve(jobs_);
+        argv_.reserve(command_.size() + 1);
+        buf_.resize(kInitialBuffer);
+
+        read_input();
+        if (!stopped() && !starts_.empty()) launch();
+        while (!running_.empty()) reap_one();
+        return status_;
+    }
+
+private:
+    struct Child {
+        pid_t pid;
+        int pidfd;
+    };
+
+    BuiltinIO& io_;
+    std::vector<std::string_view> command_;
+    std::string program_;
+    std::shared_ptr<const Environment> environment_;
+    size_t space_ = 0;
+    size_t max_args_ = 0;
+    size_t jobs_ = 1;
+    char delimiter_ = '\n';
+    int out_fd_ = STDOUT_FILENO;
+    int null_fd_ = -1;
+    int status_ = 0;
+
+    std::vector<char> buf_;
+    size_t used_ = 0;    // bytes read into buf_
+    size_t scanned_ = 0; // start of the first argument not yet cut off
+    std::vector<size_t> starts_; // the pending batch, as offsets into buf_
+    size_t batch_cost_ = 0;
+    std::vector<char*> argv_;
+    std::vector<Child> running_;
+    std::vector<pollfd> poll_fds_;
+
+    // A command could not be started, or one was killed by ^C: nothing more
+    // is launched, though what runs already is waited for
+    bool stopped() const { return status_ == kCannotRun || status_ == kInterrupted; }
+
+    void read_input() {
+        while (!stopped()) {
+            if (used_ == buf_.size()) make_room();
+            const ssize_t n = read(io_.in, buf_.data() + used_, buf_.size() - used_);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                io_.err << "xargs: read error: " << std::strerror(errno) << '\n';
+                status_ = 1;
+                return;
+            }
+            if (n == 0) break;
+            used_ += static_cast<size_t>(n);
+            cut_arguments();
+        }
+        // A last argument with no delimiter after it
+        if (!stopped() && scanned_ < used_) {
+            if (used_ == buf_.size()) make_room();
+            buf_[used_++] = delimiter_;
+            cut_arguments();
+        }
+    }
+
+    void cut_arguments() {
+        while (!stopped()) {
+            char* begin = buf_.data() + scanned_;
+            auto* end = static_cast<char*>(std::memchr(begin, delimiter_, used_ - scanned_));
+            if (!end) return;
+            *end = '\0';
+            const size_t size = static_cast<size_t>(end - begin);
+            if (size > 0 || delimiter_ == '\0') add(scanned_, size);
+            scanned_ += size + 1;
+        }
+    }
+
+    void add(size_t start, size_t size) {
+        const size_t cost = argument_cost(size);
+        if (!starts_.empty() && (batch_cost_ + cost > space_ || starts_.size() == max_args_)) {
+            launch();
+            if (stopped()) return;
+        }
+        if (cost > space_) {
+            // Kept out rather than failing the whole run at exec
+            io_.err << "xargs: argument too long for the command line\n";
+            status_ = kSomeFailed;
+            return;
+        }
+        starts_.push_back(start);
+        batch_cost_ += cost;
+    }
+
+    // Drop what has been launched and cut off; grow only when the pending
+    // batch and the partial argument fill the buffer by themselves
+    void make_room() {
+        const size_t keep = starts_.empty() ? scanned_ : starts_.front();
+        if (keep == 0) {
+            buf_.resize(buf_.size() * 2);
+            return;
+        }
+        std::memmove(buf_.data(), buf_.data() + keep, used_ - keep);
+        used_ -= keep;
+        scanned_ -= keep;
+        for (size_t& start : starts_) start -= keep;
+    }
+
+    void launch() {
+        while (running_.size() >= jobs_) reap_one();
+        if (stopped()) return;
+
+        argv_.clear();
+        append_argv(argv_, command_);
+        for (size_t start : starts_) argv_.push_back(buf_.data() + start);
+        argv_.push_back(nullptr);
+        starts_.clear();
+        batch_cost_ = 0;
+
+        LaunchRequest req;
+        req.program = program_.c_str();
+        req.argv = argv_.data();
+        req.envp = environment_->envp();
+        if (null_fd_ >= 0) req.fd_actions.push_back({FdAction::Kind::Dup, STDIN_FILENO, null_fd_});
+        if (out_fd_ != STDOUT_FILENO) req.fd_actions.push_back({FdAction::Kind::Dup, STDOUT_FILENO, out_fd_});
+        // In the job's process group, which has the terminal, so ^C reaches them
+        req.pgroup = io_.pgroup;
+
+        pid_t pid;
+        {
+            TraceSpan span(TracePhase::Spawn, command_.front());
+            // Once this returns the child has its own copy of argv, so the
+            // buffer is free to be reused
+            pid = launch_process(req);
+        }
+        if (pid < 0) {
+            io_.err << "xargs: " << command_.front() << ": " << std::strerror(errno) << '\n';
+            status_ = kCannotRun;
+            return;
+        }
+        running_.push_back({pid, pidfd_open(pid)});
+    }
+
+    // Wait for whichever child finishes first, or without pidfds for the
+    // oldest
+    void reap_one() {
+        size_t done = 0;
+        bool all_pidfds = true;
+        for (const Child& child : running_) all_pidfds = all_pidfds && child.pidfd >= 0;
+        if (all_pidfds && running_.size() > 1) {
+            poll_fds_.clear();
+            for (const Child& child : running_) poll_fds_.push_back({child.pidfd, POLLIN, 0});
+            while (poll(poll_fds_.data(), poll_fds_.size(), -1) < 0 && errno == EINTR) {}
+            while (done + 1 < running_.size() && !(poll_fds_[done].revents & (POLLIN | POLLHUP))) ++done;
+        }
+
+        Child child = running_[done];
+        running_.erase(running_.begin() + static_cast<std::ptrdiff_t>(done));
+        TraceSpan span(TracePhase::Wait, command_.front());
+        const int status = wait_child(child.pid);
+        if (child.pidfd >= 0) close(child.pidfd);
+        if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+            status_ = kInterrupted;
+        } else if (decode_wait_status(status) != 0 && status_ == 0) {
+            status_ = kSomeFailed;
+        }
+    }
+};
+
+} // namespace
+
+int builtin_xargs(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    char delimiter = '\n';
+    size_t max_args = SIZE_MAX;
+    size_t jobs = 1;
+
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+        const auto& arg = args[i];
+        if (arg == "--") {
+            ++i;
+            break;
+        }
+        if (arg == "-0" || arg == "--null") {
+            delimiter = '\0';
+            continue;
+        }
+        // -n MAX and -P N, with the number attached or following
+        const bool is_max = arg.starts_with("-n");
+        if (!is_max && !arg.starts_with("-P")) {
+            io.err << "xargs: " << arg << ": invalid option\n";
+            return 2;
+        }
+        std::string_view number = arg.substr(2);
+        if (number.empty() && i + 1 < args.size()) number = args[++i];
+        size_t& target = is_max ? max_args : jobs;
+        if (!parse_count(number, target) || (is_max && target == 0)) {
+            io.err << "xargs: " << arg.substr(0, 2) << ": expected a number\n";
+            return 2;
+        }
+    }
+    if (jobs == 0) jobs = usable_cpus();
+
+    std::vector<std::string_view> command(args.begin() + static_cast<std::ptrdiff_t>(i), args.end());
+    if (command.empty()) {
+        io.err << "xargs: usage: xargs [-0] [-n MAX] [-P N] command [args...]\n";
+        return 2;
+    }
+    auto path = shell.path_cache.find(std::string(command[0]));
+    if (path.empty()) {
+        io.err << "xargs: " << command[0] << ": command not found\n";
+        return kNotFound;
+    }
+
+    Batcher batcher(shell, io, std::move(command), path.string());
+    return batcher.run(delimiter, max_args, jobs);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <string_view>
+#include <vector>
+
+#include "builtins.hpp"
+
+// xargs [-0] [-n MAX] [-P N] command [args...]
+//
+// Run command with the arguments read from standard input appended, one per
+// line (blank lines are skipped) or, with -0, NUL-terminated. As many go to
+// each run as fit in ARG_MAX beside the environment, or at most MAX. N runs
+// are kept in flight, 1 by default; 0 means one per CPU the shell may run
+// on. Nothing runs when there are no arguments. Returns 123 if any run
+// failed, 126 if one could not be started, 127 if command is not found and
+// 130 once a run killed by ^C has stopped the rest.
+int builtin_xargs(Shell& shell, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+#endif